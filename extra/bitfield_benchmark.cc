@@ -0,0 +1,133 @@
+// Compares the bitfield kernels with the per-bit and per-byte loops
+// they replaced, on bitfields of a huge torrent at several densities.
+// Each result is checked against the loop it replaces.
+
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include "utils/bitfield_kernels.h"
+
+static const uint32_t size_bits = 4 << 20;
+static const uint32_t size_bytes = size_bits / 8;
+
+static bool
+get(const std::vector<uint8_t>& data, uint32_t index) {
+  return data[index / 8] & (1 << (7 - index % 8));
+}
+
+static std::vector<uint8_t>
+random_bitfield(double density) {
+  std::vector<uint8_t> data(size_bytes);
+
+  for (uint32_t i = 0; i < size_bits; i++)
+    if (drand48() < density)
+      data[i / 8] |= 1 << (7 - i % 8);
+
+  return data;
+}
+
+static double
+measure(const char* name, const std::function<uint64_t()>& func, uint64_t& result) {
+  auto start = std::chrono::steady_clock::now();
+  unsigned int rounds = 0;
+
+  do {
+    result = func();
+    rounds++;
+  } while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(200));
+
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+  std::printf("  %-28s %10.1f us\n", name, us);
+  return us;
+}
+
+static void
+compare(const char* name, const std::function<uint64_t()>& old_func, const std::function<uint64_t()>& new_func) {
+  uint64_t old_result;
+  uint64_t new_result;
+
+  std::printf("%s\n", name);
+  double old_us = measure("loop", old_func, old_result);
+  double new_us = measure("kernel", new_func, new_result);
+
+  std::printf("  %-28s %10.1fx%s\n", "speedup", old_us / new_us, old_result == new_result ? "" : "  MISMATCH");
+}
+
+int
+main() {
+  std::printf("simd: %s\n\n", torrent::bitfield_has_simd() ? "yes" : "no");
+
+  for (double density : { 0.0001, 0.01, 0.5 }) {
+    auto peer = random_bitfield(density);
+    auto untouched = random_bitfield(0.5);
+
+    std::printf("== %u bits, peer density %g\n", size_bits, density);
+
+    compare("popcount", [&] {
+        uint64_t count = 0;
+        for (uint32_t i = 0; i < size_bytes; i++)
+          count += __builtin_popcount(peer[i]);
+        return count;
+      }, [&] {
+        return torrent::bitfield_count(peer.data(), 0, size_bits);
+      });
+
+    compare("range popcount (by bit)", [&] {
+        uint64_t count = 0;
+        for (uint32_t i = 3; i < size_bits - 5; i++)
+          count += get(peer, i);
+        return count;
+      }, [&] {
+        return torrent::bitfield_count(peer.data(), 3, size_bits - 5);
+      });
+
+    // As ChunkStatistics does when a peer connects.
+    std::vector<uint8_t> counters(size_bits);
+
+    compare("add set bits to counters", [&] {
+        uint8_t before = counters[size_bits / 2];
+        for (uint32_t i = 0; i < size_bits; i++)
+          counters[i] += get(peer, i);
+        return uint64_t{uint8_t(counters[size_bits / 2] - before)};
+      }, [&] {
+        uint8_t before = counters[size_bits / 2];
+        torrent::bitfield_for_each(peer.data(), 0, size_bits, [&](uint32_t i) { counters[i]++; });
+        return uint64_t{uint8_t(counters[size_bits / 2] - before)};
+      });
+
+    compare("iterate peer & untouched", [&] {
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < size_bytes; i++) {
+          uint8_t wanted = peer[i] & untouched[i];
+          for (int j = 0; wanted != 0 && j < 8; j++)
+            if (wanted & (1 << (7 - j)))
+              sum += i * 8 + j;
+        }
+        return sum;
+      }, [&] {
+        uint64_t sum = 0;
+        for (auto i = torrent::bitfield_find_and(peer.data(), untouched.data(), 0, size_bits); i != size_bits;
+             i = torrent::bitfield_find_and(peer.data(), untouched.data(), i + 1, size_bits))
+          sum += i;
+        return sum;
+      });
+
+    compare("first peer & ~untouched", [&] {
+        for (uint32_t i = 0; i < size_bits; i++)
+          if (get(peer, i) && !get(untouched, i))
+            return uint64_t{i};
+        return uint64_t{size_bits};
+      }, [&] {
+        return uint64_t{torrent::bitfield_find_and_not(peer.data(), untouched.data(), 0, size_bits)};
+      });
+
+    std::printf("\n");
+  }
+
+  return 0;
+}
@@ -0,0 +1,3 @@
+STUFF="-Wall -O2 -I.. -I../src/"
+
+g++ $STUFF -o bitfield_benchmark bitfield_benchmark.cc ../src/utils/bitfield_kernels.cc
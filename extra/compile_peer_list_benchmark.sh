@@ -0,0 +1,4 @@
+STUFF="-Wall -O2 -I.. -I../src/"
+
+# Needs libtorrent to have been built in the source tree.
+g++ $STUFF -o peer_list_benchmark peer_list_benchmark.cc -L../src/.libs -Wl,-rpath,../src/.libs -ltorrent
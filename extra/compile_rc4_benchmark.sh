@@ -0,0 +1,3 @@
+STUFF="-Wall -O2 -I.. -I../src/ -lcrypto -pthread `pkg-config --libs-only-L openssl` `pkg-config --cflags openssl`"
+
+g++ $STUFF -o rc4_benchmark rc4_benchmark.cc ../src/utils/rc4.cc ../src/utils/rc4_prefetch.cc ../src/utils/crypto_queue.cc ../src/torrent/exceptions.cc
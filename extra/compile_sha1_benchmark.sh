@@ -0,0 +1,3 @@
+STUFF="-Wall -O2 -I.. -I../src/ `pkg-config --cflags openssl`"
+
+g++ $STUFF -o sha1_benchmark sha1_benchmark.cc ../src/utils/sha1.cc ../src/torrent/exceptions.cc `pkg-config --libs-only-L openssl` -lcrypto
@@ -0,0 +1,111 @@
+// Compares the memory per peer and the insert and lookup times of
+// the flat PeerTable with pooled PeerInfo storage against the
+// multimap and individually allocated PeerInfo it replaced. Memory
+// includes the PeerInfo objects and their socket addresses.
+
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <malloc.h>
+#include <vector>
+#include <arpa/inet.h>
+
+#include "torrent/peer/peer_info.h"
+#include "torrent/peer/peer_table.h"
+#include "utils/object_pool.h"
+
+using multimap_type = std::multimap<torrent::socket_address_key, torrent::PeerInfo*>;
+
+// Large blocks are mmap'ed, and counted in hblkhd rather than uordblks.
+static size_t
+heap_used() {
+  auto info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+static double
+elapsed_ns(std::chrono::steady_clock::time_point start, size_t count) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+static void
+print_result(const char* name, size_t bytes, size_t count, double insert_ns, double find_ns) {
+  std::printf("  %-24s %8.1f bytes/peer %8.1f ns/insert %8.1f ns/find\n", name, double(bytes) / count, insert_ns, find_ns);
+}
+
+int
+main() {
+  for (size_t count : { 10000, 100000, 1000000, 4000000 }) {
+    std::vector<sockaddr_in> addresses(count);
+    std::vector<torrent::socket_address_key> keys;
+    keys.reserve(count);
+
+    for (size_t i = 0; i < count; i++) {
+      addresses[i].sin_family = AF_INET;
+      addresses[i].sin_addr.s_addr = htonl(0x0a000000 + i * 2654435761u % 0xf0000000);
+      addresses[i].sin_port = htons(6881);
+
+      keys.push_back(torrent::socket_address_key::from_sin_addr(addresses[i]));
+    }
+
+    std::printf("== %zu peers, sizeof(PeerInfo) %zu\n", count, sizeof(torrent::PeerInfo));
+
+    uint64_t found = 0;
+
+    {
+      size_t before = heap_used();
+      auto start = std::chrono::steady_clock::now();
+
+      multimap_type peers;
+
+      for (size_t i = 0; i < count; i++)
+        peers.emplace(keys[i], new torrent::PeerInfo(reinterpret_cast<sockaddr*>(&addresses[i])));
+
+      double insert_ns = elapsed_ns(start, count);
+      size_t bytes = heap_used() - before;
+
+      start = std::chrono::steady_clock::now();
+
+      for (auto& key : keys)
+        found += peers.find(key) != peers.end();
+
+      print_result("multimap + new", bytes, count, insert_ns, elapsed_ns(start, count));
+
+      for (auto& v : peers)
+        delete v.second;
+    }
+
+    {
+      size_t before = heap_used();
+      auto start = std::chrono::steady_clock::now();
+
+      torrent::PeerTable peers;
+      torrent::ObjectPool<torrent::PeerInfo> pool;
+
+      for (size_t i = 0; i < count; i++)
+        peers.insert(pool.create(reinterpret_cast<sockaddr*>(&addresses[i])));
+
+      double insert_ns = elapsed_ns(start, count);
+      size_t bytes = heap_used() - before;
+
+      start = std::chrono::steady_clock::now();
+
+      for (auto& key : keys)
+        found += peers.find(key) != peers.end();
+
+      print_result("PeerTable + ObjectPool", bytes, count, insert_ns, elapsed_ns(start, count));
+
+      for (auto itr = peers.begin(); itr != peers.end(); itr++)
+        pool.destroy(itr.peer_info());
+    }
+
+    if (found != 2 * count)
+      std::printf("  MISMATCH\n");
+
+    std::printf("\n");
+  }
+
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Compares the OpenSSL RC4 previously used for encrypted peer
+// connections with the in-house implementation, inline and with the
+// keystream prefetched on a CryptoQueue worker. The cpu column is the
+// rate relative to the calling thread's cpu time, which is what the
+// prefetching offloads.
+
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#include <openssl/rc4.h>
+
+#include "utils/crypto_queue.h"
+#include "utils/rc4.h"
+#include "utils/rc4_prefetch.h"
+
+static const unsigned char key[20] = "benchmark key 01234";
+
+static double
+thread_cpu_time() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+measure(const char* name, std::vector<unsigned char>& buffer, unsigned int write_size, const std::function<void(unsigned char*, unsigned int)>& fn) {
+  auto start = std::chrono::steady_clock::now();
+  double cpu_start = thread_cpu_time();
+
+  for (unsigned int i = 0; i < buffer.size(); i += write_size)
+    fn(buffer.data() + i, write_size);
+
+  double cpu = thread_cpu_time() - cpu_start;
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::printf("%-24s wall %8.1f MiB/s  cpu %8.1f MiB/s\n", name, buffer.size() / wall / (1 << 20), buffer.size() / cpu / (1 << 20));
+}
+
+int
+main(int argc, char** argv) {
+  unsigned int size = (argc > 1 ? std::atoi(argv[1]) : 256) << 20;
+  unsigned int write_size = 16 << 10;
+
+  std::vector<unsigned char> plain(size);
+
+  for (auto& c : plain)
+    c = std::rand();
+
+  std::vector<unsigned char> expected = plain;
+  std::vector<unsigned char> buffer = plain;
+
+  RC4_KEY openssl_key;
+  RC4_set_key(&openssl_key, sizeof(key), key);
+
+  measure("openssl", expected, write_size, [&](unsigned char* data, unsigned int length) {
+      RC4(&openssl_key, length, data, data);
+    });
+
+  torrent::RC4 rc4(key, sizeof(key));
+
+  measure("in-house", buffer, write_size, [&](unsigned char* data, unsigned int length) {
+      rc4.crypt(data, length);
+    });
+
+  if (buffer != expected) {
+    std::printf("in-house output differs from openssl\n");
+    return 1;
+  }
+
+  torrent::CryptoQueue queue;
+  queue.set_worker_count(1);
+
+  buffer = plain;
+
+  {
+    torrent::RC4Prefetch prefetch(torrent::RC4(key, sizeof(key)), &queue);
+
+    measure("in-house, prefetched", buffer, write_size, [&](unsigned char* data, unsigned int length) {
+        prefetch.crypt(data, data, length);
+      });
+  }
+
+  if (buffer != expected) {
+    std::printf("prefetched output differs from openssl\n");
+    return 1;
+  }
+
+  return 0;
+}
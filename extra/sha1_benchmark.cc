@@ -0,0 +1,111 @@
+// Compares hashing torrent pieces with OpenSSL, with the SHA extensions
+// backend of Sha1 and eight at a time with Sha1Multi. Each digest is
+// checked against OpenSSL.
+//
+// OpenSSL uses the SHA extensions itself when present, run with
+// OPENSSL_ia32cap=":~0x20000000" to see how it does without them.
+
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <openssl/evp.h>
+
+#include "utils/sha1.h"
+
+static void
+measure(const char* name, size_t total, const std::function<void()>& fn) {
+  auto start = std::chrono::steady_clock::now();
+  unsigned int rounds = 0;
+
+  do {
+    fn();
+    rounds++;
+  } while (std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::printf("%-24s %8.1f MiB/s\n", name, total * rounds / wall / (1 << 20));
+}
+
+int
+main(int argc, char** argv) {
+  unsigned int piece_size = (argc > 1 ? std::atoi(argv[1]) : 256) << 10;
+  unsigned int pieces     = 64;
+
+  std::vector<unsigned char> data(size_t(piece_size) * pieces);
+
+  for (auto& c : data)
+    c = std::rand();
+
+  std::vector<unsigned char> expected(20 * pieces);
+  std::vector<unsigned char> result(20 * pieces);
+
+  EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+
+  measure("openssl", data.size(), [&]() {
+      for (unsigned int i = 0; i < pieces; i++) {
+        EVP_DigestInit(ctx, EVP_sha1());
+        EVP_DigestUpdate(ctx, data.data() + size_t(i) * piece_size, piece_size);
+        EVP_DigestFinal(ctx, expected.data() + 20 * i, nullptr);
+      }
+    });
+
+  EVP_MD_CTX_free(ctx);
+
+  if (torrent::Sha1::is_accelerated()) {
+    torrent::Sha1 sha1;
+
+    measure("sha extensions", data.size(), [&]() {
+        for (unsigned int i = 0; i < pieces; i++) {
+          sha1.init();
+          sha1.update(data.data() + size_t(i) * piece_size, piece_size);
+          sha1.final_c(result.data() + 20 * i);
+        }
+      });
+
+    if (result != expected) {
+      std::printf("sha extensions output differs from openssl\n");
+      return 1;
+    }
+  }
+
+  if (!torrent::Sha1Multi::is_available())
+    return 0;
+
+  torrent::Sha1Multi multi;
+
+  // Fewer lanes than the maximum is what the hash check queue does when
+  // only a few chunks are ready.
+  for (unsigned int lanes : { 8, 6, 4, 3, 2 }) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "avx2 multi-buffer, %u", lanes);
+
+    unsigned int count = pieces - pieces % lanes;
+
+    measure(name, size_t(piece_size) * count, [&]() {
+        for (unsigned int i = 0; i < count; i += lanes) {
+          multi.init(lanes);
+
+          for (unsigned int lane = 0; lane < lanes; lane++)
+            multi.update(lane, data.data() + size_t(i + lane) * piece_size, piece_size);
+
+          multi.finalize();
+
+          for (unsigned int lane = 0; lane < lanes; lane++)
+            multi.digest(lane, result.data() + 20 * (i + lane));
+        }
+      });
+
+    if (std::memcmp(result.data(), expected.data(), 20 * count) != 0) {
+      std::printf("avx2 multi-buffer output differs from openssl\n");
+      return 1;
+    }
+  }
+
+  return 0;
+}
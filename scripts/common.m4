@@ -157,6 +157,154 @@ AC_DEFUN([TORRENT_CHECK_POPCOUNT], [
   ])
 ])
 
+AC_DEFUN([TORRENT_CHECK_SHA_NI], [
+  AC_MSG_CHECKING(for SHA extensions intrinsics)
+
+  AC_COMPILE_IFELSE([AC_LANG_SOURCE([
+      #include <cpuid.h>
+      #include <immintrin.h>
+      __attribute__((target("sha,sse4.1"))) __m128i f(__m128i a, __m128i b) { return _mm_sha1rnds4_epu32(a, b, 0); }
+      int g() { unsigned int a, b, c, d; return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_SHA) && __builtin_cpu_supports("sse4.1"); }
+    ])],
+    [
+      AC_MSG_RESULT(yes)
+      AC_DEFINE(USE_SHA_NI, 1, Use SHA extensions for SHA-1 when supported by the CPU.)
+    ], [
+      AC_MSG_RESULT(no)
+  ])
+])
+
+AC_DEFUN([TORRENT_CHECK_AVX2], [
+  AC_MSG_CHECKING(for AVX2 intrinsics)
+
+  AC_COMPILE_IFELSE([AC_LANG_SOURCE([
+      #include <immintrin.h>
+      __attribute__((target("avx2"))) int f(__m256i a, __m256i b) { return _mm256_testz_si256(_mm256_and_si256(a, b), _mm256_sad_epu8(a, b)); }
+      int g() { return __builtin_cpu_supports("avx2"); }
+    ])],
+    [
+      AC_MSG_RESULT(yes)
+      AC_DEFINE(USE_AVX2, 1, Use AVX2 for bitfield operations and multi-buffer SHA-1 when supported by the CPU.)
+    ], [
+      AC_MSG_RESULT(no)
+  ])
+])
+
+AC_DEFUN([TORRENT_CHECK_IO_URING], [
+  AC_MSG_CHECKING(for io_uring)
+
+  AC_COMPILE_IFELSE([AC_LANG_SOURCE([
+      #include <linux/io_uring.h>
+      #include <sys/eventfd.h>
+      #include <sys/syscall.h>
+      #include <unistd.h>
+      int main() {
+        struct io_uring_params p = {};
+        int fd = syscall(__NR_io_uring_setup, 8, &p);
+        syscall(__NR_io_uring_register, fd, IORING_REGISTER_EVENTFD, &fd, 1);
+        return (p.features & IORING_FEAT_SINGLE_MMAP) + IORING_OP_READ + IORING_OP_WRITE + IORING_FSYNC_DATASYNC;
+      }
+    ])],
+    [
+      AC_MSG_RESULT(yes)
+      AC_DEFINE(USE_IO_URING, 1, Use io_uring for asynchronous disk io.)
+    ], [
+      AC_MSG_RESULT(no)
+  ])
+])
+
+AC_DEFUN([TORRENT_CHECK_SENDFILE], [
+  AC_MSG_CHECKING(for sendfile)
+
+  AC_COMPILE_IFELSE([AC_LANG_SOURCE([
+      #include <sys/sendfile.h>
+      int main() { off_t offset = 0; return sendfile(1, 0, &offset, 1); }
+    ])],
+    [
+      AC_MSG_RESULT(yes)
+      AC_DEFINE(USE_SENDFILE, 1, Use sendfile for uploading unencrypted piece data.)
+    ], [
+      AC_MSG_RESULT(no)
+  ])
+])
+
+AC_DEFUN([TORRENT_CHECK_MMSG], [
+  AC_MSG_CHECKING(for recvmmsg and sendmmsg)
+
+  AC_COMPILE_IFELSE([AC_LANG_SOURCE([
+      #define _GNU_SOURCE
+      #include <sys/socket.h>
+      int main() {
+        struct mmsghdr msg = {};
+        return recvmmsg(0, &msg, 1, MSG_DONTWAIT, 0) + sendmmsg(0, &msg, 1, 0);
+      }
+    ])],
+    [
+      AC_MSG_RESULT(yes)
+      AC_DEFINE(USE_MMSG, 1, Use recvmmsg and sendmmsg for batched datagram io.)
+    ], [
+      AC_MSG_RESULT(no)
+  ])
+])
+
+AC_DEFUN([TORRENT_CHECK_ZEROCOPY], [
+  AC_MSG_CHECKING(for MSG_ZEROCOPY)
+
+  AC_COMPILE_IFELSE([AC_LANG_SOURCE([
+      #include <sys/socket.h>
+      #include <linux/errqueue.h>
+      int main() {
+        int one = 1;
+        struct sock_extended_err err = {};
+        setsockopt(0, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one));
+        return send(0, &one, sizeof(one), MSG_ZEROCOPY) + MSG_ERRQUEUE + SO_EE_ORIGIN_ZEROCOPY + SO_EE_CODE_ZEROCOPY_COPIED + err.ee_data;
+      }
+    ])],
+    [
+      AC_MSG_RESULT(yes)
+      AC_DEFINE(USE_ZEROCOPY, 1, Use MSG_ZEROCOPY for uploading piece data.)
+    ], [
+      AC_MSG_RESULT(no)
+  ])
+])
+
+AC_DEFUN([TORRENT_CHECK_TCP_INFO], [
+  AC_MSG_CHECKING(for TCP_INFO)
+
+  AC_COMPILE_IFELSE([AC_LANG_SOURCE([
+      #include <sys/socket.h>
+      #include <netinet/in.h>
+      #include <netinet/tcp.h>
+      int main() {
+        struct tcp_info info = {};
+        socklen_t length = sizeof(info);
+        return getsockopt(0, IPPROTO_TCP, TCP_INFO, &info, &length) + info.tcpi_rtt + info.tcpi_rcv_rtt;
+      }
+    ])],
+    [
+      AC_MSG_RESULT(yes)
+      AC_DEFINE(USE_TCP_INFO, 1, Use TCP_INFO to read the round-trip time of peer connections.)
+    ], [
+      AC_MSG_RESULT(no)
+  ])
+])
+
+AC_DEFUN([TORRENT_CHECK_SYNC_FILE_RANGE], [
+  AC_MSG_CHECKING(for sync_file_range)
+
+  AC_COMPILE_IFELSE([AC_LANG_SOURCE([
+      #define _GNU_SOURCE
+      #include <fcntl.h>
+      int main() { return sync_file_range(0, 0, 0, SYNC_FILE_RANGE_WRITE); }
+    ])],
+    [
+      AC_MSG_RESULT(yes)
+      AC_DEFINE(USE_SYNC_FILE_RANGE, 1, Use sync_file_range for chunk writeback.)
+    ], [
+      AC_MSG_RESULT(no)
+  ])
+])
+
 AC_DEFUN([TORRENT_CHECK_CACHELINE], [
   AC_MSG_CHECKING(for cacheline)
 
@@ -0,0 +1,92 @@
+#include "config.h"
+
+#include "data/buffer_pool.h"
+
+#include <map>
+#include <mutex>
+#include <sys/mman.h>
+
+#include "data/memory_chunk.h"
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+namespace {
+
+std::mutex                     buffer_pool_lock;
+std::multimap<uint32_t, char*> buffer_pool_free;
+uint64_t                       buffer_pool_bytes{0};
+
+} // namespace
+
+uint32_t
+BufferPool::aligned_size(uint32_t size) {
+  return (size + MemoryChunk::page_size() - 1) / MemoryChunk::page_size() * MemoryChunk::page_size();
+}
+
+char*
+BufferPool::allocate(uint32_t size) {
+  size = aligned_size(size);
+
+  {
+    auto lock = std::scoped_lock(buffer_pool_lock);
+    auto itr  = buffer_pool_free.find(size);
+
+    if (itr != buffer_pool_free.end()) {
+      char* ptr = itr->second;
+
+      buffer_pool_free.erase(itr);
+      buffer_pool_bytes -= size;
+
+      return ptr;
+    }
+  }
+
+  auto ptr = static_cast<char*>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0));
+
+  if (ptr == MAP_FAILED)
+    return nullptr;
+
+  return ptr;
+}
+
+void
+BufferPool::release(char* ptr, uint32_t size) {
+  if (ptr == nullptr)
+    throw internal_error("BufferPool::release(...) received a null pointer.");
+
+  size = aligned_size(size);
+
+  {
+    auto lock = std::scoped_lock(buffer_pool_lock);
+
+    if (buffer_pool_bytes + size <= max_pooled_bytes) {
+      buffer_pool_free.emplace(size, ptr);
+      buffer_pool_bytes += size;
+      return;
+    }
+  }
+
+  if (munmap(ptr, size) != 0)
+    throw internal_error("BufferPool::release(...) munmap failed.");
+}
+
+uint64_t
+BufferPool::pooled_bytes() {
+  auto lock = std::scoped_lock(buffer_pool_lock);
+
+  return buffer_pool_bytes;
+}
+
+void
+BufferPool::clear() {
+  auto lock = std::scoped_lock(buffer_pool_lock);
+
+  for (auto& [size, ptr] : buffer_pool_free)
+    munmap(ptr, size);
+
+  buffer_pool_free.clear();
+  buffer_pool_bytes = 0;
+}
+
+} // namespace torrent
@@ -0,0 +1,27 @@
+#ifndef LIBTORRENT_DATA_BUFFER_POOL_H
+#define LIBTORRENT_DATA_BUFFER_POOL_H
+
+#include <cinttypes>
+
+namespace torrent {
+
+// Page aligned anonymous buffers backing chunks in buffered storage
+// mode. Released buffers are kept for reuse, up to 'max_pooled_bytes',
+// to avoid churning the address space with mmap/munmap.
+class BufferPool {
+public:
+  static constexpr uint64_t max_pooled_bytes = uint64_t{64} << 20;
+
+  // Returns nullptr on failure. The size is rounded up to the page size.
+  static char*        allocate(uint32_t size);
+  static void         release(char* ptr, uint32_t size);
+
+  static uint64_t     pooled_bytes();
+  static void         clear();
+
+  static uint32_t     aligned_size(uint32_t size);
+};
+
+} // namespace torrent
+
+#endif
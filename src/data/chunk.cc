@@ -37,12 +37,20 @@
 #include "config.h"
 
 #include <algorithm>
+#include <cerrno>
 #include <csetjmp>
 #include <csignal>
 #include <cstring>
 #include <functional>
+#include <mutex>
 
+#include "data/buffer_pool.h"
+#include "data/socket_file.h"
+#include "data/thread_disk.h"
+#include "data/write_back.h"
 #include "torrent/exceptions.h"
+#include "torrent/data/file.h"
+#include "torrent/utils/log.h"
 
 #include "chunk.h"
 #include "chunk_iterator.h"
@@ -66,10 +74,26 @@ Chunk::is_all_valid() const {
 
 void
 Chunk::clear() {
+  if (m_fill != nullptr) {
+    auto lock = std::scoped_lock(m_fill->lock);
+
+    // The disk thread is still reading into the buffers, so the last
+    // read releases them instead.
+    if (m_fill->pending != 0) {
+      auto last = std::stable_partition(begin(), end(), [](const ChunkPart& c) { return c.mapped() != ChunkPart::MAPPED_BUFFER; });
+
+      m_fill->detached.assign(last, end());
+      base_type::erase(last, end());
+    }
+  }
+
+  m_fill.reset();
+
   std::for_each(begin(), end(), std::mem_fn(&ChunkPart::clear));
 
   m_chunkSize = 0;
   m_prot = ~0;
+  m_dirty = false;
   base_type::clear();
 }
 
@@ -168,17 +192,147 @@ Chunk::incore_length(uint32_t pos, uint32_t length) {
   return result;
 }
 
+bool
+Chunk::is_buffered() const {
+  return std::any_of(begin(), end(), [](const ChunkPart& c) { return c.mapped() == ChunkPart::MAPPED_BUFFER; });
+}
+
+void
+Chunk::fill_async(std::function<void ()> slot_filled) {
+  if (m_fill != nullptr)
+    throw internal_error("Chunk::fill_async() called twice.");
+
+  auto state = std::make_shared<fill_state>();
+  state->slot_filled = std::move(slot_filled);
+
+  auto parts = std::count_if(begin(), end(), [](const ChunkPart& c) { return c.mapped() == ChunkPart::MAPPED_BUFFER; });
+
+  if (parts == 0)
+    return;
+
+  // Count every part before submitting so an early completion can't
+  // see zero pending.
+  state->pending = parts;
+  m_fill = state;
+
+  for (auto& c : *this) {
+    if (c.mapped() != ChunkPart::MAPPED_BUFFER)
+      continue;
+
+    // Opening the files of the later parts may have closed this one to
+    // make room, along with its direct descriptor, so it is opened again
+    // right before queuing the read. Closing it after that is ordered
+    // after the read on the disk thread.
+    int direct_fd = c.file()->is_open() ? c.direct_fd() : -1;
+
+    // Direct reads start at the page aligned offset below the part, see
+    // SocketFile::create_aligned_buffer_chunk, and may read past its end.
+    uint32_t skip   = direct_fd != -1 ? c.chunk().begin() - c.chunk().ptr() : 0;
+    uint32_t needed = skip + c.size();
+
+    auto done = [state, needed](int result, [[maybe_unused]] DiskIo::buffer_type buffer) {
+        if (result < static_cast<int>(needed)) {
+          int expected = 0;
+          state->error.compare_exchange_strong(expected, result < 0 ? -result : EIO);
+
+          lt_log_print(LOG_STORAGE_ERROR, "chunk: buffered read failed : %s", result < 0 ? std::strerror(-result) : "short read");
+        }
+
+        std::vector<ChunkPart> detached;
+
+        {
+          auto lock = std::scoped_lock(state->lock);
+
+          if (--state->pending != 0)
+            return;
+
+          detached.swap(state->detached);
+        }
+
+        std::for_each(detached.begin(), detached.end(), std::mem_fn(&ChunkPart::clear));
+
+        if (state->slot_filled)
+          state->slot_filled();
+      };
+
+    if (!c.file()->prepare(c.is_uncached(), MemoryChunk::prot_read, 0)) {
+      done(errno != 0 ? -errno : -EBADF, nullptr);
+      continue;
+    }
+
+    if (thread_disk() == nullptr) {
+      done(SocketFile(c.file()->file_descriptor()).fill_chunk(c.chunk(), c.file_offset()) ? needed : -EIO, nullptr);
+      continue;
+    }
+
+    // The buffer is owned by the chunk, or by the fill state once the
+    // chunk is cleared.
+    DiskIo::buffer_type buffer(DiskIo::buffer_type(), c.chunk().begin() - skip);
+
+    if (direct_fd != -1)
+      thread_disk()->disk_io()->read(direct_fd, c.file_offset() - skip, std::move(buffer), BufferPool::aligned_size(needed),
+                                     nullptr, nullptr, std::move(done));
+    else if (c.is_uncached())
+      thread_disk()->disk_io()->read_uncached(c.file()->file_descriptor(), c.file_offset(), std::move(buffer), c.size(),
+                                              nullptr, nullptr, std::move(done));
+    else
+      thread_disk()->disk_io()->read(c.file()->file_descriptor(), c.file_offset(), std::move(buffer), c.size(),
+                                     nullptr, nullptr, std::move(done));
+  }
+}
+
 bool
 Chunk::sync(int flags) {
   bool success = true;
 
   for (auto& c : *this)
-    if (!c.chunk().sync(0, c.chunk().size(), flags))
+    if (!c.sync(flags))
+      success = false;
+
+  if (success)
+    m_dirty = false;
+
+  return success;
+}
+
+inline static bool
+is_write_back_part(const ChunkPart& part) {
+  return part.mapped() == ChunkPart::MAPPED_MMAP && part.file() != nullptr &&
+    !part.file()->is_padding() && part.file()->is_open();
+}
+
+bool
+Chunk::sync_write_back(int flags, WriteBack* write_back) {
+  bool success = true;
+
+  for (auto& c : *this) {
+    if (is_write_back_part(c))
+      write_back->insert(c.file()->file_descriptor(), c.file_offset(), c.size());
+    else if (!c.sync(flags))
       success = false;
+  }
 
   return success;
 }
 
+std::vector<int>
+Chunk::write_back_files() const {
+  std::vector<int> fds;
+
+  for (auto& c : *this)
+    if (is_write_back_part(c) && std::find(fds.begin(), fds.end(), c.file()->file_descriptor()) == fds.end())
+      fds.push_back(c.file()->file_descriptor());
+
+  return fds;
+}
+
+bool
+Chunk::is_write_back_failed(const WriteBack* write_back) const {
+  return std::any_of(begin(), end(), [write_back](const ChunkPart& c) {
+      return is_write_back_part(c) && write_back->is_failed(c.file()->file_descriptor());
+    });
+}
+
 void
 Chunk::preload(uint32_t position, uint32_t length, bool useAdvise) {
   if (position >= m_chunkSize)
@@ -209,6 +363,27 @@ Chunk::preload(uint32_t position, uint32_t length, bool useAdvise) {
   } while (itr.next());
 }
 
+void
+Chunk::preload_async(uint32_t position, uint32_t length) {
+  if (position >= m_chunkSize)
+    throw internal_error("Chunk::preload_async(...) position > m_chunkSize.");
+
+  length = std::min(length, m_chunkSize - position);
+
+  for (auto itr = at_position(position); itr != end() && length != 0; itr++) {
+    uint32_t part_length = std::min(length, itr->remaining_from(position));
+
+    // Padding and buffered parts are already in memory.
+    if (itr->mapped() == ChunkPart::MAPPED_MMAP && itr->file() != nullptr &&
+        !itr->file()->is_padding() && itr->file()->is_open()) {
+      thread_disk()->disk_io()->readahead(itr->file()->file_descriptor(), itr->file_offset() + (position - itr->position()), part_length);
+    }
+
+    position += part_length;
+    length -= part_length;
+  }
+}
+
 // Consider using uint32_t returning first mismatch or length if
 // matching.
 bool
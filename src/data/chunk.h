@@ -2,7 +2,10 @@
 #define LIBTORRENT_STORAGE_CHUNK_H
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <new>
 #include <vector>
 
@@ -10,6 +13,8 @@
 
 namespace torrent {
 
+class WriteBack;
+
 class Chunk : private std::vector<ChunkPart> {
 public:
   using base_type = std::vector<ChunkPart>;
@@ -62,17 +67,60 @@ public:
   bool                is_incore(uint32_t pos, uint32_t length = ~uint32_t());
   uint32_t            incore_length(uint32_t pos, uint32_t length = ~uint32_t());
 
+  // Buffered chunks are written back by ChunkList on the disk thread
+  // when marked dirty since the last successful write.
+  bool                is_buffered() const;
+  bool                is_dirty() const                { return m_dirty; }
+  void                set_dirty()                     { m_dirty = true; }
+  void                clear_dirty()                   { m_dirty = false; }
+
+  // Buffered parts of a chunk created with 'fill_async' are read in by
+  // the disk thread, and must not be accessed until 'is_filled'.
+  // 'slot_filled' is called on the disk thread once all reads are
+  // done. A failed read leaves the rest of that part unspecified, and
+  // its errno is returned by 'fill_error' once filled.
+  //
+  // Clearing the chunk before then hands the buffers to the last read
+  // to release.
+  bool                is_filled() const               { return m_fill == nullptr || m_fill->pending == 0; }
+  int                 fill_error() const              { return m_fill == nullptr ? 0 : m_fill->error.load(); }
+  void                fill_async(std::function<void ()> slot_filled);
+
   bool                sync(int flags);
 
+  // Like sync, but file backed mapped parts are added to 'write_back'
+  // to be flushed as merged ranges by the caller, which clears the
+  // dirty flag once the flush succeeded. 'write_back_files' lists the
+  // file descriptors of those parts.
+  bool                sync_write_back(int flags, WriteBack* write_back);
+  std::vector<int>    write_back_files() const;
+  bool                is_write_back_failed(const WriteBack* write_back) const;
+
   void                preload(uint32_t position, uint32_t length, bool useAdvise);
 
+  // Queue readahead of the file backed range on the disk thread so
+  // the page cache is warm before the pages are touched, without
+  // blocking the calling thread.
+  void                preload_async(uint32_t position, uint32_t length);
+
   bool                to_buffer(void* buffer, uint32_t position, uint32_t length);
   bool                from_buffer(const void* buffer, uint32_t position, uint32_t length);
   bool                compare_buffer(const void* buffer, uint32_t position, uint32_t length);
 
 private:
+  struct fill_state {
+    std::atomic<unsigned int> pending{0};
+    std::atomic<int>          error{0};
+    std::mutex                lock;
+    std::vector<ChunkPart>    detached;
+    std::function<void ()>    slot_filled;
+  };
+
   uint32_t            m_chunkSize{};
   int                 m_prot{~0};
+  bool                m_dirty{false};
+
+  std::shared_ptr<fill_state> m_fill;
 };
 
 inline Chunk::iterator
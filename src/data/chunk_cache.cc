@@ -0,0 +1,362 @@
+#include "config.h"
+
+#include "data/chunk_cache.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "thread_main.h"
+#include "data/chunk.h"
+#include "data/chunk_list.h"
+#include "data/thread_disk.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/exceptions.h"
+#include "torrent/data/file.h"
+
+namespace torrent {
+
+ChunkCache::~ChunkCache() {
+  if (ThreadMain::thread_main() != nullptr)
+    ThreadMain::thread_main()->cancel_callback(this);
+}
+
+void
+ChunkCache::set_max_size(uint64_t bytes) {
+  m_maxSize = bytes;
+  m_targetRecent = std::min(m_targetRecent, m_maxSize);
+
+  if (m_maxSize == 0)
+    return clear();
+
+  replace();
+}
+
+ChunkCache::buffer_type
+ChunkCache::find(ChunkList* chunk_list, uint32_t index) {
+  key_type key(chunk_list, index);
+  auto itr = m_entries.find(key);
+
+  if (itr != m_entries.end()) {
+    auto& location = itr->second;
+
+    switch (location.list) {
+    case LIST_RECENT:
+    case LIST_FREQUENT:
+      // A chunk read ahead is used for the first time.
+      if (location.itr->prefetched) {
+        location.itr->prefetched = false;
+        move_to(location, location.list);
+      } else {
+        move_to(location, LIST_FREQUENT);
+      }
+
+      m_statsHits++;
+      chunk_list->inc_stats_cache_hits();
+
+      return location.itr->buffer;
+
+    // Ghost hits adapt the target size of the recent list, but only
+    // once per fetch as many peers may request the chunk before it
+    // has been read.
+    case LIST_RECENT_GHOST:
+    case LIST_FREQUENT_GHOST:
+      if (m_fetching.find(key) == m_fetching.end())
+        adapt_target(location);
+      break;
+    }
+  }
+
+  m_statsMisses++;
+  chunk_list->inc_stats_cache_misses();
+
+  return nullptr;
+}
+
+void
+ChunkCache::fetch(ChunkList* chunk_list, uint32_t index, Chunk* chunk) {
+  if (!is_missing(chunk_list, index))
+    return;
+
+  start_fetch(key_type(chunk_list, index), chunk, false);
+}
+
+bool
+ChunkCache::is_missing(const ChunkList* chunk_list, uint32_t index) const {
+  key_type key(chunk_list, index);
+
+  if (m_fetching.find(key) != m_fetching.end())
+    return false;
+
+  auto itr = m_entries.find(key);
+
+  return itr == m_entries.end() || itr->second.list == LIST_RECENT_GHOST || itr->second.list == LIST_FREQUENT_GHOST;
+}
+
+void
+ChunkCache::prefetch(ChunkList* chunk_list, uint32_t index, Chunk* chunk) {
+  key_type key(chunk_list, index);
+
+  if (!is_enabled() || chunk->chunk_size() > m_maxSize || !is_missing(chunk_list, index))
+    return;
+
+  auto itr = m_entries.find(key);
+
+  if (itr != m_entries.end())
+    adapt_target(itr->second);
+
+  start_fetch(key, chunk, true);
+}
+
+void
+ChunkCache::start_fetch(key_type key, Chunk* chunk, bool prefetched) {
+  if (!is_enabled() || chunk->chunk_size() > m_maxSize)
+    return;
+
+  struct fetch_state {
+    buffer_type buffer;
+    uint32_t    size;
+    uint32_t    remaining{0};
+    bool        failed{false};
+  };
+
+  uint64_t id = ++m_fetchId;
+  m_fetching[key] = id;
+
+  auto state = std::make_shared<fetch_state>();
+  state->buffer = buffer_type(new char[chunk->chunk_size()]);
+  state->size   = chunk->chunk_size();
+
+  // Count every part up front so a completion arriving early cannot
+  // finish the fetch while parts are still being submitted.
+  state->remaining = 1 + std::count_if(chunk->begin(), chunk->end(), [](const ChunkPart& part) { return part.size() != 0; });
+
+  auto part_done = [this, key, id, state, prefetched](int result, uint32_t expected) {
+      if (result < 0 || static_cast<uint32_t>(result) != expected)
+        state->failed = true;
+
+      if (--state->remaining != 0)
+        return;
+
+      if (state->failed)
+        fetch_done(key, id, nullptr, 0, prefetched);
+      else
+        fetch_done(key, id, state->buffer, state->size, prefetched);
+    };
+
+  for (auto& part : *chunk) {
+    if (part.size() == 0)
+      continue;
+
+    // Padding and buffered parts are already in memory, and reading
+    // them from the file could return stale data.
+    if (part.mapped() != ChunkPart::MAPPED_MMAP || part.file() == nullptr ||
+        part.file()->is_padding() || !part.file()->is_open()) {
+      std::memcpy(state->buffer.get() + part.position(), part.chunk().begin(), part.size());
+      part_done(part.size(), part.size());
+      continue;
+    }
+
+    uint32_t size = part.size();
+
+    thread_disk()->disk_io()->read(part.file()->file_descriptor(), part.file_offset(),
+                                   buffer_type(state->buffer, state->buffer.get() + part.position()), size,
+                                   ThreadMain::thread_main(), this,
+                                   [part_done, size](int result, auto) { part_done(result, size); });
+  }
+
+  part_done(0, 0);
+}
+
+void
+ChunkCache::fetch_done(key_type key, uint64_t id, buffer_type buffer, uint32_t size, bool prefetched) {
+  auto itr = m_fetching.find(key);
+
+  // The chunk list was erased, or a newer fetch replaced this one.
+  if (itr == m_fetching.end() || itr->second != id)
+    return;
+
+  m_fetching.erase(itr);
+
+  if (buffer != nullptr)
+    insert(key.first, key.second, std::move(buffer), size, prefetched);
+}
+
+void
+ChunkCache::insert(const ChunkList* chunk_list, uint32_t index, buffer_type buffer, uint32_t size, bool prefetched) {
+  if (buffer == nullptr)
+    throw internal_error("ChunkCache::insert(...) received a null buffer.");
+
+  if (size > m_maxSize)
+    return;
+
+  key_type key(chunk_list, index);
+  auto itr = m_entries.find(key);
+
+  if (itr != m_entries.end() && itr->second.list != LIST_RECENT_GHOST && itr->second.list != LIST_FREQUENT_GHOST)
+    return;
+
+  // The manager may evict other chunks to make room, which only moves
+  // them to the ghost lists and so leaves 'itr' valid.
+  if (!charge(size))
+    return;
+
+  if (itr == m_entries.end()) {
+    m_recent.push_front(entry_type{key, size, std::move(buffer), prefetched});
+    m_recentSize += size;
+    m_entries.emplace(key, location_type{LIST_RECENT, m_recent.begin()});
+
+  } else {
+    // Seen before, so it moves straight to the frequent list.
+    move_to(itr->second, LIST_FREQUENT);
+    itr->second.itr->buffer = std::move(buffer);
+  }
+
+  replace();
+}
+
+void
+ChunkCache::erase(const ChunkList* chunk_list) {
+  auto first = m_entries.lower_bound(key_type(chunk_list, 0));
+  auto last  = m_entries.lower_bound(key_type(chunk_list + 1, 0));
+
+  while (first != last)
+    remove(first++);
+
+  m_fetching.erase(m_fetching.lower_bound(key_type(chunk_list, 0)),
+                   m_fetching.lower_bound(key_type(chunk_list + 1, 0)));
+}
+
+void
+ChunkCache::clear() {
+  for (const auto& entry : m_recent)
+    release(entry.size);
+  for (const auto& entry : m_frequent)
+    release(entry.size);
+
+  m_entries.clear();
+  m_fetching.clear();
+
+  m_recent.clear();
+  m_frequent.clear();
+  m_recentGhost.clear();
+  m_frequentGhost.clear();
+
+  m_recentSize = m_frequentSize = m_recentGhostSize = m_frequentGhostSize = 0;
+  m_targetRecent = 0;
+}
+
+void
+ChunkCache::evict(uint64_t bytes) {
+  shrink_to(size() - std::min(size(), bytes));
+}
+
+bool
+ChunkCache::charge(uint32_t size) {
+  return m_manager == nullptr || m_manager->allocate(size, ChunkManager::allocate_dont_log);
+}
+
+void
+ChunkCache::release(uint32_t size) {
+  if (m_manager != nullptr)
+    m_manager->deallocate(size, ChunkManager::allocate_dont_log);
+}
+
+ChunkCache::entry_list&
+ChunkCache::list(list_type type) {
+  switch (type) {
+  case LIST_RECENT:         return m_recent;
+  case LIST_FREQUENT:       return m_frequent;
+  case LIST_RECENT_GHOST:   return m_recentGhost;
+  case LIST_FREQUENT_GHOST: return m_frequentGhost;
+  default:
+    throw internal_error("ChunkCache::list(...) invalid type.");
+  }
+}
+
+uint64_t&
+ChunkCache::list_size(list_type type) {
+  switch (type) {
+  case LIST_RECENT:         return m_recentSize;
+  case LIST_FREQUENT:       return m_frequentSize;
+  case LIST_RECENT_GHOST:   return m_recentGhostSize;
+  case LIST_FREQUENT_GHOST: return m_frequentGhostSize;
+  default:
+    throw internal_error("ChunkCache::list_size(...) invalid type.");
+  }
+}
+
+// Moves the entry to the front of the list, dropping the buffer when
+// it becomes a ghost. Any sends in progress keep their own reference.
+void
+ChunkCache::move_to(location_type& location, list_type type) {
+  uint32_t size = location.itr->size;
+
+  list_size(location.list) -= size;
+  list_size(type) += size;
+
+  list(type).splice(list(type).begin(), list(location.list), location.itr);
+
+  if ((type == LIST_RECENT_GHOST || type == LIST_FREQUENT_GHOST) &&
+      (location.list == LIST_RECENT || location.list == LIST_FREQUENT)) {
+    location.itr->buffer.reset();
+    release(size);
+  }
+
+  location.list = type;
+}
+
+// A request for a ghost entry means the list it was evicted from was
+// too small, so the recent list target is moved towards it.
+void
+ChunkCache::adapt_target(const location_type& location) {
+  switch (location.list) {
+  case LIST_RECENT_GHOST: {
+    uint64_t delta = location.itr->size * std::max<uint64_t>(1, m_frequentGhostSize / std::max<uint64_t>(1, m_recentGhostSize));
+    m_targetRecent = std::min(m_maxSize, m_targetRecent + delta);
+    break;
+  }
+  case LIST_FREQUENT_GHOST: {
+    uint64_t delta = location.itr->size * std::max<uint64_t>(1, m_recentGhostSize / std::max<uint64_t>(1, m_frequentGhostSize));
+    m_targetRecent = m_targetRecent - std::min(m_targetRecent, delta);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void
+ChunkCache::remove(std::map<key_type, location_type>::iterator itr) {
+  if (itr->second.list == LIST_RECENT || itr->second.list == LIST_FREQUENT)
+    release(itr->second.itr->size);
+
+  list_size(itr->second.list) -= itr->second.itr->size;
+  list(itr->second.list).erase(itr->second.itr);
+
+  m_entries.erase(itr);
+}
+
+void
+ChunkCache::replace() {
+  shrink_to(m_maxSize);
+
+  // Ghost entries only hold keys, but are bounded as in ARC so they
+  // describe roughly one cache worth of recent history each.
+  while (!m_recentGhost.empty() && m_recentSize + m_recentGhostSize > m_maxSize)
+    remove(m_entries.find(m_recentGhost.back().key));
+
+  while (!m_frequentGhost.empty() && size() + m_recentGhostSize + m_frequentGhostSize > 2 * m_maxSize)
+    remove(m_entries.find(m_frequentGhost.back().key));
+}
+
+void
+ChunkCache::shrink_to(uint64_t target) {
+  while (size() > target) {
+    list_type from = (!m_recent.empty() && (m_recentSize > m_targetRecent || m_frequent.empty())) ? LIST_RECENT : LIST_FREQUENT;
+    list_type to   = from == LIST_RECENT ? LIST_RECENT_GHOST : LIST_FREQUENT_GHOST;
+
+    move_to(m_entries.find(list(from).back().key)->second, to);
+  }
+}
+
+} // namespace torrent
@@ -0,0 +1,146 @@
+#ifndef LIBTORRENT_DATA_CHUNK_CACHE_H
+#define LIBTORRENT_DATA_CHUNK_CACHE_H
+
+#include <list>
+#include <map>
+#include <memory>
+
+namespace torrent {
+
+class Chunk;
+class ChunkList;
+class ChunkManager;
+
+// Memory bounded cache of whole chunks used for uploading, shared by
+// all downloads. Eviction follows ARC (adaptive replacement cache),
+// keeping chunks requested once and chunks requested repeatedly in
+// separate lists, and using ghost entries of recently evicted chunks
+// to adapt the balance between them. Sizes are tracked in bytes as
+// chunk sizes differ between downloads.
+//
+// Chunks are inserted when an asynchronous read on the disk thread
+// completes, so a miss never blocks the caller. Chunks are also read
+// ahead on the first request for them, before the upload reaches the
+// piece.
+//
+// With a manager the cached chunks are charged to its memory budget,
+// and the manager evicts them when it runs short. Reads in progress
+// are only charged once inserted.
+class ChunkCache {
+public:
+  using buffer_type = std::shared_ptr<char[]>;
+  using key_type    = std::pair<const ChunkList*, uint32_t>;
+
+  ChunkCache() = default;
+  explicit ChunkCache(ChunkManager* manager) : m_manager(manager) {}
+  ~ChunkCache();
+
+  uint64_t            max_size() const                { return m_maxSize; }
+  void                set_max_size(uint64_t bytes);
+
+  uint64_t            size() const                    { return m_recentSize + m_frequentSize; }
+  uint64_t            target_recent_size() const      { return m_targetRecent; }
+
+  uint64_t            recent_size() const             { return m_recentSize; }
+  uint64_t            frequent_size() const           { return m_frequentSize; }
+  uint64_t            recent_ghost_size() const       { return m_recentGhostSize; }
+  uint64_t            frequent_ghost_size() const     { return m_frequentGhostSize; }
+
+  uint64_t            stats_hits() const              { return m_statsHits; }
+  uint64_t            stats_misses() const            { return m_statsMisses; }
+
+  bool                is_enabled() const              { return m_maxSize != 0; }
+
+  // Returns nullptr on a miss, and updates the hit/miss counters of
+  // both the cache and the chunk list.
+  buffer_type         find(ChunkList* chunk_list, uint32_t index);
+
+  // Reads the chunk on the disk thread and inserts it once all parts
+  // have completed. The chunk must be kept valid by the caller only
+  // for the duration of this call.
+  void                fetch(ChunkList* chunk_list, uint32_t index, Chunk* chunk);
+
+  // True if the chunk is neither cached nor being read.
+  bool                is_missing(const ChunkList* chunk_list, uint32_t index) const;
+
+  // Reads the chunk ahead of its first use. A ghost entry counts as a
+  // ghost hit now, and the first find after the read completes does
+  // not count as a repeated use.
+  void                prefetch(ChunkList* chunk_list, uint32_t index, Chunk* chunk);
+
+  void                insert(const ChunkList* chunk_list, uint32_t index, buffer_type buffer, uint32_t size, bool prefetched = false);
+
+  void                erase(const ChunkList* chunk_list);
+  void                clear();
+
+  // Evicts cached chunks, as if the cache was full, until at least
+  // 'bytes' have been released or the cache is empty.
+  void                evict(uint64_t bytes);
+
+private:
+  ChunkCache(const ChunkCache&) = delete;
+  ChunkCache& operator=(const ChunkCache&) = delete;
+
+  enum list_type {
+    LIST_RECENT,
+    LIST_FREQUENT,
+    LIST_RECENT_GHOST,
+    LIST_FREQUENT_GHOST
+  };
+
+  struct entry_type {
+    key_type            key;
+    uint32_t            size;
+    buffer_type         buffer;
+    bool                prefetched{false};
+  };
+
+  using entry_list = std::list<entry_type>;
+
+  struct location_type {
+    list_type           list;
+    entry_list::iterator itr;
+  };
+
+  entry_list&         list(list_type type);
+  uint64_t&           list_size(list_type type);
+
+  void                move_to(location_type& location, list_type type);
+  void                remove(std::map<key_type, location_type>::iterator itr);
+
+  bool                charge(uint32_t size);
+  void                release(uint32_t size);
+
+  void                replace();
+  void                shrink_to(uint64_t target);
+  void                adapt_target(const location_type& location);
+
+  void                start_fetch(key_type key, Chunk* chunk, bool prefetched);
+  void                fetch_done(key_type key, uint64_t id, buffer_type buffer, uint32_t size, bool prefetched);
+
+  ChunkManager*       m_manager{nullptr};
+
+  uint64_t            m_maxSize{0};
+  uint64_t            m_targetRecent{0};
+
+  entry_list          m_recent;
+  entry_list          m_frequent;
+  entry_list          m_recentGhost;
+  entry_list          m_frequentGhost;
+
+  uint64_t            m_recentSize{0};
+  uint64_t            m_frequentSize{0};
+  uint64_t            m_recentGhostSize{0};
+  uint64_t            m_frequentGhostSize{0};
+
+  std::map<key_type, location_type> m_entries;
+  std::map<key_type, uint64_t>      m_fetching;
+  uint64_t                          m_fetchId{0};
+
+  uint64_t            m_statsHits{0};
+  uint64_t            m_statsMisses{0};
+};
+
+} // namespace torrent
+
+#endif
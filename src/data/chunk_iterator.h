@@ -50,6 +50,7 @@ public:
   // Only non-zero length ranges will be returned.
   Chunk::data_type    data();
 
+  ChunkPart*          chunk_part()   { return &*m_iterator; }
   MemoryChunk*        memory_chunk() { return &m_iterator->chunk(); }
 
   uint32_t            memory_chunk_first() const { return m_first - m_iterator->position(); }
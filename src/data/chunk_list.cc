@@ -1,11 +1,24 @@
 #include "config.h"
 
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <utility>
 #include <rak/error_number.h>
 
+#include "data/chunk_cache.h"
+#include "data/socket_file.h"
+#include "data/thread_disk.h"
+#include "data/write_back.h"
 #include "torrent/exceptions.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/data/download_data.h"
+#include "torrent/data/file.h"
 #include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
 #include "utils/instrumentation.h"
 
 #include "chunk_list.h"
@@ -25,6 +38,104 @@ struct chunk_list_earliest_modified {
   std::chrono::microseconds m_time{this_thread::cached_time()};
 };
 
+// Buffered chunks are written back by the disk thread, and mapped
+// chunks that must be durable are synced there, the job is kept until
+// all parts are done and then handed back to the thread that
+// submitted it.
+struct ChunkList::write_job {
+  ChunkListNode*      node;
+  std::pair<int,bool> options;
+  bool                report_errors;
+
+  unsigned int        pending{0};
+  int                 error{0};
+};
+
+//
+// Once the chunk list is cleared the state is detached from it, and
+// holds the chunks still being written until the last job is done.
+//
+// Chunks being filled post their index back the same way.
+struct ChunkList::write_state {
+  std::mutex                              lock;
+
+  unsigned int                            in_flight{0};
+  std::condition_variable                 idle;
+  std::vector<std::shared_ptr<write_job>> completed;
+  bool                                    callback_posted{false};
+
+  std::vector<uint32_t>                   filled;
+  bool                                    fill_callback_posted{false};
+
+  ChunkList*                              owner;
+  utils::Thread*                          thread{};
+
+  std::vector<std::unique_ptr<Chunk>>     detached;
+
+  void                job_done(const std::shared_ptr<write_job>& job, int result, uint32_t expected);
+  void                fill_done(uint32_t index);
+};
+
+void
+ChunkList::write_state::job_done(const std::shared_ptr<write_job>& job, int result, uint32_t expected) {
+  std::vector<std::unique_ptr<Chunk>> released;
+  auto guard = std::scoped_lock(lock);
+
+  if (result != static_cast<int>(expected) && job->error == 0)
+    job->error = result < 0 ? -result : EIO;
+
+  if (--job->pending != 0)
+    return;
+
+  completed.push_back(job);
+
+  // Post while holding the lock so that once 'in_flight' reaches
+  // zero the callback can be cancelled.
+  if (!callback_posted && thread != nullptr) {
+    callback_posted = true;
+
+    auto target = owner;
+    thread->callback(target, [target]() { target->process_write_backs(); });
+  }
+
+  if (--in_flight != 0)
+    return;
+
+  idle.notify_all();
+
+  // The chunks of a cleared chunk list are released once nothing
+  // is left in flight.
+  if (owner == nullptr)
+    released.swap(detached);
+}
+
+void
+ChunkList::write_state::fill_done(uint32_t index) {
+  // Hashing chunks are waited for by the hash check queue.
+  if (thread_disk() != nullptr)
+    thread_disk()->hash_check_queue()->notify_filled();
+
+  auto guard = std::scoped_lock(lock);
+
+  if (owner == nullptr || thread == nullptr)
+    return;
+
+  filled.push_back(index);
+
+  if (!fill_callback_posted) {
+    fill_callback_posted = true;
+
+    auto target = owner;
+    thread->callback(target, [target]() { target->process_fills(); });
+  }
+}
+
+ChunkList::ChunkList() :
+  m_write_state(std::make_shared<write_state>()) {
+
+  m_write_state->owner = this;
+}
+
 inline bool
 ChunkList::is_queued(ChunkListNode* node) {
   return std::find(m_queue.begin(), m_queue.end(), node) != m_queue.end();
@@ -56,6 +167,31 @@ void
 ChunkList::clear() {
   LT_LOG_THIS(INFO, "Clearing.", 0);
 
+  if (m_manager != nullptr)
+    m_manager->chunk_cache()->erase(this);
+
+  utils::Thread* thread;
+
+  {
+    auto lock = std::scoped_lock(m_write_state->lock);
+
+    // Completions of write-backs still in flight no longer post to
+    // this chunk list.
+    thread = m_write_state->thread;
+    m_write_state->owner = nullptr;
+    m_write_state->thread = nullptr;
+  }
+
+  if (thread != nullptr)
+    thread->cancel_callback(this);
+
+  process_write_backs();
+
+  auto state = std::exchange(m_write_state, std::make_shared<write_state>());
+  m_write_state->owner = this;
+
+  std::vector<std::unique_ptr<Chunk>> done_chunks;
+
   // Don't do any sync'ing as whomever decided to shut down really
   // doesn't care, so just de-reference all chunks in queue.
   for (auto chunk : m_queue) {
@@ -63,11 +199,37 @@ ChunkList::clear() {
       throw internal_error("ChunkList::clear() called but a node in the queue is still referenced.");
 
     chunk->dec_rw();
-    clear_chunk(chunk, release_default);
+
+    if (!chunk->is_write_pending()) {
+      clear_chunk(chunk, release_default);
+      continue;
+    }
+
+    // The disk thread still writes from the buffers, so the chunk is
+    // handed to the write state which releases it once done.
+    {
+      auto lock = std::scoped_lock(state->lock);
+
+      if (state->in_flight == 0)
+        done_chunks.emplace_back(chunk->chunk());
+      else
+        state->detached.emplace_back(chunk->chunk());
+    }
+
+    chunk->set_chunk(NULL);
+    chunk->set_write_pending(false);
+
+    m_manager->deallocate(m_chunk_size, 0);
   }
 
   m_queue.clear();
 
+  // Chunks still being filled, or filled and not yet taken, have no
+  // references.
+  for (auto& node : *this)
+    if (node.is_valid() && node.references() == 0)
+      clear_chunk(&node, release_default);
+
   if (std::any_of(begin(), end(), std::mem_fn(&ChunkListNode::chunk)))
     throw internal_error("ChunkList::clear() called but a node with a valid chunk was found.");
 
@@ -126,6 +288,9 @@ ChunkList::get(size_type index, get_flags flags) {
     node->set_chunk(chunk);
     node->set_time_modified(0us);
 
+    if (chunk->is_buffered() && !(flags & get_dont_fill))
+      fill_chunk(node);
+
   } else if (flags & get_writable && !node->chunk()->is_writable()) {
     if (node->blocking() != 0) {
       if ((flags & get_nonblock))
@@ -134,15 +299,41 @@ ChunkList::get(size_type index, get_flags flags) {
       throw internal_error("No support yet for getting write permission for blocked chunk.");
     }
 
+    if (!node->chunk()->is_filled())
+      return ChunkHandle::from_error(rak::error_number::e_again);
+
     Chunk* chunk = m_slot_create_chunk(index, prot_flags);
 
-    if (chunk == NULL)
-      return ChunkHandle::from_error(rak::error_number::current().is_valid() ? rak::error_number::current() : rak::error_number::e_noent);
+    if (chunk == NULL) {
+      rak::error_number current_error = rak::error_number::current();
+
+      return ChunkHandle::from_error(current_error.is_valid() ? current_error : rak::error_number::e_noent);
+    }
 
     delete node->chunk();
 
     node->set_chunk(chunk);
     node->set_time_modified(0us);
+
+    if (chunk->is_buffered() && !(flags & get_dont_fill))
+      fill_chunk(node);
+  }
+
+  // Only the hash checker handles chunks still being read in by the
+  // disk thread, others try again once it is done. A chunk that could
+  // not be read is released once nobody holds it.
+  if (!(flags & get_hashing)) {
+    if (!node->chunk()->is_filled())
+      return ChunkHandle::from_error(rak::error_number::e_again);
+
+    if (node->chunk()->fill_error() != 0) {
+      int error = node->chunk()->fill_error();
+
+      if (node->references() == 0)
+        clear_chunk(node, release_default);
+
+      return ChunkHandle::from_error(rak::error_number(error));
+    }
   }
 
   node->inc_references();
@@ -186,6 +377,7 @@ ChunkList::release(ChunkHandle* handle, release_flags flags) {
   }
 
   if (handle->is_writable()) {
+    handle->object()->chunk()->set_dirty();
 
     if (handle->object()->writable() == 1) {
       if (is_queued(handle->object()))
@@ -224,34 +416,94 @@ ChunkList::clear_chunk(ChunkListNode* node, release_flags flags) {
   m_manager->deallocate(m_chunk_size, (flags & release_dont_log) ? ChunkManager::allocate_dont_log : 0);
 }
 
+// The chunk is owned by the node while being filled, without any
+// references, until process_fills releases it.
+//
+// Without a disk thread the chunk is read before fill_async returns,
+// and process_fills is still posted rather than called from within
+// get().
+void
+ChunkList::fill_chunk(ChunkListNode* node) {
+  auto state = m_write_state;
+  auto index = node->index();
+
+  {
+    auto lock = std::scoped_lock(state->lock);
+
+    if (state->thread == nullptr) {
+      if ((state->thread = utils::Thread::self()) == nullptr)
+        throw internal_error("ChunkList::fill_chunk(...) called outside a thread.");
+    }
+  }
+
+  node->chunk()->fill_async([state, index]() { state->fill_done(index); });
+}
+
+// Called on the thread that got the chunks once they are filled.
+void
+ChunkList::process_fills() {
+  std::vector<uint32_t> indices;
+
+  {
+    auto lock = std::scoped_lock(m_write_state->lock);
+
+    indices.swap(m_write_state->filled);
+    m_write_state->fill_callback_posted = false;
+  }
+
+  for (auto index : indices) {
+    if (m_slot_chunk_filled)
+      m_slot_chunk_filled(index);
+
+    ChunkListNode* node = &base_type::at(index);
+
+    // The node may since have been given a new chunk that is still
+    // being filled.
+    if (node->is_valid() && node->references() == 0 && node->chunk()->is_filled())
+      clear_chunk(node, release_default);
+  }
+}
+
 inline bool
 ChunkList::sync_chunk(ChunkListNode* node, std::pair<int,bool> options) {
-  if (node->references() <= 0 || node->writable() <= 0)
-    throw internal_error("ChunkList::sync_chunk(...) got a node with invalid reference count.");
-
   if (!node->chunk()->sync(options.first))
     return false;
 
+  sync_chunk_done(node, options);
+  return true;
+}
+
+void
+ChunkList::sync_chunk_done(ChunkListNode* node, std::pair<int,bool> options) {
+  if (node->references() <= 0 || node->writable() <= 0)
+    throw internal_error("ChunkList::sync_chunk_done(...) got a node with invalid reference count.");
+
   node->set_sync_triggered(true);
 
   // When returning here we're not properly deallocating the piece.
   //
   // Only release the chunk after a blocking sync.
   if (!options.second)
-    return true;
+    return;
 
   node->dec_rw();
 
   if (node->references() == 0)
     clear_chunk(node, release_default);
-
-  return true;
 }
 
 uint32_t
 ChunkList::sync_chunks(sync_flags flags) {
   LT_LOG_THIS(DEBUG, "Sync chunks: flags:%#x.", flags);
 
+  // Syncing everything must not leave writes in flight, so those
+  // already submitted are waited for and processed first. Failed ones
+  // are dirty again and written below.
+  if ((flags & sync_all)) {
+    wait_write_backs();
+    process_write_backs();
+  }
+
   Queue::iterator split;
 
   if ((flags & sync_all))
@@ -283,21 +535,68 @@ ChunkList::sync_chunks(sync_flags flags) {
     split = partition_optimize(split, m_queue.end(), 50, 5, false);
 
   uint32_t failed = 0;
+  int      error = 0;
+
+  // The errno of the first failure, taken where it happened as later
+  // calls may change it.
+  auto set_error = [&error](int e) {
+      if (error == 0)
+        error = e != 0 ? e : EIO;
+    };
+
+  // Periodic syncs are paced by the write-back budget, chunks past
+  // their sync timeout are always synced.
+  bool paced = (flags & sync_use_timeout);
+
+  // Mapped chunks are flushed as merged file ranges after the loop
+  // when supported, else synced one by one.
+  WriteBack write_back;
+  std::vector<std::pair<ChunkListNode*, std::pair<int,bool>>> write_back_nodes;
 
   for (auto itr = split, last = m_queue.end(); itr != last; ++itr) {
 
     // We can easily skip pieces by swap_iter, so there should be no
     // problem being selective about the ranges we sync.
 
-    // Use a function for checking the next few chunks and see how far
-    // we want to sync. When we want to sync everything use end. Call
-    // before the loop, or add a check.
+    if ((*itr)->is_write_pending()) {
+      std::iter_swap(itr, split++);
+      continue;
+    }
 
-    // if we don't want to sync, swap and break.
+    if (paced && m_manager->write_back_remaining() == 0 && !check_node(*itr)) {
+      std::iter_swap(itr, split++);
+      continue;
+    }
 
     std::pair<int,bool> options = sync_options(*itr, flags);
 
-    if (!sync_chunk(*itr, options)) {
+    if (paced)
+      m_manager->consume_write_back((*itr)->chunk()->chunk_size());
+
+    // Buffered chunks stay queued until the disk thread is done.
+    if ((*itr)->chunk()->is_buffered()) {
+      if (!write_back_chunk(*itr, options, !(flags & sync_ignore_error))) {
+        set_error(errno);
+        failed++;
+      }
+
+      std::iter_swap(itr, split++);
+      continue;
+    }
+
+    if (WriteBack::is_supported()) {
+      if (!(*itr)->chunk()->sync_write_back(options.first, &write_back)) {
+        set_error(errno);
+        std::iter_swap(itr, split++);
+
+        failed++;
+        continue;
+      }
+
+      write_back_nodes.emplace_back(*itr, options);
+
+    } else if (!sync_chunk(*itr, options)) {
+      set_error(errno);
       std::iter_swap(itr, split++);
 
       failed++;
@@ -308,6 +607,49 @@ ChunkList::sync_chunks(sync_flags flags) {
       std::iter_swap(itr, split++);
   }
 
+  if (!write_back.empty()) {
+    bool success = write_back.flush();
+
+    // The rate is measured from when the writeback completes, not when
+    // it was queued.
+    auto manager = m_manager;
+
+    write_back.wait_async(utils::Thread::self(), manager, [manager](uint64_t bytes, uint32_t ranges, std::chrono::microseconds latency) {
+        manager->receive_write_back(bytes, ranges, latency);
+      });
+
+    std::vector<std::pair<ChunkListNode*, std::pair<int,bool>>> durable_nodes;
+
+    for (auto [node, options] : write_back_nodes) {
+      bool is_failed = !success && node->chunk()->is_write_back_failed(&write_back);
+      bool is_durable = !is_failed && (options.first & MemoryChunk::sync_sync);
+
+      // Keep failed chunks, and those waiting to be made durable, in
+      // the queue. Nodes not released are already placed before split.
+      if ((is_failed || is_durable) && options.second) {
+        auto node_itr = std::find(split, m_queue.end(), node);
+        std::iter_swap(node_itr, split++);
+      }
+
+      if (is_failed) {
+        set_error(write_back.error());
+        failed++;
+        continue;
+      }
+
+      if (is_durable) {
+        durable_nodes.emplace_back(node, options);
+        continue;
+      }
+
+      node->chunk()->clear_dirty();
+      sync_chunk_done(node, options);
+    }
+
+    if (!durable_nodes.empty())
+      sync_write_back_files(durable_nodes, !(flags & sync_ignore_error));
+  }
+
   if (lt_log_is_valid(LOG_INSTRUMENTATION_MINCORE)) {
     instrumentation_update(INSTRUMENTATION_MINCORE_SYNC_SUCCESS, std::distance(split, m_queue.end()));
     instrumentation_update(INSTRUMENTATION_MINCORE_SYNC_FAILED, failed);
@@ -320,7 +662,197 @@ ChunkList::sync_chunks(sync_flags flags) {
   // The caller must either make sure that it is safe to close the
   // download or set the sync_ignore_error flag.
   if (failed && !(flags & sync_ignore_error))
-    m_slot_storage_error("Could not sync chunk: " + std::string(rak::error_number::current().c_str()));
+    m_slot_storage_error("Could not sync chunk: " + std::string(std::strerror(error)));
+
+  if ((flags & sync_all))
+    wait_write_backs();
+
+  return failed + process_write_backs();
+}
+
+// Blocks until the disk thread is done with every write-back job.
+void
+ChunkList::wait_write_backs() {
+  auto lock = std::unique_lock(m_write_state->lock);
+
+  m_write_state->idle.wait(lock, [this] { return m_write_state->in_flight == 0; });
+}
+
+// Submits the buffered parts of the chunk to the disk thread, or
+// writes them directly when there is none. Returns false if the files
+// could not be prepared, in which case nothing was submitted.
+bool
+ChunkList::write_back_chunk(ChunkListNode* node, std::pair<int,bool> options, bool report_errors) {
+  Chunk* chunk = node->chunk();
+  bool dirty = chunk->is_dirty();
+  bool sync = (options.first & MemoryChunk::sync_sync);
+
+  for (auto& c : *chunk) {
+    if (c.mapped() != ChunkPart::MAPPED_BUFFER) {
+      if (!c.sync(options.first))
+        return false;
+
+      continue;
+    }
+
+    if (!c.chunk().is_writable())
+      continue;
+
+    if (c.file() == nullptr)
+      throw internal_error("ChunkList::write_back_chunk(...) buffered part has no file.");
+
+    if (!c.file()->prepare(false, MemoryChunk::prot_read | MemoryChunk::prot_write, 0))
+      return false;
+  }
+
+  std::vector<ChunkPart*> parts;
+
+  for (auto& c : *chunk)
+    if (c.mapped() == ChunkPart::MAPPED_BUFFER && c.chunk().is_writable() && (dirty || sync))
+      parts.push_back(&c);
+
+  auto state = m_write_state;
+  auto job = start_write_job(node, options, report_errors, parts.size());
+  auto done = [state, job](int result, uint32_t expected) { state->job_done(job, result, expected); };
+
+  for (auto part : parts) {
+    int fd = part->file()->file_descriptor();
+    uint32_t length = part->size();
+
+    if (thread_disk() == nullptr) {
+      SocketFile file(fd);
+      bool success = (!dirty || file.write_chunk(part->chunk(), part->file_offset())) && (!sync || file.sync_data());
+
+      done(success ? static_cast<int>(length) : -errno, length);
+      continue;
+    }
+
+    // The buffer is owned by the node, which is kept until the job
+    // has been processed.
+    DiskIo::buffer_type buffer(DiskIo::buffer_type(), part->chunk().begin());
+    auto slot_done = [done, length](int result, [[maybe_unused]] DiskIo::buffer_type b) { done(result, length); };
+
+    if (!dirty)
+      thread_disk()->disk_io()->fsync(fd, nullptr, nullptr, [done](int result, DiskIo::buffer_type) { done(result, 0); });
+    else if (sync)
+      thread_disk()->disk_io()->write_sync(fd, part->file_offset(), std::move(buffer), length, nullptr, nullptr, std::move(slot_done));
+    else
+      thread_disk()->disk_io()->write(fd, part->file_offset(), std::move(buffer), length, nullptr, nullptr, std::move(slot_done));
+  }
+
+  // Release the submission reference.
+  done(0, 0);
+  return true;
+}
+
+// Marks the node write pending until the job's 'pending' completions,
+// and the caller's submission reference, are done.
+std::shared_ptr<ChunkList::write_job>
+ChunkList::start_write_job(ChunkListNode* node, std::pair<int,bool> options, bool report_errors, unsigned int pending) {
+  auto job = std::make_shared<write_job>(write_job{node, options, report_errors});
+
+  // Count every part before submitting so an early completion can't
+  // see zero pending.
+  job->pending = pending + 1;
+
+  {
+    auto lock = std::scoped_lock(m_write_state->lock);
+
+    if (thread_disk() != nullptr && m_write_state->thread == nullptr) {
+      if ((m_write_state->thread = utils::Thread::self()) == nullptr)
+        throw internal_error("ChunkList::start_write_job(...) called outside a thread.");
+    }
+
+    m_write_state->in_flight++;
+  }
+
+  node->chunk()->clear_dirty();
+  node->set_write_pending(true);
+
+  return job;
+}
+
+// Makes the files of flushed mapped chunks durable, with one fdatasync
+// per file on the disk thread, or directly when there is none.
+void
+ChunkList::sync_write_back_files(const std::vector<std::pair<ChunkListNode*, std::pair<int,bool>>>& nodes, bool report_errors) {
+  auto state = m_write_state;
+
+  std::vector<std::shared_ptr<write_job>> jobs;
+  std::map<int, std::vector<std::shared_ptr<write_job>>> files;
+
+  for (auto [node, options] : nodes) {
+    auto fds = node->chunk()->write_back_files();
+
+    jobs.push_back(start_write_job(node, options, report_errors, fds.size()));
+
+    for (int fd : fds)
+      files[fd].push_back(jobs.back());
+  }
+
+  for (auto& [fd, file_jobs] : files) {
+    auto done = [state, file_jobs = std::move(file_jobs)](int result, [[maybe_unused]] DiskIo::buffer_type b) {
+        for (auto& job : file_jobs)
+          state->job_done(job, result, 0);
+      };
+
+    if (thread_disk() == nullptr)
+      done(SocketFile(fd).sync_data() ? 0 : -errno, DiskIo::buffer_type());
+    else
+      thread_disk()->disk_io()->fsync(fd, nullptr, nullptr, std::move(done));
+  }
+
+  // Release the submission references.
+  for (auto& job : jobs)
+    state->job_done(job, 0, 0);
+}
+
+// Called on the submitting thread once write-backs are done. Returns
+// the number of failed chunks, which are kept queued and marked dirty
+// so they get written again.
+uint32_t
+ChunkList::process_write_backs() {
+  std::vector<std::shared_ptr<write_job>> jobs;
+
+  {
+    auto lock = std::scoped_lock(m_write_state->lock);
+
+    jobs.swap(m_write_state->completed);
+    m_write_state->callback_posted = false;
+  }
+
+  uint32_t failed = 0;
+  int      error = 0;
+
+  for (auto& job : jobs) {
+    ChunkListNode* node = job->node;
+
+    node->set_write_pending(false);
+
+    if (job->error != 0) {
+      LT_LOG_THIS(DEBUG, "Write back failed: index:%" PRIu32 " errmsg:%s.", node->index(), std::strerror(job->error));
+
+      node->chunk()->set_dirty();
+      failed++;
+
+      if (job->report_errors)
+        error = job->error;
+
+      continue;
+    }
+
+    // Modified while being written, leave it for the next sync.
+    if (node->chunk()->is_dirty())
+      continue;
+
+    if (job->options.second)
+      m_queue.erase(std::find(m_queue.begin(), m_queue.end(), node));
+
+    sync_chunk_done(node, job->options);
+  }
+
+  if (error != 0)
+    m_slot_storage_error("Could not sync chunk: " + std::string(std::strerror(error)));
 
   return failed;
 }
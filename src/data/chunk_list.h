@@ -2,6 +2,7 @@
 #define LIBTORRENT_DATA_CHUNK_LIST_H
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -24,6 +25,7 @@ public:
   using Queue     = std::vector<ChunkListNode*>;
 
   using slot_chunk_index = std::function<Chunk*(uint32_t, int)>;
+  using slot_index       = std::function<void(uint32_t)>;
   using slot_value       = std::function<uint64_t()>;
   using slot_string      = std::function<void(const std::string&)>;
 
@@ -56,7 +58,8 @@ public:
     get_nonblock      = (1 << 2),
     get_hashing       = (1 << 3),
     get_not_hashing   = (1 << 4),
-    get_dont_log      = (1 << 5)
+    get_dont_log      = (1 << 5),
+    get_dont_fill     = (1 << 6)
   };
 
   enum release_flags {
@@ -66,7 +69,7 @@ public:
 
   static constexpr int flag_active = (1 << 0);
 
-  ChunkList() = default;
+  ChunkList();
   ~ChunkList() { clear(); }
 
   int                 flags() const                       { return m_flags; }
@@ -78,7 +81,13 @@ public:
   uint32_t            chunk_size() const                  { return m_chunk_size; }
   size_type           queue_size() const                  { return m_queue.size(); }
 
+  uint64_t            stats_cache_hits() const            { return m_stats_cache_hits; }
+  uint64_t            stats_cache_misses() const          { return m_stats_cache_misses; }
+  void                inc_stats_cache_hits()              { m_stats_cache_hits++; }
+  void                inc_stats_cache_misses()            { m_stats_cache_misses++; }
+
   download_data*      data()                              { return m_data; }
+  ChunkManager*       manager()                           { return m_manager; }
 
   void                set_data(download_data* data)       { m_data = data; }
   void                set_manager(ChunkManager* manager)  { m_manager = manager; }
@@ -89,6 +98,12 @@ public:
   void                resize(size_type to_size);
   void                clear();
 
+  // Buffered chunks are read in on the disk thread, and until then
+  // gets that are not hashing fail with e_again. Once done
+  // 'slot_chunk_filled' is called so those may try again, after which
+  // the chunk is released if nobody took it. Writable chunks whose
+  // data is about to be replaced may skip the read with
+  // 'get_dont_fill'.
   ChunkHandle         get(size_type index, get_flags flags);
   void                release(ChunkHandle* handle, release_flags flags);
 
@@ -96,13 +111,17 @@ public:
   // keyword. Then use that flag to decide if we should skip
   // non-continious regions.
 
-  // Returns the number of failed syncs.
+  // Returns the number of failed syncs. Buffered chunks are written
+  // back on the disk thread, and their failures reported through
+  // slot_storage_error once done. With 'sync_all' this waits for the
+  // disk thread, so every failure is included in the result.
   uint32_t            sync_chunks(sync_flags flags);
 
   slot_string&        slot_storage_error()        { return m_slot_storage_error; }
   slot_chunk_index&   slot_create_chunk()         { return m_slot_create_chunk; }
   slot_chunk_index&   slot_create_hashing_chunk() { return m_slot_create_hashing_chunk; }
   slot_value&         slot_free_diskspace()       { return m_slot_free_diskspace; }
+  slot_index&         slot_chunk_filled()         { return m_slot_chunk_filled; }
 
   using chunk_address_result = std::pair<iterator, Chunk::iterator>;
 
@@ -116,6 +135,10 @@ private:
 
   inline void         clear_chunk(ChunkListNode* node, release_flags flags);
   inline bool         sync_chunk(ChunkListNode* node, std::pair<int,bool> options);
+  void                sync_chunk_done(ChunkListNode* node, std::pair<int,bool> options);
+
+  void                fill_chunk(ChunkListNode* node);
+  void                process_fills();
 
   Queue::iterator     partition_optimize(Queue::iterator first, Queue::iterator last, int weight, int maxDistance, bool dontSkip);
 
@@ -124,6 +147,16 @@ private:
 
   static std::pair<int,bool> sync_options(ChunkListNode* node, sync_flags flags);
 
+  struct write_job;
+  struct write_state;
+
+  std::shared_ptr<write_job> start_write_job(ChunkListNode* node, std::pair<int,bool> options, bool report_errors, unsigned int pending);
+
+  bool                write_back_chunk(ChunkListNode* node, std::pair<int,bool> options, bool report_errors);
+  void                sync_write_back_files(const std::vector<std::pair<ChunkListNode*, std::pair<int,bool>>>& nodes, bool report_errors);
+  uint32_t            process_write_backs();
+  void                wait_write_backs();
+
   download_data*      m_data{};
   ChunkManager*       m_manager{};
   Queue               m_queue;
@@ -131,10 +164,16 @@ private:
   int                 m_flags{0};
   uint32_t            m_chunk_size{0};
 
+  uint64_t            m_stats_cache_hits{0};
+  uint64_t            m_stats_cache_misses{0};
+
+  std::shared_ptr<write_state> m_write_state;
+
   slot_string         m_slot_storage_error;
   slot_chunk_index    m_slot_create_chunk;
   slot_chunk_index    m_slot_create_hashing_chunk;
   slot_value          m_slot_free_diskspace;
+  slot_index          m_slot_chunk_filled;
 };
 
 inline ChunkList::sync_flags
@@ -37,6 +37,10 @@ public:
   bool                sync_triggered() const         { return m_async_triggered; }
   void                set_sync_triggered(bool v)     { m_async_triggered = v; }
 
+  // A buffered chunk is being written back on the disk thread.
+  bool                is_write_pending() const       { return m_write_pending; }
+  void                set_write_pending(bool v)      { m_write_pending = v; }
+
   int                 references() const             { return m_references; }
   int                 dec_references()               { return --m_references; }
   int                 inc_references()               { return ++m_references; }
@@ -61,6 +65,7 @@ private:
   int                 m_blocking{0};
 
   bool                m_async_triggered{false};
+  bool                m_write_pending{false};
 
   std::chrono::microseconds m_time_modified{};
   std::chrono::microseconds m_time_preloaded{};
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 
+#include "data/buffer_pool.h"
 #include "torrent/exceptions.h"
 #include "chunk_part.h"
 
@@ -14,14 +15,27 @@ ChunkPart::clear() {
     m_chunk.unmap();
     break;
 
+  case MAPPED_BUFFER:
+    // Aligned reads may start the data past the allocated buffer.
+    BufferPool::release(m_chunk.ptr(), m_chunk.end() - m_chunk.ptr());
+    break;
+
   default:
   case MAPPED_STATIC:
-    throw internal_error("ChunkPart::clear() only MAPPED_MMAP supported.");
+    throw internal_error("ChunkPart::clear() only MAPPED_MMAP and MAPPED_BUFFER supported.");
   }
 
   m_chunk.clear();
 }
 
+bool
+ChunkPart::sync(int flags) {
+  if (m_mapped == MAPPED_BUFFER)
+    throw internal_error("ChunkPart::sync(...) called on a buffered part.");
+
+  return m_chunk.sync(0, m_chunk.size(), flags);
+}
+
 bool
 ChunkPart::is_incore(uint32_t pos, uint32_t length) {
   length = std::min(length, remaining_from(pos));
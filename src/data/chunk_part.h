@@ -13,7 +13,8 @@ class ChunkPart {
 public:
   enum mapped_type {
     MAPPED_MMAP,
-    MAPPED_STATIC
+    MAPPED_STATIC,
+    MAPPED_BUFFER
   };
 
   ChunkPart(mapped_type mapped, const MemoryChunk& c, uint32_t pos) :
@@ -26,6 +27,10 @@ public:
 
   void                clear();
 
+  // Only for mapped parts, buffered parts are written back by
+  // ChunkList through DiskIo.
+  bool                sync(int flags);
+
   mapped_type         mapped() const                        { return m_mapped; }
 
   MemoryChunk&        chunk()                               { return m_chunk; }
@@ -41,6 +46,12 @@ public:
 
   void                set_file(File* f, uint64_t f_offset)  { m_file = f; m_file_offset = f_offset; }
 
+  // Buffered hashing parts read around the page cache, with O_DIRECT
+  // through 'direct_fd' if not -1.
+  bool                is_uncached() const                   { return m_uncached; }
+  int                 direct_fd() const                     { return m_direct_fd; }
+  void                set_uncached(int direct_fd)           { m_uncached = true; m_direct_fd = direct_fd; }
+
   bool                is_incore(uint32_t pos, uint32_t length = ~uint32_t());
   uint32_t            incore_length(uint32_t pos, uint32_t length = ~uint32_t());
 
@@ -55,6 +66,9 @@ private:
   // temporary storage, etc.
   File*               m_file{};
   uint64_t            m_file_offset{0};
+
+  bool                m_uncached{false};
+  int                 m_direct_fd{-1};
 };
 
 } // namespace torrent
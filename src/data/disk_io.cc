@@ -0,0 +1,456 @@
+#include "config.h"
+
+#include "data/disk_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef USE_IO_URING
+#include <linux/fs.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "data/socket_file.h"
+#include "data/thread_disk.h"
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
+#include "utils/io_uring.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print(LOG_STORAGE, "disk_io: " log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+DiskIo::DiskIo() = default;
+
+DiskIo::~DiskIo() {
+  if (m_fileDesc != -1)
+    ::close(m_fileDesc);
+}
+
+void
+DiskIo::init(Poll* poll) {
+#ifdef USE_IO_URING
+  int event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (event_fd == -1) {
+    LT_LOG("could not create eventfd, using synchronous fallback : %s", std::strerror(errno));
+    return;
+  }
+
+  m_ring = IoUring::create(ring_entries);
+
+  if (m_ring != nullptr && !m_ring->register_eventfd(event_fd))
+    m_ring.reset();
+
+  if (m_ring == nullptr) {
+    LT_LOG("io_uring unavailable, using synchronous fallback : %s", std::strerror(errno));
+    ::close(event_fd);
+    return;
+  }
+
+  m_fileDesc = event_fd;
+
+  poll->open(this);
+  poll->insert_read(this);
+
+  LT_LOG("using io_uring : fd:%i", m_ring->fd());
+#endif
+}
+
+void
+DiskIo::cleanup(Poll* poll) {
+  // Drain everything synchronously, the submitting threads are
+  // responsible for having cancelled any callbacks they no longer
+  // want.
+#ifdef USE_IO_URING
+  while (m_in_flight != 0) {
+    if (m_ring->submit_and_wait() == -1 && errno != EINTR)
+      throw internal_error("DiskIo::cleanup() io_uring_enter failed: " + std::string(std::strerror(errno)));
+
+    reap_uring();
+  }
+#endif
+
+  m_ring.reset();
+
+  if (m_fileDesc != -1) {
+    poll->remove_read(this);
+    poll->close(this);
+
+    ::close(m_fileDesc);
+    m_fileDesc = -1;
+  }
+
+  perform();
+}
+
+DiskIo::open_file::~open_file() {
+  if (closed)
+    ::close(fd);
+}
+
+void
+DiskIo::submit(op_type op, int fd, uint64_t offset, buffer_type buffer, uint32_t length,
+               utils::Thread* thread, void* target, slot_done done) {
+  auto request = std::make_unique<request_type>();
+
+  request->op     = op;
+  request->fd     = -1;
+  request->offset = offset;
+  request->buffer = std::move(buffer);
+  request->length = length;
+  request->thread = thread;
+  request->target = target;
+  request->done   = std::move(done);
+
+  if ((op == OP_READ || op == OP_READ_UNCACHED || op == OP_WRITE || op == OP_WRITE_SYNC) && request->buffer == nullptr)
+    throw internal_error("DiskIo::submit(...) received a null buffer.");
+
+  if (fd < 0)
+    return complete(std::move(request), -EBADF);
+
+  {
+    auto lock = std::scoped_lock(m_lock);
+    auto itr = m_files.find(fd);
+
+    if (itr == m_files.end())
+      itr = m_files.emplace(fd, std::make_shared<open_file>(fd)).first;
+
+    request->file = itr->second;
+    request->fd   = fd;
+
+    m_pending.push_back(std::move(request));
+  }
+
+  thread_disk()->interrupt();
+}
+
+void
+DiskIo::close_file(int fd) {
+  file_ptr file;
+
+  {
+    auto lock = std::scoped_lock(m_lock);
+    auto itr = m_files.find(fd);
+
+    if (itr != m_files.end()) {
+      file = std::move(itr->second);
+      m_files.erase(itr);
+    }
+  }
+
+  if (file == nullptr) {
+    ::close(fd);
+    return;
+  }
+
+  // Closed by whichever of this and the last pending request releases
+  // the handle.
+  file->closed = true;
+}
+
+size_t
+DiskIo::pending_size() {
+  auto lock = std::scoped_lock(m_lock);
+
+  return m_pending.size();
+}
+
+void
+DiskIo::perform() {
+  if (m_ring != nullptr) {
+    perform_uncached();
+    return submit_uring();
+  }
+
+  while (true) {
+    request_ptr request;
+
+    {
+      auto lock = std::scoped_lock(m_lock);
+
+      if (m_pending.empty())
+        return;
+
+      request = std::move(m_pending.front());
+      m_pending.pop_front();
+    }
+
+    perform_sync(std::move(request));
+  }
+}
+
+void
+DiskIo::perform_sync(request_ptr request) {
+  if (request->op == OP_READAHEAD) {
+#ifdef USE_POSIX_FADVISE
+    int result = ::posix_fadvise(request->fd, request->offset, request->length, POSIX_FADV_WILLNEED);
+#else
+    int result = 0;
+#endif
+    return complete(std::move(request), -result);
+  }
+
+  if (request->op == OP_SYNC_RANGE) {
+#ifdef USE_SYNC_FILE_RANGE
+    int flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+    int result = ::sync_file_range(request->fd, request->offset, request->length, flags) == -1 ? -errno : 0;
+#else
+    int result = -ENOSYS;
+#endif
+    return complete(std::move(request), result);
+  }
+
+  if (request->op == OP_READ_UNCACHED) {
+    SocketFile file(request->fd);
+
+    auto resident = file.resident_pages(request->offset, request->length);
+    int result = perform_transfer(request.get());
+
+    file.drop_pages(request->offset, request->length, resident);
+    return complete(std::move(request), result);
+  }
+
+  int result = perform_transfer(request.get());
+  complete(std::move(request), result);
+}
+
+// Uncached reads need the page cache residency from before the read,
+// so they are not passed to io_uring.
+void
+DiskIo::perform_uncached() {
+  std::vector<request_ptr> requests;
+
+  {
+    auto lock = std::scoped_lock(m_lock);
+
+    for (auto itr = m_pending.begin(); itr != m_pending.end(); ) {
+      if ((*itr)->op != OP_READ_UNCACHED) {
+        ++itr;
+        continue;
+      }
+
+      requests.push_back(std::move(*itr));
+      itr = m_pending.erase(itr);
+    }
+  }
+
+  for (auto& request : requests)
+    perform_sync(std::move(request));
+}
+
+int
+DiskIo::perform_transfer(request_type* request) {
+  while (request->op == OP_FSYNC || request->done_bytes != request->length) {
+    char*    data   = request->buffer.get() + request->done_bytes;
+    uint32_t length = request->length - request->done_bytes;
+    uint64_t offset = request->offset + request->done_bytes;
+
+    ssize_t result;
+
+    switch (request->op) {
+    case OP_READ:
+    case OP_READ_UNCACHED: result = ::pread(request->fd, data, length, offset); break;
+    case OP_WRITE:
+    case OP_WRITE_SYNC: result = ::pwrite(request->fd, data, length, offset); break;
+#if defined(SYS_DARWIN)
+    case OP_FSYNC: result = ::fsync(request->fd); break;
+#else
+    case OP_FSYNC: result = ::fdatasync(request->fd); break;
+#endif
+    default:
+      throw internal_error("DiskIo::perform_transfer(...) invalid op.");
+    }
+
+    if (result == -1 && errno == EINTR)
+      continue;
+
+    // E.g. O_DIRECT reads that end at an unaligned end-of-file fail
+    // when resumed, so keep what was read.
+    if (result == -1)
+      return is_read(request->op) && request->done_bytes != 0 ? request->done_bytes : -errno;
+
+    if (request->op == OP_FSYNC || result == 0)
+      break;
+
+    request->done_bytes += result;
+  }
+
+  if (request->op == OP_WRITE_SYNC && request->done_bytes == request->length) {
+#if defined(SYS_DARWIN)
+    int result = ::fsync(request->fd);
+#else
+    int result = ::fdatasync(request->fd);
+#endif
+
+    if (result == -1)
+      return -errno;
+  }
+
+  return request->done_bytes;
+}
+
+// In-flight requests are capped at the completion queue size so the
+// kernel never has to hold back completions. Entries the kernel
+// refused with EAGAIN or EBUSY stay in the ring and are retried after
+// reaping, or on the next completion if there was nothing to reap.
+void
+DiskIo::submit_uring() {
+#ifdef USE_IO_URING
+  while (true) {
+    while (m_in_flight < m_ring->cq_entries()) {
+      auto lock = std::scoped_lock(m_lock);
+
+      // Left for the next perform.
+      if (m_pending.empty() || m_pending.front()->op == OP_READ_UNCACHED)
+        break;
+
+      io_uring_sqe* sqe = m_ring->next_sqe();
+
+      if (sqe == nullptr)
+        break;
+
+      request_type* request = m_pending.front().release();
+      m_pending.pop_front();
+
+      switch (request->op) {
+      case OP_READ:  sqe->opcode = IORING_OP_READ; break;
+      case OP_WRITE: sqe->opcode = IORING_OP_WRITE; break;
+      case OP_WRITE_SYNC:
+        sqe->opcode   = IORING_OP_WRITE;
+        sqe->rw_flags = RWF_DSYNC;
+        break;
+      case OP_FSYNC:
+        sqe->opcode      = IORING_OP_FSYNC;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        break;
+      case OP_READAHEAD:
+        sqe->opcode         = IORING_OP_FADVISE;
+        sqe->fadvise_advice = POSIX_FADV_WILLNEED;
+        break;
+      case OP_SYNC_RANGE:
+        sqe->opcode           = IORING_OP_SYNC_FILE_RANGE;
+        sqe->sync_range_flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+        break;
+      default:
+        throw internal_error("DiskIo::submit_uring(...) invalid op.");
+      }
+
+      sqe->fd        = request->fd;
+      sqe->user_data = reinterpret_cast<uintptr_t>(request);
+
+      if (request->op == OP_READAHEAD || request->op == OP_SYNC_RANGE) {
+        sqe->len = request->length;
+        sqe->off = request->offset;
+
+      } else if (request->op != OP_FSYNC) {
+        sqe->addr = reinterpret_cast<uintptr_t>(request->buffer.get() + request->done_bytes);
+        sqe->len  = request->length - request->done_bytes;
+        sqe->off  = request->offset + request->done_bytes;
+      }
+
+      m_in_flight++;
+    }
+
+    if (m_ring->unsubmitted() == 0)
+      return;
+
+    if (m_ring->submit() != -1)
+      return;
+
+    if (errno != EAGAIN && errno != EBUSY)
+      throw internal_error("DiskIo::submit_uring() io_uring_enter failed: " + std::string(std::strerror(errno)));
+
+    if (reap_completions() == 0)
+      return;
+  }
+#endif
+}
+
+void
+DiskIo::reap_uring() {
+#ifdef USE_IO_URING
+  reap_completions();
+  submit_uring();
+#endif
+}
+
+unsigned int
+DiskIo::reap_completions() {
+  unsigned int count = 0;
+
+#ifdef USE_IO_URING
+  io_uring_cqe cqe;
+
+  while (m_ring->peek_cqe(&cqe)) {
+    request_ptr request(reinterpret_cast<request_type*>(cqe.user_data));
+    m_in_flight--;
+    count++;
+
+    if (cqe.res < 0) {
+      int result = is_read(request->op) && request->done_bytes != 0 ? request->done_bytes : cqe.res;
+      complete(std::move(request), result);
+      continue;
+    }
+
+    request->done_bytes += cqe.res;
+
+    // Resubmit short reads and writes, only stopping at end-of-file.
+    if ((request->op == OP_READ || request->op == OP_WRITE || request->op == OP_WRITE_SYNC) &&
+        cqe.res != 0 && request->done_bytes != request->length) {
+      auto lock = std::scoped_lock(m_lock);
+      m_pending.push_front(std::move(request));
+      continue;
+    }
+
+    int result = request->done_bytes;
+    complete(std::move(request), result);
+  }
+#endif
+
+  return count;
+}
+
+void
+DiskIo::complete(request_ptr request, int result) {
+  request->file.reset();
+
+  if (!request->done)
+    return;
+
+  if (request->thread == nullptr)
+    return request->done(result, std::move(request->buffer));
+
+  request->thread->callback(request->target, [done = std::move(request->done), buffer = std::move(request->buffer), result]() {
+      done(result, buffer);
+    });
+}
+
+void
+DiskIo::event_read() {
+  uint64_t value;
+
+  while (::read(m_fileDesc, &value, sizeof(value)) == sizeof(value))
+    ;
+
+  reap_uring();
+}
+
+void
+DiskIo::event_write() {
+  throw internal_error("DiskIo::event_write() called.");
+}
+
+void
+DiskIo::event_error() {
+  throw internal_error("DiskIo::event_error() called.");
+}
+
+} // namespace torrent
@@ -0,0 +1,172 @@
+#ifndef LIBTORRENT_DATA_DISK_IO_H
+#define LIBTORRENT_DATA_DISK_IO_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "torrent/event.h"
+
+namespace torrent {
+
+class IoUring;
+
+// Asynchronous disk reads and writes performed by ThreadDisk. Requests
+// are submitted through io_uring when the kernel supports it, else
+// they are performed with pread/pwrite on the disk thread itself.
+//
+// Completions are passed back to the submitting thread with
+// Thread::callback, so cancel_callback on the target also cancels any
+// pending completions. With a null thread the completion is instead
+// called directly on the disk thread. The buffer is owned by the
+// request until the completion has been called.
+//
+// Users are the buffered chunks, which are filled and written back
+// through here, the upload chunk cache fetches, readahead for upload
+// preloading and the sync_file_range write-back of mapped chunks.
+//
+// Blocks received into mapped chunks are not routed through here;
+// they are copied into the mapping on the main thread, which only
+// dirties the page cache, and the disk writes are then done by the
+// write-back above. Uploads from mapped chunks without the chunk cache
+// likewise read the mapping directly, with readahead issued here to
+// avoid faulting on the main thread.
+class DiskIo : public Event {
+public:
+  using buffer_type = std::shared_ptr<char[]>;
+  using slot_done   = std::function<void(int result, buffer_type buffer)>;
+
+  enum op_type {
+    OP_READ,
+    OP_READ_UNCACHED,
+    OP_WRITE,
+    OP_WRITE_SYNC,
+    OP_FSYNC,
+    OP_READAHEAD,
+    OP_SYNC_RANGE
+  };
+
+  DiskIo();
+  ~DiskIo() override;
+
+  bool                is_uring() const { return m_ring != nullptr; }
+
+  const char*         type_name() const override { return "disk_io"; }
+
+  // Called from the disk thread.
+  void                init(Poll* poll);
+  void                cleanup(Poll* poll);
+
+  void                perform();
+
+  // Thread-safe. Requests use the caller's file descriptor, which must
+  // be closed with 'close_file' so that it stays open until they
+  // complete. The result is the number of bytes transferred, or a
+  // negative errno value. Reads stop short at end-of-file, or on an
+  // error once some data was read.
+  //
+  // If 'done' is empty no completion is sent.
+  void                submit(op_type op, int fd, uint64_t offset, buffer_type buffer, uint32_t length,
+                             utils::Thread* thread, void* target, slot_done done);
+
+  void                read(int fd, uint64_t offset, buffer_type buffer, uint32_t length, utils::Thread* thread, void* target, slot_done done) {
+    submit(OP_READ, fd, offset, std::move(buffer), length, thread, target, std::move(done));
+  }
+  // Like read, but the pages it brings into the page cache are
+  // dropped afterwards, leaving what other readers cached. Performed
+  // synchronously by the disk thread.
+  void                read_uncached(int fd, uint64_t offset, buffer_type buffer, uint32_t length, utils::Thread* thread, void* target, slot_done done) {
+    submit(OP_READ_UNCACHED, fd, offset, std::move(buffer), length, thread, target, std::move(done));
+  }
+  void                write(int fd, uint64_t offset, buffer_type buffer, uint32_t length, utils::Thread* thread, void* target, slot_done done) {
+    submit(OP_WRITE, fd, offset, std::move(buffer), length, thread, target, std::move(done));
+  }
+
+  // Like write, but the data is also synced to disk before completing.
+  void                write_sync(int fd, uint64_t offset, buffer_type buffer, uint32_t length, utils::Thread* thread, void* target, slot_done done) {
+    submit(OP_WRITE_SYNC, fd, offset, std::move(buffer), length, thread, target, std::move(done));
+  }
+  void                fsync(int fd, utils::Thread* thread, void* target, slot_done done) {
+    submit(OP_FSYNC, fd, 0, buffer_type(), 0, thread, target, std::move(done));
+  }
+
+  // Starts writeback of the range if needed and waits for it to
+  // complete, using sync_file_range. Fails with ENOSYS where that is
+  // not supported.
+  void                sync_range(int fd, uint64_t offset, uint32_t length, utils::Thread* thread, void* target, slot_done done) {
+    submit(OP_SYNC_RANGE, fd, offset, buffer_type(), length, thread, target, std::move(done));
+  }
+
+  // Asks the kernel to start reading the range into the page cache.
+  void                readahead(int fd, uint64_t offset, uint32_t length) {
+    submit(OP_READAHEAD, fd, offset, buffer_type(), length, nullptr, nullptr, slot_done());
+  }
+
+  // Thread-safe. Closes 'fd' once the requests pending on it complete,
+  // so the number is not reused while they are in flight.
+  void                close_file(int fd);
+
+  size_t              pending_size();
+  uint32_t            in_flight() const { return m_in_flight; }
+
+  void                event_read() override;
+  void                event_write() override;
+  void                event_error() override;
+
+private:
+  struct open_file {
+    explicit open_file(int f) : fd(f) {}
+    ~open_file();
+
+    int               fd;
+    std::atomic<bool> closed{false};
+  };
+
+  using file_ptr = std::shared_ptr<open_file>;
+
+  struct request_type {
+    op_type        op;
+    file_ptr       file;
+    int            fd;
+    uint64_t       offset;
+    buffer_type    buffer;
+    uint32_t       length;
+    uint32_t       done_bytes{0};
+
+    utils::Thread* thread;
+    void*          target;
+    slot_done      done;
+  };
+
+  using request_ptr = std::unique_ptr<request_type>;
+
+  static constexpr unsigned int ring_entries = 64;
+
+  DiskIo(const DiskIo&) = delete;
+  DiskIo& operator=(const DiskIo&) = delete;
+
+  static bool         is_read(op_type op) { return op == OP_READ || op == OP_READ_UNCACHED; }
+
+  void                perform_sync(request_ptr request);
+  void                perform_uncached();
+  int                 perform_transfer(request_type* request);
+  void                submit_uring();
+  void                reap_uring();
+  unsigned int        reap_completions();
+
+  void                complete(request_ptr request, int result);
+
+  std::mutex                  m_lock;
+  std::deque<request_ptr>     m_pending;
+  std::unordered_map<int, file_ptr> m_files;
+
+  std::unique_ptr<IoUring>    m_ring;
+  uint32_t                    m_in_flight{0};
+};
+
+} // namespace torrent
+
+#endif
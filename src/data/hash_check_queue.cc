@@ -2,14 +2,20 @@
 
 #include "hash_check_queue.h"
 
+#include <pthread.h>
+
 #include "data/hash_chunk.h"
 #include "torrent/hash_string.h"
 #include "utils/instrumentation.h"
+#include "utils/sha1.h"
 
 namespace torrent {
 
 HashCheckQueue::HashCheckQueue()  = default;
-HashCheckQueue::~HashCheckQueue() = default;
+
+HashCheckQueue::~HashCheckQueue() {
+  stop_workers();
+}
 
 // Always poke thread_disk after calling this.
 void
@@ -28,6 +34,8 @@ HashCheckQueue::push_back(HashChunk* hash_chunk) {
   int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
   instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, 1);
   instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, size);
+
+  m_cv.notify_one();
 }
 
 // erase...
@@ -70,9 +78,79 @@ void
 HashCheckQueue::perform() {
   auto lock = std::unique_lock(m_lock);
 
-  while (!empty()) {
-    HashChunk* hash_chunk = base_type::front();
-    base_type::pop_front();
+  while (find_ready() != end())
+    perform_chunks(lock, false);
+}
+
+void
+HashCheckQueue::notify_filled() {
+  auto lock = std::scoped_lock(m_lock);
+
+  m_cv.notify_all();
+}
+
+HashCheckQueue::iterator
+HashCheckQueue::find_ready() {
+  return std::find_if(begin(), end(), [](HashChunk* hash_chunk) { return hash_chunk->chunk()->chunk()->is_filled(); });
+}
+
+unsigned int
+HashCheckQueue::worker_count() {
+  auto lock = std::scoped_lock(m_workers_lock);
+
+  return m_workers.size();
+}
+
+void
+HashCheckQueue::set_worker_count(unsigned int count) {
+  auto workers_lock = std::scoped_lock(m_workers_lock);
+
+  if (count == m_workers.size())
+    return;
+
+  if (!m_workers.empty()) {
+    {
+      auto lock = std::scoped_lock(m_lock);
+      m_workers_stop = true;
+    }
+
+    m_cv.notify_all();
+
+    for (auto& worker : m_workers)
+      worker.join();
+
+    m_workers.clear();
+    m_workers_stop = false;
+  }
+
+  while (m_workers.size() < count)
+    m_workers.emplace_back(&HashCheckQueue::worker_loop, this);
+}
+
+// Called with the queue locked, returns with it locked. The lock is
+// released while hashing so other workers can pull chunks.
+//
+// When enough chunks are ready for Sha1Multi to beat hashing them one
+// at a time, up to a full set of lanes is taken and hashed together.
+void
+HashCheckQueue::perform_chunks(std::unique_lock<std::mutex>& lock, bool on_worker) {
+  auto is_ready = [](HashChunk* hash_chunk) { return hash_chunk->chunk()->chunk()->is_filled(); };
+
+  unsigned int ready = std::count_if(begin(), end(), is_ready);
+  unsigned int limit = ready >= Sha1Multi::min_lanes() ? Sha1Multi::max_lanes : 1;
+
+  HashChunk*   chunks[Sha1Multi::max_lanes];
+  HashString   hashes[Sha1Multi::max_lanes];
+  unsigned int count = 0;
+
+  for (auto itr = begin(); itr != end() && count < limit; ) {
+    if (!is_ready(*itr)) {
+      ++itr;
+      continue;
+    }
+
+    HashChunk* hash_chunk = *itr;
+    itr = base_type::erase(itr);
 
     if (!hash_chunk->chunk()->is_loaded())
       throw internal_error("HashCheckQueue::perform(): !entry.node->is_loaded().");
@@ -81,16 +159,75 @@ HashCheckQueue::perform() {
     instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
     instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
 
-    lock.unlock();
+    chunks[count++] = hash_chunk;
+  }
 
-    if (!hash_chunk->perform(~uint32_t(), true))
+  lock.unlock();
+
+  if (count == 1) {
+    if (!chunks[0]->perform(~uint32_t(), true))
       throw internal_error("HashCheckQueue::perform(): !hash_chunk->perform(~uint32_t(), true).");
 
-    HashString hash;
-    hash_chunk->hash_c(hash.data());
+    chunks[0]->hash_c(hashes[0].data());
+
+  } else {
+    HashChunk::perform_multi(chunks, count, hashes);
+  }
+
+  // Every chunk of the batch is delivered even if the slot throws for
+  // one of them. Workers report each exception, else the first one is
+  // passed on afterwards.
+  std::exception_ptr error;
+
+  for (unsigned int i = 0; i < count; i++) {
+    try {
+      m_slot_chunk_done(chunks[i], hashes[i]);
+
+    } catch (...) {
+      if (on_worker && m_slot_worker_error)
+        m_slot_worker_error(std::current_exception());
+      else if (!error)
+        error = std::current_exception();
+    }
+  }
+
+  lock.lock();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void
+HashCheckQueue::worker_loop() {
+#if defined(HAS_PTHREAD_SETNAME_NP_DARWIN)
+  pthread_setname_np("rtorrent hash");
+#elif defined(HAS_PTHREAD_SETNAME_NP_GENERIC)
+  pthread_setname_np(pthread_self(), "rtorrent hash");
+#endif
+
+  auto lock = std::unique_lock(m_lock);
+
+  while (true) {
+    m_cv.wait(lock, [this] { return m_workers_stop || find_ready() != end(); });
+
+    if (m_workers_stop)
+      return;
+
+    // The worker keeps pulling chunks after reporting an error, so the
+    // pool doesn't shrink as errors accumulate.
+    try {
+      perform_chunks(lock, true);
+
+    } catch (...) {
+      if (!m_slot_worker_error)
+        throw;
+
+      if (lock.owns_lock())
+        lock.unlock();
 
-    m_slot_chunk_done(hash_chunk, hash);
-    lock.lock();
+      m_slot_worker_error(std::current_exception());
+      lock.lock();
+    }
   }
 }
 
@@ -1,9 +1,13 @@
 #ifndef LIBTORRENT_DATA_HASH_CHECK_QUEUE_H
 #define LIBTORRENT_DATA_HASH_CHECK_QUEUE_H
 
+#include <condition_variable>
 #include <deque>
+#include <exception>
 #include <functional>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 // TODO: Create separate directory for thread_disk's hash checking code.
 
@@ -16,6 +20,7 @@ class HashCheckQueue : private std::deque<HashChunk*> {
 public:
   using base_type         = std::deque<HashChunk*>;
   using slot_chunk_handle = std::function<void(HashChunk*, const HashString&)>;
+  using slot_error_handle = std::function<void(std::exception_ptr)>;
 
   using base_type::iterator;
 
@@ -35,13 +40,40 @@ public:
   void                push_back(HashChunk* node);
   void                perform();
 
+  // Chunks still being filled by the disk thread are skipped until
+  // this is called.
+  void                notify_filled();
+
   bool                remove(HashChunk* node);
 
+  // Worker threads pull hash chunks from the queue concurrently with
+  // the thread calling perform(), and deliver them through the same
+  // slot. Changing the count stops and joins any existing workers.
+  unsigned int        worker_count();
+  void                set_worker_count(unsigned int count);
+
+  void                stop_workers() { set_worker_count(0); }
+
   slot_chunk_handle&  slot_chunk_done() { return m_slot_chunk_done; }
 
+  // Exceptions thrown while hashing on a worker thread are passed here
+  // instead, as nothing on that thread can handle them. The worker
+  // continues with the next chunk afterwards.
+  slot_error_handle&  slot_worker_error() { return m_slot_worker_error; }
+
 private:
-  std::mutex          m_lock;
-  slot_chunk_handle   m_slot_chunk_done;
+  iterator            find_ready();
+  void                perform_chunks(std::unique_lock<std::mutex>& lock, bool on_worker);
+  void                worker_loop();
+
+  std::mutex               m_lock;
+  std::condition_variable  m_cv;
+  slot_chunk_handle        m_slot_chunk_done;
+  slot_error_handle        m_slot_worker_error;
+
+  std::mutex               m_workers_lock;
+  std::vector<std::thread> m_workers;
+  bool                     m_workers_stop{false};
 };
 
 } // namespace torrent
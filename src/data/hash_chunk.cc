@@ -3,6 +3,7 @@
 #include "chunk.h"
 #include "chunk_list_node.h"
 #include "hash_chunk.h"
+#include "torrent/hash_string.h"
 
 namespace torrent {
 
@@ -62,6 +63,29 @@ HashChunk::advise_willneed(uint32_t length) {
   }
 }
 
+void
+HashChunk::perform_multi(HashChunk* const* chunks, unsigned int count, HashString* hashes) {
+  Sha1Multi multi;
+  multi.init(count);
+
+  for (unsigned int lane = 0; lane < count; lane++) {
+    HashChunk* hash_chunk = chunks[lane];
+
+    if (hash_chunk->m_position != 0)
+      throw internal_error("HashChunk::perform_multi(...) called on a partially hashed chunk");
+
+    for (auto& part : *hash_chunk->m_chunk.chunk())
+      multi.update(lane, part.chunk().begin(), part.size());
+
+    hash_chunk->m_position = hash_chunk->m_chunk.chunk()->chunk_size();
+  }
+
+  multi.finalize();
+
+  for (unsigned int lane = 0; lane < count; lane++)
+    multi.digest(lane, hashes[lane].data());
+}
+
 uint32_t
 HashChunk::perform_part(Chunk::iterator itr, uint32_t length) {
   length = std::min(length, remaining_part(itr, m_position));
@@ -15,6 +15,7 @@ namespace torrent {
 // stuff related to performance and responsiveness.
 
 class ChunkListNode;
+class HashString;
 
 class HashChunk {
 public:
@@ -34,6 +35,10 @@ public:
 
   void                advise_willneed(uint32_t length);
 
+  // Hashes the whole of each chunk with Sha1Multi, writing the results
+  // to 'hashes' instead of going through hash_c().
+  static void         perform_multi(HashChunk* const* chunks, unsigned int count, HashString* hashes);
+
 private:
   HashChunk(const HashChunk&) = delete;
   HashChunk& operator=(const HashChunk&) = delete;
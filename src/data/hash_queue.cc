@@ -55,6 +55,20 @@ HashQueue::push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_ty
   thread_disk()->interrupt();
 }
 
+void
+HashQueue::push_back_hashed(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d, const HashString& hash_value) {
+  LT_LOG_DATA(id, DEBUG, "Adding hashed index:%" PRIu32 " to queue.", handle.index());
+
+  if (!handle.is_loaded())
+    throw internal_error("HashQueue::push_back_hashed(...) received an invalid chunk");
+
+  auto hash_chunk = new HashChunk(handle);
+
+  base_type::push_back(HashQueueNode(id, hash_chunk, std::move(d)));
+
+  chunk_done(hash_chunk, hash_value);
+}
+
 bool
 HashQueue::has(HashQueueNode::id_type id) {
   return std::any_of(begin(), end(), [id](const auto& n) { return id == n.id(); });
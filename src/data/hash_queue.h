@@ -45,6 +45,11 @@ public:
 
   void                push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d);
 
+  // Queue a chunk whose hash was already calculated, e.g. as the data
+  // was received. It is passed to the owner in order with the other
+  // done chunks, without touching the disk thread.
+  void                push_back_hashed(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d, const HashString& hash_value);
+
   bool                has(HashQueueNode::id_type id);
   bool                has(HashQueueNode::id_type id, uint32_t index);
 
@@ -1,6 +1,9 @@
 #include "config.h"
 
+#include <cstring>
+
 #include "data/chunk_list.h"
+#include "torrent/chunk_manager.h"
 #include "torrent/exceptions.h"
 #include "torrent/data/download_data.h"
 #include "torrent/utils/log.h"
@@ -40,6 +43,7 @@ HashTorrent::clear() {
   m_outstanding = -1;
   m_position = 0;
   m_errno = 0;
+  m_failed_errno = 0;
 
   this_thread::scheduler()->erase(&m_delay_checked);
 }
@@ -99,6 +103,23 @@ HashTorrent::receive_chunk_cleared(uint32_t index) {
   m_ranges.insert(index, index + 1);
 }
 
+// Chunks that could not be read fail the check once the outstanding
+// chunks are done, like chunks that could not be mapped.
+void
+HashTorrent::receive_chunk_failed(uint32_t index, int error) {
+  LT_LOG_THIS(DEBUG, "Received chunk failed: index:%" PRIu32 " errno:%i.", index, error);
+
+  if (m_outstanding <= 0)
+    throw internal_error("HashTorrent::receive_chunk_failed() m_outstanding <= 0.");
+
+  m_outstanding--;
+
+  if (m_failed_errno == 0)
+    m_failed_errno = error;
+
+  queue(false);
+}
+
 void
 HashTorrent::queue(bool quick) {
   LT_LOG_THIS(DEBUG, "Queue: position:%u outstanding:%i try_quick:%u.", m_position, m_outstanding, quick);
@@ -106,8 +127,27 @@ HashTorrent::queue(bool quick) {
   if (!is_checking())
     throw internal_error("HashTorrent::queue() called but it's not running.");
 
+  if (m_failed_errno != 0) {
+    if (m_outstanding != 0)
+      return;
+
+    int error = m_failed_errno;
+    clear();
+
+    m_errno = error;
+
+    LT_LOG_THIS(INFO, "Completed (read error): position:%u errno:%i msg:'%s'.",
+                m_position, m_errno, std::strerror(m_errno));
+
+    this_thread::scheduler()->update_wait_for(&m_delay_checked, 0s);
+    return;
+  }
+
+  uint64_t max_outstanding_memory = m_chunk_list->manager()->hash_check_max_memory();
+
   while (m_position < m_chunk_list->size()) {
-    if (m_outstanding > 10 && m_outstanding * m_chunk_list->chunk_size() > (128 << 20))
+    // Always allow one chunk so huge chunks still get checked.
+    if (m_outstanding > 0 && uint64_t(m_outstanding + 1) * m_chunk_list->chunk_size() > max_outstanding_memory)
       return;
 
     // Not very efficient, but this is seldomly done.
@@ -122,7 +162,13 @@ HashTorrent::queue(bool quick) {
 
     // Need to do increment later if we're going to support resume
     // hashing a quick hashed torrent.
-    ChunkHandle handle = m_chunk_list->get(m_position, ChunkList::get_dont_log | ChunkList::get_hashing);
+    // Quick hashing only checks that the chunk can be created.
+    auto flags = ChunkList::get_dont_log | ChunkList::get_hashing;
+
+    if (quick)
+      flags = flags | ChunkList::get_dont_fill;
+
+    ChunkHandle handle = m_chunk_list->get(m_position, flags);
 
     if (quick) {
       // We're not actually interested in doing any hashing, so just
@@ -42,6 +42,7 @@ public:
 
   void                receive_chunkdone(uint32_t index);
   void                receive_chunk_cleared(uint32_t index);
+  void                receive_chunk_failed(uint32_t index, int error);
 
 private:
   void                queue(bool quick);
@@ -51,6 +52,7 @@ private:
   Ranges              m_ranges;
 
   int                 m_errno{0};
+  int                 m_failed_errno{0};
 
   ChunkList*          m_chunk_list;
 
@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include "socket_file.h"
+#include "data/buffer_pool.h"
 #include "torrent/exceptions.h"
 #include "torrent/utils/log.h"
 
@@ -9,6 +10,7 @@
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
 #define LT_LOG_ERROR(log_fmt, ...)                                      \
   lt_log_print(LOG_STORAGE, "socket_file->%i: " log_fmt, m_fd, __VA_ARGS__);
@@ -153,4 +155,154 @@ SocketFile::create_chunk(uint64_t offset, uint32_t length, int prot, int flags)
   return MemoryChunk(ptr, ptr + align, ptr + align + length, prot, flags);
 }
 
+MemoryChunk
+SocketFile::create_buffer_chunk(uint64_t offset, uint32_t length, int prot) const {
+  if (!is_open())
+    throw internal_error("SocketFile::create_buffer_chunk() called on a closed file");
+
+  if (length == 0 || offset > size() || offset + length > size())
+    return MemoryChunk();
+
+  char* ptr = BufferPool::allocate(length);
+
+  if (ptr == nullptr)
+    return MemoryChunk();
+
+  return MemoryChunk(ptr, ptr, ptr + length, prot, MemoryChunk::map_anon);
+}
+
+bool
+SocketFile::fill_chunk(const MemoryChunk& chunk, uint64_t offset) const {
+  if (!is_open())
+    throw internal_error("SocketFile::fill_chunk() called on a closed file");
+
+  for (uint32_t done = 0; done != chunk.size(); ) {
+    ssize_t result = ::pread(m_fd, chunk.begin() + done, chunk.size() - done, offset + done);
+
+    if (result == -1 && errno == EINTR)
+      continue;
+
+    if (result <= 0) {
+      LT_LOG_ERROR("pread failed : %s", result == 0 ? "unexpected end of file" : strerror(errno));
+      return false;
+    }
+
+    done += result;
+  }
+
+  return true;
+}
+
+int
+SocketFile::open_direct([[maybe_unused]] const std::string& path) {
+#ifdef O_DIRECT
+  return ::open(path.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+#else
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
+MemoryChunk
+SocketFile::create_aligned_buffer_chunk(uint64_t offset, uint32_t length, int prot) const {
+  if (!is_open())
+    throw internal_error("SocketFile::create_aligned_buffer_chunk() called on a closed file");
+
+  if (length == 0 || offset > size() || offset + length > size())
+    return MemoryChunk();
+
+  uint32_t skip = offset % MemoryChunk::page_size();
+  char* ptr = BufferPool::allocate(skip + length);
+
+  if (ptr == nullptr)
+    return MemoryChunk();
+
+  return MemoryChunk(ptr, ptr + skip, ptr + skip + length, prot, MemoryChunk::map_anon);
+}
+
+std::vector<unsigned char>
+SocketFile::resident_pages([[maybe_unused]] uint64_t offset, [[maybe_unused]] uint32_t length) const {
+  std::vector<unsigned char> pages;
+
+#if USE_MINCORE
+  uint64_t first = offset - offset % MemoryChunk::page_size();
+  uint64_t total = offset + length - first;
+
+  void* ptr = ::mmap(nullptr, total, PROT_READ, MAP_SHARED, m_fd, first);
+
+  if (ptr == MAP_FAILED)
+    return pages;
+
+  pages.resize((total + MemoryChunk::page_size() - 1) / MemoryChunk::page_size());
+
+#if USE_MINCORE_UNSIGNED
+  if (::mincore(ptr, total, pages.data()) == -1)
+#else
+  if (::mincore(ptr, total, reinterpret_cast<char*>(pages.data())) == -1)
+#endif
+    pages.clear();
+
+  ::munmap(ptr, total);
+#endif
+
+  return pages;
+}
+
+void
+SocketFile::drop_pages([[maybe_unused]] uint64_t offset, [[maybe_unused]] uint32_t length,
+                       [[maybe_unused]] const std::vector<unsigned char>& resident) const {
+#ifdef USE_POSIX_FADVISE
+  uint64_t first = offset - offset % MemoryChunk::page_size();
+
+  for (size_t page = 0; page < resident.size(); ) {
+    if (resident[page] & 0x1) {
+      page++;
+      continue;
+    }
+
+    size_t last = page;
+
+    while (last < resident.size() && !(resident[last] & 0x1))
+      last++;
+
+    posix_fadvise(m_fd, first + page * MemoryChunk::page_size(), (last - page) * MemoryChunk::page_size(), POSIX_FADV_DONTNEED);
+    page = last;
+  }
+#endif
+}
+
+bool
+SocketFile::write_chunk(const MemoryChunk& chunk, uint64_t offset) const {
+  if (!is_open())
+    throw internal_error("SocketFile::write_chunk() called on a closed file");
+
+  for (uint32_t done = 0; done != chunk.size(); ) {
+    ssize_t result = ::pwrite(m_fd, chunk.begin() + done, chunk.size() - done, offset + done);
+
+    if (result == -1 && errno == EINTR)
+      continue;
+
+    if (result <= 0) {
+      LT_LOG_ERROR("pwrite failed : %s", strerror(errno));
+      return false;
+    }
+
+    done += result;
+  }
+
+  return true;
+}
+
+bool
+SocketFile::sync_data() const {
+  if (!is_open())
+    throw internal_error("SocketFile::sync_data() called on a closed file");
+
+#if defined(SYS_DARWIN)
+  return ::fsync(m_fd) == 0;
+#else
+  return ::fdatasync(m_fd) == 0;
+#endif
+}
+
 } // namespace torrent
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <cinttypes>
+#include <vector>
 #include <fcntl.h>
 #include <sys/types.h>
 
@@ -40,6 +41,31 @@ public:
   static MemoryChunk  create_padding_chunk(uint32_t length, int prot, int flags);
   MemoryChunk         create_chunk(uint64_t offset, uint32_t length, int prot, int flags) const;
 
+  // Used by buffered storage mode, an unfilled pooled buffer to be
+  // read into with fill_chunk or by the disk thread, and written back
+  // explicitly.
+  MemoryChunk         create_buffer_chunk(uint64_t offset, uint32_t length, int prot) const;
+  bool                fill_chunk(const MemoryChunk& chunk, uint64_t offset) const;
+
+  // Like create_buffer_chunk, but the buffer starts at the page
+  // aligned offset below 'offset' so it can be read into with O_DIRECT,
+  // see Chunk::fill_async.
+  MemoryChunk         create_aligned_buffer_chunk(uint64_t offset, uint32_t length, int prot) const;
+
+  // Opens a read-only O_DIRECT descriptor, or returns -1.
+  static int          open_direct(const std::string& path);
+
+  // Page cache residency of the pages covering the range, non-zero if
+  // resident, or an empty vector if it could not be determined.
+  std::vector<unsigned char> resident_pages(uint64_t offset, uint32_t length) const;
+
+  // Drops the pages of the range not marked in 'resident', i.e. those
+  // brought into the page cache since it was taken.
+  void                drop_pages(uint64_t offset, uint32_t length, const std::vector<unsigned char>& resident) const;
+
+  bool                write_chunk(const MemoryChunk& chunk, uint64_t offset) const;
+  bool                sync_data() const;
+
   fd_type             fd() const                                        { return m_fd; }
 
 private:
@@ -4,8 +4,10 @@
 
 #include <cassert>
 
+#include "manager.h"
 #include "thread_main.h"
 #include "data/hash_queue.h"
+#include "torrent/chunk_manager.h"
 #include "torrent/exceptions.h"
 #include "torrent/net/resolver.h"
 #include "utils/instrumentation.h"
@@ -38,10 +40,21 @@ ThreadDisk::init_thread() {
   m_hash_check_queue.slot_chunk_done() = [](auto hc, const auto& hv) {
       ThreadMain::thread_main()->hash_queue()->chunk_done(hc, hv);
     };
+  m_hash_check_queue.slot_worker_error() = [this](std::exception_ptr e) {
+      ThreadMain::thread_main()->callback(this, [e]() { std::rethrow_exception(e); });
+    };
+
+  // The worker count may have been set before this thread existed.
+  if (manager != nullptr)
+    m_hash_check_queue.set_worker_count(manager->chunk_manager()->hash_check_workers());
+
+  m_disk_io.init(m_poll.get());
 }
 
 void
 ThreadDisk::cleanup_thread() {
+  m_hash_check_queue.stop_workers();
+  m_disk_io.cleanup(m_poll.get());
   m_thread_disk = nullptr;
 
   assert(m_hash_check_queue.empty() && "ThreadDisk::cleanup_thread(): m_hash_check_queue not empty.");
@@ -60,6 +73,7 @@ ThreadDisk::call_events() {
     throw shutdown_exception();
   }
 
+  m_disk_io.perform();
   m_hash_check_queue.perform();
   process_callbacks();
 }
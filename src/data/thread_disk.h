@@ -1,6 +1,7 @@
 #ifndef LIBTORRENT_DATA_THREAD_DISK_H
 #define LIBTORRENT_DATA_THREAD_DISK_H
 
+#include "data/disk_io.h"
 #include "data/hash_check_queue.h"
 #include "torrent/common.h"
 #include "torrent/utils/thread.h"
@@ -17,6 +18,7 @@ public:
   const char*     name() const override { return "rtorrent disk"; }
 
   HashCheckQueue* hash_check_queue() { return &m_hash_check_queue; }
+  DiskIo*         disk_io()          { return &m_disk_io; }
 
   void            init_thread() override;
   void            cleanup_thread() override;
@@ -30,6 +32,7 @@ private:
   static ThreadDisk* m_thread_disk;
 
   HashCheckQueue  m_hash_check_queue;
+  DiskIo          m_disk_io;
 };
 
 inline ThreadDisk* thread_disk() {
@@ -0,0 +1,163 @@
+#include "config.h"
+
+#include "data/write_back.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <memory>
+#include <unistd.h>
+
+#include "data/thread_disk.h"
+#include "torrent/exceptions.h"
+#include "torrent/utils/chrono.h"
+#include "torrent/utils/thread.h"
+
+namespace torrent {
+
+bool
+WriteBack::is_supported() {
+#ifdef USE_SYNC_FILE_RANGE
+  return true;
+#else
+  return false;
+#endif
+}
+
+void
+WriteBack::insert(int fd, uint64_t offset, uint64_t length) {
+  if (fd < 0)
+    throw internal_error("WriteBack::insert(...) received an invalid file descriptor.");
+
+  if (length == 0)
+    return;
+
+  m_ranges.push_back(range_type{fd, offset, length});
+}
+
+bool
+WriteBack::flush() {
+  m_failed.clear();
+  m_error = 0;
+  m_flushed.clear();
+  m_bytes = 0;
+  m_mergedRanges = 0;
+
+  if (m_ranges.empty()) {
+    m_latency = std::chrono::microseconds(0);
+    return true;
+  }
+
+  m_started = utils::time_since_epoch();
+
+  std::sort(m_ranges.begin(), m_ranges.end(), [](const range_type& a, const range_type& b) {
+      return a.fd != b.fd ? a.fd < b.fd : a.offset < b.offset;
+    });
+
+  // Start writeback of all merged ranges, so the device queue is
+  // filled in offset order.
+  range_type current = m_ranges.front();
+
+  for (auto itr = m_ranges.begin() + 1; itr != m_ranges.end(); ++itr) {
+    if (itr->fd == current.fd && itr->offset <= current.offset + current.length) {
+      current.length = std::max(current.length, itr->offset + itr->length - current.offset);
+      continue;
+    }
+
+    flush_range(current);
+    current = *itr;
+  }
+
+  flush_range(current);
+
+  m_ranges.clear();
+  m_latency = utils::time_since_epoch() - m_started;
+
+  return m_failed.empty();
+}
+
+void
+WriteBack::wait_async(utils::Thread* thread, void* target, slot_measured slot) {
+  struct wait_state {
+    uint64_t                  bytes{0};
+    uint32_t                  ranges{0};
+    uint32_t                  remaining{1};
+    std::chrono::microseconds started;
+  };
+
+  if (thread == nullptr && thread_disk() != nullptr)
+    throw internal_error("WriteBack::wait_async(...) called without a thread.");
+
+  auto state = std::make_shared<wait_state>();
+  state->started = m_started;
+
+  auto range_done = [state, slot](int result, uint64_t length) {
+      if (result >= 0) {
+        state->bytes += length;
+        state->ranges++;
+      }
+
+      if (--state->remaining == 0 && state->ranges != 0)
+        slot(state->bytes, state->ranges, utils::time_since_epoch() - state->started);
+    };
+
+  for (auto& range : m_flushed) {
+    if (is_failed(range.fd))
+      continue;
+
+    // DiskIo requests are limited to 32 bit lengths.
+    for (uint64_t offset = 0; offset < range.length; offset += (1 << 30)) {
+      uint32_t length = std::min<uint64_t>(range.length - offset, 1 << 30);
+
+      if (thread_disk() == nullptr) {
+#ifdef USE_SYNC_FILE_RANGE
+        int flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+
+        state->remaining++;
+        range_done(sync_file_range(range.fd, range.offset + offset, length, flags) == -1 ? -errno : 0, length);
+#endif
+        continue;
+      }
+
+      state->remaining++;
+
+      thread_disk()->disk_io()->sync_range(range.fd, range.offset + offset, length, thread, target,
+                                           [range_done, length](int result, auto) { range_done(result, length); });
+    }
+  }
+
+  range_done(-1, 0);
+}
+
+void
+WriteBack::clear() {
+  m_ranges.clear();
+  m_flushed.clear();
+  m_failed.clear();
+  m_error = 0;
+}
+
+bool
+WriteBack::is_failed(int fd) const {
+  return std::find(m_failed.begin(), m_failed.end(), fd) != m_failed.end();
+}
+
+void
+WriteBack::flush_range([[maybe_unused]] const range_type& range) {
+  m_bytes += range.length;
+  m_mergedRanges++;
+  m_flushed.push_back(range);
+
+#ifdef USE_SYNC_FILE_RANGE
+  if (sync_file_range(range.fd, range.offset, range.length, SYNC_FILE_RANGE_WRITE) == -1) {
+    if (m_error == 0)
+      m_error = errno;
+
+    m_failed.push_back(range.fd);
+  }
+#else
+  throw internal_error("WriteBack::flush_range(...) called but sync_file_range is not supported.");
+#endif
+}
+
+} // namespace torrent
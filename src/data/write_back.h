@@ -0,0 +1,77 @@
+#ifndef LIBTORRENT_DATA_WRITE_BACK_H
+#define LIBTORRENT_DATA_WRITE_BACK_H
+
+#include <chrono>
+#include <cinttypes>
+#include <functional>
+#include <vector>
+
+namespace torrent {
+
+namespace utils {
+class Thread;
+}
+
+// Collects the file ranges of dirty mapped chunks and flushes them
+// as merged, per-file sorted ranges with sync_file_range, so the
+// kernel sees sequential writeback instead of one msync per chunk.
+// Making the files durable is left to the caller, see ChunkList.
+//
+// sync_file_range with SYNC_FILE_RANGE_WRITE only queues the
+// writeback, so the device throughput is measured by waiting for the
+// flushed ranges on the disk thread.
+class WriteBack {
+public:
+  using slot_measured = std::function<void(uint64_t bytes, uint32_t ranges, std::chrono::microseconds latency)>;
+
+  static bool         is_supported();
+
+  bool                empty() const            { return m_ranges.empty(); }
+
+  void                insert(int fd, uint64_t offset, uint64_t length);
+
+  // Returns false if any range failed, see is_failed.
+  bool                flush();
+  void                clear();
+
+  bool                is_failed(int fd) const;
+
+  // The errno of the first range that failed in the last flush.
+  int                 error() const            { return m_error; }
+
+  // Statistics of the last flush, the latency only covering the time
+  // to queue the writeback.
+  uint64_t                  bytes() const       { return m_bytes; }
+  uint32_t                  ranges() const      { return m_mergedRanges; }
+  std::chrono::microseconds latency() const     { return m_latency; }
+
+  // Waits on the disk thread for the writeback of the ranges in the
+  // last flush to complete, then calls 'slot' on 'thread' with the
+  // bytes written and the time since the flush started. Without a
+  // disk thread the wait is done before returning.
+  void                wait_async(utils::Thread* thread, void* target, slot_measured slot);
+
+private:
+  struct range_type {
+    int      fd;
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  void                flush_range(const range_type& range);
+
+  std::vector<range_type> m_ranges;
+  std::vector<range_type> m_flushed;
+  std::vector<int>        m_failed;
+  int                     m_error{0};
+
+  std::chrono::microseconds m_started{0};
+
+  uint64_t                  m_bytes{0};
+  uint32_t                  m_mergedRanges{0};
+  std::chrono::microseconds m_latency{0};
+};
+
+} // namespace torrent
+
+#endif
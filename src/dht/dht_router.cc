@@ -358,6 +358,11 @@ DhtRouter::get_statistics() const {
   stats.errors_received  = m_server.errors_received();
   stats.errors_caught    = m_server.errors_caught();
 
+  stats.read_calls       = m_server.stats_read_calls();
+  stats.read_datagrams   = m_server.stats_read_datagrams();
+  stats.write_calls      = m_server.stats_write_calls();
+  stats.write_datagrams  = m_server.stats_write_datagrams();
+
   stats.num_nodes        = m_nodes.size();
   stats.num_buckets      = m_routingTable.size();
 
@@ -161,6 +161,8 @@ DhtServer::reset_statistics() {
   m_errorsReceived = 0;
   m_errorsCaught = 0;
 
+  reset_datagram_stats();
+
   m_uploadNode.rate()->set_total(0);
   m_downloadNode.rate()->set_total(0);
 }
@@ -674,182 +676,210 @@ DhtServer::clear_transactions() {
 
 void
 DhtServer::event_read() {
+  constexpr unsigned int batch_size = 16;
+
+  std::array<std::array<char, 2048>, batch_size> buffers;
+  std::array<sockaddr_in6, batch_size> addresses;
+  std::array<datagram_type, batch_size> datagrams;
+
   uint32_t total = 0;
 
   while (true) {
-    Object request;
-    int type = '?';
-    DhtMessage message;
-    const HashString* nodeId = NULL;
+    for (unsigned int i = 0; i < batch_size; i++) {
+      addresses[i] = sockaddr_in6{};
+      datagrams[i] = datagram_type{buffers[i].data(), static_cast<unsigned int>(buffers[i].size()),
+                                   reinterpret_cast<sockaddr*>(&addresses[i]), sizeof(sockaddr_in6)};
+    }
 
-    sockaddr_in6 sa_raw{};
-    sockaddr* sa = reinterpret_cast<sockaddr*>(&sa_raw);
+    int count = read_datagrams_sa(datagrams.data(), batch_size);
 
-    try {
-      char buffer[2048];
-      int32_t read = read_datagram_sa(buffer, sizeof(buffer), sa, sizeof(sa_raw));
+    if (count <= 0)
+      break;
 
-      if (read < 0)
-        break;
+    for (int i = 0; i < count; i++)
+      total += process_datagram(buffers[i].data(), datagrams[i].length, &addresses[i]);
 
-      // We can currently only process mapped-IPv4 addresses, not real IPv6.
-      // Translate them to an af_inet socket_address.
-      if (sa_is_v4mapped(sa)) {
-        auto sa_unmapped = sin_from_v4mapped_in6(&sa_raw);
-        *reinterpret_cast<sockaddr_in*>(&sa_raw) = *sa_unmapped.get();
-      }
+    // A partial batch means the socket has been drained.
+    if (static_cast<unsigned int>(count) < batch_size)
+      break;
+  }
 
-      if (sa->sa_family != AF_INET)
-        continue;
+  m_downloadThrottle->node_used_unthrottled(total);
+  m_downloadNode.rate()->insert(total);
 
-      total += read;
+  start_write();
+}
 
-      // If it's not a valid bencode dictionary at all, it's probably not a DHT
-      // packet at all, so we don't throw an error to prevent bounce loops.
-      try {
-        static_map_read_bencode(buffer, buffer + read, message);
-      } catch (const bencode_error&) {
-        continue;
-      }
+// Returns the number of bytes to account for the datagram.
+uint32_t
+DhtServer::process_datagram(char* buffer, uint32_t length, sockaddr_in6* sa_raw) {
+  int type = '?';
+  DhtMessage message;
+  const HashString* nodeId = NULL;
 
-      if (!message[key_t].is_raw_string())
-        throw dht_error(dht_error_protocol, "No transaction ID");
+  sockaddr* sa = reinterpret_cast<sockaddr*>(sa_raw);
 
-      // Restrict the length of Transaction IDs. We echo them in our replies.
-      if(message[key_t].as_raw_string().size() > 20) {
-		  throw dht_error(dht_error_protocol, "Transaction ID length too long");
-      }
+  try {
+    // We can currently only process mapped-IPv4 addresses, not real IPv6.
+    // Translate them to an af_inet socket_address.
+    if (sa_is_v4mapped(sa)) {
+      auto sa_unmapped = sin_from_v4mapped_in6(sa_raw);
+      *reinterpret_cast<sockaddr_in*>(sa_raw) = *sa_unmapped.get();
+    }
 
-      if (!message[key_y].is_raw_string())
-        throw dht_error(dht_error_protocol, "No message type");
+    if (sa->sa_family != AF_INET)
+      return 0;
 
-      if (message[key_y].as_raw_string().size() != 1)
-        throw dht_error(dht_error_bad_method, "Unsupported message type");
+    // If it's not a valid bencode dictionary at all, it's probably not a DHT
+    // packet at all, so we don't throw an error to prevent bounce loops.
+    try {
+      static_map_read_bencode(buffer, buffer + length, message);
+    } catch (const bencode_error&) {
+      return length;
+    }
 
-      type = message[key_y].as_raw_string().data()[0];
+    if (!message[key_t].is_raw_string())
+      throw dht_error(dht_error_protocol, "No transaction ID");
 
-      // Queries and replies have node ID in different dictionaries.
-      if (type == 'r' || type == 'q') {
-        if (!message[type == 'q' ? key_a_id : key_r_id].is_raw_string())
-          throw dht_error(dht_error_protocol, "Invalid `id' value");
+    // Restrict the length of Transaction IDs. We echo them in our replies.
+    if(message[key_t].as_raw_string().size() > 20) {
+		  throw dht_error(dht_error_protocol, "Transaction ID length too long");
+    }
 
-        raw_string nodeIdStr = message[type == 'q' ? key_a_id : key_r_id].as_raw_string();
+    if (!message[key_y].is_raw_string())
+      throw dht_error(dht_error_protocol, "No message type");
 
-        if (nodeIdStr.size() < HashString::size_data)
-          throw dht_error(dht_error_protocol, "`id' value too short");
+    if (message[key_y].as_raw_string().size() != 1)
+      throw dht_error(dht_error_bad_method, "Unsupported message type");
 
-        nodeId = HashString::cast_from(nodeIdStr.data());
-      }
+    type = message[key_y].as_raw_string().data()[0];
 
-      // Sanity check the returned transaction ID.
-      if ((type == 'r' || type == 'e') &&
-          (!message[key_t].is_raw_string() || message[key_t].as_raw_string().size() != 1))
-        throw dht_error(dht_error_protocol, "Invalid transaction ID type/length.");
+    // Queries and replies have node ID in different dictionaries.
+    if (type == 'r' || type == 'q') {
+      if (!message[type == 'q' ? key_a_id : key_r_id].is_raw_string())
+        throw dht_error(dht_error_protocol, "Invalid `id' value");
 
-      // Stupid broken implementations.
-      if (nodeId != NULL && *nodeId == m_router->id())
-        throw dht_error(dht_error_protocol, "Send your own ID, not mine");
+      raw_string nodeIdStr = message[type == 'q' ? key_a_id : key_r_id].as_raw_string();
 
-      switch (type) {
-        case 'q':
-          process_query(*nodeId, sa, message);
-          break;
+      if (nodeIdStr.size() < HashString::size_data)
+        throw dht_error(dht_error_protocol, "`id' value too short");
 
-        case 'r':
-          process_response(*nodeId, sa, message);
-          break;
+      nodeId = HashString::cast_from(nodeIdStr.data());
+    }
 
-        case 'e':
-          process_error(sa, message);
-          break;
+    // Sanity check the returned transaction ID.
+    if ((type == 'r' || type == 'e') &&
+        (!message[key_t].is_raw_string() || message[key_t].as_raw_string().size() != 1))
+      throw dht_error(dht_error_protocol, "Invalid transaction ID type/length.");
 
-        default:
-          throw dht_error(dht_error_bad_method, "Unknown message type.");
-      }
+    // Stupid broken implementations.
+    if (nodeId != NULL && *nodeId == m_router->id())
+      throw dht_error(dht_error_protocol, "Send your own ID, not mine");
 
-    // If node was querying us, reply with error packet, otherwise mark the node as "query failed",
-    // so that if it repeatedly sends malformed replies we will drop it instead of propagating it
-    // to other nodes.
-    } catch (const bencode_error& e) {
-      if ((type == 'r' || type == 'e') && nodeId != NULL) {
-        m_router->node_inactive(*nodeId, sa);
-      } else {
-        snprintf(message.data_end, message.data + torrent::DhtMessage::data_size - message.data_end - 1, "Malformed packet: %s", e.what());
-        message.data[torrent::DhtMessage::data_size - 1] = '\0';
-        create_error(message, sa, dht_error_protocol, message.data_end);
-      }
+    switch (type) {
+      case 'q':
+        process_query(*nodeId, sa, message);
+        break;
 
-    } catch (const dht_error& e) {
-      if ((type == 'r' || type == 'e') && nodeId != NULL)
-        m_router->node_inactive(*nodeId, sa);
-      else
-        create_error(message, sa, e.code(), e.what());
+      case 'r':
+        process_response(*nodeId, sa, message);
+        break;
+
+      case 'e':
+        process_error(sa, message);
+        break;
 
-    } catch (const network_error&) {
+      default:
+        throw dht_error(dht_error_bad_method, "Unknown message type.");
     }
-  }
 
-  m_downloadThrottle->node_used_unthrottled(total);
-  m_downloadNode.rate()->insert(total);
+  // If node was querying us, reply with error packet, otherwise mark the node as "query failed",
+  // so that if it repeatedly sends malformed replies we will drop it instead of propagating it
+  // to other nodes.
+  } catch (const bencode_error& e) {
+    if ((type == 'r' || type == 'e') && nodeId != NULL) {
+      m_router->node_inactive(*nodeId, sa);
+    } else {
+      snprintf(message.data_end, message.data + torrent::DhtMessage::data_size - message.data_end - 1, "Malformed packet: %s", e.what());
+      message.data[torrent::DhtMessage::data_size - 1] = '\0';
+      create_error(message, sa, dht_error_protocol, message.data_end);
+    }
 
-  start_write();
+  } catch (const dht_error& e) {
+    if ((type == 'r' || type == 'e') && nodeId != NULL)
+      m_router->node_inactive(*nodeId, sa);
+    else
+      create_error(message, sa, e.code(), e.what());
+
+  } catch (const network_error&) {
+  }
+
+  return length;
 }
 
 bool
 DhtServer::process_queue(packet_queue& queue, uint32_t* quota) {
   uint32_t used = 0;
 
-  while (!queue.empty()) {
-    auto packet = queue.front();
-    DhtTransaction::key_type transactionKey = 0;
+  std::array<std::shared_ptr<DhtTransactionPacket>, max_batch_size> packets;
+  std::array<datagram_type, max_batch_size> datagrams;
 
-    if(packet->has_transaction())
-      transactionKey = packet->transaction()->key(packet->id());
+  while (!queue.empty()) {
+    unsigned int count = 0;
+    uint32_t batch_length = 0;
+    bool quota_reached = false;
+
+    while (!queue.empty() && count < max_batch_size) {
+      auto& packet = queue.front();
+
+      // Make sure its transaction hasn't timed out yet, if it has/had one
+      // and don't bother sending non-transaction packets (replies) after
+      // more than 15 seconds in the queue.
+      if (packet->has_failed() || packet->age() > 15) {
+        queue.pop_front();
+        continue;
+      }
 
-    // Make sure its transaction hasn't timed out yet, if it has/had one
-    // and don't bother sending non-transaction packets (replies) after
-    // more than 15 seconds in the queue.
-    if (packet->has_failed() || packet->age() > 15) {
-      queue.pop_front();
-      continue;
-    }
+      if (batch_length + packet->length() > *quota) {
+        quota_reached = true;
+        break;
+      }
 
-    if (packet->length() > *quota) {
-      m_uploadThrottle->node_used(&m_uploadNode, used);
-      return false;
-    }
+      batch_length += packet->length();
 
-    queue.pop_front();
+      datagrams[count] = datagram_type{const_cast<char*>(packet->c_str()), static_cast<unsigned int>(packet->length()), packet->address(), 0};
+      packets[count++] = std::move(packet);
 
-    try {
-      int written = write_datagram_sa(packet->c_str(), packet->length(), packet->address());
+      queue.pop_front();
+    }
 
-      if (written == -1)
-        throw network_error();
+    unsigned int position = 0;
 
-      used += written;
-      *quota -= written;
+    while (position < count) {
+      int sent = write_datagrams_sa(datagrams.data() + position, count - position);
 
-      if (static_cast<unsigned int>(written) != packet->length())
-        throw network_error();
+      if (sent <= 0) {
+        sent_packet(packets[position], true);
+        position++;
+        continue;
+      }
 
-    } catch (const network_error&) {
-      // Couldn't write packet, maybe something wrong with node address or routing, so mark node as bad.
-      if (packet->has_transaction()) {
-        auto itr = m_transactions.find(transactionKey);
-        if (itr == m_transactions.end())
-          throw internal_error("DhtServer::process_queue could not find transaction.");
+      for (unsigned int i = position; i < position + sent; i++) {
+        used += datagrams[i].length;
+        *quota -= datagrams[i].length;
 
-        failed_transaction(itr, false);
+        sent_packet(packets[i], datagrams[i].length != packets[i]->length());
       }
+
+      position += sent;
     }
 
-    if (packet->has_transaction()) {
-      // here transaction can be already deleted by failed_transaction.
-      auto itr = m_transactions.find(transactionKey);
+    for (unsigned int i = 0; i < count; i++)
+      packets[i].reset();
 
-      if (itr != m_transactions.end())
-        packet->transaction()->set_packet(NULL);
+    if (quota_reached) {
+      m_uploadThrottle->node_used(&m_uploadNode, used);
+      return false;
     }
   }
 
@@ -857,6 +887,29 @@ DhtServer::process_queue(packet_queue& queue, uint32_t* quota) {
   return true;
 }
 
+void
+DhtServer::sent_packet(const std::shared_ptr<DhtTransactionPacket>& packet, bool failed) {
+  if (!packet->has_transaction())
+    return;
+
+  DhtTransaction::key_type transactionKey = packet->transaction()->key(packet->id());
+
+  if (failed) {
+    // Couldn't write packet, maybe something wrong with node address or routing, so mark node as bad.
+    auto itr = m_transactions.find(transactionKey);
+    if (itr == m_transactions.end())
+      throw internal_error("DhtServer::process_queue could not find transaction.");
+
+    failed_transaction(itr, false);
+  }
+
+  // here transaction can be already deleted by failed_transaction.
+  auto itr = m_transactions.find(transactionKey);
+
+  if (itr != m_transactions.end())
+    packet->transaction()->set_packet(NULL);
+}
+
 void
 DhtServer::event_write() {
   if (m_highQueue.empty() && m_lowQueue.empty())
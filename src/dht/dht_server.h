@@ -134,7 +134,10 @@ private:
 
   void                clear_transactions();
 
+  uint32_t            process_datagram(char* buffer, uint32_t length, sockaddr_in6* sa_raw);
+
   bool                process_queue(packet_queue& queue, uint32_t* quota);
+  void                sent_packet(const std::shared_ptr<DhtTransactionPacket>& packet, bool failed);
   void                receive_timeout();
 
   DhtRouter*          m_router{};
@@ -0,0 +1,99 @@
+#include "config.h"
+
+#include "chunk_rarity_index.h"
+
+#include <algorithm>
+
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+void
+ChunkRarityIndex::initialize(const uint8_t* rarity, uint32_t size) {
+  m_keys.resize(size);
+
+  for (uint32_t index = 0; index < size; index++)
+    m_keys[index] = class_unwanted * class_keys + rarity[index];
+
+  rebuild();
+}
+
+void
+ChunkRarityIndex::clear() {
+  m_chunks = std::vector<uint32_t>();
+  m_positions = std::vector<uint32_t>();
+  m_keys = std::vector<uint16_t>();
+  m_first = std::vector<uint32_t>();
+}
+
+void
+ChunkRarityIndex::assign_classes(const std::vector<class_type>& classes) {
+  if (classes.size() != size())
+    throw internal_error("ChunkRarityIndex::assign_classes(...) size mismatch.");
+
+  for (uint32_t index = 0; index < size(); index++)
+    m_keys[index] = classes[index] * class_keys + m_keys[index] % class_keys;
+
+  rebuild();
+}
+
+// Counting sort of the chunks by key.
+void
+ChunkRarityIndex::rebuild() {
+  m_chunks.resize(m_keys.size());
+  m_positions.resize(m_keys.size());
+  m_first.assign(key_count + 1, 0);
+
+  for (auto key : m_keys)
+    m_first[key + 1]++;
+
+  for (uint32_t key = 0; key < key_count; key++)
+    m_first[key + 1] += m_first[key];
+
+  std::vector<uint32_t> next(m_first.begin(), m_first.end() - 1);
+
+  for (uint32_t index = 0; index < m_keys.size(); index++) {
+    uint32_t position = next[m_keys[index]]++;
+
+    m_chunks[position] = index;
+    m_positions[index] = position;
+  }
+}
+
+// Walks the chunk one bucket at a time towards 'key', swapping it to
+// the edge of each bucket it leaves and moving that boundary past it.
+void
+ChunkRarityIndex::move(uint32_t index, uint32_t key) {
+  if (index >= size() || key >= key_count)
+    throw internal_error("ChunkRarityIndex::move(...) out of range.");
+
+  uint32_t current = m_keys[index];
+
+  while (current < key) {
+    uint32_t last = m_first[current + 1] - 1;
+
+    swap_positions(m_positions[index], last);
+    m_first[current + 1]--;
+    current++;
+  }
+
+  while (current > key) {
+    uint32_t first = m_first[current];
+
+    swap_positions(m_positions[index], first);
+    m_first[current]++;
+    current--;
+  }
+
+  m_keys[index] = key;
+}
+
+inline void
+ChunkRarityIndex::swap_positions(uint32_t a, uint32_t b) {
+  std::swap(m_chunks[a], m_chunks[b]);
+
+  m_positions[m_chunks[a]] = a;
+  m_positions[m_chunks[b]] = b;
+}
+
+} // namespace torrent
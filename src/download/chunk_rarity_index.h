@@ -0,0 +1,77 @@
+#ifndef LIBTORRENT_DOWNLOAD_CHUNK_RARITY_INDEX_H
+#define LIBTORRENT_DOWNLOAD_CHUNK_RARITY_INDEX_H
+
+#include <cinttypes>
+#include <vector>
+
+namespace torrent {
+
+// Chunk indices ordered by priority class and then rarity, for
+// ChunkSelector to pick the rarest wanted chunk without scanning the
+// bitfield.
+//
+// The indices are kept in a single array split into one bucket per
+// key, the key being 'class * 256 + rarity'. A change of rarity by one
+// swaps the chunk with the first or last entry of its bucket and moves
+// the bucket boundary, so ChunkStatistics can keep the index updated
+// in constant time per chunk.
+class ChunkRarityIndex {
+public:
+  using class_type = uint8_t;
+
+  static constexpr class_type class_high     = 0;
+  static constexpr class_type class_normal   = 1;
+  static constexpr class_type class_unwanted = 2;
+
+  static constexpr uint32_t   class_keys     = 256;
+  static constexpr uint32_t   key_count      = 3 * class_keys;
+
+  bool                empty() const                       { return m_chunks.empty(); }
+  uint32_t            size() const                        { return m_chunks.size(); }
+
+  // Number of chunks in the high and normal classes, which are the
+  // first entries of the array.
+  uint32_t            wanted_size() const                 { return empty() ? 0 : m_first[class_unwanted * class_keys]; }
+
+  // Takes the rarity of each chunk, leaving all unwanted.
+  void                initialize(const uint8_t* rarity, uint32_t size);
+  void                clear();
+
+  // Reassigns the class of every chunk at once.
+  void                assign_classes(const std::vector<class_type>& classes);
+
+  uint32_t            key(uint32_t index) const           { return m_keys[index]; }
+  class_type          chunk_class(uint32_t index) const   { return m_keys[index] / class_keys; }
+
+  void                set_class(uint32_t index, class_type c);
+  void                set_rarity(uint32_t index, uint8_t rarity);
+
+  // The chunks with 'key' are the positions in the range
+  // [bucket_first(key), bucket_first(key + 1)).
+  uint32_t            bucket_first(uint32_t key) const    { return m_first[key]; }
+  uint32_t            at(uint32_t position) const         { return m_chunks[position]; }
+
+private:
+  void                rebuild();
+  void                move(uint32_t index, uint32_t key);
+  void                swap_positions(uint32_t a, uint32_t b);
+
+  std::vector<uint32_t> m_chunks;
+  std::vector<uint32_t> m_positions;
+  std::vector<uint16_t> m_keys;
+  std::vector<uint32_t> m_first;
+};
+
+inline void
+ChunkRarityIndex::set_class(uint32_t index, class_type c) {
+  move(index, c * class_keys + m_keys[index] % class_keys);
+}
+
+inline void
+ChunkRarityIndex::set_rarity(uint32_t index, uint8_t rarity) {
+  move(index, m_keys[index] - m_keys[index] % class_keys + rarity);
+}
+
+} // namespace torrent
+
+#endif
@@ -50,7 +50,6 @@ namespace torrent {
 // Consider making statistics a part of selector.
 void
 ChunkSelector::initialize(ChunkStatistics* cs) {
-  m_position = invalid_chunk;
   m_statistics = cs;
 
   Bitfield* completed = m_data->mutable_completed_bitfield();
@@ -61,97 +60,60 @@ ChunkSelector::initialize(ChunkStatistics* cs) {
   std::transform(completed->begin(), completed->end(), untouched->begin(), [](const Bitfield::value_type& v) { return ~v; });
   untouched->update();
 
-  m_sharedQueue.enable(32);
-  m_sharedQueue.clear();
+  m_index.initialize(cs->data(), cs->size());
+  m_statistics->set_rarity_index(&m_index);
 }
 
 void
 ChunkSelector::cleanup() {
   m_data->mutable_untouched_bitfield()->clear();
+
+  if (m_statistics != NULL)
+    m_statistics->set_rarity_index(NULL);
+
+  m_index.clear();
   m_statistics = NULL;
 }
 
-// Consider if ChunksSelector::not_using_index(...) needs to be
-// modified.
 void
 ChunkSelector::update_priorities() {
   if (empty())
     return;
 
-  m_sharedQueue.clear();
+  std::vector<ChunkRarityIndex::class_type> classes(size(), ChunkRarityIndex::class_unwanted);
+
+  for (const auto& range : *m_data->normal_priority())
+    std::fill(classes.begin() + range.first, classes.begin() + range.second, ChunkRarityIndex::class_normal);
 
-  if (m_position == invalid_chunk)
-    m_position = random() % size();
+  for (const auto& range : *m_data->high_priority())
+    std::fill(classes.begin() + range.first, classes.begin() + range.second, ChunkRarityIndex::class_high);
 
-  advance_position();
+  for (uint32_t index = 0; index < size(); index++)
+    if (!m_data->untouched_bitfield()->get(index))
+      classes[index] = ChunkRarityIndex::class_unwanted;
+
+  m_index.assign_classes(classes);
 }
 
+// Checking the rarest chunks against the peer's bitfield finds one
+// right away unless the peer has few of the chunks we want, in which
+// case scanning its bitfield is cheaper. Seeders have all chunks so
+// the index is always used.
 uint32_t
 ChunkSelector::find(PeerChunks* pc, [[maybe_unused]] bool highPriority) {
-  // This needs to be re-enabled.
-  if (m_position == invalid_chunk)
+  if (m_index.wanted_size() == 0)
     return invalid_chunk;
 
-  // When we're a seeder, 'm_sharedQueue' is used. Since the peer's
-  // bitfield is guaranteed to be filled we can use the same code as
-  // for non-seeders. This generalization does incur a slight
-  // performance hit as it compares against a bitfield we know has all
-  // set.
-  rak::partial_queue* queue = pc->is_seeder() ? &m_sharedQueue : pc->download_cache();
-
-  // Randomize position on average every 16 chunks to prevent
-  // inefficient distribution with a slow seed and fast peers
-  // all arriving at the same position.
-  if ((random() & 63) == 0) {
-    m_position = random() % size();
-    queue->clear();
-  }
-
-  if (queue->is_enabled()) {
+  uint32_t limit = pc->is_seeder() ? m_index.wanted_size() : std::max(search_index_minimum, size() / 64);
+  uint32_t index = search_index(pc->bitfield(), limit);
 
-    // First check the cached queue.
-    while (queue->prepare_pop()) {
-      uint32_t pos = queue->pop();
-
-      if (!m_data->untouched_bitfield()->get(pos))
-        continue;
-
-      return pos;
-    }
-
-  } else {
-    // Only non-seeders can reach this branch as m_sharedQueue is
-    // always enabled.
-    queue->enable(8);
-  }
+  if (index == invalid_chunk && limit < m_index.wanted_size())
+    index = search_bitfield(pc->bitfield());
 
-  queue->clear();
-
-  (search_linear(pc->bitfield(), queue, m_data->high_priority(), m_position, size()) &&
-   search_linear(pc->bitfield(), queue, m_data->high_priority(), 0, m_position));
-
-  if (queue->prepare_pop()) {
-    // Set that the peer has high priority pieces cached.
-
-  } else {
-    // Set that the peer has normal priority pieces cached.
-
-    // Urgh...
-    queue->clear();
-
-    (search_linear(pc->bitfield(), queue, m_data->normal_priority(), m_position, size()) &&
-     search_linear(pc->bitfield(), queue, m_data->normal_priority(), 0, m_position));
-
-    if (!queue->prepare_pop())
-      return invalid_chunk;
-  }
-
-  uint32_t pos = queue->pop();
-  
-  if (!m_data->untouched_bitfield()->get(pos))
+  if (index != invalid_chunk && !m_data->untouched_bitfield()->get(index))
     throw internal_error("ChunkSelector::find(...) bad index.");
-  
-  return pos;
+
+  return index;
 }
 
 bool
@@ -168,11 +130,7 @@ ChunkSelector::using_index(uint32_t index) {
     throw internal_error("ChunkSelector::select_index(...) index already set.");
 
   m_data->mutable_untouched_bitfield()->unset(index);
-
-  // We always know 'm_position' points to a wanted chunk. If it
-  // changes, we need to move m_position to the next one.
-  if (index == m_position)
-    advance_position();
+  m_index.set_class(index, ChunkRarityIndex::class_unwanted);
 }
 
 void
@@ -184,105 +142,104 @@ ChunkSelector::not_using_index(uint32_t index) {
     throw internal_error("ChunkSelector::deselect_index(...) index already unset.");
 
   m_data->mutable_untouched_bitfield()->set(index);
-
-  // This will make sure that if we enable new chunks, it will start
-  // downloading them event when 'index == invalid_chunk'.
-  if (m_position == invalid_chunk)
-    m_position = index;
+  m_index.set_class(index, chunk_class(index));
 }
 
-// This could propably be split into two functions, one for checking
-// if it shoul insert into the request_list(), and the other
-// whetever we are interested in the new piece.
-//
-// Since this gets called whenever a new piece arrives, we can skip
-// the rarity-first/linear etc searches through bitfields and just
-// start downloading.
 bool
-ChunkSelector::received_have_chunk(PeerChunks* pc, uint32_t index) {
+ChunkSelector::received_have_chunk([[maybe_unused]] PeerChunks* pc, uint32_t index) {
+  return m_index.chunk_class(index) != ChunkRarityIndex::class_unwanted;
+}
+
+ChunkRarityIndex::class_type
+ChunkSelector::chunk_class(uint32_t index) const {
   if (!m_data->untouched_bitfield()->get(index))
-    return false;
+    return ChunkRarityIndex::class_unwanted;
 
-  // Also check if the peer only has high-priority chunks.
-  if (!m_data->high_priority()->has(index) && !m_data->normal_priority()->has(index))
-    return false;
+  if (m_data->high_priority()->has(index))
+    return ChunkRarityIndex::class_high;
 
-  if (pc->download_cache()->is_enabled())
-    pc->download_cache()->insert(m_statistics->rarity(index), index);
+  if (m_data->normal_priority()->has(index))
+    return ChunkRarityIndex::class_normal;
 
-  return true;
+  return ChunkRarityIndex::class_unwanted;
 }
 
-bool
-ChunkSelector::search_linear(const Bitfield* bf, rak::partial_queue* pq, const download_data::priority_ranges* ranges, uint32_t first, uint32_t last) {
-  auto itr = ranges->find(first);
+// Walks the wanted chunks in key order, starting each bucket at a
+// random position so peers do not all converge on the same chunk.
+uint32_t
+ChunkSelector::search_index(const Bitfield* bf, uint32_t limit) {
+  uint32_t last_key = ChunkRarityIndex::class_unwanted * ChunkRarityIndex::class_keys;
 
-  while (itr != ranges->end() && itr->first < last) {
+  for (uint32_t key = 0; key < last_key; key++) {
+    uint32_t first = m_index.bucket_first(key);
+    uint32_t count = m_index.bucket_first(key + 1) - first;
 
-    if (!search_linear_range(bf, pq, std::max(first, itr->first), std::min(last, itr->second)))
-      return false;
+    if (count == 0)
+      continue;
 
-    ++itr;    
+    uint32_t start = random() % count;
+
+    for (uint32_t i = 0; i < count; i++, limit--) {
+      if (limit == 0)
+        return invalid_chunk;
+
+      uint32_t index = m_index.at(first + (start + i) % count);
+
+      if (bf->get(index))
+        return index;
+    }
   }
 
-  return true;
+  return invalid_chunk;
 }
 
-// Could propably add another argument for max seen or something, this
-// would be used to find better chunks to request.
-inline bool
-ChunkSelector::search_linear_range(const Bitfield* bf, rak::partial_queue* pq, uint32_t first, uint32_t last) {
-  if (first >= last || last > size())
-    throw internal_error("ChunkSelector::search_linear_range(...) received an invalid range.");
+// Exact fallback, picking the chunk with the lowest key among those
+// the peer has. High priority ranges are searched first as any chunk
+// found there beats all normal priority chunks.
+uint32_t
+ChunkSelector::search_bitfield(const Bitfield* bf) {
+  uint32_t start = random() % size();
+  uint32_t index = search_bitfield_ranges(bf, m_data->high_priority(), start);
 
-  Bitfield::const_iterator local  = m_data->untouched_bitfield()->begin() + first / 8;
-  Bitfield::const_iterator source = bf->begin() + first / 8;
+  if (index == invalid_chunk)
+    index = search_bitfield_ranges(bf, m_data->normal_priority(), start);
 
-  // Unset any bits before 'first'.
-  Bitfield::value_type wanted = (*source & *local) & Bitfield::mask_from(first % 8);
+  return index;
+}
 
-  while (m_data->untouched_bitfield()->position(local + 1) < last) {
-    if (wanted && !search_linear_byte(pq, m_data->untouched_bitfield()->position(local), wanted))
-      return false;
+// Scans from 'start' to the end and then wraps around, so ties are
+// not always broken in favor of the lowest index.
+uint32_t
+ChunkSelector::search_bitfield_ranges(const Bitfield* bf, const download_data::priority_ranges* ranges, uint32_t start) {
+  const Bitfield* untouched = m_data->untouched_bitfield();
 
-    wanted = (*++source & *++local);
-  }
-  
-  // Unset any bits from 'last'.
-  wanted &= Bitfield::mask_before(last - m_data->untouched_bitfield()->position(local));
-
-  if (wanted)
-    return search_linear_byte(pq, m_data->untouched_bitfield()->position(local), wanted);
-  else
-    return true;
-}
+  uint32_t best_index = invalid_chunk;
+  uint32_t best_key = ChunkRarityIndex::class_unwanted * ChunkRarityIndex::class_keys;
 
-// Take pointer to partial_queue
-inline bool
-ChunkSelector::search_linear_byte(rak::partial_queue* pq, uint32_t index, Bitfield::value_type wanted) {
-  for (int i = 0; i < 8; ++i) {
-    if (!(wanted & Bitfield::mask_at(i)))
-      continue;
+  for (int pass = 0; pass < 2; pass++) {
+    for (const auto& range : *ranges) {
+      uint32_t first = pass == 0 ? std::max(range.first, start) : range.first;
+      uint32_t last = pass == 0 ? range.second : std::min(range.second, start);
 
-    if (!pq->insert(m_statistics->rarity(index + i), index + i) && pq->is_full())
-      return false;
-  }
+      if (first >= last)
+        continue;
 
-  return true;
-}
+      for (auto index = bf->find_first_and(*untouched, first, last); index != last; index = bf->find_first_and(*untouched, index + 1, last)) {
+        uint32_t key = m_index.key(index);
 
-void
-ChunkSelector::advance_position() {
+        if (key >= best_key)
+          continue;
 
-  // Need to replace with a special-purpose function for finding the
-  // next position.
+        if (key % ChunkRarityIndex::class_keys == 0)
+          return index;
 
-//   int position = m_position;
+        best_index = index;
+        best_key = key;
+      }
+    }
+  }
 
-//   ((m_position = search_linear(&m_bitfield, &m_highPriority, position, size())) == invalid_chunk &&
-//    (m_position = search_linear(&m_bitfield, &m_highPriority, 0, position)) == invalid_chunk &&
-//    (m_position = search_linear(&m_bitfield, &m_normalPriority, position, size())) == invalid_chunk &&
-//    (m_position = search_linear(&m_bitfield, &m_normalPriority, 0, position)) == invalid_chunk);
+  return best_index;
 }
 
 } // namespace torrent
@@ -38,8 +38,8 @@
 #define LIBTORRENT_DOWNLOAD_CHUNK_SELECTOR_H
 
 #include <cinttypes>
-#include <rak/partial_queue.h>
 
+#include "download/chunk_rarity_index.h"
 #include "torrent/bitfield.h"
 #include "torrent/data/download_data.h"
 #include "torrent/utils/ranges.h"
@@ -53,6 +53,9 @@ namespace torrent {
 //
 // When updating Content::bitfield, make sure you update this bitfield
 // and unmark any chunks in Delegator.
+//
+// Wanted chunks are picked rarest first, high priority before normal,
+// using a ChunkRarityIndex that ChunkStatistics keeps updated.
 
 class ChunkStatistics;
 class PeerChunks;
@@ -101,23 +104,21 @@ public:
   bool                received_have_chunk(PeerChunks* pc, uint32_t index);
 
 private:
-  bool                search_linear(const Bitfield* bf, rak::partial_queue* pq, const download_data::priority_ranges* ranges, uint32_t first, uint32_t last);
-  inline bool         search_linear_range(const Bitfield* bf, rak::partial_queue* pq, uint32_t first, uint32_t last);
-  inline bool         search_linear_byte(rak::partial_queue* pq, uint32_t index, Bitfield::value_type wanted);
+  // Number of chunks checked against the peer's bitfield in rarity
+  // order before scanning the bitfield instead.
+  static constexpr uint32_t search_index_minimum = 64;
 
-//   inline uint32_t     search_rarest(const Bitfield* bf, priority_ranges* ranges, uint32_t first, uint32_t last);
-//   inline uint32_t     search_rarest_range(const Bitfield* bf, uint32_t first, uint32_t last);
-//   inline uint32_t     search_rarest_byte(uint8_t wanted);
+  ChunkRarityIndex::class_type chunk_class(uint32_t index) const;
 
-  void                advance_position();
+  uint32_t            search_index(const Bitfield* bf, uint32_t limit);
+  uint32_t            search_bitfield(const Bitfield* bf);
+  uint32_t            search_bitfield_ranges(const Bitfield* bf, const download_data::priority_ranges* ranges, uint32_t start);
 
   download_data*      m_data;
 
-  ChunkStatistics*    m_statistics;
-  
-  rak::partial_queue  m_sharedQueue;
+  ChunkStatistics*    m_statistics{};
 
-  uint32_t            m_position;
+  ChunkRarityIndex    m_index;
 };
 
 } // namespace torrent
@@ -39,11 +39,11 @@
 #include "torrent/exceptions.h"
 
 #include "protocol/peer_chunks.h"
+#include "utils/bitfield_kernels.h"
 
+#include "chunk_rarity_index.h"
 #include "chunk_statistics.h"
 
-#include <algorithm>
-
 namespace torrent {
 
 inline bool
@@ -51,6 +51,24 @@ ChunkStatistics::should_add(PeerChunks* pc) const {
   return m_accounted < max_accounted;
 }
 
+inline void
+ChunkStatistics::increment_rarity(size_type index) {
+  auto& rarity = base_type::operator[](index);
+  rarity++;
+
+  if (m_rarity_index != NULL)
+    m_rarity_index->set_rarity(index, rarity);
+}
+
+inline void
+ChunkStatistics::decrement_rarity(size_type index) {
+  auto& rarity = base_type::operator[](index);
+  rarity--;
+
+  if (m_rarity_index != NULL)
+    m_rarity_index->set_rarity(index, rarity);
+}
+
 void
 ChunkStatistics::initialize(size_type s) {
   if (!empty())
@@ -82,11 +100,7 @@ ChunkStatistics::received_connect(PeerChunks* pc) {
     pc->set_using_counter(true);
     m_accounted++;
 
-    auto itr = base_type::begin();
-
-    // Use a bitfield iterator instead.
-    for (Bitfield::size_type index = 0; index < pc->bitfield()->size_bits(); ++index, ++itr)
-      *itr += pc->bitfield()->get(index);
+    bitfield_for_each(pc->bitfield()->begin(), 0, pc->bitfield()->size_bits(), [this](uint32_t index) { increment_rarity(index); });
   }
 }
 
@@ -110,11 +124,7 @@ ChunkStatistics::received_disconnect(PeerChunks* pc) {
 
     m_accounted--;
 
-    auto itr = base_type::begin();
-
-    // Use a bitfield iterator instead.
-    for (Bitfield::size_type index = 0; index < pc->bitfield()->size_bits(); ++index, ++itr)
-      *itr -= pc->bitfield()->get(index);
+    bitfield_for_each(pc->bitfield()->begin(), 0, pc->bitfield()->size_bits(), [this](uint32_t index) { decrement_rarity(index); });
   }
 }
 
@@ -132,12 +142,12 @@ ChunkStatistics::received_have_chunk(PeerChunks* pc, uint32_t index, uint32_t le
     m_accounted++;
   }
 
-  pc->bitfield()->set(index);
+  pc->set_chunk(index);
   pc->peer_rate()->insert(length);
   
   if (pc->using_counter()) {
 
-    base_type::operator[](index)++;
+    increment_rarity(index);
 
     // The below code should not cause useless work to be done in case
     // of immediate disconnect.
@@ -148,7 +158,8 @@ ChunkStatistics::received_have_chunk(PeerChunks* pc, uint32_t index, uint32_t le
       m_complete++;
       m_accounted--;
 
-      std::transform(base_type::begin(), base_type::end(), base_type::begin(), [] (auto c) { return c - 1; });
+      for (size_type i = 0; i < size(); ++i)
+        decrement_rarity(i);
     }
 
   } else {
@@ -42,6 +42,7 @@
 
 namespace torrent {
 
+class ChunkRarityIndex;
 class PeerChunks;
 
 class ChunkStatistics : public std::vector<uint8_t> {
@@ -94,6 +95,9 @@ public:
   // The caller must ensure that the chunk index is valid and has not
   // been set already.
   void                received_have_chunk(PeerChunks* pc, uint32_t index, uint32_t length);
+
+  // Kept updated with every change of rarity.
+  void                set_rarity_index(ChunkRarityIndex* index)  { m_rarity_index = index; }
   
   const_iterator      begin() const                   { return base_type::begin(); }
   const_iterator      end() const                     { return base_type::end(); }
@@ -104,8 +108,13 @@ public:
 
 private:
   inline bool         should_add(PeerChunks* pc) const;
+  inline void         increment_rarity(size_type index);
+  inline void         decrement_rarity(size_type index);
+
   size_type           m_complete{};
   size_type           m_accounted{};
+
+  ChunkRarityIndex*   m_rarity_index{};
 };
 
 } // namespace torrent
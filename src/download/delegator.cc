@@ -22,25 +22,18 @@ Delegator::delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPiece
   // in progress.
 
   // TODO: What if the hash failed? Don't want data from that peer again.
-  if (affinity >= 0) {
-    for (BlockList* itr : m_transfers) {
-      if (new_transfers.size() >= maxPieces)
-        return new_transfers;
+  auto affinity_itr = m_transfers.find(affinity);
 
-      if (affinity == itr->index())
-        delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
-    }
-  }
+  if (affinity_itr != m_transfers.end() && (*affinity_itr)->has_free())
+    delegate_from_blocklist(new_transfers, maxPieces, *affinity_itr, peerInfo);
+
+  if (new_transfers.size() >= maxPieces)
+    return new_transfers;
 
   // Prioritize full seeders
   if (peerChunks->is_seeder()) {
-    for (BlockList* itr : m_transfers) {
-      if (new_transfers.size() >= maxPieces)
-        return new_transfers;
-
-      if (itr->by_seeder())
-        delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
-    }
+    delegate_from_free_list(new_transfers, maxPieces, peerChunks, PRIORITY_HIGH, true);
+    delegate_from_free_list(new_transfers, maxPieces, peerChunks, PRIORITY_NORMAL, true);
 
     // Create new high priority pieces.
     delegate_new_chunks(new_transfers, maxPieces, peerChunks, true);
@@ -52,25 +45,13 @@ Delegator::delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPiece
     return new_transfers;
 
   // Find existing high priority pieces.
-  for (BlockList* itr : m_transfers) {
-    if (new_transfers.size() >= maxPieces)
-      return new_transfers;
-
-    if (itr->priority() == PRIORITY_HIGH && peerChunks->bitfield()->get(itr->index()))
-      delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
-  }
+  delegate_from_free_list(new_transfers, maxPieces, peerChunks, PRIORITY_HIGH, false);
 
   // Create new high priority pieces.
   delegate_new_chunks(new_transfers, maxPieces, peerChunks, true);
 
   // Find existing normal priority pieces.
-  for (BlockList* itr : m_transfers) {
-    if (new_transfers.size() >= maxPieces)
-      return new_transfers;
-
-    if (itr->priority() == PRIORITY_NORMAL && peerChunks->bitfield()->get(itr->index()))
-      delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
-  }
+  delegate_from_free_list(new_transfers, maxPieces, peerChunks, PRIORITY_NORMAL, false);
 
   // Create new normal priority pieces.
   delegate_new_chunks(new_transfers, maxPieces, peerChunks, false);
@@ -125,29 +106,58 @@ Delegator::delegate_new_chunks(std::vector<BlockTransfer*> &transfers, uint32_t
     else
       (*itr)->set_priority(PRIORITY_NORMAL);
 
+    m_transfers.insert_free(*itr);
+
     delegate_from_blocklist(transfers, maxPieces, *itr, pc->peer_info());
   }
 }
 
+// Blocks before BlockList::first_free() are known to be taken, so the
+// scans start there and move it past the blocks handed out.
 void
 Delegator::delegate_from_blocklist(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, BlockList* c, PeerInfo* peerInfo) {
-  for (auto i = c->begin(); i != c->end() && transfers.size() < maxPieces; ++i) {
+  auto first = c->begin() + c->first_free();
+
+  for (auto i = first; i != c->end() && transfers.size() < maxPieces; ++i) {
     // If not finished and stalled, and no one is downloading this, then assign
     if (!i->is_finished() && i->is_stalled() && i->size_all() == 0)
       transfers.push_back(i->insert(peerInfo));
   }
 
-  if (transfers.size() >= maxPieces)
-    return;
-
-  // Fill any remaining slots with potentially stalled pieces.
-  for (auto i = c->begin(); i != c->end() && transfers.size() < maxPieces; ++i) {
-    if (!i->is_finished() && i->is_stalled()) {
-      BlockTransfer* inserted_info = i->insert(peerInfo);
-      if (inserted_info != NULL)
-        transfers.push_back(inserted_info);
+  if (transfers.size() < maxPieces) {
+    // Fill any remaining slots with potentially stalled pieces.
+    for (auto i = first; i != c->end() && transfers.size() < maxPieces; ++i) {
+      if (!i->is_finished() && i->is_stalled()) {
+        BlockTransfer* inserted_info = i->insert(peerInfo);
+        if (inserted_info != NULL)
+          transfers.push_back(inserted_info);
+      }
     }
   }
+
+  while (first != c->end() && (first->is_finished() || !first->is_stalled()))
+    ++first;
+
+  c->set_first_free(first - c->begin());
+}
+
+// Visits only the BlockLists that may have free blocks, dropping those
+// found to be full from the free list.
+void
+Delegator::delegate_from_free_list(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, PeerChunks* pc, priority_enum p, bool bySeeder) {
+  const auto& free_list = m_transfers.free_list(p);
+
+  for (uint32_t position = 0; position < free_list.size() && transfers.size() < maxPieces; ) {
+    BlockList* blockList = free_list[position];
+
+    if (blockList->has_free() && (!bySeeder || blockList->by_seeder()) && pc->bitfield()->get(blockList->index()))
+      delegate_from_blocklist(transfers, maxPieces, blockList, pc->peer_info());
+
+    if (blockList->has_free())
+      position++;
+    else
+      m_transfers.erase_free(p, position);
+  }
 }
 
 } // namespace torrent
@@ -2,6 +2,7 @@
 
 #include "download/download_main.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
@@ -73,6 +74,9 @@ DownloadMain::DownloadMain()
   m_chunkList->slot_free_diskspace() = [this]() {
       return file_list()->free_diskspace();
     };
+  m_chunkList->slot_chunk_filled() = [this](uint32_t index) {
+      receive_chunk_filled(index);
+    };
 }
 
 DownloadMain::~DownloadMain() {
@@ -128,6 +132,10 @@ DownloadMain::open(int flags) {
   m_chunkList->resize(file_list()->size_chunks());
   m_chunkStatistics->initialize(file_list()->size_chunks());
 
+  m_seed_bitfield.set_size_bits(file_list()->size_chunks());
+  m_seed_bitfield.allocate();
+  m_seed_bitfield.set_all();
+
   info()->set_flags(DownloadInfo::flag_open);
 }
 
@@ -146,6 +154,7 @@ DownloadMain::close() {
 //   m_trackerManager->close();
 
   m_delegator.transfer_list()->clear();
+  m_piece_hash_table.clear();
 
   file_list()->close();
 
@@ -153,6 +162,7 @@ DownloadMain::close() {
   // be released.
   m_chunkStatistics->clear();
   m_chunkList->clear();
+  m_seed_bitfield.clear();
   m_chunkSelector->cleanup();
 }
 
@@ -269,6 +279,20 @@ DownloadMain::receive_chunk_done(unsigned int index) {
   m_slot_hash_check_add(handle);
 }
 
+// Connections may be erased while resuming, so each is looked up
+// again before it is called.
+void
+DownloadMain::receive_chunk_filled(uint32_t index) {
+  std::vector<Peer*> peers(connection_list()->begin(), connection_list()->end());
+
+  for (auto peer : peers) {
+    if (std::find(connection_list()->begin(), connection_list()->end(), peer) == connection_list()->end())
+      continue;
+
+    peer->m_ptr()->receive_chunk_filled(index);
+  }
+}
+
 void
 DownloadMain::receive_corrupt_chunk(PeerInfo* peerInfo) {
   peerInfo->set_failed_counter(peerInfo->failed_counter() + 1);
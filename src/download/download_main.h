@@ -6,6 +6,7 @@
 
 #include "data/chunk_handle.h"
 #include "download/delegator.h"
+#include "download/piece_hash_table.h"
 #include "net/address_list.h"
 #include "net/data_buffer.h"
 #include "torrent/data/file_list.h"
@@ -62,6 +63,7 @@ public:
   ChunkStatistics*    chunk_statistics()                         { return m_chunkStatistics; }
 
   Delegator*          delegator()                                { return &m_delegator; }
+  PieceHashTable*     piece_hash_table()                         { return &m_piece_hash_table; }
 
   have_queue_type*    have_queue()                               { return &m_haveQueue; }
 
@@ -71,6 +73,10 @@ public:
 
   ConnectionList*     connection_list()                          { return m_connectionList; }
   FileList*           file_list()                                { return &m_fileList; }
+
+  // All-set bitfield shared by the PeerChunks of seeders while the
+  // download is open.
+  const Bitfield*     seed_bitfield() const                      { return &m_seed_bitfield; }
   PeerList*           peer_list()                                { return &m_peerList; }
 
   std::pair<ThrottleList*, ThrottleList*> throttles(const sockaddr* sa);
@@ -109,6 +115,7 @@ public:
 
   void                receive_connect_peers();
   void                receive_chunk_done(unsigned int index);
+  void                receive_chunk_filled(uint32_t index);
   void                receive_corrupt_chunk(PeerInfo* peerInfo);
 
   void                receive_tracker_success();
@@ -145,6 +152,7 @@ private:
   ChunkStatistics*    m_chunkStatistics;
 
   Delegator           m_delegator;
+  PieceHashTable      m_piece_hash_table;
   have_queue_type     m_haveQueue;
   std::unique_ptr<InitialSeeding> m_initial_seeding;
 
@@ -152,6 +160,8 @@ private:
   FileList            m_fileList;
   PeerList            m_peerList;
 
+  Bitfield            m_seed_bitfield;
+
   DataBuffer          m_ut_pex_delta;
   DataBuffer          m_ut_pex_initial;
   pex_list            m_ut_pex_list;
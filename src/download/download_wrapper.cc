@@ -8,9 +8,11 @@
 #include "download/chunk_selector.h"
 #include "protocol/handshake_manager.h"
 #include "protocol/peer_connection_base.h"
+#include "torrent/data/block_list.h"
 #include "torrent/data/file.h"
 #include "torrent/data/file_list.h"
 #include "torrent/data/file_manager.h"
+#include "torrent/data/transfer_list.h"
 #include "torrent/download_info.h"
 #include "torrent/peer/connection_list.h"
 #include "torrent/peer/peer.h"
@@ -159,6 +161,9 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
     if (hash == NULL) {
       m_hash_checker->receive_chunk_cleared(handle.index());
 
+    } else if (handle.chunk()->fill_error() != 0) {
+      m_hash_checker->receive_chunk_failed(handle.index(), handle.chunk()->fill_error());
+
     } else {
       if (std::memcmp(hash, chunk_hash(handle.index()), 20) == 0)
         m_main->file_list()->mark_completed(handle.index());
@@ -181,11 +186,17 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
     if (data()->untouched_bitfield()->get(handle.index()))
       throw internal_error("DownloadWrapper::receive_hash_done(...) received a chunk that isn't set in ChunkSelector.");
 
-    if (std::memcmp(hash, chunk_hash(handle.index()), 20) == 0) {
+    // A chunk that could not be read back is treated as having failed
+    // the check, so its pieces are downloaded again.
+    if (handle.chunk()->fill_error() != 0)
+      LT_LOG_STORAGE_ERRORS("could not read chunk for hash check: index:%" PRIu32 " errno:%i", handle.index(), handle.chunk()->fill_error());
+
+    if (handle.chunk()->fill_error() == 0 && std::memcmp(hash, chunk_hash(handle.index()), 20) == 0) {
       bool was_partial = data()->wanted_chunks() != 0;
 
       m_main->file_list()->mark_completed(handle.index());
       m_main->delegator()->transfer_list()->hash_succeeded(handle.index(), handle.chunk());
+      m_main->piece_hash_table()->erase(handle.index());
       m_main->update_endgame();
 
       if (m_main->file_list()->is_done()) {
@@ -202,6 +213,11 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
         m_main->have_queue()->emplace_front(this_thread::cached_time(), handle.index());
 
     } else {
+      // The chunk data is about to be replaced by stored or
+      // redownloaded blocks, so it must be read back for the next
+      // hash check.
+      m_main->piece_hash_table()->invalidate(handle.index());
+
       // This needs to ensure the chunk is still valid.
       m_main->delegator()->transfer_list()->hash_failed(handle.index(), handle.chunk());
     }
@@ -224,6 +240,17 @@ DownloadWrapper::check_chunk_hash(ChunkHandle handle, bool hashing) {
   ChunkHandle new_handle = m_main->chunk_list()->get(handle.index(), flags);
   m_main->chunk_list()->release(&handle, ChunkList::release_default);
 
+  if (!hashing && new_handle.is_loaded()) {
+    auto transfer_list = m_main->delegator()->transfer_list();
+    auto itr = transfer_list->find(new_handle.index());
+    HashString hash_value;
+
+    if (itr != transfer_list->end() && m_main->piece_hash_table()->final((*itr)->index(), (*itr)->piece().length(), hash_value.data())) {
+      hash_queue()->push_back_hashed(new_handle, data(), [this](auto c, auto h) { receive_hash_done(c, h); }, hash_value);
+      return;
+    }
+  }
+
   hash_queue()->push_back(new_handle, data(), [this](auto c, auto h) { receive_hash_done(c, h); });
 }
 
@@ -0,0 +1,83 @@
+#include "config.h"
+
+#include "piece_hash_table.h"
+
+#include "torrent/exceptions.h"
+#include "utils/sha1.h"
+
+namespace torrent {
+
+PieceHashTable::PieceHashTable() = default;
+PieceHashTable::~PieceHashTable() = default;
+
+bool
+PieceHashTable::is_complete(uint32_t index, uint32_t length) const {
+  auto itr = m_entries.find(index);
+
+  return itr != m_entries.end() && itr->second.hash != nullptr && itr->second.position == length;
+}
+
+uint32_t
+PieceHashTable::position(uint32_t index) const {
+  auto itr = m_entries.find(index);
+
+  return itr != m_entries.end() ? itr->second.position : 0;
+}
+
+void
+PieceHashTable::update(uint32_t index, uint32_t piece_length, uint32_t offset, const void* buffer, uint32_t length) {
+  if (offset + length > piece_length)
+    throw internal_error("PieceHashTable::update(...) received range out of bounds.");
+
+  auto& entry = m_entries[index];
+
+  if (offset < entry.position) {
+    invalidate(index);
+    return;
+  }
+
+  // Gaps are left for the full re-read, only data arriving at the
+  // hashed position can be used.
+  if (offset != entry.position)
+    return;
+
+  if (entry.hash == nullptr) {
+    entry.hash = std::make_unique<Sha1>();
+    entry.hash->init();
+  }
+
+  entry.hash->update(buffer, length);
+  entry.position += length;
+}
+
+bool
+PieceHashTable::final(uint32_t index, uint32_t length, char* buffer) {
+  if (!is_complete(index, length))
+    return false;
+
+  m_entries[index].hash->final_c(buffer);
+  invalidate(index);
+  return true;
+}
+
+// The position is left at the sentinel so no further updates are
+// accepted.
+void
+PieceHashTable::invalidate(uint32_t index) {
+  auto& entry = m_entries[index];
+
+  entry.hash.reset();
+  entry.position = ~uint32_t();
+}
+
+void
+PieceHashTable::erase(uint32_t index) {
+  m_entries.erase(index);
+}
+
+void
+PieceHashTable::clear() {
+  m_entries.clear();
+}
+
+} // namespace torrent
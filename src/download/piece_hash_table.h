@@ -0,0 +1,53 @@
+#ifndef LIBTORRENT_DOWNLOAD_PIECE_HASH_TABLE_H
+#define LIBTORRENT_DOWNLOAD_PIECE_HASH_TABLE_H
+
+#include <cinttypes>
+#include <memory>
+#include <unordered_map>
+
+namespace torrent {
+
+class Sha1;
+
+// Incremental hashes of pieces in the TransferList as their data is
+// received in order, so verifying the chunk does not need to read it
+// back. Any write before the hashed position, e.g. from a replaced
+// leader, invalidates the piece's hash until it is erased.
+//
+// Kept by DownloadMain next to the TransferList, as internal state
+// stays out of the exported BlockList.
+class PieceHashTable {
+public:
+  PieceHashTable();
+  ~PieceHashTable();
+
+  bool                empty() const                       { return m_entries.empty(); }
+  size_t              size() const                        { return m_entries.size(); }
+
+  bool                is_complete(uint32_t index, uint32_t length) const;
+  uint32_t            position(uint32_t index) const;
+
+  void                update(uint32_t index, uint32_t piece_length, uint32_t offset, const void* buffer, uint32_t length);
+  // Writes the hash to 'buffer' and invalidates the entry if all
+  // 'length' bytes of the piece were hashed, else returns false.
+  bool                final(uint32_t index, uint32_t length, char* buffer);
+  void                invalidate(uint32_t index);
+
+  void                erase(uint32_t index);
+  void                clear();
+
+private:
+  PieceHashTable(const PieceHashTable&) = delete;
+  PieceHashTable& operator=(const PieceHashTable&) = delete;
+
+  struct entry_type {
+    std::unique_ptr<Sha1> hash;
+    uint32_t              position{0};
+  };
+
+  std::unordered_map<uint32_t, entry_type> m_entries;
+};
+
+} // namespace torrent
+
+#endif
@@ -7,6 +7,7 @@
 #include "download/download_main.h"
 #include "download/download_wrapper.h"
 #include "net/listen.h"
+#include "net/utp_context.h"
 #include "protocol/handshake_manager.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/connection_manager.h"
@@ -71,6 +72,9 @@ Manager::Manager()
   m_handshake_manager->slot_download_id()         = [this](auto hash) { return m_download_manager->find_main(hash); };
   m_handshake_manager->slot_download_obfuscated() = [this](auto hash) { return m_download_manager->find_main_obfuscated(hash); };
   m_connection_manager->listen()->slot_accepted() = [this](auto fd, auto sa) { return m_handshake_manager->add_incoming(fd, sa); };
+  m_connection_manager->utp()->slot_accept_filter() = [this](auto sa) { return m_handshake_manager->filter_incoming_utp(sa); };
+  m_connection_manager->utp()->slot_accepted() = [this](auto fd, auto sa) { return m_handshake_manager->add_incoming_utp(fd, sa); };
+  m_connection_manager->utp()->slot_connect_failed() = [this](auto fd) { return m_handshake_manager->receive_utp_failed(fd); };
 
   m_resource_manager->push_group("default");
   m_resource_manager->group_back()->up_queue()->set_heuristics(choke_queue::HEURISTICS_UPLOAD_LEECH);
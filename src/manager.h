@@ -16,7 +16,7 @@ class ResourceManager;
 
 using EncodingList = std::list<std::string>;
 
-class Manager {
+class LIBTORRENT_EXPORT Manager {
 public:
   Manager();
   ~Manager();
@@ -67,7 +67,7 @@ private:
   utils::SchedulerEntry m_task_tick;
 };
 
-extern Manager* manager;
+extern LIBTORRENT_EXPORT Manager* manager;
 
 } // namespace torrent
 
@@ -0,0 +1,53 @@
+#ifndef LIBTORRENT_NET_POLL_INTERNAL_H
+#define LIBTORRENT_NET_POLL_INTERNAL_H
+
+#include <cstdint>
+
+#include "torrent/poll.h"
+
+namespace torrent {
+
+// Poll implementations on Linux, epoll and io_uring, chosen by
+// Poll::create. Interest flags use the poll(2) values, which the
+// epoll backend shares.
+class PollInternal {
+public:
+  virtual ~PollInternal() = default;
+
+  virtual Poll::backend_type backend() const = 0;
+
+  virtual uint32_t     open_max() const = 0;
+
+  virtual uint32_t     max_events() const = 0;
+  virtual void         set_max_events(uint32_t count) = 0;
+
+  virtual uint32_t     event_mask(Event* event) const = 0;
+
+  virtual void         open(Event* event, bool edge) = 0;
+  virtual void         close(Event* event) = 0;
+  virtual void         cleanup_closed(Event* event) = 0;
+
+  virtual void         insert(Event* event, uint32_t flags) = 0;
+  virtual void         remove(Event* event, uint32_t flags) = 0;
+
+  virtual void         drained(Event* event, uint32_t flags) = 0;
+
+  virtual int          poll(int64_t timeout_usec) = 0;
+  virtual unsigned int process() = 0;
+
+  bool                 is_edge_triggered() const      { return m_edge_triggered; }
+  void                 set_edge_triggered(bool state) { m_edge_triggered = state; }
+
+protected:
+  // Number of times an edge-triggered event is requeued while its
+  // handler doesn't drain the socket, after which it is re-armed and
+  // left to the kernel to report again.
+  static constexpr uint8_t edge_requeue_max = 16;
+
+private:
+  bool                 m_edge_triggered{false};
+};
+
+} // namespace torrent
+
+#endif
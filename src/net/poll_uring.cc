@@ -0,0 +1,378 @@
+#include "config.h"
+
+#include "net/poll_uring.h"
+
+#ifdef USE_IO_URING
+
+#include <cerrno>
+#include <sys/poll.h>
+
+#include "torrent/event.h"
+#include "torrent/exceptions.h"
+#include "torrent/utils/thread.h"
+#include "utils/io_uring.h"
+
+namespace torrent {
+
+// Completions for POLL_REMOVE requests are not needed.
+static constexpr uint64_t ignore_user_data = ~uint64_t();
+
+static inline uint64_t
+poll_user_data(int fd, uint32_t generation) {
+  return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+}
+
+PollUring::~PollUring() = default;
+
+std::unique_ptr<PollUring>
+PollUring::create(uint32_t open_max) {
+  // Multishot poll was added in the same release as
+  // IORING_FEAT_RSRC_TAGS, which has no feature flag of its own.
+  auto ring = IoUring::create(1024, 8192);
+
+  if (ring == nullptr)
+    return nullptr;
+
+  if (!(ring->features() & IORING_FEAT_EXT_ARG) || !(ring->features() & IORING_FEAT_RSRC_TAGS))
+    return nullptr;
+
+  std::unique_ptr<PollUring> poll(new PollUring);
+
+  poll->m_ring = std::move(ring);
+  poll->m_entries.resize(open_max);
+
+  return poll;
+}
+
+void
+PollUring::set_max_events(uint32_t count) {
+  if (count == 0 || count > m_entries.size())
+    throw input_error("Poll::set_max_events(...) count out of range.");
+
+  m_max_events = count;
+}
+
+uint32_t
+PollUring::event_mask(Event* event) const {
+  auto& entry = m_entries[event->file_descriptor()];
+
+  return entry.event != event ? 0 : entry.mask;
+}
+
+void
+PollUring::set_mask(Event* event, uint32_t mask) {
+  auto& entry = m_entries[event->file_descriptor()];
+
+  entry.event = event;
+  entry.mask = mask;
+
+  set_pending(event->file_descriptor());
+}
+
+void
+PollUring::set_pending(int fd) {
+  if (m_entries[fd].flags & flag_pending)
+    return;
+
+  m_entries[fd].flags |= flag_pending;
+  m_pending.push_back(fd);
+}
+
+void
+PollUring::set_ready(int fd, uint8_t flags) {
+  m_entries[fd].flags |= flags;
+
+  if (m_entries[fd].flags & flag_queued)
+    return;
+
+  m_entries[fd].flags |= flag_queued;
+  m_ready.push_back(fd);
+}
+
+void
+PollUring::open(Event* event, bool edge) {
+  if (event_mask(event) != 0)
+    throw internal_error("Poll::open(...) called but the file descriptor is active");
+
+  if (edge)
+    m_entries[event->file_descriptor()].flags |= flag_edge;
+}
+
+// The kernel holds a file reference for each armed poll, so a closed
+// descriptor must still have its request removed. Mark it stale in
+// case the descriptor is reused before the next sync.
+void
+PollUring::close(Event* event) {
+  if (event_mask(event) != 0)
+    throw internal_error("Poll::close(...) called but the file descriptor is active");
+
+  auto& entry = m_entries[event->file_descriptor()];
+
+  entry.event = nullptr;
+  entry.mask = 0;
+  entry.flags = (entry.flags & flag_lists) | flag_stale;
+  entry.requeues = 0;
+
+  set_pending(event->file_descriptor());
+}
+
+void
+PollUring::cleanup_closed(Event* event) {
+  auto& entry = m_entries[event->file_descriptor()];
+
+  if (entry.event != event)
+    return;
+
+  entry.event = nullptr;
+  entry.mask = 0;
+  entry.flags = (entry.flags & flag_lists) | flag_stale;
+  entry.requeues = 0;
+
+  set_pending(event->file_descriptor());
+}
+
+void
+PollUring::insert(Event* event, uint32_t flags) {
+  uint32_t mask = event_mask(event);
+
+  if ((mask & flags) == flags)
+    return;
+
+  set_mask(event, mask | flags);
+}
+
+void
+PollUring::remove(Event* event, uint32_t flags) {
+  uint32_t mask = event_mask(event);
+
+  if (!(mask & flags))
+    return;
+
+  if (flags & POLLIN)
+    m_entries[event->file_descriptor()].flags &= ~flag_ready_read;
+
+  if (flags & POLLOUT)
+    m_entries[event->file_descriptor()].flags &= ~flag_ready_write;
+
+  set_mask(event, mask & ~flags);
+}
+
+void
+PollUring::drained(Event* event, uint32_t flags) {
+  auto& entry = m_entries[event->file_descriptor()];
+
+  if (entry.event != event)
+    return;
+
+  if (flags & POLLIN)
+    entry.flags &= ~flag_ready_read;
+
+  if (flags & POLLOUT)
+    entry.flags &= ~flag_ready_write;
+}
+
+io_uring_sqe*
+PollUring::next_sqe() {
+  io_uring_sqe* sqe = m_ring->next_sqe();
+
+  if (sqe == nullptr) {
+    if (m_ring->submit() == -1)
+      throw internal_error("PollUring::next_sqe() io_uring_enter failed: " + std::string(std::strerror(errno)));
+
+    if ((sqe = m_ring->next_sqe()) == nullptr)
+      throw internal_error("PollUring::next_sqe() submission queue full after submit.");
+  }
+
+  *sqe = io_uring_sqe{};
+  return sqe;
+}
+
+// Turns the interest changes made since the last wakeup into POLL_ADD
+// and POLL_REMOVE requests, bumping the generation so completions from
+// replaced requests are ignored.
+void
+PollUring::sync() {
+  for (int fd : m_pending) {
+    auto& entry = m_entries[fd];
+
+    entry.flags &= ~flag_pending;
+
+    uint32_t wanted = entry.event != nullptr ? entry.mask : 0;
+
+    if (entry.armed_mask == wanted && !(entry.flags & flag_stale))
+      continue;
+
+    if (entry.armed_mask != 0) {
+      io_uring_sqe* sqe = next_sqe();
+
+      sqe->opcode    = IORING_OP_POLL_REMOVE;
+      sqe->fd        = -1;
+      sqe->addr      = poll_user_data(fd, entry.generation);
+      sqe->user_data = ignore_user_data;
+
+      entry.armed_mask = 0;
+    }
+
+    entry.generation++;
+    entry.flags &= ~flag_stale;
+
+    if (wanted == 0)
+      continue;
+
+    io_uring_sqe* sqe = next_sqe();
+
+    sqe->opcode         = IORING_OP_POLL_ADD;
+    sqe->fd             = fd;
+    sqe->poll32_events  = wanted;
+    sqe->len            = (entry.flags & flag_edge) ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data      = poll_user_data(fd, entry.generation);
+
+    entry.armed_mask = wanted;
+  }
+
+  m_pending.clear();
+}
+
+int
+PollUring::poll(int64_t timeout_usec) {
+  sync();
+
+  // Events left on the ready list, or completions not processed due
+  // to 'max_events', must not wait for new ones.
+  if (!m_ready.empty() || m_ring->has_cqe())
+    timeout_usec = 0;
+
+  if (timeout_usec == 0)
+    return m_ring->unsubmitted() != 0 ? m_ring->submit() : 0;
+
+  if (m_ring->submit_and_wait(timeout_usec) == -1)
+    return errno == ETIME ? 0 : -1;
+
+  return 0;
+}
+
+unsigned int
+PollUring::process() {
+  unsigned int count = 0;
+  io_uring_cqe cqe;
+
+  for (uint32_t processed = 0; processed != m_max_events && m_ring->peek_cqe(&cqe); processed++) {
+    if (cqe.user_data == ignore_user_data)
+      continue;
+
+    int      fd         = static_cast<uint32_t>(cqe.user_data);
+    uint32_t generation = cqe.user_data >> 32;
+
+    if (static_cast<size_t>(fd) >= m_entries.size())
+      continue;
+
+    auto& entry = m_entries[fd];
+
+    if (entry.generation != generation)
+      continue;
+
+    // A failed request, e.g. on a descriptor closed without calling
+    // Poll::close, is reported as an error and not re-armed until the
+    // event's interest changes.
+    if (cqe.res < 0) {
+      entry.armed_mask = 0;
+
+      if (entry.event != nullptr && entry.mask & POLLERR) {
+        count++;
+        entry.event->event_error();
+      }
+
+      continue;
+    }
+
+    // One-shot polls, and multishot polls the kernel terminated, are
+    // re-armed by the next sync.
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+      entry.armed_mask = 0;
+      set_pending(fd);
+    }
+
+    if (utils::Thread::self()->callbacks_should_interrupt_polling())
+      utils::Thread::self()->process_callbacks(true);
+
+    uint32_t events = cqe.res;
+
+    // Each branch must check the event is still registered, as the
+    // handlers may remove or close it.
+    if (events & POLLERR && entry.event != nullptr && entry.mask & POLLERR) {
+      count++;
+      entry.event->event_error();
+    }
+
+    if (entry.flags & flag_edge) {
+      set_ready(fd,
+                ((events & (POLLIN | POLLHUP)) ? flag_ready_read : 0) |
+                ((events & POLLOUT) ? flag_ready_write : 0));
+      continue;
+    }
+
+    if (events & (POLLIN | POLLHUP) && entry.event != nullptr && entry.mask & POLLIN) {
+      count++;
+      entry.event->event_read();
+    }
+
+    if (events & POLLOUT && entry.event != nullptr && entry.mask & POLLOUT) {
+      count++;
+      entry.event->event_write();
+    }
+  }
+
+  return count + process_ready();
+}
+
+// Same semantics as the epoll backend's ready list. An event requeued
+// 'edge_requeue_max' times without being drained is re-armed instead,
+// so the new poll request reports it only if it is still ready.
+unsigned int
+PollUring::process_ready() {
+  unsigned int count = 0;
+
+  m_ready_processing.swap(m_ready);
+
+  for (int fd : m_ready_processing) {
+    auto& entry = m_entries[fd];
+
+    entry.flags &= ~flag_queued;
+
+    if ((entry.flags & flag_ready_read) && entry.event != nullptr && entry.mask & POLLIN) {
+      count++;
+      entry.event->event_read();
+    }
+
+    if ((entry.flags & flag_ready_write) && entry.event != nullptr && entry.mask & POLLOUT) {
+      count++;
+      entry.event->event_write();
+    }
+
+    uint8_t wanted = ((entry.mask & POLLIN) ? flag_ready_read : 0) | ((entry.mask & POLLOUT) ? flag_ready_write : 0);
+
+    if (entry.event == nullptr || !(entry.flags & flag_edge)) {
+      entry.flags &= ~(flag_ready_read | flag_ready_write);
+      entry.requeues = 0;
+
+    } else if ((entry.flags & wanted) == 0) {
+      entry.requeues = 0;
+
+    } else if (++entry.requeues < edge_requeue_max) {
+      set_ready(fd, 0);
+
+    } else {
+      entry.flags = (entry.flags & ~(flag_ready_read | flag_ready_write)) | flag_stale;
+      entry.requeues = 0;
+
+      set_pending(fd);
+    }
+  }
+
+  m_ready_processing.clear();
+  return count;
+}
+
+} // namespace torrent
+
+#endif // USE_IO_URING
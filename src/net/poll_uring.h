@@ -0,0 +1,96 @@
+#ifndef LIBTORRENT_NET_POLL_URING_H
+#define LIBTORRENT_NET_POLL_URING_H
+
+#include <memory>
+#include <vector>
+
+#include "net/poll_internal.h"
+
+struct io_uring_sqe;
+
+namespace torrent {
+
+class IoUring;
+
+// Poll backend using io_uring POLL_ADD requests, selected with
+// Poll::BACKEND_IO_URING. Interest changes are only recorded when
+// made, and submitted as a single batch before waiting, so toggling
+// write interest within an iteration costs no system calls.
+//
+// Level-triggered events use one-shot polls re-armed after each
+// completion. Edge-triggered events use multishot polls and the same
+// ready list semantics as the epoll backend.
+class PollUring : public PollInternal {
+public:
+  ~PollUring() override;
+
+  // Returns nullptr if the kernel lacks multishot poll or timeouts
+  // on io_uring_enter.
+  static std::unique_ptr<PollUring> create(uint32_t open_max);
+
+  Poll::backend_type  backend() const override          { return Poll::BACKEND_IO_URING; }
+
+  uint32_t            open_max() const override         { return m_entries.size(); }
+
+  uint32_t            max_events() const override       { return m_max_events; }
+  void                set_max_events(uint32_t count) override;
+
+  uint32_t            event_mask(Event* event) const override;
+
+  void                open(Event* event, bool edge) override;
+  void                close(Event* event) override;
+  void                cleanup_closed(Event* event) override;
+
+  void                insert(Event* event, uint32_t flags) override;
+  void                remove(Event* event, uint32_t flags) override;
+
+  void                drained(Event* event, uint32_t flags) override;
+
+  int                 poll(int64_t timeout_usec) override;
+  unsigned int        process() override;
+
+private:
+  PollUring() = default;
+  PollUring(const PollUring&) = delete;
+  PollUring& operator=(const PollUring&) = delete;
+
+  static constexpr uint8_t flag_edge        = (1 << 0);
+  static constexpr uint8_t flag_ready_read  = (1 << 1);
+  static constexpr uint8_t flag_ready_write = (1 << 2);
+  static constexpr uint8_t flag_queued      = (1 << 3);
+  static constexpr uint8_t flag_pending     = (1 << 4);
+  static constexpr uint8_t flag_stale       = (1 << 5);
+
+  // Flags describing list membership, kept when an event is closed.
+  static constexpr uint8_t flag_lists       = flag_queued | flag_pending;
+
+  struct entry_type {
+    Event*   event{nullptr};
+    uint32_t mask{0};
+    uint32_t armed_mask{0};
+    uint32_t generation{0};
+    uint8_t  flags{0};
+    uint8_t  requeues{0};
+  };
+
+  void                set_mask(Event* event, uint32_t mask);
+  void                set_pending(int fd);
+  void                set_ready(int fd, uint8_t flags);
+
+  void                sync();
+  struct io_uring_sqe* next_sqe();
+
+  unsigned int        process_ready();
+
+  std::unique_ptr<IoUring> m_ring;
+  uint32_t                 m_max_events{1024};
+
+  std::vector<entry_type>  m_entries;
+  std::vector<int>         m_pending;
+  std::vector<int>         m_ready;
+  std::vector<int>         m_ready_processing;
+};
+
+} // namespace torrent
+
+#endif
@@ -2,6 +2,9 @@
 
 #include "socket_datagram.h"
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
 #include <sys/socket.h>
 
 #include "torrent/exceptions.h"
@@ -60,4 +63,170 @@ SocketDatagram::write_datagram_sa(const void* buffer, unsigned int length, socka
   return r;
 }
 
+int
+SocketDatagram::read_datagrams_sa(datagram_type* datagrams, unsigned int count) {
+  if (count == 0)
+    throw internal_error("Tried to receive zero datagrams");
+
+  count = std::min(count, max_batch_size);
+  m_stats_read_calls++;
+
+  int r = -1;
+
+#ifdef USE_MMSG
+  if (m_use_mmsg)
+    r = read_datagrams_mmsg(datagrams, count);
+#endif
+
+  if (!m_use_mmsg)
+    r = read_datagrams_single(datagrams, count);
+
+  if (r > 0)
+    m_stats_read_datagrams += r;
+
+  return r;
+}
+
+int
+SocketDatagram::write_datagrams_sa(datagram_type* datagrams, unsigned int count) {
+  if (count == 0)
+    throw internal_error("Tried to send zero datagrams");
+
+  count = std::min(count, max_batch_size);
+  m_stats_write_calls++;
+
+  // IPv4 destinations need to be mapped when sending from an inet6
+  // socket.
+  std::array<sa_unique_ptr, max_batch_size> mapped;
+  std::array<sockaddr*, max_batch_size> addresses;
+
+  for (unsigned int i = 0; i < count; i++) {
+    if (datagrams[i].length == 0)
+      throw internal_error("Tried to send buffer length 0");
+
+    if (m_ipv6_socket && datagrams[i].address != nullptr && datagrams[i].address->sa_family == AF_INET)
+      mapped[i] = sa_to_v4mapped_in(reinterpret_cast<sockaddr_in*>(datagrams[i].address));
+
+    addresses[i] = mapped[i] ? mapped[i].get() : datagrams[i].address;
+  }
+
+  int r = -1;
+
+#ifdef USE_MMSG
+  if (m_use_mmsg)
+    r = write_datagrams_mmsg(datagrams, addresses.data(), count);
+#endif
+
+  if (!m_use_mmsg)
+    r = write_datagrams_single(datagrams, addresses.data(), count);
+
+  if (r > 0)
+    m_stats_write_datagrams += r;
+
+  return r;
+}
+
+#ifdef USE_MMSG
+
+int
+SocketDatagram::read_datagrams_mmsg(datagram_type* datagrams, unsigned int count) {
+  std::array<mmsghdr, max_batch_size> msgs{};
+  std::array<iovec, max_batch_size> iovs;
+
+  for (unsigned int i = 0; i < count; i++) {
+    iovs[i].iov_base = datagrams[i].buffer;
+    iovs[i].iov_len  = datagrams[i].length;
+
+    msgs[i].msg_hdr.msg_name    = datagrams[i].address;
+    msgs[i].msg_hdr.msg_namelen = datagrams[i].address_length;
+    msgs[i].msg_hdr.msg_iov     = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen  = 1;
+  }
+
+  int r = ::recvmmsg(m_fileDesc, msgs.data(), count, MSG_DONTWAIT, nullptr);
+
+  if (r == -1 && errno == ENOSYS)
+    m_use_mmsg = false;
+
+  for (int i = 0; i < r; i++) {
+    datagrams[i].length         = msgs[i].msg_len;
+    datagrams[i].address_length = msgs[i].msg_hdr.msg_namelen;
+  }
+
+  return r;
+}
+
+int
+SocketDatagram::write_datagrams_mmsg(datagram_type* datagrams, sockaddr** addresses, unsigned int count) {
+  std::array<mmsghdr, max_batch_size> msgs{};
+  std::array<iovec, max_batch_size> iovs;
+
+  for (unsigned int i = 0; i < count; i++) {
+    iovs[i].iov_base = datagrams[i].buffer;
+    iovs[i].iov_len  = datagrams[i].length;
+
+    if (addresses[i] != nullptr) {
+      msgs[i].msg_hdr.msg_name    = addresses[i];
+      msgs[i].msg_hdr.msg_namelen = sa_length(addresses[i]);
+    }
+
+    msgs[i].msg_hdr.msg_iov    = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int r = ::sendmmsg(m_fileDesc, msgs.data(), count, 0);
+
+  if (r == -1 && errno == ENOSYS)
+    m_use_mmsg = false;
+
+  for (int i = 0; i < r; i++)
+    datagrams[i].length = msgs[i].msg_len;
+
+  return r;
+}
+
+#endif
+
+int
+SocketDatagram::read_datagrams_single(datagram_type* datagrams, unsigned int count) {
+  unsigned int i = 0;
+
+  for (; i < count; i++) {
+    int length = ::recvfrom(m_fileDesc, datagrams[i].buffer, datagrams[i].length, MSG_DONTWAIT,
+                            datagrams[i].address, &datagrams[i].address_length);
+
+    if (length == -1)
+      break;
+
+    datagrams[i].length = length;
+  }
+
+  return i != 0 ? i : -1;
+}
+
+int
+SocketDatagram::write_datagrams_single(datagram_type* datagrams, sockaddr** addresses, unsigned int count) {
+  unsigned int i = 0;
+
+  for (; i < count; i++) {
+    int length = ::sendto(m_fileDesc, datagrams[i].buffer, datagrams[i].length, 0,
+                          addresses[i], addresses[i] != nullptr ? sa_length(addresses[i]) : 0);
+
+    if (length == -1)
+      break;
+
+    datagrams[i].length = length;
+  }
+
+  return i != 0 ? i : -1;
+}
+
+void
+SocketDatagram::reset_datagram_stats() {
+  m_stats_read_calls = 0;
+  m_stats_read_datagrams = 0;
+  m_stats_write_calls = 0;
+  m_stats_write_datagrams = 0;
+}
+
 } // namespace torrent
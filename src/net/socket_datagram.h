@@ -1,6 +1,7 @@
 #ifndef LIBTORRENT_NET_SOCKET_DGRAM_H
 #define LIBTORRENT_NET_SOCKET_DGRAM_H
 
+#include <cstdint>
 #include <sys/socket.h>
 
 #include "socket_base.h"
@@ -9,6 +10,18 @@ namespace torrent {
 
 class SocketDatagram : public SocketBase {
 public:
+  // Entry for batched io. On read 'length' and 'address_length' hold
+  // the capacity and are updated with the received sizes, on write
+  // 'length' is updated with the bytes sent.
+  struct datagram_type {
+    void*               buffer;
+    unsigned int        length;
+    sockaddr*           address;
+    socklen_t           address_length;
+  };
+
+  static constexpr unsigned int max_batch_size = 32;
+
   ~SocketDatagram() override;
 
   int                 read_datagram(void* buffer, unsigned int length);
@@ -16,6 +29,40 @@ public:
 
   int                 read_datagram_sa(void* buffer, unsigned int length, sockaddr* from_sa, socklen_t from_length);
   int                 write_datagram_sa(const void* buffer, unsigned int length, sockaddr* sa);
+
+  // Uses recvmmsg/sendmmsg when available, else a call per datagram,
+  // transferring at most 'max_batch_size' datagrams. Returns the number
+  // transferred, or -1 with errno set if the first one failed.
+  int                 read_datagrams_sa(datagram_type* datagrams, unsigned int count);
+  int                 write_datagrams_sa(datagram_type* datagrams, unsigned int count);
+
+  // Calls and datagrams transferred by the batched functions, the
+  // ratio being the average batch size.
+  uint64_t            stats_read_calls() const       { return m_stats_read_calls; }
+  uint64_t            stats_read_datagrams() const   { return m_stats_read_datagrams; }
+  uint64_t            stats_write_calls() const      { return m_stats_write_calls; }
+  uint64_t            stats_write_datagrams() const  { return m_stats_write_datagrams; }
+
+  void                reset_datagram_stats();
+
+protected:
+  // Cleared if the kernel turns out not to support recvmmsg/sendmmsg.
+#ifdef USE_MMSG
+  bool                m_use_mmsg{true};
+#else
+  bool                m_use_mmsg{false};
+#endif
+
+private:
+  int                 read_datagrams_mmsg(datagram_type* datagrams, unsigned int count);
+  int                 read_datagrams_single(datagram_type* datagrams, unsigned int count);
+  int                 write_datagrams_mmsg(datagram_type* datagrams, sockaddr** addresses, unsigned int count);
+  int                 write_datagrams_single(datagram_type* datagrams, sockaddr** addresses, unsigned int count);
+
+  uint64_t            m_stats_read_calls{0};
+  uint64_t            m_stats_read_datagrams{0};
+  uint64_t            m_stats_write_calls{0};
+  uint64_t            m_stats_write_datagrams{0};
 };
 
 } // namespace torrent
@@ -2,12 +2,32 @@
 
 #include "socket_stream.h"
 
+#include <cerrno>
 #include <rak/error_number.h>
 
+#include "torrent/poll.h"
+
+#ifdef USE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
+#ifdef USE_ZEROCOPY
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#endif
+
+#ifdef USE_TCP_INFO
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
 namespace torrent {
 
 SocketStream::~SocketStream() = default;
 
+// A short read or write means the socket buffer was drained, which
+// edge-triggered polling needs to know before waiting for a new edge.
+
 uint32_t
 SocketStream::read_stream_throws(void* buf, uint32_t length) {
   int r = read_stream(buf, length);
@@ -15,6 +35,9 @@ SocketStream::read_stream_throws(void* buf, uint32_t length) {
   if (r == 0)
     throw close_connection();
 
+  if (r < 0 || static_cast<uint32_t>(r) < length)
+    this_thread::poll()->drained_read(this);
+
   if (r < 0) {
     if (rak::error_number::current().is_blocked_momentary())
       return 0;
@@ -36,6 +59,9 @@ SocketStream::write_stream_throws(const void* buf, uint32_t length) {
   if (r == 0)
     throw close_connection();
 
+  if (r < 0 || static_cast<uint32_t>(r) < length)
+    this_thread::poll()->drained_write(this);
+
   if (r < 0) {
     if (rak::error_number::current().is_blocked_momentary())
       return 0;
@@ -50,4 +76,183 @@ SocketStream::write_stream_throws(const void* buf, uint32_t length) {
   return r;
 }
 
+uint32_t
+SocketStream::write_stream_vector_throws(const iovec* iov, int count) {
+  uint32_t length = 0;
+
+  for (int i = 0; i < count; i++)
+    length += iov[i].iov_len;
+
+  if (length == 0)
+    throw internal_error("Tried to write to buffer length 0.");
+
+  int r = ::writev(m_fileDesc, iov, count);
+
+  if (r == 0)
+    throw close_connection();
+
+  if (r < 0 || static_cast<uint32_t>(r) < length)
+    this_thread::poll()->drained_write(this);
+
+  if (r < 0) {
+    if (rak::error_number::current().is_blocked_momentary())
+      return 0;
+    else if (rak::error_number::current().is_closed())
+      throw close_connection();
+    else if (rak::error_number::current().is_blocked_prolonged())
+      throw blocked_connection();
+    else
+      throw connection_error(rak::error_number::current().value());
+  }
+
+  return r;
+}
+
+bool
+SocketStream::has_write_file() {
+#ifdef USE_SENDFILE
+  return true;
+#else
+  return false;
+#endif
+}
+
+uint32_t
+SocketStream::write_file_throws([[maybe_unused]] int fd, [[maybe_unused]] uint64_t offset, uint32_t length) {
+  if (length == 0)
+    throw internal_error("Tried to write file to socket with length 0.");
+
+#ifdef USE_SENDFILE
+  off_t file_offset = offset;
+  ssize_t r = ::sendfile(m_fileDesc, fd, &file_offset, length);
+
+  // Reading past the end of the file, which can happen if it was
+  // truncated behind our back.
+  if (r == 0)
+    throw storage_error("Could not send file data, unexpected end of file.");
+
+  if (r < 0 || static_cast<uint32_t>(r) < length)
+    this_thread::poll()->drained_write(this);
+
+  if (r < 0) {
+    if (rak::error_number::current().is_blocked_momentary())
+      return 0;
+    else if (rak::error_number::current().is_closed())
+      throw close_connection();
+    else if (rak::error_number::current().is_blocked_prolonged())
+      throw blocked_connection();
+    else
+      throw connection_error(rak::error_number::current().value());
+  }
+
+  return r;
+#else
+  throw internal_error("SocketStream::write_file_throws() called but sendfile is not supported.");
+#endif
+}
+
+bool
+SocketStream::has_zerocopy() {
+#ifdef USE_ZEROCOPY
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool
+SocketStream::enable_zerocopy() {
+#ifdef USE_ZEROCOPY
+  int opt = 1;
+  return ::setsockopt(m_fileDesc, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt)) == 0;
+#else
+  return false;
+#endif
+}
+
+uint32_t
+SocketStream::write_stream_zerocopy_throws([[maybe_unused]] const void* buf, uint32_t length, bool* zerocopy) {
+  if (length == 0)
+    throw internal_error("Tried to write to buffer length 0.");
+
+#ifdef USE_ZEROCOPY
+  int r = ::send(m_fileDesc, buf, length, MSG_ZEROCOPY);
+
+  if (r == -1 && errno == ENOBUFS) {
+    *zerocopy = false;
+    return write_stream_throws(buf, length);
+  }
+
+  *zerocopy = true;
+
+  if (r == 0)
+    throw close_connection();
+
+  if (r < 0 || static_cast<uint32_t>(r) < length)
+    this_thread::poll()->drained_write(this);
+
+  if (r < 0) {
+    if (rak::error_number::current().is_blocked_momentary())
+      return 0;
+    else if (rak::error_number::current().is_closed())
+      throw close_connection();
+    else if (rak::error_number::current().is_blocked_prolonged())
+      throw blocked_connection();
+    else
+      throw connection_error(rak::error_number::current().value());
+  }
+
+  return r;
+#else
+  throw internal_error("SocketStream::write_stream_zerocopy_throws() called but MSG_ZEROCOPY is not supported.");
+#endif
+}
+
+void
+SocketStream::read_zerocopy_completions([[maybe_unused]] const slot_zerocopy_type& slot) {
+#ifdef USE_ZEROCOPY
+  while (true) {
+    char control[128];
+    msghdr msg{};
+
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (::recvmsg(m_fileDesc, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+      return;
+
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+            (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+        continue;
+
+      auto err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+
+      if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+
+      slot(err->ee_info, err->ee_data, err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+    }
+  }
+#endif
+}
+
+bool
+SocketStream::read_tcp_rtt([[maybe_unused]] uint32_t* rtt) {
+#ifdef USE_TCP_INFO
+  tcp_info info{};
+  socklen_t length = sizeof(info);
+
+  if (::getsockopt(m_fileDesc, IPPROTO_TCP, TCP_INFO, &info, &length) == -1)
+    return false;
+
+  // Use the receiver's estimate until the peer has acknowledged
+  // enough of our data to have a sender estimate.
+  *rtt = info.tcpi_rtt != 0 ? info.tcpi_rtt : info.tcpi_rcv_rtt;
+  return *rtt != 0;
+#else
+  return false;
+#endif
+}
+
 } // namespace torrent
@@ -39,6 +39,8 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <functional>
 
 #include "torrent/exceptions.h"
 #include "socket_base.h"
@@ -58,6 +60,36 @@ public:
   uint32_t            read_stream_throws(void* buf, uint32_t length);
   uint32_t            write_stream_throws(const void* buf, uint32_t length);
 
+  // Gathered write of 'count' buffers in a single syscall. Same
+  // semantics as write_stream_throws.
+  uint32_t            write_stream_vector_throws(const iovec* iov, int count);
+
+  // Send file data directly from the page cache, bypassing the copy
+  // from mapped memory. Same semantics as write_stream_throws.
+  static bool         has_write_file();
+  uint32_t            write_file_throws(int fd, uint64_t offset, uint32_t length);
+
+  // Zero-copy sends with MSG_ZEROCOPY. The buffer must stay valid
+  // until the kernel reports the send completed; each call that
+  // returns a non-zero length is assigned the next id, starting at
+  // zero. Falls back to a copying send if the kernel is out of
+  // buffers for pinned pages.
+  static bool         has_zerocopy();
+  bool                enable_zerocopy();
+  uint32_t            write_stream_zerocopy_throws(const void* buf, uint32_t length, bool* zerocopy);
+
+  // Drains completion notifications from the socket error queue,
+  // calling 'slot' with each inclusive range of ids and whether the
+  // kernel copied the data anyway.
+  using slot_zerocopy_type = std::function<void(uint32_t, uint32_t, bool)>;
+
+  void                read_zerocopy_completions(const slot_zerocopy_type& slot);
+
+  // Smoothed round-trip time in microseconds as estimated by the
+  // kernel. Returns false for non-TCP sockets, such as the local
+  // socket pairs carrying uTP connections.
+  bool                read_tcp_rtt(uint32_t* rtt);
+
   // Handles all the error catching etc. Returns true if the buffer is
   // finished reading/writing.
   bool                read_buffer(void* buf, uint32_t length, uint32_t& pos);
@@ -0,0 +1,355 @@
+#include "config.h"
+
+#include "net/utp_context.h"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+
+#include "net/utp_socket.h"
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+#include "torrent/net/fd.h"
+#include "torrent/net/socket_address.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/random.h"
+
+#define LT_LOG_THIS(log_fmt, ...)                                       \
+  lt_log_print(LOG_CONNECTION, "utp: " log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+UtpContext::UtpContext() {
+  m_task_tick.slot() = [this] { receive_tick(); };
+}
+
+UtpContext::~UtpContext() {
+  close();
+}
+
+bool
+UtpContext::open(const sockaddr* bind_address) {
+  close();
+
+  if (bind_address->sa_family != AF_INET && bind_address->sa_family != AF_INET6)
+    throw input_error("uTP socket must be bound to an inet or inet6 address");
+
+  fd_flags open_flags = fd_flag_datagram | fd_flag_nonblock;
+
+  if (bind_address->sa_family == AF_INET)
+    open_flags |= fd_flag_v4only;
+
+  m_fileDesc = fd_open(open_flags);
+
+  if (m_fileDesc == -1)
+    return false;
+
+  m_ipv6_socket = bind_address->sa_family == AF_INET6;
+
+  if (!fd_bind(m_fileDesc, bind_address)) {
+    LT_LOG_THIS("could not bind datagram socket : %s : %s", sa_pretty_str(bind_address).c_str(), std::strerror(errno));
+
+    get_fd().close();
+    get_fd().clear();
+    return false;
+  }
+
+  LT_LOG_THIS("opened datagram socket : %s", sa_pretty_str(bind_address).c_str());
+
+  this_thread::poll()->open(this);
+  this_thread::poll()->insert_read(this);
+  this_thread::poll()->insert_error(this);
+
+  return true;
+}
+
+void
+UtpContext::close() {
+  if (!is_open())
+    return;
+
+  LT_LOG_THIS("closing : connections:%zu", m_sockets.size());
+
+  this_thread::scheduler()->erase(&m_task_tick);
+
+  m_sockets.clear();
+  m_connecting.clear();
+  m_received.clear();
+
+  this_thread::poll()->remove_and_close(this);
+
+  get_fd().close();
+  get_fd().clear();
+}
+
+// Raw address, port and connection id, with v4-mapped addresses
+// matching their inet form.
+std::string
+UtpContext::make_key(const sockaddr* sa, uint16_t id) {
+  std::string key;
+
+  if (sa->sa_family == AF_INET) {
+    auto sin = reinterpret_cast<const sockaddr_in*>(sa);
+    key.append(reinterpret_cast<const char*>(&sin->sin_addr), 4);
+    key.append(reinterpret_cast<const char*>(&sin->sin_port), 2);
+
+  } else if (sa->sa_family == AF_INET6) {
+    auto sin6 = reinterpret_cast<const sockaddr_in6*>(sa);
+    auto offset = sin6_is_v4mapped(sin6) ? 12 : 0;
+
+    key.append(reinterpret_cast<const char*>(&sin6->sin6_addr) + offset, 16 - offset);
+    key.append(reinterpret_cast<const char*>(&sin6->sin6_port), 2);
+  }
+
+  key.append(reinterpret_cast<const char*>(&id), 2);
+  return key;
+}
+
+int
+UtpContext::connect(const sockaddr* sa) {
+  if (!is_open()) {
+    errno = ENOTCONN;
+    return -1;
+  }
+
+  uint16_t recv_id;
+  std::string key;
+
+  // Find an unused connection id for this address.
+  do {
+    recv_id = random_uniform_uint16();
+    key = make_key(sa, recv_id);
+  } while (m_sockets.find(key) != m_sockets.end());
+
+  int fds[2];
+
+  if (::socketpair(AF_LOCAL, SOCK_STREAM, 0, fds) == -1)
+    return -1;
+
+  if (!fd_set_nonblock(fds[0]) || !fd_set_nonblock(fds[1])) {
+    fd_close(fds[0]);
+    fd_close(fds[1]);
+    return -1;
+  }
+
+  auto socket = std::make_unique<UtpSocket>(this, sa, recv_id, recv_id + 1, fds[1]);
+  auto socket_ptr = socket.get();
+
+  m_bridge_count++;
+  m_sockets.emplace(key, std::move(socket));
+  m_connecting.emplace(socket_ptr, fds[0]);
+
+  socket_ptr->connect();
+  schedule_tick();
+
+  return fds[0];
+}
+
+void
+UtpContext::send_packet(const char* data, uint32_t length, const sockaddr* sa) {
+  // Dropped packets are recovered like any other loss.
+  if (write_datagram_sa(data, length, const_cast<sockaddr*>(sa)) == -1) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+      LT_LOG_THIS("send failed : %s : %s", sa_pretty_str(sa).c_str(), std::strerror(errno));
+
+    return;
+  }
+
+  m_stats_packets_sent++;
+}
+
+void
+UtpContext::event_read() {
+  constexpr unsigned int batch_size = 16;
+
+  std::array<std::array<char, UtpSocket::packet_size + 512>, batch_size> buffers;
+  std::array<sockaddr_storage, batch_size> addresses;
+  std::array<datagram_type, batch_size> datagrams;
+
+  while (true) {
+    for (unsigned int i = 0; i < batch_size; i++)
+      datagrams[i] = datagram_type{buffers[i].data(), static_cast<unsigned int>(buffers[i].size()),
+                                   reinterpret_cast<sockaddr*>(&addresses[i]), sizeof(sockaddr_storage)};
+
+    int count = read_datagrams_sa(datagrams.data(), batch_size);
+
+    if (count == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+
+      if (errno == EINTR || errno == ECONNREFUSED)
+        continue;
+
+      LT_LOG_THIS("receive failed : %s", std::strerror(errno));
+      break;
+    }
+
+    m_stats_packets_received += count;
+
+    for (int i = 0; i < count; i++)
+      receive_packet(buffers[i].data(), datagrams[i].length, reinterpret_cast<sockaddr*>(&addresses[i]));
+
+    if (static_cast<unsigned int>(count) < batch_size)
+      break;
+  }
+
+  // Acknowledge each connection once per batch of datagrams.
+  for (auto socket : m_received)
+    socket->flush_ack();
+
+  m_received.clear();
+
+  reap_closed();
+}
+
+void
+UtpContext::event_write() {
+  throw internal_error("UtpContext::event_write() called but not supported.");
+}
+
+void
+UtpContext::event_error() {
+  int error = get_fd().get_error();
+
+  if (error != 0)
+    LT_LOG_THIS("socket error : %s", std::strerror(error));
+}
+
+void
+UtpContext::receive_packet(const char* data, uint32_t length, const sockaddr* sa) {
+  UtpSocket::header_type header;
+
+  if (!UtpSocket::read_header(data, length, &header))
+    return;
+
+  if (header.type == UtpSocket::ST_SYN) {
+    auto itr = m_sockets.find(make_key(sa, header.connection_id + 1));
+
+    if (itr != m_sockets.end()) {
+      itr->second->receive(header, data, length);
+      m_received.push_back(itr->second.get());
+      return;
+    }
+
+    receive_syn(data, length, sa);
+    return;
+  }
+
+  auto itr = m_sockets.find(make_key(sa, header.connection_id));
+
+  if (itr == m_sockets.end()) {
+    if (header.type != UtpSocket::ST_RESET)
+      send_reset(sa, header.connection_id, header.seq_nr);
+
+    return;
+  }
+
+  itr->second->receive(header, data, length);
+
+  if (m_received.empty() || m_received.back() != itr->second.get())
+    m_received.push_back(itr->second.get());
+}
+
+void
+UtpContext::receive_syn(const char* data, uint32_t length, const sockaddr* sa) {
+  UtpSocket::header_type header;
+  UtpSocket::read_header(data, length, &header);
+
+  if (!m_slot_accepted)
+    return;
+
+  sa_unique_ptr address = sa_is_v4mapped(sa) ? sa_from_v4mapped(sa) : sa_copy(sa);
+
+  if (m_slot_accept_filter && !m_slot_accept_filter(address.get())) {
+    send_reset(sa, header.connection_id, header.seq_nr);
+    return;
+  }
+
+  int fds[2];
+
+  if (::socketpair(AF_LOCAL, SOCK_STREAM, 0, fds) == -1) {
+    LT_LOG_THIS("could not accept connection : %s : %s", sa_pretty_str(sa).c_str(), std::strerror(errno));
+    return;
+  }
+
+  if (!fd_set_nonblock(fds[0]) || !fd_set_nonblock(fds[1])) {
+    fd_close(fds[0]);
+    fd_close(fds[1]);
+    return;
+  }
+
+  auto socket = std::make_unique<UtpSocket>(this, address.get(), header.connection_id + 1, header.connection_id, fds[1]);
+  auto socket_ptr = socket.get();
+
+  m_bridge_count++;
+  m_sockets.emplace(make_key(sa, header.connection_id + 1), std::move(socket));
+
+  socket_ptr->accept(header);
+  schedule_tick();
+
+  // The slot may close the file descriptor right away, which the
+  // socket notices on the next poll.
+  m_slot_accepted(fds[0], address.get());
+}
+
+void
+UtpContext::send_reset(const sockaddr* sa, uint16_t connection_id, uint16_t ack_nr) {
+  char buffer[UtpSocket::header_size]{};
+
+  buffer[0] = (UtpSocket::ST_RESET << 4) | UtpSocket::version;
+  buffer[2] = connection_id >> 8;
+  buffer[3] = connection_id;
+  buffer[18] = ack_nr >> 8;
+  buffer[19] = ack_nr;
+
+  send_packet(buffer, sizeof(buffer), sa);
+}
+
+void
+UtpContext::receive_tick() {
+  for (auto& entry : m_sockets)
+    entry.second->tick();
+
+  reap_closed();
+  schedule_tick();
+}
+
+void
+UtpContext::reap_closed() {
+  for (auto itr = m_sockets.begin(); itr != m_sockets.end(); ) {
+    if (!itr->second->is_closed()) {
+      ++itr;
+      continue;
+    }
+
+    auto connecting = m_connecting.find(itr->second.get());
+
+    if (connecting != m_connecting.end()) {
+      if (itr->second->is_connect_failed() && m_slot_connect_failed)
+        m_slot_connect_failed(connecting->second);
+
+      m_connecting.erase(connecting);
+    }
+
+    itr = m_sockets.erase(itr);
+  }
+
+  // Only track outgoing connections until they are established.
+  for (auto itr = m_connecting.begin(); itr != m_connecting.end(); ) {
+    if (itr->first->state() == UtpSocket::STATE_CONNECTED)
+      itr = m_connecting.erase(itr);
+    else
+      ++itr;
+  }
+}
+
+void
+UtpContext::schedule_tick() {
+  if (m_sockets.empty() || m_task_tick.is_scheduled())
+    return;
+
+  this_thread::scheduler()->wait_for(&m_task_tick, 100ms);
+}
+
+} // namespace torrent
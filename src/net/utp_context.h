@@ -0,0 +1,104 @@
+#ifndef LIBTORRENT_NET_UTP_CONTEXT_H
+#define LIBTORRENT_NET_UTP_CONTEXT_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "net/socket_datagram.h"
+#include "torrent/utils/scheduler.h"
+
+namespace torrent {
+
+class UtpSocket;
+
+// Multiplexes uTP connections over one datagram socket, see
+// UtpSocket. Connections are identified by the remote address and
+// our receive connection id.
+class UtpContext : public SocketDatagram {
+public:
+  using socket_map               = std::unordered_map<std::string, std::unique_ptr<UtpSocket>>;
+
+  using slot_accept_filter_type  = std::function<bool(const sockaddr*)>;
+  using slot_accepted_type       = std::function<void(int, const sockaddr*)>;
+  using slot_connect_failed_type = std::function<void(int)>;
+
+  UtpContext();
+  ~UtpContext() override;
+
+  const char*         type_name() const override { return "utp"; }
+
+  bool                is_open() const { return get_fd().is_valid(); }
+
+  // Binds to 'bind_address', including its port. Closing drops all
+  // connections, closing their end of the local socket pairs.
+  bool                open(const sockaddr* bind_address);
+  void                close();
+
+  // Returns a non-blocking stream socket that carries the connection
+  // once established, or -1 with errno set. Data written before the
+  // peer answers is sent after the handshake completes.
+  int                 connect(const sockaddr* sa);
+
+  size_t              size() const { return m_sockets.size(); }
+
+  // Our ends of the local socket pairs still open, which count
+  // against the connection manager's socket limit.
+  uint32_t            bridge_count() const { return m_bridge_count; }
+
+  const socket_map&   sockets() const { return m_sockets; }
+
+  // Called before anything is allocated for an incoming SYN, which is
+  // answered with a reset if it returns false.
+  slot_accept_filter_type&  slot_accept_filter()  { return m_slot_accept_filter; }
+
+  // Takes ownership of the file descriptor for incoming connections.
+  slot_accepted_type&       slot_accepted()       { return m_slot_accepted; }
+
+  // Called with the file descriptor returned by connect() if the peer
+  // never answered, before our end is closed.
+  slot_connect_failed_type& slot_connect_failed() { return m_slot_connect_failed; }
+
+  void                event_read() override;
+  void                event_write() override;
+  void                event_error() override;
+
+  // For UtpSocket.
+  void                send_packet(const char* data, uint32_t length, const sockaddr* sa);
+  void                bridge_closed() { m_bridge_count--; }
+
+  uint64_t            stats_packets_received() const { return m_stats_packets_received; }
+  uint64_t            stats_packets_sent() const     { return m_stats_packets_sent; }
+
+private:
+  static std::string  make_key(const sockaddr* sa, uint16_t id);
+
+  void                receive_packet(const char* data, uint32_t length, const sockaddr* sa);
+  void                receive_syn(const char* data, uint32_t length, const sockaddr* sa);
+  void                send_reset(const sockaddr* sa, uint16_t connection_id, uint16_t ack_nr);
+
+  void                receive_tick();
+  void                reap_closed();
+  void                schedule_tick();
+
+  socket_map                     m_sockets;
+  std::unordered_map<UtpSocket*, int> m_connecting;
+  std::vector<UtpSocket*>        m_received;
+
+  uint32_t                       m_bridge_count{0};
+
+  utils::SchedulerEntry          m_task_tick;
+
+  slot_accept_filter_type        m_slot_accept_filter;
+  slot_accepted_type             m_slot_accepted;
+  slot_connect_failed_type       m_slot_connect_failed;
+
+  uint64_t                       m_stats_packets_received{0};
+  uint64_t                       m_stats_packets_sent{0};
+};
+
+} // namespace torrent
+
+#endif
@@ -0,0 +1,866 @@
+#include "config.h"
+
+#include "net/utp_socket.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+
+#include "net/utp_context.h"
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+#include "torrent/net/fd.h"
+#include "torrent/utils/chrono.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/random.h"
+
+#define LT_LOG_UTP(log_fmt, ...)                                        \
+  lt_log_print(LOG_CONNECTION, "utp->%s:%u: " log_fmt, sa_addr_str(m_address.get()).c_str(), m_recv_id, __VA_ARGS__);
+
+namespace torrent {
+
+static inline void
+put16(char* p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static inline void
+put32(char* p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static inline uint16_t
+get16(const char* p) {
+  auto u = reinterpret_cast<const uint8_t*>(p);
+  return (u[0] << 8) | u[1];
+}
+
+static inline uint32_t
+get32(const char* p) {
+  auto u = reinterpret_cast<const uint8_t*>(p);
+  return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | u[3];
+}
+
+// Sequence numbers wrap, compare by the signed distance.
+static inline bool
+seq_less(uint16_t lhs, uint16_t rhs) {
+  return static_cast<int16_t>(lhs - rhs) < 0;
+}
+
+static inline bool
+seq_less_equal(uint16_t lhs, uint16_t rhs) {
+  return static_cast<int16_t>(lhs - rhs) <= 0;
+}
+
+static inline bool
+delay_less(uint32_t lhs, uint32_t rhs) {
+  return static_cast<int32_t>(lhs - rhs) < 0;
+}
+
+bool
+UtpSocket::read_header(const char* data, uint32_t length, header_type* header) {
+  if (length < header_size)
+    return false;
+
+  auto type_version = static_cast<uint8_t>(data[0]);
+
+  if ((type_version & 0xf) != version || (type_version >> 4) > ST_SYN)
+    return false;
+
+  header->type                 = type_version >> 4;
+  header->extension            = data[1];
+  header->connection_id        = get16(data + 2);
+  header->timestamp            = get32(data + 4);
+  header->timestamp_difference = get32(data + 8);
+  header->wnd_size             = get32(data + 12);
+  header->seq_nr               = get16(data + 16);
+  header->ack_nr               = get16(data + 18);
+
+  return true;
+}
+
+UtpSocket::UtpSocket(UtpContext* context, const sockaddr* sa, uint16_t recv_id, uint16_t send_id, int fd) :
+    m_context(context),
+    m_address(sa_copy(sa)),
+    m_recv_id(recv_id),
+    m_send_id(send_id) {
+  m_fileDesc = fd;
+  m_last_receive = time_usec();
+
+  this_thread::poll()->open(this);
+  this_thread::poll()->insert_read(this);
+  this_thread::poll()->insert_error(this);
+}
+
+UtpSocket::~UtpSocket() {
+  close_bridge();
+}
+
+uint64_t
+UtpSocket::time_usec() {
+  return utils::time_since_epoch().count();
+}
+
+void
+UtpSocket::connect() {
+  LT_LOG_UTP("connecting", 0);
+
+  m_seq_nr = 1;
+  queue_packet(ST_SYN, nullptr, 0);
+  try_send();
+}
+
+void
+UtpSocket::accept(const header_type& syn) {
+  LT_LOG_UTP("accepted", 0);
+
+  m_state = STATE_CONNECTED;
+  m_seq_nr = random_uniform_uint16();
+  m_ack_nr = syn.seq_nr;
+  m_peer_wnd = syn.wnd_size;
+  m_reply_micro = static_cast<uint32_t>(time_usec()) - syn.timestamp;
+
+  send_state();
+}
+
+uint32_t
+UtpSocket::receive_window() const {
+  uint32_t used = m_recv_buffer.size() - m_recv_position + m_reorder_bytes;
+
+  return used < receive_buffer_size ? receive_buffer_size - used : 0;
+}
+
+bool
+UtpSocket::window_allows(uint32_t size) const {
+  // Always allow one packet in flight, unless the peer advertises a
+  // closed window.
+  if (m_cur_window == 0)
+    return m_peer_wnd != 0;
+
+  return m_cur_window + size <= std::min(m_cwnd, m_peer_wnd);
+}
+
+void
+UtpSocket::queue_packet(uint8_t type, const char* data, uint32_t length) {
+  packet_entry packet;
+  packet.seq_nr = m_seq_nr++;
+  packet.type = type;
+  packet.payload.assign(data != nullptr ? data : "", length);
+
+  m_outbuf_bytes += length;
+  m_outbuf.push_back(std::move(packet));
+}
+
+void
+UtpSocket::send_packet(packet_entry& packet, uint64_t now) {
+  char buffer[packet_size];
+
+  buffer[0] = (packet.type << 4) | version;
+  buffer[1] = 0;
+  put16(buffer + 2, packet.type == ST_SYN ? m_recv_id : m_send_id);
+  put32(buffer + 4, now);
+  put32(buffer + 8, m_reply_micro);
+  put32(buffer + 12, receive_window());
+  put16(buffer + 16, packet.seq_nr);
+  put16(buffer + 18, m_ack_nr);
+
+  std::memcpy(buffer + header_size, packet.payload.data(), packet.payload.size());
+
+  m_context->send_packet(buffer, packet.size(), m_address.get());
+
+  if (!packet.sent || packet.need_resend)
+    m_cur_window += packet.size();
+
+  packet.sent = true;
+  packet.need_resend = false;
+  packet.sent_time = now;
+  packet.transmissions++;
+
+  m_last_send = now;
+  m_need_ack = false;
+
+  if (m_rto_deadline == 0)
+    m_rto_deadline = now + m_rto;
+}
+
+void
+UtpSocket::send_state() {
+  char buffer[header_size + 2 + max_sack_bytes];
+  uint32_t length = header_size;
+  uint64_t now = time_usec();
+
+  buffer[0] = (ST_STATE << 4) | version;
+  buffer[1] = 0;
+  put16(buffer + 2, m_send_id);
+  put32(buffer + 4, now);
+  put32(buffer + 8, m_reply_micro);
+  put32(buffer + 12, receive_window());
+  put16(buffer + 16, m_seq_nr);
+  put16(buffer + 18, m_ack_nr);
+
+  if (!m_reorder.empty()) {
+    // Bit 'i' acknowledges 'ack_nr + 2 + i', least significant bit
+    // first.
+    uint32_t highest = 0;
+
+    for (auto& entry : m_reorder)
+      highest = std::max<uint32_t>(highest, static_cast<uint16_t>(entry.first - m_ack_nr - 2));
+
+    uint32_t bytes = std::min((highest / 32 + 1) * 4, max_sack_bytes);
+    auto bits = reinterpret_cast<uint8_t*>(buffer + header_size + 2);
+
+    std::fill(bits, bits + bytes, 0);
+
+    for (auto& entry : m_reorder) {
+      uint32_t index = static_cast<uint16_t>(entry.first - m_ack_nr - 2);
+
+      if (index < bytes * 8)
+        bits[index / 8] |= 1 << (index % 8);
+    }
+
+    buffer[1] = extension_sack;
+    buffer[header_size] = 0;
+    buffer[header_size + 1] = bytes;
+    length += 2 + bytes;
+  }
+
+  m_context->send_packet(buffer, length, m_address.get());
+
+  m_last_send = now;
+  m_need_ack = false;
+}
+
+void
+UtpSocket::send_reset() {
+  char buffer[header_size];
+
+  buffer[0] = (ST_RESET << 4) | version;
+  buffer[1] = 0;
+  put16(buffer + 2, m_send_id);
+  put32(buffer + 4, time_usec());
+  put32(buffer + 8, m_reply_micro);
+  put32(buffer + 12, 0);
+  put16(buffer + 16, m_seq_nr);
+  put16(buffer + 18, m_ack_nr);
+
+  m_context->send_packet(buffer, header_size, m_address.get());
+}
+
+void
+UtpSocket::try_send() {
+  if (m_state == STATE_CLOSED)
+    return;
+
+  uint64_t now = time_usec();
+  auto itr = m_outbuf.begin();
+
+  m_cwnd_limited = false;
+
+  // Retransmissions go first, oldest first.
+  for (auto last = itr + m_sent_count; itr != last; ++itr) {
+    if (!itr->need_resend || itr->acked)
+      continue;
+
+    if (!window_allows(itr->size())) {
+      m_cwnd_limited = true;
+      return;
+    }
+
+    send_packet(*itr, now);
+  }
+
+  for (; itr != m_outbuf.end(); ++itr) {
+    if (m_state == STATE_SYN_SENT && itr->type != ST_SYN)
+      return;
+
+    if (!window_allows(itr->size())) {
+      m_cwnd_limited = true;
+
+      // Probe a closed window when the retransmission timer fires.
+      if (m_rto_deadline == 0)
+        m_rto_deadline = now + m_rto;
+
+      return;
+    }
+
+    send_packet(*itr, now);
+    m_sent_count++;
+  }
+}
+
+void
+UtpSocket::receive(const header_type& header, const char* data, uint32_t length) {
+  if (m_state == STATE_CLOSED)
+    return;
+
+  // Walk the extension chain once, finding the selective acks and
+  // where the payload starts. Packets with a truncated chain are
+  // dropped.
+  const uint8_t* sack = nullptr;
+  uint32_t sack_length = 0;
+  uint8_t extension = header.extension;
+  uint32_t offset = header_size;
+
+  while (extension != 0) {
+    uint32_t ext_length = offset + 2 <= length ? static_cast<uint8_t>(data[offset + 1]) : 0;
+
+    if (offset + 2 + ext_length > length) {
+      LT_LOG_UTP("dropped packet with malformed extensions", 0);
+      return;
+    }
+
+    if (extension == extension_sack) {
+      sack = reinterpret_cast<const uint8_t*>(data + offset + 2);
+      sack_length = ext_length;
+    }
+
+    extension = data[offset];
+    offset += 2 + ext_length;
+  }
+
+  uint64_t now = time_usec();
+
+  m_last_receive = now;
+  m_reply_micro = static_cast<uint32_t>(now) - header.timestamp;
+  m_peer_wnd = header.wnd_size;
+
+  if (header.type == ST_RESET) {
+    LT_LOG_UTP("received reset", 0);
+
+    m_connect_failed = m_state == STATE_SYN_SENT;
+    set_closed();
+    return;
+  }
+
+  if (header.type == ST_SYN) {
+    // Our reply was lost, the initiator retransmitted its SYN.
+    if (m_state == STATE_CONNECTED && header.seq_nr == m_ack_nr)
+      send_state();
+
+    return;
+  }
+
+  if (m_state == STATE_SYN_SENT) {
+    if (header.type != ST_STATE || header.ack_nr != m_outbuf.front().seq_nr)
+      return;
+
+    LT_LOG_UTP("connected", 0);
+
+    m_state = STATE_CONNECTED;
+    m_ack_nr = header.seq_nr - 1;
+  }
+
+  receive_ack(header, sack, sack_length, now);
+
+  switch (header.type) {
+  case ST_DATA:
+    receive_data(header.seq_nr, data + offset, length - offset);
+    break;
+
+  case ST_FIN:
+    if (!m_got_fin) {
+      m_got_fin = true;
+      m_fin_seq_nr = header.seq_nr;
+    }
+
+    receive_data(header.seq_nr, "", 0);
+    break;
+
+  default:
+    break;
+  }
+
+  try_send();
+
+  if (m_read_blocked && !m_local_eof && m_outbuf_bytes < send_buffer_size / 2) {
+    m_read_blocked = false;
+    this_thread::poll()->insert_read(this);
+  }
+
+  check_closed();
+}
+
+void
+UtpSocket::receive_ack(const header_type& header, const uint8_t* sack, uint32_t sack_length, uint64_t now) {
+  // Ignore acknowledgements of packets we never sent.
+  if (m_outbuf.empty() || m_sent_count == 0 ||
+      seq_less(header.ack_nr, m_outbuf.front().seq_nr - 1) ||
+      !seq_less(header.ack_nr, m_outbuf[m_sent_count - 1].seq_nr + 1)) {
+    m_last_ack_nr = header.ack_nr;
+    return;
+  }
+
+  uint32_t acked_bytes = 0;
+
+  while (m_sent_count != 0 && seq_less_equal(m_outbuf.front().seq_nr, header.ack_nr)) {
+    auto& packet = m_outbuf.front();
+
+    acked_packet(packet, now, acked_bytes);
+
+    if (packet.type == ST_FIN) {
+      m_fin_acked = true;
+      m_fin_acked_time = now;
+    }
+
+    m_outbuf_bytes -= packet.payload.size();
+    m_outbuf.pop_front();
+    m_sent_count--;
+  }
+
+  bool cumulative = acked_bytes != 0;
+
+  if (sack != nullptr)
+    receive_sack(header.ack_nr, sack, sack_length, now, acked_bytes);
+
+  if (!cumulative && header.type == ST_STATE && header.ack_nr == m_last_ack_nr && m_sent_count != 0) {
+    if (++m_dup_acks == 3 && !m_outbuf.front().acked && !m_outbuf.front().need_resend)
+      lost_packet(m_outbuf.front());
+  } else if (cumulative) {
+    m_dup_acks = 0;
+  }
+
+  m_last_ack_nr = header.ack_nr;
+
+  if (acked_bytes == 0)
+    return;
+
+  m_timeouts = 0;
+  m_rto_deadline = m_cur_window != 0 ? now + m_rto : 0;
+
+  if (header.timestamp_difference != 0)
+    update_cwnd(header.timestamp_difference, acked_bytes, now);
+}
+
+void
+UtpSocket::receive_sack(uint16_t ack_nr, const uint8_t* bits, uint32_t length, uint64_t now, uint32_t& acked_bytes) {
+  if (m_sent_count == 0)
+    return;
+
+  uint16_t first = m_outbuf.front().seq_nr;
+  uint32_t sacked_after = 0;
+
+  // Walk backwards so packets with three or more selectively acked
+  // packets after them are considered lost, as with duplicate acks.
+  for (int index = length * 8 - 1; index >= 0; index--) {
+    uint32_t position = static_cast<uint16_t>(ack_nr + 2 + index - first);
+
+    if (position >= m_sent_count)
+      continue;
+
+    auto& packet = m_outbuf[position];
+
+    if (bits[index / 8] & (1 << (index % 8))) {
+      acked_packet(packet, now, acked_bytes);
+      sacked_after++;
+      continue;
+    }
+
+    if (sacked_after >= 3 && !packet.acked && !packet.need_resend && packet.transmissions == 1)
+      lost_packet(packet);
+  }
+
+  // The packet at 'ack_nr + 1' is not covered by the bitfield.
+  if (sacked_after >= 3 && !m_outbuf.front().acked && !m_outbuf.front().need_resend && m_outbuf.front().transmissions == 1)
+    lost_packet(m_outbuf.front());
+}
+
+void
+UtpSocket::acked_packet(packet_entry& packet, uint64_t now, uint32_t& acked_bytes) {
+  if (packet.acked)
+    return;
+
+  packet.acked = true;
+
+  if (!packet.need_resend)
+    m_cur_window -= packet.size();
+
+  acked_bytes += packet.size();
+
+  // Only packets sent once give an unambiguous sample.
+  if (packet.transmissions == 1)
+    update_rtt(now - packet.sent_time);
+}
+
+void
+UtpSocket::lost_packet(packet_entry& packet) {
+  packet.need_resend = true;
+  m_cur_window -= packet.size();
+
+  // Halve the window once per window of data.
+  if (seq_less(m_loss_seq_nr, packet.seq_nr)) {
+    m_cwnd = std::max(m_cwnd / 2, min_cwnd);
+    m_loss_seq_nr = m_seq_nr;
+  }
+}
+
+void
+UtpSocket::update_rtt(uint64_t sample) {
+  if (m_rtt == 0) {
+    m_rtt = sample;
+    m_rtt_var = sample / 2;
+  } else {
+    int64_t delta = static_cast<int64_t>(m_rtt) - static_cast<int64_t>(sample);
+
+    m_rtt_var += (std::abs(delta) - static_cast<int64_t>(m_rtt_var)) / 4;
+    m_rtt += (static_cast<int64_t>(sample) - static_cast<int64_t>(m_rtt)) / 8;
+  }
+
+  m_rto = std::clamp(m_rtt + 4 * m_rtt_var, min_rto, max_rto);
+}
+
+// LEDBAT, with the base delay kept as the minimum over the last two
+// minutes so clock drift and route changes age out.
+void
+UtpSocket::update_cwnd(uint32_t delay_sample, uint32_t acked_bytes, uint64_t now) {
+  if (now >= m_base_delay_rotate) {
+    m_base_delay_index = (m_base_delay_index + 1) % m_base_delay.size();
+    m_base_delay[m_base_delay_index] = delay_sample;
+    m_base_delay_rotate = now + 60000000;
+
+    if (m_base_delay[(m_base_delay_index + 1) % m_base_delay.size()] == 0)
+      m_base_delay.fill(delay_sample);
+
+  } else if (delay_less(delay_sample, m_base_delay[m_base_delay_index])) {
+    m_base_delay[m_base_delay_index] = delay_sample;
+  }
+
+  uint32_t base_delay = m_base_delay[0];
+
+  for (auto delay : m_base_delay)
+    if (delay_less(delay, base_delay))
+      base_delay = delay;
+
+  int64_t our_delay = std::min<uint32_t>(delay_sample - base_delay, 10 * target_delay);
+
+  double off_target = static_cast<double>(static_cast<int64_t>(target_delay) - our_delay) / target_delay;
+  double window_factor = static_cast<double>(std::min(acked_bytes, m_cwnd)) / std::max(m_cwnd, acked_bytes);
+  double gain = max_cwnd_increase * off_target * window_factor;
+
+  // Don't grow a window the sender isn't using.
+  if (gain > 0 && !m_cwnd_limited)
+    return;
+
+  int64_t cwnd = static_cast<int64_t>(m_cwnd) + static_cast<int64_t>(gain);
+  m_cwnd = std::clamp<int64_t>(cwnd, min_cwnd, max_cwnd);
+}
+
+void
+UtpSocket::receive_data(uint16_t seq_nr, const char* data, uint32_t length) {
+  m_need_ack = true;
+
+  if (seq_less_equal(seq_nr, m_ack_nr))
+    return;
+
+  uint16_t distance = seq_nr - m_ack_nr - 1;
+
+  if (distance != 0) {
+    if (distance >= max_sack_bytes * 8 || length > receive_window() || m_reorder.count(seq_nr) != 0)
+      return;
+
+    m_reorder.emplace(seq_nr, std::string(data, length));
+    m_reorder_bytes += length;
+    return;
+  }
+
+  if (length > receive_window())
+    return;
+
+  deliver(data, length);
+  m_ack_nr = seq_nr;
+
+  for (auto itr = m_reorder.find(m_ack_nr + 1); itr != m_reorder.end(); itr = m_reorder.find(m_ack_nr + 1)) {
+    m_reorder_bytes -= itr->second.size();
+    deliver(itr->second.data(), itr->second.size());
+
+    m_ack_nr++;
+    m_reorder.erase(itr);
+  }
+
+  if (m_got_fin && seq_less_equal(m_fin_seq_nr, m_ack_nr)) {
+    LT_LOG_UTP("received fin", 0);
+
+    m_remote_eof = true;
+    m_reorder.clear();
+    m_reorder_bytes = 0;
+
+    flush_bridge();
+  }
+}
+
+void
+UtpSocket::deliver(const char* data, uint32_t length) {
+  if (length == 0 || m_fileDesc == -1)
+    return;
+
+  bool was_empty = m_recv_buffer.size() == m_recv_position;
+
+  m_recv_buffer.append(data, length);
+
+  if (was_empty)
+    flush_bridge();
+}
+
+void
+UtpSocket::flush_bridge() {
+  if (m_fileDesc == -1)
+    return;
+
+  uint32_t previous_window = receive_window();
+
+  while (m_recv_position != m_recv_buffer.size()) {
+    int r = ::send(m_fileDesc, m_recv_buffer.data() + m_recv_position, m_recv_buffer.size() - m_recv_position, MSG_NOSIGNAL);
+
+    if (r == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        break;
+
+      // The local side is gone and can't receive more data.
+      LT_LOG_UTP("local socket closed with data pending : %s", std::strerror(errno));
+
+      send_reset();
+      set_closed();
+      return;
+    }
+
+    m_recv_position += r;
+  }
+
+  if (m_recv_position == m_recv_buffer.size()) {
+    m_recv_buffer.clear();
+    m_recv_position = 0;
+
+    this_thread::poll()->remove_write(this);
+
+    if (m_remote_eof && !m_bridge_shutdown) {
+      m_bridge_shutdown = true;
+      ::shutdown(m_fileDesc, SHUT_WR);
+    }
+
+  } else {
+    if (m_recv_position > receive_buffer_size / 2) {
+      m_recv_buffer.erase(0, m_recv_position);
+      m_recv_position = 0;
+    }
+
+    this_thread::poll()->insert_write(this);
+  }
+
+  // Let the peer know the window opened again.
+  if (previous_window < packet_size && receive_window() >= packet_size && m_state == STATE_CONNECTED)
+    send_state();
+}
+
+void
+UtpSocket::flush_ack() {
+  if (m_need_ack && m_state == STATE_CONNECTED)
+    send_state();
+}
+
+void
+UtpSocket::tick() {
+  if (m_state == STATE_CLOSED)
+    return;
+
+  uint64_t now = time_usec();
+
+  if (m_rto_deadline != 0 && now >= m_rto_deadline)
+    timeout(now);
+
+  if (m_state == STATE_CLOSED)
+    return;
+
+  if (now - m_last_receive >= idle_timeout) {
+    LT_LOG_UTP("idle timeout", 0);
+
+    send_reset();
+    set_closed();
+    return;
+  }
+
+  if (m_fin_acked && now - m_fin_acked_time >= linger_timeout) {
+    set_closed();
+    return;
+  }
+
+  if (m_state == STATE_CONNECTED && now - m_last_send >= keepalive_interval)
+    send_state();
+}
+
+void
+UtpSocket::timeout(uint64_t now) {
+  m_rto_deadline = 0;
+
+  // Nothing in flight, the window was closed. Probe it with one
+  // packet.
+  if (m_cur_window == 0 && std::none_of(m_outbuf.begin(), m_outbuf.begin() + m_sent_count, [](auto& p) { return !p.acked; })) {
+    if (m_sent_count != m_outbuf.size() && m_peer_wnd < packet_size)
+      m_peer_wnd = packet_size;
+
+    try_send();
+    return;
+  }
+
+  m_timeouts++;
+
+  if (m_timeouts > (m_state == STATE_SYN_SENT ? max_syn_timeouts : max_timeouts)) {
+    LT_LOG_UTP("timed out : state:%i", m_state);
+
+    m_connect_failed = m_state == STATE_SYN_SENT;
+
+    if (!m_connect_failed)
+      send_reset();
+
+    set_closed();
+    return;
+  }
+
+  m_rto = std::min(m_rto * 2, max_rto);
+  m_cwnd = min_cwnd;
+  m_loss_seq_nr = m_seq_nr;
+
+  for (auto itr = m_outbuf.begin(), last = itr + m_sent_count; itr != last; ++itr) {
+    if (itr->acked || itr->need_resend)
+      continue;
+
+    itr->need_resend = true;
+    m_cur_window -= itr->size();
+  }
+
+  try_send();
+
+  if (m_rto_deadline == 0)
+    m_rto_deadline = now + m_rto;
+}
+
+void
+UtpSocket::event_read() {
+  char buffer[64 << 10];
+
+  while (m_outbuf_bytes < send_buffer_size) {
+    int r = ::recv(m_fileDesc, buffer, std::min<uint32_t>(sizeof(buffer), send_buffer_size - m_outbuf_bytes), 0);
+
+    if (r == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        break;
+
+      LT_LOG_UTP("local socket error : %s", std::strerror(errno));
+
+      send_reset();
+      set_closed();
+      return;
+    }
+
+    if (r == 0) {
+      close_bridge_read();
+      break;
+    }
+
+    // Fill up the last unsent packet before starting a new one.
+    const char* position = buffer;
+    const char* last = buffer + r;
+
+    if (m_sent_count != m_outbuf.size() && m_outbuf.back().type == ST_DATA && m_outbuf.back().payload.size() < payload_size) {
+      uint32_t length = std::min<uint32_t>(payload_size - m_outbuf.back().payload.size(), last - position);
+
+      m_outbuf.back().payload.append(position, length);
+      m_outbuf_bytes += length;
+      position += length;
+    }
+
+    while (position != last) {
+      uint32_t length = std::min<uint32_t>(payload_size, last - position);
+
+      queue_packet(ST_DATA, position, length);
+      position += length;
+    }
+  }
+
+  if (!m_local_eof && m_outbuf_bytes >= send_buffer_size) {
+    m_read_blocked = true;
+    this_thread::poll()->remove_read(this);
+  }
+
+  try_send();
+}
+
+void
+UtpSocket::event_write() {
+  flush_bridge();
+}
+
+void
+UtpSocket::event_error() {
+  LT_LOG_UTP("local socket error event", 0);
+
+  send_reset();
+  set_closed();
+}
+
+// The local side closed or shut down writing, send a FIN after the
+// queued data.
+void
+UtpSocket::close_bridge_read() {
+  if (m_local_eof)
+    return;
+
+  LT_LOG_UTP("local eof, sending fin", 0);
+
+  m_local_eof = true;
+  this_thread::poll()->remove_read(this);
+
+  if (m_state == STATE_SYN_SENT && m_sent_count == 0) {
+    set_closed();
+    return;
+  }
+
+  queue_packet(ST_FIN, nullptr, 0);
+}
+
+void
+UtpSocket::check_closed() {
+  if (m_state == STATE_CLOSED)
+    return;
+
+  if (!m_fin_acked || !m_remote_eof || !m_bridge_shutdown)
+    return;
+
+  // Acknowledge the peer's FIN before forgetting the connection.
+  if (m_need_ack)
+    send_state();
+
+  set_closed();
+}
+
+void
+UtpSocket::set_closed() {
+  if (m_state == STATE_CLOSED)
+    return;
+
+  m_state = STATE_CLOSED;
+  m_rto_deadline = 0;
+
+  // Closing our end is how the local side learns of failures, any
+  // undelivered data is lost.
+  close_bridge();
+}
+
+void
+UtpSocket::close_bridge() {
+  if (m_fileDesc == -1)
+    return;
+
+  this_thread::poll()->remove_and_close(this);
+
+  fd_close(m_fileDesc);
+  m_fileDesc = -1;
+
+  m_context->bridge_closed();
+}
+
+} // namespace torrent
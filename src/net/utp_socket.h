@@ -0,0 +1,222 @@
+#ifndef LIBTORRENT_NET_UTP_SOCKET_H
+#define LIBTORRENT_NET_UTP_SOCKET_H
+
+#include <array>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+#include "net/socket_base.h"
+#include "torrent/net/socket_address.h"
+
+namespace torrent {
+
+class UtpContext;
+
+// A single uTP (BEP 29) connection, multiplexed by UtpContext over a
+// shared datagram socket.
+//
+// The connection is exposed to the rest of the library as one end of
+// a local stream socket pair, so Handshake and the PeerConnection
+// classes use it like any TCP socket. This socket owns the other end,
+// packetizing what is read from it and writing the received in-order
+// stream back.
+//
+// Congestion control is LEDBAT (RFC 6817), using the one-way delay
+// echoed by the peer to keep queuing delay near 'target_delay', and
+// halving the window on loss. Out-of-order packets are reported with
+// the selective ACK extension.
+class UtpSocket : public SocketBase {
+public:
+  enum packet_type : uint8_t {
+    ST_DATA  = 0,
+    ST_FIN   = 1,
+    ST_STATE = 2,
+    ST_RESET = 3,
+    ST_SYN   = 4
+  };
+
+  enum state_type {
+    STATE_SYN_SENT,
+    STATE_CONNECTED,
+    STATE_CLOSED
+  };
+
+  struct header_type {
+    uint8_t  type;
+    uint8_t  extension;
+    uint16_t connection_id;
+    uint32_t timestamp;
+    uint32_t timestamp_difference;
+    uint32_t wnd_size;
+    uint16_t seq_nr;
+    uint16_t ack_nr;
+  };
+
+  static constexpr uint8_t  version               = 1;
+  static constexpr uint8_t  extension_sack        = 1;
+
+  static constexpr uint32_t header_size           = 20;
+  static constexpr uint32_t payload_size          = 1200;
+  static constexpr uint32_t packet_size           = header_size + payload_size;
+
+  static constexpr uint32_t send_buffer_size      = 512 << 10;
+  static constexpr uint32_t receive_buffer_size   = 512 << 10;
+
+  static constexpr uint32_t min_cwnd              = 2 * packet_size;
+  static constexpr uint32_t max_cwnd              = 4 << 20;
+  static constexpr uint32_t max_cwnd_increase     = 3000;
+
+  static constexpr uint32_t target_delay          = 100000;
+
+  static constexpr uint64_t min_rto               = 500000;
+  static constexpr uint64_t max_rto               = 60000000;
+  static constexpr uint64_t keepalive_interval    = 29000000;
+  static constexpr uint64_t idle_timeout          = 90000000;
+  static constexpr uint64_t linger_timeout        = 30000000;
+
+  static constexpr uint32_t max_syn_timeouts      = 3;
+  static constexpr uint32_t max_timeouts          = 6;
+  static constexpr uint32_t max_sack_bytes        = 32;
+
+  // Returns false if the datagram is not a valid uTP packet.
+  static bool         read_header(const char* data, uint32_t length, header_type* header);
+
+  UtpSocket(UtpContext* context, const sockaddr* sa, uint16_t recv_id, uint16_t send_id, int fd);
+  ~UtpSocket() override;
+
+  const char*         type_name() const override { return "utp"; }
+
+  state_type          state() const              { return m_state; }
+  bool                is_closed() const          { return m_state == STATE_CLOSED; }
+
+  // True if an outgoing connection was never acknowledged by the
+  // peer.
+  bool                is_connect_failed() const  { return m_connect_failed; }
+
+  const sockaddr*     address() const            { return m_address.get(); }
+  uint16_t            recv_id() const            { return m_recv_id; }
+
+  uint32_t            cwnd() const               { return m_cwnd; }
+  uint64_t            rtt() const                { return m_rtt; }
+
+  void                connect();
+  void                accept(const header_type& syn);
+
+  // Called once per datagram addressed to this connection, and
+  // periodically by UtpContext to handle timeouts.
+  void                receive(const header_type& header, const char* data, uint32_t length);
+  void                tick();
+
+  // Sends an ACK if one is owed. Called after a batch of datagrams so
+  // consecutive data packets are acknowledged once.
+  void                flush_ack();
+
+  void                event_read() override;
+  void                event_write() override;
+  void                event_error() override;
+
+private:
+  struct packet_entry {
+    uint16_t    seq_nr;
+    uint8_t     type;
+    bool        sent{false};
+    bool        need_resend{false};
+    bool        acked{false};
+    uint32_t    transmissions{0};
+    uint64_t    sent_time{0};
+    std::string payload;
+
+    uint32_t    size() const { return header_size + payload.size(); }
+  };
+
+  static uint64_t     time_usec();
+
+  uint32_t            receive_window() const;
+  bool                window_allows(uint32_t size) const;
+
+  void                queue_packet(uint8_t type, const char* data, uint32_t length);
+  void                send_packet(packet_entry& packet, uint64_t now);
+  void                send_state();
+  void                send_reset();
+  void                try_send();
+
+  void                receive_ack(const header_type& header, const uint8_t* sack, uint32_t sack_length, uint64_t now);
+  void                receive_sack(uint16_t ack_nr, const uint8_t* bits, uint32_t length, uint64_t now, uint32_t& acked_bytes);
+  void                receive_data(uint16_t seq_nr, const char* data, uint32_t length);
+
+  void                acked_packet(packet_entry& packet, uint64_t now, uint32_t& acked_bytes);
+  void                lost_packet(packet_entry& packet);
+
+  void                update_rtt(uint64_t sample);
+  void                update_cwnd(uint32_t delay_sample, uint32_t acked_bytes, uint64_t now);
+
+  void                timeout(uint64_t now);
+
+  void                deliver(const char* data, uint32_t length);
+  void                flush_bridge();
+  void                close_bridge();
+  void                close_bridge_read();
+
+  void                check_closed();
+  void                set_closed();
+
+  UtpContext*         m_context;
+  sa_unique_ptr       m_address;
+
+  state_type          m_state{STATE_SYN_SENT};
+  bool                m_connect_failed{false};
+
+  uint16_t            m_recv_id;
+  uint16_t            m_send_id;
+  uint16_t            m_seq_nr{1};
+  uint16_t            m_ack_nr{0};
+
+  // Sent and unsent packets in sequence order, the first
+  // 'm_sent_count' having been sent at least once.
+  std::deque<packet_entry> m_outbuf;
+  uint32_t            m_outbuf_bytes{0};
+  uint32_t            m_sent_count{0};
+  uint32_t            m_cur_window{0};
+
+  uint32_t            m_cwnd{min_cwnd};
+  bool                m_cwnd_limited{false};
+  uint32_t            m_peer_wnd{packet_size};
+  uint16_t            m_loss_seq_nr{0};
+  uint16_t            m_last_ack_nr{0};
+  uint32_t            m_dup_acks{0};
+
+  uint64_t            m_rtt{0};
+  uint64_t            m_rtt_var{0};
+  uint64_t            m_rto{1000000};
+  uint64_t            m_rto_deadline{0};
+  uint32_t            m_timeouts{0};
+
+  std::array<uint32_t, 2> m_base_delay{};
+  unsigned int        m_base_delay_index{0};
+  uint64_t            m_base_delay_rotate{0};
+
+  uint32_t            m_reply_micro{0};
+  uint64_t            m_last_send{0};
+  uint64_t            m_last_receive{0};
+
+  std::string         m_recv_buffer;
+  uint32_t            m_recv_position{0};
+  std::unordered_map<uint16_t, std::string> m_reorder;
+  uint32_t            m_reorder_bytes{0};
+  bool                m_need_ack{false};
+
+  bool                m_read_blocked{false};
+  bool                m_local_eof{false};
+  bool                m_fin_acked{false};
+  uint64_t            m_fin_acked_time{0};
+
+  bool                m_got_fin{false};
+  uint16_t            m_fin_seq_nr{0};
+  bool                m_remote_eof{false};
+  bool                m_bridge_shutdown{false};
+};
+
+} // namespace torrent
+
+#endif
@@ -37,16 +37,19 @@
 #ifndef LIBTORRENT_PROTOCOL_ENCRYPTION_H
 #define LIBTORRENT_PROTOCOL_ENCRYPTION_H
 
+#include <memory>
+
 #include "utils/rc4.h"
+#include "utils/rc4_prefetch.h"
 
 namespace torrent {
 
 class EncryptionInfo {
 public:
-  void                encrypt(const void *indata, void *outdata, unsigned int length) { m_encrypt.crypt(indata, outdata, length); }
-  void                encrypt(void *data, unsigned int length)                        { m_encrypt.crypt(data, length); }
-  void                decrypt(const void *indata, void *outdata, unsigned int length) { m_decrypt.crypt(indata, outdata, length); }
-  void                decrypt(void *data, unsigned int length)                        { m_decrypt.crypt(data, length); }
+  void                encrypt(const void *indata, void *outdata, unsigned int length);
+  void                encrypt(void *data, unsigned int length)                        { encrypt(data, data, length); }
+  void                decrypt(const void *indata, void *outdata, unsigned int length);
+  void                decrypt(void *data, unsigned int length)                        { decrypt(data, data, length); }
 
   bool                is_encrypted() const              { return m_encrypted; }
   bool                is_obfuscated() const             { return m_obfuscated; }
@@ -56,6 +59,11 @@ public:
   void                set_encrypt(const RC4& encrypt)   { m_encrypt = encrypt; m_encrypted = m_obfuscated = true; }
   void                set_decrypt(const RC4& decrypt)   { m_decrypt = decrypt; m_decryptValid = true; }
 
+  // Generate the keystreams on the queue's workers from now on.
+  // Copies share the prefetched streams, so only call this on the
+  // final copy.
+  void                start_prefetch(CryptoQueue* queue);
+
 private:
   bool                m_encrypted{false};
   bool                m_obfuscated{false};
@@ -63,8 +71,36 @@ private:
 
   RC4                 m_encrypt;
   RC4                 m_decrypt;
+
+  std::shared_ptr<RC4Prefetch> m_encrypt_prefetch;
+  std::shared_ptr<RC4Prefetch> m_decrypt_prefetch;
 };
 
+inline void
+EncryptionInfo::encrypt(const void *indata, void *outdata, unsigned int length) {
+  if (m_encrypt_prefetch != nullptr)
+    m_encrypt_prefetch->crypt(indata, outdata, length);
+  else
+    m_encrypt.crypt(indata, outdata, length);
+}
+
+inline void
+EncryptionInfo::decrypt(const void *indata, void *outdata, unsigned int length) {
+  if (m_decrypt_prefetch != nullptr)
+    m_decrypt_prefetch->crypt(indata, outdata, length);
+  else
+    m_decrypt.crypt(indata, outdata, length);
+}
+
+inline void
+EncryptionInfo::start_prefetch(CryptoQueue* queue) {
+  if (m_encrypted)
+    m_encrypt_prefetch = std::make_shared<RC4Prefetch>(m_encrypt, queue);
+
+  if (m_decryptValid)
+    m_decrypt_prefetch = std::make_shared<RC4Prefetch>(m_decrypt, queue);
+}
+
 } // namespace torrent
 
 #endif
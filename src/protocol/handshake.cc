@@ -985,7 +985,7 @@ Handshake::prepare_proxy_connect() {
 
 void
 Handshake::prepare_key_plus_pad() {
-  if (!m_encryption.initialize())
+  if (!m_encryption.initialize(manager->connection_manager()->diffie_hellman_pool()))
     throw handshake_error(ConnectionManager::handshake_failed, e_handshake_invalid_value);
 
   m_encryption.key()->store_pub_key(m_writeBuffer.end(), 96);
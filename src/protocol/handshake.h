@@ -69,6 +69,10 @@ public:
 
   State               state() const                 { return m_state; }
 
+  // Set for connections carried over uTP, see UtpSocket.
+  bool                is_utp() const                { return m_utp; }
+  void                set_utp(bool state)           { m_utp = state; }
+
   void                initialize_incoming(const sockaddr* sa);
   void                initialize_outgoing(const sockaddr* sa, DownloadMain* d, PeerInfo* peerInfo);
 
@@ -158,6 +162,7 @@ protected:
   bool                m_writeDone{false};
 
   bool                m_incoming;
+  bool                m_utp{false};
 
   c_sa_unique_ptr     m_address;
   char                m_options[8];
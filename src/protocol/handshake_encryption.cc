@@ -4,6 +4,7 @@
 
 #include "torrent/net/network_config.h"
 #include "utils/diffie_hellman.h"
+#include "utils/diffie_hellman_pool.h"
 #include "utils/sha1.h"
 
 namespace torrent {
@@ -32,8 +33,8 @@ HandshakeEncryption::HandshakeEncryption(int options) :
 }
 
 bool
-HandshakeEncryption::initialize() {
-  m_key = std::make_unique<DiffieHellman>(dh_prime, dh_prime_length, dh_generator, dh_generator_length);
+HandshakeEncryption::initialize(DiffieHellmanPool* pool) {
+  m_key = pool->take();
 
   return m_key->is_valid();
 }
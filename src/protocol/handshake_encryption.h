@@ -45,6 +45,7 @@
 namespace torrent {
 
 class DiffieHellman;
+class DiffieHellmanPool;
 
 class HandshakeEncryption {
 public:
@@ -93,7 +94,7 @@ public:
   unsigned int        length_ia() const                            { return m_lengthIA; }
   void                set_length_ia(unsigned int len)              { m_lengthIA = len; }
 
-  bool                initialize();
+  bool                initialize(DiffieHellmanPool* pool);
   void                cleanup();
 
   void                initialize_decrypt(const char* origHash, bool incoming);
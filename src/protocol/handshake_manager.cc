@@ -6,6 +6,7 @@
 #include "manager.h"
 #include "peer_connection_base.h"
 #include "download/download_main.h"
+#include "net/utp_context.h"
 #include "torrent/connection_manager.h"
 #include "torrent/download_info.h"
 #include "torrent/error.h"
@@ -112,17 +113,50 @@ HandshakeManager::add_incoming(int fd, const sockaddr* sa) {
   base_type::push_back(std::move(handshake));
 }
 
+// Called by UtpContext before it allocates the connection and local
+// socket pair for an incoming SYN.
+bool
+HandshakeManager::filter_incoming_utp(const sockaddr* sa) {
+  if (!manager->connection_manager()->can_connect()) {
+    LT_LOG_SA(sa, "rejected incoming utp connection: rejected by connection manager", 0);
+    return false;
+  }
+
+  if (!manager->connection_manager()->filter(sa)) {
+    LT_LOG_SA(sa, "rejected incoming utp connection: filtered", 0);
+    return false;
+  }
+
+  return true;
+}
+
+// The file descriptor is our end of the local socket pair bridging a
+// uTP connection, so socket options do not apply. The connection was
+// already checked by filter_incoming_utp().
+void
+HandshakeManager::add_incoming_utp(int fd, const sockaddr* sa) {
+  LT_LOG_SA(sa, "accepted incoming utp connection: fd:%i", fd);
+
+  manager->connection_manager()->inc_socket_count();
+
+  auto handshake = std::make_unique<Handshake>(fd, this, config::network_config()->encryption_options());
+  handshake->set_utp(true);
+  handshake->initialize_incoming(sa);
+
+  base_type::push_back(std::move(handshake));
+}
+
 void
 HandshakeManager::add_outgoing(const sockaddr* sa, DownloadMain* download) {
   if (!manager->connection_manager()->can_connect() ||
       !manager->connection_manager()->filter(sa))
     return;
 
-  create_outgoing(sa, download, config::network_config()->encryption_options());
+  create_outgoing(sa, download, config::network_config()->encryption_options(), manager->connection_manager()->utp()->is_open());
 }
 
 void
-HandshakeManager::create_outgoing(const sockaddr* sa, DownloadMain* download, int encryption_options) {
+HandshakeManager::create_outgoing(const sockaddr* sa, DownloadMain* download, int encryption_options, bool utp) {
   int connection_options = PeerList::connect_keep_handshakes;
 
   if (!(encryption_options & net::NetworkConfig::encryption_retrying))
@@ -141,6 +175,7 @@ HandshakeManager::create_outgoing(const sockaddr* sa, DownloadMain* download, in
   if (proxy_address->sa_family != AF_UNSPEC) {
     connect_address = sa_copy(proxy_address.get());
     encryption_options |= net::NetworkConfig::encryption_use_proxy;
+    utp = false;
   }
 
   SocketFd fd;
@@ -175,7 +210,18 @@ HandshakeManager::create_outgoing(const sockaddr* sa, DownloadMain* download, in
       return true;
     };
 
-  if (!prepare_fd()) {
+  auto prepare_utp_fd = [&fd, &connect_address]() {
+      fd = SocketFd(manager->connection_manager()->utp()->connect(connect_address.get()));
+
+      if (!fd.is_valid()) {
+        LT_LOG_SAP(connect_address, "could not create outgoing utp connection: %s", std::strerror(errno));
+        return false;
+      }
+
+      return true;
+    };
+
+  if (!(utp ? prepare_utp_fd() : prepare_fd())) {
     if (fd.is_valid())
       fd.close();
 
@@ -192,10 +238,11 @@ HandshakeManager::create_outgoing(const sockaddr* sa, DownloadMain* download, in
   else
     message = ConnectionManager::handshake_outgoing;
 
-  LT_LOG_SA(sa, "created outgoing connection: fd:%i encryption:%x message:%x", fd.get_fd(), encryption_options, message);
+  LT_LOG_SA(sa, "created outgoing connection: fd:%i encryption:%x message:%x utp:%i", fd.get_fd(), encryption_options, message, utp);
   manager->connection_manager()->inc_socket_count();
 
   auto handshake = std::make_unique<Handshake>(fd.get_fd(), this, encryption_options);
+  handshake->set_utp(utp);
   handshake->initialize_outgoing(sa, download, peer_info);
 
   base_type::push_back(std::move(handshake));
@@ -276,10 +323,38 @@ HandshakeManager::receive_failed(Handshake* handshake, int message, int error) {
 
     LT_LOG_SA(sa, "Retrying %s.", retry_options & net::NetworkConfig::encryption_try_outgoing ? "encrypted" : "plaintext");
 
-    create_outgoing(sa, download, retry_options);
+    create_outgoing(sa, download, retry_options, handshake->is_utp());
   }
 }
 
+// Peers that do not answer over uTP are retried over TCP.
+void
+HandshakeManager::receive_utp_failed(int fd) {
+  auto itr = std::find_if(base_type::begin(), base_type::end(), [fd](auto& h) {
+      return h->is_utp() && h->get_fd().get_fd() == fd;
+    });
+
+  if (itr == base_type::end())
+    return;
+
+  Handshake* handshake = itr->get();
+
+  if (!handshake->is_active())
+    throw internal_error("HandshakeManager::receive_utp_failed(...) called on an inactive handshake.");
+
+  auto sa = handshake->socket_address();
+  auto handshake_ptr = find_and_erase(handshake);
+
+  handshake->deactivate_connection();
+  handshake->destroy_connection();
+
+  LT_LOG_SA(sa, "utp connection failed, retrying over tcp", 0);
+
+  int retry_options = handshake->encryption()->options() | net::NetworkConfig::encryption_retrying;
+
+  create_outgoing(sa, handshake->download(), retry_options, false);
+}
+
 void
 HandshakeManager::receive_timeout(Handshake* h) {
   receive_failed(h, ConnectionManager::handshake_failed,
@@ -39,6 +39,8 @@ public:
   void                erase_download(DownloadMain* info);
 
   void                add_incoming(int fd, const sockaddr* sa);
+  bool                filter_incoming_utp(const sockaddr* sa);
+  void                add_incoming_utp(int fd, const sockaddr* sa);
   void                add_outgoing(const sockaddr* sa, DownloadMain* info);
 
   slot_download&      slot_download_id()         { return m_slot_download_id; }
@@ -52,13 +54,16 @@ public:
   void                receive_failed(Handshake* h, int message, int error);
   void                receive_timeout(Handshake* h);
 
+  // The uTP connection carrying the handshake on 'fd' got no reply.
+  void                receive_utp_failed(int fd);
+
   static ProtocolExtension*  default_extensions()                       { return &DefaultExtensions; }
 
 private:
   HandshakeManager(const HandshakeManager&) = delete;
   HandshakeManager& operator=(const HandshakeManager&) = delete;
 
-  void                create_outgoing(const sockaddr* sa, DownloadMain* info, int encryptionOptions);
+  void                create_outgoing(const sockaddr* sa, DownloadMain* info, int encryptionOptions, bool utp);
   value_type          find_and_erase(Handshake* handshake);
 
   static bool         setup_socket(int fd, int family);
@@ -0,0 +1,57 @@
+#include "config.h"
+
+#include "peer_chunks.h"
+
+#include "utils/instrumentation.h"
+
+namespace torrent {
+
+PeerChunks::~PeerChunks() {
+  if (m_bitfieldShared)
+    instrumentation_update(INSTRUMENTATION_MEMORY_BITFIELDS_SHARED, -static_cast<int64_t>(m_seedBitfield->size_bytes()));
+}
+
+void
+PeerChunks::set_bitfield(Bitfield* bf, const Bitfield* seed) {
+  mutable_bitfield()->swap(*bf);
+  m_seedBitfield = seed;
+
+  share_bitfield();
+}
+
+void
+PeerChunks::set_chunk(uint32_t index) {
+  if (bitfield()->get(index))
+    return;
+
+  m_bitfield.set(index);
+  share_bitfield();
+}
+
+Bitfield*
+PeerChunks::mutable_bitfield() {
+  if (!m_bitfieldShared)
+    return &m_bitfield;
+
+  m_bitfield.copy(*m_seedBitfield);
+  m_bitfieldShared = false;
+
+  instrumentation_update(INSTRUMENTATION_MEMORY_BITFIELDS_SHARED, -static_cast<int64_t>(m_seedBitfield->size_bytes()));
+  return &m_bitfield;
+}
+
+// Bitfields of a different size than the seed bitfield, such as the
+// one faked for meta-data downloads, are kept private.
+void
+PeerChunks::share_bitfield() {
+  if (m_bitfieldShared || m_seedBitfield == nullptr || m_bitfield.empty() ||
+      !m_bitfield.is_all_set() || m_bitfield.size_bits() != m_seedBitfield->size_bits())
+    return;
+
+  m_bitfield.clear();
+  m_bitfieldShared = true;
+
+  instrumentation_update(INSTRUMENTATION_MEMORY_BITFIELDS_SHARED, static_cast<int64_t>(m_seedBitfield->size_bytes()));
+}
+
+} // namespace torrent
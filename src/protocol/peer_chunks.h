@@ -4,7 +4,6 @@
 #include <list>
 
 #include "net/throttle_node.h"
-#include "rak/partial_queue.h"
 #include "torrent/bitfield.h"
 #include "torrent/data/piece.h"
 #include "torrent/rate.h"
@@ -18,7 +17,12 @@ class PeerChunks {
 public:
   using piece_list_type = std::list<Piece>;
 
-  bool                is_seeder() const             { return m_bitfield.is_all_set(); }
+  PeerChunks() = default;
+  ~PeerChunks();
+  PeerChunks(const PeerChunks&) = delete;
+  PeerChunks& operator=(const PeerChunks&) = delete;
+
+  bool                is_seeder() const             { return bitfield()->is_all_set(); }
 
   PeerInfo*           peer_info()                   { return m_peerInfo; }
   const PeerInfo*     peer_info() const             { return m_peerInfo; }
@@ -27,10 +31,19 @@ public:
   bool                using_counter() const         { return m_usingCounter; }
   void                set_using_counter(bool state) { m_usingCounter = state; }
 
-  Bitfield*           bitfield()                    { return &m_bitfield; }
-  const Bitfield*     bitfield() const              { return &m_bitfield; }
+  // Seeders share the download's all-set bitfield instead of keeping
+  // a copy of their own, so the bitfield may only be modified through
+  // set_bitfield() and set_chunk().
+  const Bitfield*     bitfield() const              { return m_bitfieldShared ? m_seedBitfield : &m_bitfield; }
+  bool                is_bitfield_shared() const    { return m_bitfieldShared; }
+
+  // Takes the contents of 'bf'. The bitfield is shared with 'seed',
+  // which must outlive this object, whenever the peer has all chunks.
+  void                set_bitfield(Bitfield* bf, const Bitfield* seed);
+  void                set_chunk(uint32_t index);
 
-  auto*               download_cache()              { return &m_downloadCache; }
+  // Copies the shared bitfield into a private one first if needed.
+  Bitfield*           mutable_bitfield();
 
   auto*               upload_queue()                { return &m_uploadQueue; }
   const auto*         upload_queue() const          { return &m_uploadQueue; }
@@ -52,11 +65,13 @@ public:
 private:
   PeerInfo*           m_peerInfo{};
 
+  void                share_bitfield();
+
   bool                m_usingCounter{false};
+  bool                m_bitfieldShared{false};
 
   Bitfield            m_bitfield;
-
-  rak::partial_queue  m_downloadCache;
+  const Bitfield*     m_seedBitfield{};
 
   piece_list_type     m_uploadQueue;
   piece_list_type     m_cancelQueue;
@@ -1,8 +1,11 @@
 #include "config.h"
 
+#include <array>
 #include <cstdio>
+#include <cstring>
 #include <rak/error_number.h>
 
+#include "data/chunk_cache.h"
 #include "data/chunk_iterator.h"
 #include "data/chunk_list.h"
 #include "download/chunk_selector.h"
@@ -11,6 +14,9 @@
 #include "torrent/chunk_manager.h"
 #include "torrent/connection_manager.h"
 #include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
+#include "torrent/data/file.h"
+#include "torrent/data/transfer_list.h"
 #include "torrent/download/choke_group.h"
 #include "torrent/download/choke_queue.h"
 #include "torrent/download_info.h"
@@ -88,13 +94,16 @@ PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, Socke
   m_encryption = *encryptionInfo;
   m_extensions = extensions;
 
+  if (m_encryption.is_encrypted() && manager->connection_manager()->encryption_workers() != 0)
+    m_encryption.start_prefetch(manager->connection_manager()->crypto_queue());
+
   m_extensions->set_connection(this);
 
   m_upChoke.set_entry(m_download->up_group_entry());
   m_downChoke.set_entry(m_download->down_group_entry());
 
   m_peerChunks.set_peer_info(m_peerInfo);
-  m_peerChunks.bitfield()->swap(*bitfield);
+  m_peerChunks.set_bitfield(bitfield, m_download->seed_bitfield());
 
   std::pair<ThrottleList*, ThrottleList*> throttles = m_download->throttles(m_peerInfo->socket_address());
   m_up->set_throttle(throttles.first);
@@ -122,7 +131,7 @@ PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, Socke
     return;
   }
 
-  this_thread::poll()->open(this);
+  this_thread::poll()->open_edge(this);
   this_thread::poll()->insert_read(this);
   this_thread::poll()->insert_write(this);
   this_thread::poll()->insert_error(this);
@@ -134,8 +143,6 @@ PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, Socke
   // Hmm... cleanup?
 //   update_interested();
 
-  m_peerChunks.download_cache()->clear();
-
   if (!m_download->file_list()->is_done()) {
     m_sendInterested = true;
     m_downInterested = true;
@@ -154,6 +161,15 @@ PeerConnectionBase::cleanup() {
   m_request_list.clear();
 
   up_chunk_release();
+
+  // Once the socket is closed no more completions can be read. The
+  // kernel keeps its own references to the mapped pages still being
+  // sent, and buffered chunks, whose memory is reused once released,
+  // are never sent with zero-copy.
+  if (m_zerocopyState == zerocopy_enabled)
+    up_zerocopy_completions();
+
+  up_zerocopy_release(true);
   down_chunk_release();
 
   m_download->info()->set_upload_unchoked(m_download->info()->upload_unchoked() - m_upChoke.unchoked());
@@ -249,8 +265,6 @@ PeerConnectionBase::receive_download_choke(bool choke) {
   }
 
   if (choke) {
-    m_peerChunks.download_cache()->disable();
-
     // If the queue isn't empty, then we might still receive some
     // pieces, so don't remove us from throttle or release the chunk.
     if (!request_list()->is_downloading() && request_list()->queued_empty()) {
@@ -302,8 +316,13 @@ PeerConnectionBase::receive_download_choke(bool choke) {
   return true;
 }
 
-void
+// Returns false while the chunk is filled, writing resumes in
+// receive_chunk_filled.
+bool
 PeerConnectionBase::load_up_chunk() {
+  if (m_upCache != nullptr && m_upCacheIndex == m_upPiece.index())
+    return true;
+
   if (m_upChunk.is_valid() && m_upChunk.index() == m_upPiece.index()) {
     // Better checking needed.
     //     m_upChunk.chunk()->preload(m_upPiece.offset(), m_upChunk.chunk()->size());
@@ -311,19 +330,42 @@ PeerConnectionBase::load_up_chunk() {
     if (lt_log_is_valid(LOG_INSTRUMENTATION_MINCORE))
       log_mincore_stats_func(m_upChunk.chunk()->is_incore(m_upPiece.offset(), m_upPiece.length()), false, m_incoreContinous);
 
-    return;
+    return true;
   }
 
   up_chunk_release();
 
+  if (is_encrypted() && m_encryptBuffer == nullptr) {
+    m_encryptBuffer = std::make_unique<EncryptBuffer>();
+    m_encryptBuffer->reset();
+  }
+
+  ChunkCache* cache = manager->chunk_manager()->chunk_cache();
+
+  if (cache->is_enabled()) {
+    m_upCache = cache->find(m_download->chunk_list(), m_upPiece.index());
+    m_upCacheIndex = m_upPiece.index();
+
+    if (m_upCache != nullptr)
+      return true;
+  }
+
   m_upChunk = m_download->chunk_list()->get(m_upPiece.index(), ChunkList::get_not_hashing);
 
-  if (!m_upChunk.is_valid())
+  if (!m_upChunk.is_valid()) {
+    if (m_upChunk.error_number().value() == rak::error_number::e_again) {
+      m_upChunkWait = true;
+      return false;
+    }
+
     throw storage_error("File chunk read error: " + std::string(m_upChunk.error_number().c_str()));
+  }
 
-  if (is_encrypted() && m_encryptBuffer == nullptr) {
-    m_encryptBuffer = std::make_unique<EncryptBuffer>();
-    m_encryptBuffer->reset();
+  // The cache reads the chunk on the disk thread, which also warms
+  // the page cache for the mapped chunk we use until it is done.
+  if (cache->is_enabled()) {
+    cache->fetch(m_download->chunk_list(), m_upPiece.index(), m_upChunk.chunk());
+    return true;
   }
 
   m_incoreContinous = false;
@@ -344,13 +386,19 @@ PeerConnectionBase::load_up_chunk() {
       preloadSize < cm->preload_min_size() ||
       m_peerChunks.upload_throttle()->rate()->rate() < cm->preload_required_rate() * ((preloadSize + (2 << 20) - 1) / (2 << 20))) {
     cm->inc_stats_not_preloaded();
-    return;
+    return true;
   }
 
   cm->inc_stats_preloaded();
 
   m_upChunk.object()->set_time_preloaded(this_thread::cached_time());
-  m_upChunk.chunk()->preload(m_upPiece.offset(), m_upChunk.chunk()->chunk_size(), cm->preload_type() == 1);
+
+  if (cm->preload_type() == 3)
+    m_upChunk.chunk()->preload_async(m_upPiece.offset(), m_upChunk.chunk()->chunk_size());
+  else
+    m_upChunk.chunk()->preload(m_upPiece.offset(), m_upChunk.chunk()->chunk_size(), cm->preload_type() == 1);
+
+  return true;
 }
 
 void
@@ -373,9 +421,33 @@ PeerConnectionBase::cancel_transfer(BlockTransfer* transfer) {
 
 void
 PeerConnectionBase::event_error() {
+  // Zero-copy completions are queued on the socket error queue, which
+  // is polled as an error without setting one on the socket.
+  if (m_zerocopyState == zerocopy_enabled && get_fd().get_error() == 0) {
+    up_zerocopy_completions();
+    return;
+  }
+
   m_download->connection_list()->erase(this, 0);
 }
 
+void
+PeerConnectionBase::receive_chunk_filled(uint32_t index) {
+  if (m_upChunkWait && m_upPiece.index() == index) {
+    m_upChunkWait = false;
+    this_thread::poll()->insert_write(this);
+  }
+
+  // The piece may already be in the read buffer, so don't wait for
+  // the socket.
+  if (m_downChunkWait && m_downChunkWaitIndex == index) {
+    m_downChunkWait = false;
+    this_thread::poll()->insert_read(this);
+
+    event_read();
+  }
+}
+
 bool
 PeerConnectionBase::should_connection_unchoke(choke_queue* cq) const {
   if (cq == m_download->choke_group()->up_queue())
@@ -387,6 +459,44 @@ PeerConnectionBase::should_connection_unchoke(choke_queue* cq) const {
   return true;
 }
 
+// Buffered chunks of partially downloaded pieces are read in on the
+// disk thread before blocks are written into them. Until then the
+// piece is left in the read buffer, and reading resumes in
+// receive_chunk_filled.
+bool
+PeerConnectionBase::down_chunk_prepare(const Piece& piece) {
+  if (m_downChunk.is_valid() && m_downChunk.index() == piece.index())
+    return true;
+
+  // Unwanted pieces are skipped by down_chunk_start, and the chunks of
+  // finished ones may be blocked by the hash check.
+  TransferList* transfer_list = m_download->delegator()->transfer_list();
+  auto itr = transfer_list->find(piece.index());
+
+  if (itr == transfer_list->end() || (*itr)->is_all_finished())
+    return true;
+
+  auto flags = ChunkList::get_not_hashing | ChunkList::get_writable;
+
+  if ((*itr)->finished() == 0)
+    flags = flags | ChunkList::get_dont_fill;
+
+  down_chunk_release();
+  m_downChunk = m_download->chunk_list()->get(piece.index(), flags);
+
+  if (m_downChunk.is_valid())
+    return true;
+
+  if (m_downChunk.error_number().value() != rak::error_number::e_again)
+    throw storage_error("File chunk write error: " + std::string(m_downChunk.error_number().c_str()) + ".");
+
+  m_downChunkWait = true;
+  m_downChunkWaitIndex = piece.index();
+
+  this_thread::poll()->remove_read(this);
+  return false;
+}
+
 bool
 PeerConnectionBase::down_chunk_start(const Piece& piece) {
   if (!request_list()->downloading(piece)) {
@@ -405,8 +515,15 @@ PeerConnectionBase::down_chunk_start(const Piece& piece) {
     throw internal_error("Incoming pieces list contains a bad piece.");
 
   if (!m_downChunk.is_valid() || piece.index() != m_downChunk.index()) {
+    auto flags = ChunkList::get_not_hashing | ChunkList::get_writable;
+
+    // Nothing of the piece is stored yet, so there's no need to read
+    // in a buffered chunk.
+    if (request_list()->transfer()->is_valid() && request_list()->transfer()->block()->parent()->finished() == 0)
+      flags = flags | ChunkList::get_dont_fill;
+
     down_chunk_release();
-    m_downChunk = m_download->chunk_list()->get(piece.index(), ChunkList::get_not_hashing | ChunkList::get_writable);
+    m_downChunk = m_download->chunk_list()->get(piece.index(), flags);
 
     if (!m_downChunk.is_valid())
       throw storage_error("File chunk write error: " + std::string(m_downChunk.error_number().c_str()) + ".");
@@ -481,9 +598,12 @@ PeerConnectionBase::down_chunk() {
   uint32_t bytesTransfered = 0;
   BlockTransfer* transfer = m_request_list.transfer();
 
+  uint32_t position = transfer->piece().offset() + transfer->position();
+  bool hashOnReceive = transfer->block() != nullptr && manager->chunk_manager()->hash_on_receive();
+
   Chunk::data_type data;
   ChunkIterator itr(m_downChunk.chunk(),
-                    transfer->piece().offset() + transfer->position(),
+                    position,
                     transfer->piece().offset() + std::min(transfer->position() + quota, transfer->piece().length()));
 
   do {
@@ -493,6 +613,10 @@ PeerConnectionBase::down_chunk() {
     if (is_encrypted())
       m_encryption.decrypt(data.first, data.second);
 
+    if (hashOnReceive && data.second != 0)
+      m_download->piece_hash_table()->update(transfer->index(), transfer->block()->parent()->piece().length(),
+                                             position + bytesTransfered, data.first, data.second);
+
     bytesTransfered += data.second;
 
   } while (data.second != 0 && itr.forward(data.second));
@@ -567,6 +691,10 @@ PeerConnectionBase::down_chunk_process(const void* buffer, uint32_t length) {
 
   m_downChunk.chunk()->from_buffer(buffer, transfer->piece().offset() + transfer->position(), length);
 
+  if (transfer->block() != nullptr && manager->chunk_manager()->hash_on_receive())
+    m_download->piece_hash_table()->update(transfer->index(), transfer->block()->parent()->piece().length(),
+                                           transfer->piece().offset() + transfer->position(), buffer, length);
+
   transfer->adjust_position(length);
 
   m_down->throttle()->node_used(m_peerChunks.download_throttle(), length);
@@ -688,7 +816,10 @@ PeerConnectionBase::up_chunk_encrypt(uint32_t quota) {
     quota = std::min<uint32_t>(quota - m_encryptBuffer->remaining(), m_encryptBuffer->reserved_left());
   }
 
-  m_upChunk.chunk()->to_buffer(m_encryptBuffer->end(), m_upPiece.offset() + m_encryptBuffer->remaining(), quota);
+  if (m_upCache != nullptr)
+    std::memcpy(m_encryptBuffer->end(), m_upCache.get() + m_upPiece.offset() + m_encryptBuffer->remaining(), quota);
+  else
+    m_upChunk.chunk()->to_buffer(m_encryptBuffer->end(), m_upPiece.offset() + m_encryptBuffer->remaining(), quota);
   m_encryption.encrypt(m_encryptBuffer->end(), quota);
   m_encryptBuffer->move_end(quota);
 
@@ -700,12 +831,18 @@ PeerConnectionBase::up_chunk() {
   if (!m_up->throttle()->is_throttled(m_peerChunks.upload_throttle()))
     throw internal_error("PeerConnectionBase::up_chunk() tried to write a piece but is not in throttle list");
 
-  if (!m_upChunk.chunk()->is_readable())
+  if (m_upCache == nullptr && !m_upChunk.chunk()->is_readable())
     throw internal_error("ProtocolChunk::write_part() chunk not readable, permission denided");
 
   uint32_t quota = m_up->throttle()->node_quota(m_peerChunks.upload_throttle());
 
+  // Messages queued ahead of the piece header, and the header itself,
+  // are not throttled and must not wait for quota. The node stays
+  // active until they have been written.
   if (quota == 0) {
+    if (!up_chunk_flush_messages())
+      return false;
+
     this_thread::poll()->remove_write(this);
     m_up->throttle()->node_deactivate(m_peerChunks.upload_throttle());
     return false;
@@ -713,6 +850,12 @@ PeerConnectionBase::up_chunk() {
 
   uint32_t bytesTransfered = 0;
 
+  bool use_zerocopy = !is_encrypted() && m_upCache == nullptr && !m_upChunk.chunk()->is_buffered() &&
+    manager->chunk_manager()->upload_zerocopy() && up_zerocopy_enable();
+
+  bool use_sendfile = !is_encrypted() && m_upCache == nullptr && !use_zerocopy &&
+    SocketStream::has_write_file() && manager->chunk_manager()->upload_sendfile();
+
   if (is_encrypted()) {
     // Prepare as many bytes as quota specifies, up to end of piece or
     // buffer. Only bytes beyond remaining() are new and will be
@@ -722,17 +865,32 @@ PeerConnectionBase::up_chunk() {
     bytesTransfered = write_stream_throws(m_encryptBuffer->position(), quota);
     m_encryptBuffer->consume(bytesTransfered);
 
-  } else {
-    Chunk::data_type data;
-    ChunkIterator itr(m_upChunk.chunk(), m_upPiece.offset(), m_upPiece.offset() + std::min(quota, m_upPiece.length()));
+  } else if (use_zerocopy) {
+    // Gathering would pin the write buffer, so messages are flushed
+    // first.
+    if (up_chunk_flush_messages()) {
+      Chunk::data_type data;
+      ChunkIterator itr(m_upChunk.chunk(), m_upPiece.offset(), m_upPiece.offset() + std::min(quota, m_upPiece.length()));
 
-    do {
-      data = itr.data();
-      data.second = write_stream_throws(data.first, data.second);
+      do {
+        data = itr.data();
+
+        bool zerocopy;
+        data.second = write_stream_zerocopy_throws(data.first, data.second, &zerocopy);
+
+        if (zerocopy && data.second != 0)
+          up_zerocopy_sent(data.second);
+
+        bytesTransfered += data.second;
+
+      } while (data.second != 0 && itr.forward(data.second));
+    }
 
-      bytesTransfered += data.second;
+  } else if (!use_sendfile) {
+    bytesTransfered = up_chunk_gather(std::min(quota, m_upPiece.length()));
 
-    } while (data.second != 0 && itr.forward(data.second));
+  } else if (up_chunk_flush_messages()) {
+    bytesTransfered = write_chunk_sendfile(this, m_upChunk.chunk(), m_upPiece.offset(), std::min(quota, m_upPiece.length()));
   }
 
   m_up->throttle()->node_used(m_peerChunks.upload_throttle(), bytesTransfered);
@@ -746,6 +904,82 @@ PeerConnectionBase::up_chunk() {
   return m_upPiece.length() == 0;
 }
 
+// Writes 'length' bytes of 'chunk' from 'offset', sending file backed
+// mappings directly from the file. Buffered parts may hold data not yet
+// written back, and padding or closed files have nothing to send, so
+// those are copied from memory. Returns the bytes written.
+uint32_t
+PeerConnectionBase::write_chunk_sendfile(SocketStream* socket, Chunk* chunk, uint32_t offset, uint32_t length) {
+  uint32_t written = 0;
+
+  Chunk::data_type data;
+  ChunkIterator itr(chunk, offset, offset + length);
+
+  do {
+    data = itr.data();
+
+    ChunkPart* part = itr.chunk_part();
+
+    if (part->mapped() == ChunkPart::MAPPED_MMAP &&
+        part->file() != nullptr && !part->file()->is_padding() && part->file()->is_open())
+      data.second = socket->write_file_throws(part->file()->file_descriptor(), part->file_offset() + itr.memory_chunk_first(), data.second);
+    else
+      data.second = socket->write_stream_throws(data.first, data.second);
+
+    written += data.second;
+
+  } while (data.second != 0 && itr.forward(data.second));
+
+  return written;
+}
+
+// Writes the unencrypted messages left in the write buffer, ending
+// with the piece header, together with up to 'length' bytes of the
+// piece in a single syscall. Returns the piece bytes written.
+uint32_t
+PeerConnectionBase::up_chunk_gather(uint32_t length) {
+  std::array<iovec, 16> iov;
+  unsigned int count = 0;
+
+  uint32_t buffered = m_up->buffer()->remaining();
+
+  if (buffered != 0)
+    iov[count++] = iovec{m_up->buffer()->position(), buffered};
+
+  if (m_upCache != nullptr) {
+    iov[count++] = iovec{m_upCache.get() + m_upPiece.offset(), length};
+
+  } else {
+    ChunkIterator itr(m_upChunk.chunk(), m_upPiece.offset(), m_upPiece.offset() + length);
+
+    do {
+      Chunk::data_type data = itr.data();
+      iov[count++] = iovec{data.first, data.second};
+    } while (count < iov.size() && itr.next());
+  }
+
+  uint32_t written = write_stream_vector_throws(iov.data(), count);
+  uint32_t written_buffered = std::min(written, buffered);
+
+  if (buffered != 0 && m_up->buffer()->consume(m_up->throttle()->node_used_unthrottled(written_buffered)))
+    m_up->buffer()->reset();
+
+  return written - written_buffered;
+}
+
+// Returns true once the write buffer is empty.
+bool
+PeerConnectionBase::up_chunk_flush_messages() {
+  if (m_up->buffer()->remaining() == 0)
+    return true;
+
+  if (!m_up->buffer()->consume(m_up->throttle()->node_used_unthrottled(write_stream_throws(m_up->buffer()->position(), m_up->buffer()->remaining()))))
+    return false;
+
+  m_up->buffer()->reset();
+  return true;
+}
+
 bool
 PeerConnectionBase::up_extension() {
   if (m_extensionOffset == extension_must_encrypt) {
@@ -794,8 +1028,73 @@ PeerConnectionBase::down_chunk_release() {
 
 void
 PeerConnectionBase::up_chunk_release() {
-  if (m_upChunk.is_valid())
-    m_download->chunk_list()->release(&m_upChunk, ChunkList::release_default);
+  m_upCache.reset();
+
+  if (!m_upChunk.is_valid())
+    return;
+
+  // The kernel may still be reading the pages of zero-copy sends.
+  if (!m_zerocopySends.empty()) {
+    m_zerocopyChunks.emplace_back(m_zerocopyNext - 1, m_upChunk);
+    m_upChunk.clear();
+    return;
+  }
+
+  m_download->chunk_list()->release(&m_upChunk, ChunkList::release_default);
+}
+
+bool
+PeerConnectionBase::up_zerocopy_enable() {
+  if (m_zerocopyState == zerocopy_untried)
+    m_zerocopyState = SocketStream::has_zerocopy() && enable_zerocopy() ? zerocopy_enabled : zerocopy_unsupported;
+
+  return m_zerocopyState == zerocopy_enabled;
+}
+
+void
+PeerConnectionBase::up_zerocopy_sent(uint32_t bytes) {
+  m_zerocopySends.push_back(zerocopy_send{bytes, false, false});
+  m_zerocopyNext++;
+}
+
+void
+PeerConnectionBase::up_zerocopy_completions() {
+  read_zerocopy_completions([this](uint32_t first, uint32_t last, bool copied) {
+      up_zerocopy_completed(first, last, copied);
+    });
+
+  up_zerocopy_release(false);
+}
+
+void
+PeerConnectionBase::up_zerocopy_completed(uint32_t first, uint32_t last, bool copied) {
+  uint32_t base = m_zerocopyNext - m_zerocopySends.size();
+
+  for (uint32_t index = first - base; index <= last - base && index < m_zerocopySends.size(); index++) {
+    m_zerocopySends[index].completed = true;
+    m_zerocopySends[index].copied = copied;
+  }
+
+  while (!m_zerocopySends.empty() && m_zerocopySends.front().completed) {
+    manager->chunk_manager()->inc_stats_zerocopy(m_zerocopySends.front().bytes, m_zerocopySends.front().copied);
+    m_zerocopySends.pop_front();
+  }
+}
+
+// Releases chunks whose zero-copy sends have all completed, or every
+// chunk when the socket is being closed.
+void
+PeerConnectionBase::up_zerocopy_release(bool all) {
+  if (all)
+    m_zerocopySends.clear();
+
+  uint32_t base = m_zerocopyNext - m_zerocopySends.size();
+
+  while (!m_zerocopyChunks.empty() &&
+         (m_zerocopySends.empty() || static_cast<int32_t>(base - m_zerocopyChunks.front().first) > 0)) {
+    m_download->chunk_list()->release(&m_zerocopyChunks.front().second, ChunkList::release_default);
+    m_zerocopyChunks.pop_front();
+  }
 }
 
 void
@@ -815,6 +1114,20 @@ PeerConnectionBase::read_request_piece(const Piece& p) {
 
   LT_LOG_PIECE_EVENTS("(up)   request_added    %" PRIu32 " %" PRIu32 " %" PRIu32,
                       p.index(), p.offset(), p.length());
+
+  // Read the chunk into the cache on the first request for it, so it
+  // is ready by the time the upload reaches the piece.
+  ChunkCache* cache = manager->chunk_manager()->chunk_cache();
+
+  if (cache->is_enabled() && m_download->file_list()->is_valid_piece(p) &&
+      m_download->file_list()->bitfield()->get(p.index()) && cache->is_missing(m_download->chunk_list(), p.index())) {
+    ChunkHandle handle = m_download->chunk_list()->get(p.index(), ChunkList::get_not_hashing | ChunkList::get_dont_log);
+
+    if (handle.is_valid()) {
+      cache->prefetch(m_download->chunk_list(), p.index(), handle.chunk());
+      m_download->chunk_list()->release(&handle, ChunkList::release_dont_log);
+    }
+  }
 }
 
 void
@@ -891,12 +1204,33 @@ PeerConnectionBase::should_request() {
     return m_downStall <= 1 || m_download->info()->down_rate()->rate() < (10 << 10);
 }
 
+uint32_t
+PeerConnectionBase::request_pipe_size() {
+  int mode = manager->connection_manager()->request_pipeline();
+  uint32_t rate = m_peerChunks.download_throttle()->rate()->rate();
+
+  if (mode == ConnectionManager::request_pipeline_rate || !request_list()->is_pipe_rtt_stale())
+    return request_list()->calculate_pipe_size(rate, mode);
+
+  uint32_t rtt = 0;
+  read_tcp_rtt(&rtt);
+  request_list()->update_pipe_rtt(rtt);
+
+  uint32_t pipeSize = request_list()->calculate_pipe_size(rate, mode);
+
+  if (mode == ConnectionManager::request_pipeline_compare)
+    LT_LOG_PIECE_EVENTS("(down) pipe_size rate:%" PRIu32 " rtt:%" PRIu32 " by_rate:%" PRIu32 " by_bdp:%" PRIu32,
+                        rate, request_list()->pipe_rtt(), request_list()->last_pipe_size_rate(), request_list()->last_pipe_size_bdp());
+
+  return pipeSize;
+}
+
 bool
 PeerConnectionBase::try_request_pieces() {
   if (request_list()->queued_empty())
     m_downStall = 0;
 
-  uint32_t pipeSize = request_list()->calculate_pipe_size(m_peerChunks.download_throttle()->rate()->rate());
+  uint32_t pipeSize = request_pipe_size();
 
   // Don't start requesting if we can't do it in large enough chunks.
   if (request_list()->pipe_size() >= (pipeSize + 10) / 2)
@@ -1,6 +1,8 @@
 #ifndef LIBTORRENT_PROTOCOL_PEER_CONNECTION_BASE_H
 #define LIBTORRENT_PROTOCOL_PEER_CONNECTION_BASE_H
 
+#include <deque>
+
 #include "thread_main.h"
 #include "data/chunk_handle.h"
 #include "net/socket_stream.h"
@@ -109,6 +111,9 @@ public:
   // Communication with the protocol extensions
   virtual void        receive_metadata_piece(uint32_t piece, const char* data, uint32_t length);
 
+  // Resumes a transfer waiting for a buffered chunk to be read in.
+  void                receive_chunk_filled(uint32_t index);
+
   bool                should_connection_unchoke(choke_queue* cq) const;
 
 protected:
@@ -117,7 +122,7 @@ protected:
   inline bool         read_remaining();
   inline bool         write_remaining();
 
-  void                load_up_chunk();
+  bool                load_up_chunk();
 
   void                read_request_piece(const Piece& p);
   void                read_cancel_piece(const Piece& p);
@@ -125,6 +130,7 @@ protected:
   void                write_prepare_piece();
   void                write_prepare_extension(int type, const DataBuffer& message);
 
+  bool                down_chunk_prepare(const Piece& p);
   bool                down_chunk_start(const Piece& p);
   void                down_chunk_finished();
 
@@ -140,6 +146,15 @@ protected:
 
   bool                up_chunk();
   inline uint32_t     up_chunk_encrypt(uint32_t quota);
+  uint32_t            up_chunk_gather(uint32_t length);
+  static uint32_t     write_chunk_sendfile(SocketStream* socket, Chunk* chunk, uint32_t offset, uint32_t length);
+  bool                up_chunk_flush_messages();
+
+  bool                up_zerocopy_enable();
+  void                up_zerocopy_sent(uint32_t bytes);
+  void                up_zerocopy_completions();
+  void                up_zerocopy_completed(uint32_t first, uint32_t last, bool copied);
+  void                up_zerocopy_release(bool all);
 
   bool                up_extension();
 
@@ -147,6 +162,7 @@ protected:
   void                up_chunk_release();
 
   bool                should_request();
+  uint32_t            request_pipe_size();
   bool                try_request_pieces();
 
   bool                send_pex_message();
@@ -166,6 +182,33 @@ protected:
   Piece               m_upPiece;
   ChunkHandle         m_upChunk;
 
+  // Set while the chunk of the piece being read or written is filled,
+  // with polling removed until receive_chunk_filled.
+  bool                m_downChunkWait{false};
+  uint32_t            m_downChunkWaitIndex{0};
+  bool                m_upChunkWait{false};
+
+  // Set instead of m_upChunk when the chunk is served from the
+  // upload cache.
+  std::shared_ptr<char[]> m_upCache;
+  uint32_t            m_upCacheIndex{0};
+
+  enum zerocopy_state { zerocopy_untried, zerocopy_enabled, zerocopy_unsupported };
+
+  struct zerocopy_send {
+    uint32_t          bytes;
+    bool              completed;
+    bool              copied;
+  };
+
+  // Zero-copy sends the kernel has not yet reported complete, the
+  // first having id 'm_zerocopyNext - m_zerocopySends.size()', and
+  // released up chunks kept until the send with the paired id is done.
+  zerocopy_state      m_zerocopyState{zerocopy_untried};
+  uint32_t            m_zerocopyNext{0};
+  std::deque<zerocopy_send> m_zerocopySends;
+  std::deque<std::pair<uint32_t, ChunkHandle>> m_zerocopyChunks;
+
   // The interested state no longer follows the spec's wording as it
   // has been swapped.
   //
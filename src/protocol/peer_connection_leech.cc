@@ -66,8 +66,6 @@ PeerConnection<type>::update_interested() {
   if (type != Download::CONNECTION_LEECH)
     return;
 
-  m_peerChunks.download_cache()->clear();
-
   if (m_downInterested)
     return;
 
@@ -179,6 +177,8 @@ PeerConnection<type>::read_message() {
   // Temporary.
   m_down->set_last_command(static_cast<ProtocolBase::Protocol>(buf->peek_8()));
 
+  Piece piece;
+
   switch (buf->read_8()) {
   case ProtocolBase::CHOKE:
     if (type != Download::CONNECTION_LEECH)
@@ -256,7 +256,12 @@ PeerConnection<type>::read_message() {
     if (!m_down->can_read_piece_body())
       break;
 
-    if (!down_chunk_start(m_down->read_piece(length - 9))) {
+    piece = m_down->read_piece(length - 9);
+
+    if (!down_chunk_prepare(piece))
+      break;
+
+    if (!down_chunk_start(piece)) {
 
       // We don't want this chunk.
       if (down_chunk_skip_from_buffer()) {
@@ -336,6 +341,10 @@ void
 PeerConnection<type>::event_read() {
   m_time_last_read = this_thread::cached_time();
 
+  // Yield to other events once the read budget is used, checked only
+  // when the remaining data is in the socket rather than our buffer.
+  uint64_t budget_start = m_download->info()->down_rate()->total();
+
   // Need to make sure ProtocolBuffer::end() is pointing to the end of
   // the unread data, and that the unread data starts from the
   // beginning of the buffer. Or do we use position? Propably best,
@@ -356,6 +365,12 @@ PeerConnection<type>::event_read() {
 
       switch (m_down->get_state()) {
       case ProtocolRead::IDLE:
+        // Waiting for the chunk of a piece in the buffer to be filled.
+        if (m_downChunkWait) {
+          this_thread::poll()->remove_read(this);
+          return;
+        }
+
         if (m_down->buffer()->size_end() < read_size) {
           unsigned int length = read_stream_throws(m_down->buffer()->end(), read_size - m_down->buffer()->size_end());
           m_down->throttle()->node_used_unthrottled(length);
@@ -395,6 +410,11 @@ PeerConnection<type>::event_read() {
         m_tryRequest = true;
         m_down->set_state(ProtocolRead::IDLE);
         down_chunk_finished();
+
+        if (m_down->buffer()->remaining() == 0 &&
+            this_thread::poll()->read_budget_exhausted(m_download->info()->down_rate()->total() - budget_start))
+          return;
+
         break;
 
       case ProtocolRead::READ_SKIP_PIECE:
@@ -412,6 +432,11 @@ PeerConnection<type>::event_read() {
         m_tryRequest = true;
         m_down->set_state(ProtocolRead::IDLE);
         down_chunk_finished();
+
+        if (m_down->buffer()->remaining() == 0 &&
+            this_thread::poll()->read_budget_exhausted(m_download->info()->down_rate()->total() - budget_start))
+          return;
+
         break;
 
       case ProtocolRead::READ_EXTENSION:
@@ -552,6 +577,8 @@ PeerConnection<type>::fill_write_buffer() {
 template<Download::ConnectionType type>
 void
 PeerConnection<type>::event_write() {
+  uint64_t budget_start = m_download->info()->up_rate()->total();
+
   try {
 
     do {
@@ -570,14 +597,18 @@ PeerConnection<type>::event_write() {
 
 	[[fallthrough]];
       case ProtocolWrite::MSG:
-        if (!m_up->buffer()->consume(m_up->throttle()->node_used_unthrottled(write_stream_throws(m_up->buffer()->position(), m_up->buffer()->remaining()))))
-          return;
-
-        m_up->buffer()->reset();
+        // Unencrypted messages ending with a piece header are left in
+        // the buffer for up_chunk() to write along with the payload,
+        // or on their own if there is no upload quota.
+        if (m_up->last_command() != ProtocolBase::PIECE || is_encrypted()) {
+          if (!m_up->buffer()->consume(m_up->throttle()->node_used_unthrottled(write_stream_throws(m_up->buffer()->position(), m_up->buffer()->remaining()))))
+            return;
+
+          m_up->buffer()->reset();
+        }
 
         if (m_up->last_command() == ProtocolBase::PIECE) {
           // We're uploading a piece.
-          load_up_chunk();
           m_up->set_state(ProtocolWrite::WRITE_PIECE);
 
           // fall through to WRITE_PIECE case below
@@ -595,10 +626,19 @@ PeerConnection<type>::event_write() {
 
 	[[fallthrough]];
       case ProtocolWrite::WRITE_PIECE:
+        if (!load_up_chunk()) {
+          this_thread::poll()->remove_write(this);
+          return;
+        }
+
         if (!up_chunk())
           return;
 
         m_up->set_state(ProtocolWrite::IDLE);
+
+        if (this_thread::poll()->write_budget_exhausted(m_download->info()->up_rate()->total() - budget_start))
+          return;
+
         break;
 
       case ProtocolWrite::WRITE_EXTENSION:
@@ -390,7 +390,7 @@ PeerConnectionMetadata::try_request_metadata_pieces() {
   if (request_list()->queued_empty())
     m_downStall = 0;
 
-  uint32_t pipeSize = request_list()->calculate_pipe_size(m_peerChunks.download_throttle()->rate()->rate());
+  uint32_t pipeSize = request_pipe_size();
 
   // Don't start requesting if we can't do it in large enough chunks.
   if (request_list()->pipe_size() >= (pipeSize + 10) / 2)
@@ -9,6 +9,7 @@
 #include "protocol/peer_chunks.h"
 #include "torrent/data/block.h"
 #include "torrent/data/block_list.h"
+#include "torrent/connection_manager.h"
 #include "torrent/exceptions.h"
 #include "utils/instrumentation.h"
 
@@ -327,7 +328,24 @@ RequestList::is_interested_in_active() const {
 }
 
 uint32_t
-RequestList::calculate_pipe_size(uint32_t rate) {
+RequestList::calculate_pipe_size(uint32_t rate, int mode) {
+  m_pipe_size_rate = calculate_pipe_size_rate(rate);
+
+  if (mode == ConnectionManager::request_pipeline_rate) {
+    m_pipe_size_bdp = 0;
+    return (m_pipe_size = m_pipe_size_rate);
+  }
+
+  m_pipe_size_bdp = calculate_pipe_size_bdp(rate);
+
+  if (mode == ConnectionManager::request_pipeline_bdp && m_pipe_size_bdp != 0)
+    return (m_pipe_size = m_pipe_size_bdp);
+
+  return (m_pipe_size = m_pipe_size_rate);
+}
+
+uint32_t
+RequestList::calculate_pipe_size_rate(uint32_t rate) const {
   // Change into KB.
   rate /= 1024;
 
@@ -345,4 +363,32 @@ RequestList::calculate_pipe_size(uint32_t rate) {
   }
 }
 
+// Enough requests to cover the bytes in flight during a round trip
+// plus the time the peer takes to serve them. The rate based depth is
+// used while in aggressive mode, as deep pipes then only cause
+// duplicate downloads, and until the round-trip time is known.
+uint32_t
+RequestList::calculate_pipe_size_bdp(uint32_t rate) const {
+  if (m_pipe_rtt == 0 || m_delegator->get_aggressive())
+    return 0;
+
+  uint64_t window = 2 * static_cast<uint64_t>(m_pipe_rtt) + pipe_service_time.count();
+  uint64_t blocks = static_cast<uint64_t>(rate) * window / 1000000 / Delegator::block_size;
+
+  return std::min<uint64_t>(blocks + 2, pipe_size_max);
+}
+
+bool
+RequestList::is_pipe_rtt_stale() const {
+  return torrent::this_thread::cached_time() >= m_pipe_rtt_updated + pipe_rtt_interval;
+}
+
+void
+RequestList::update_pipe_rtt(uint32_t sample) {
+  m_pipe_rtt_updated = torrent::this_thread::cached_time();
+
+  if (sample != 0)
+    m_pipe_rtt = sample;
+}
+
 } // namespace torrent
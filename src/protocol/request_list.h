@@ -4,6 +4,7 @@
 #include <deque>
 #include <vector>
 
+#include "torrent/connection_manager.h"
 #include "torrent/data/block_transfer.h"
 #include "torrent/utils/scheduler.h"
 #include "utils/instrumentation.h"
@@ -39,6 +40,12 @@ public:
   static constexpr std::chrono::microseconds timeout_choked_received{60s};
   static constexpr std::chrono::microseconds timeout_process_unordered{60s};
 
+  // Time the peer is assumed to need to serve a request on top of the
+  // network round trip, and how often the round-trip time is sampled.
+  static constexpr std::chrono::microseconds pipe_service_time{500ms};
+  static constexpr std::chrono::microseconds pipe_rtt_interval{1s};
+  static constexpr uint32_t                  pipe_size_max{2048};
+
   RequestList();
   ~RequestList();
 
@@ -77,7 +84,25 @@ public:
   size_t               choked_size() const                { return m_queues.queue_size(bucket_choked); }
 
   uint32_t             pipe_size() const;
-  uint32_t             calculate_pipe_size(uint32_t rate);
+
+  // Number of requests to keep queued, 'mode' being one of the
+  // ConnectionManager::request_pipeline_* values. The depth from each
+  // method is kept for comparison.
+  uint32_t             calculate_pipe_size(uint32_t rate, int mode = ConnectionManager::request_pipeline_rate);
+  uint32_t             calculate_pipe_size_rate(uint32_t rate) const;
+  uint32_t             calculate_pipe_size_bdp(uint32_t rate) const;
+
+  uint32_t             last_pipe_size() const             { return m_pipe_size; }
+  uint32_t             last_pipe_size_rate() const        { return m_pipe_size_rate; }
+  uint32_t             last_pipe_size_bdp() const         { return m_pipe_size_bdp; }
+
+  // Round-trip time in microseconds, zero if unknown.
+  uint32_t             pipe_rtt() const                   { return m_pipe_rtt; }
+  bool                 is_pipe_rtt_stale() const;
+
+  // The sample is the kernel's smoothed 'tcpi_rtt' and is used as is.
+  // A zero sample only restarts the sampling interval.
+  void                 update_pipe_rtt(uint32_t sample);
 
   Delegator*           delegator()                       { return m_delegator; }
   void                 set_delegator(Delegator* d)       { m_delegator = d; }
@@ -109,6 +134,12 @@ private:
   std::chrono::microseconds m_last_unchoke{};
   size_t                    m_last_unordered_position{0};
 
+  uint32_t                  m_pipe_size{0};
+  uint32_t                  m_pipe_size_rate{0};
+  uint32_t                  m_pipe_size_bdp{0};
+  uint32_t                  m_pipe_rtt{0};
+  std::chrono::microseconds m_pipe_rtt_updated{};
+
   torrent::utils::SchedulerEntry m_delay_remove_choked;
   torrent::utils::SchedulerEntry m_delay_process_unordered;
 };
@@ -5,7 +5,7 @@
 #include <algorithm>
 
 #include "exceptions.h"
-#include "rak/algorithm.h"
+#include "utils/bitfield_kernels.h"
 #include "utils/instrumentation.h"
 
 namespace torrent {
@@ -51,19 +51,39 @@ Bitfield::update() {
   // Clears the unused bits.
   clear_tail();
 
-  m_set = 0;
+  m_set = bitfield_count(m_data.get(), 0, m_size);
+}
 
-  iterator itr = m_data.get();
-  iterator last = end();
+Bitfield::size_type
+Bitfield::count_range(size_type first, size_type last) const {
+  if (first > last || last > m_size)
+    throw internal_error("Bitfield::count_range(...) invalid range.");
 
-  while (itr + sizeof(unsigned int) <= last) {
-    m_set += rak::popcount_wrapper(*reinterpret_cast<unsigned int*>(itr));
-    itr += sizeof(unsigned int);
-  }
+  return bitfield_count(m_data.get(), first, last);
+}
 
-  while (itr != last) {
-    m_set += rak::popcount_wrapper(*itr++);
-  }
+Bitfield::size_type
+Bitfield::find_first(size_type first, size_type last) const {
+  if (first > last || last > m_size)
+    throw internal_error("Bitfield::find_first(...) invalid range.");
+
+  return bitfield_find(m_data.get(), first, last);
+}
+
+Bitfield::size_type
+Bitfield::find_first_and(const Bitfield& bf, size_type first, size_type last) const {
+  if (first > last || last > m_size || bf.m_size != m_size)
+    throw internal_error("Bitfield::find_first_and(...) invalid range.");
+
+  return bitfield_find_and(m_data.get(), bf.m_data.get(), first, last);
+}
+
+Bitfield::size_type
+Bitfield::find_first_and_not(const Bitfield& bf, size_type first, size_type last) const {
+  if (first > last || last > m_size || bf.m_size != m_size)
+    throw internal_error("Bitfield::find_first_and_not(...) invalid range.");
+
+  return bitfield_find_and_not(m_data.get(), bf.m_data.get(), first, last);
 }
 
 void
@@ -50,6 +50,16 @@ public:
   void                copy(const Bitfield& bf);
   void                swap(Bitfield& bf) noexcept;
 
+  // Number of set bits in the range [first, last).
+  size_type           count_range(size_type first, size_type last) const;
+
+  // The first bit in the range [first, last) that is set, set in both
+  // bitfields, or set in this and not in 'bf'. Returns 'last' if there
+  // is none. The bitfields must be the same size.
+  size_type           find_first(size_type first, size_type last) const;
+  size_type           find_first_and(const Bitfield& bf, size_type first, size_type last) const;
+  size_type           find_first_and_not(const Bitfield& bf, size_type first, size_type last) const;
+
   void                set_all();
   void                set_range(size_type first, size_type last);
 
@@ -2,18 +2,29 @@
 
 #include "torrent/chunk_manager.h"
 
+#include <algorithm>
 #include <cassert>
 #include <sys/resource.h>
 
+#include "thread_main.h"
+#include "data/chunk_cache.h"
 #include "data/chunk_list.h"
+#include "data/thread_disk.h"
 #include "torrent/exceptions.h"
 #include "utils/instrumentation.h"
 
 namespace torrent {
 
-ChunkManager::ChunkManager() = default;
+ChunkManager::ChunkManager() :
+  m_chunkCache(std::make_unique<ChunkCache>(this)) {
+}
 
 ChunkManager::~ChunkManager() {
+  if (ThreadMain::thread_main() != nullptr)
+    ThreadMain::thread_main()->cancel_callback(this);
+
+  m_chunkCache->clear();
+
   assert(m_memoryUsage == 0 && "ChunkManager::~ChunkManager() m_memoryUsage != 0.");
   assert(m_memoryBlockCount == 0 && "ChunkManager::~ChunkManager() m_memoryBlockCount != 0.");
 }
@@ -57,6 +68,24 @@ ChunkManager::safe_free_diskspace() const {
   return m_memoryUsage + (uint64_t{512} << 20);
 }
 
+void
+ChunkManager::set_hash_check_workers(uint32_t count) {
+  if (count > 128)
+    throw input_error("Hash check worker count is out of range.");
+
+  m_hashCheckWorkers = count;
+
+  if (thread_disk() != nullptr)
+    thread_disk()->hash_check_queue()->set_worker_count(count);
+}
+
+uint64_t
+ChunkManager::hash_check_max_memory() const {
+  uint64_t per_thread = uint64_t{128} << 20;
+
+  return std::min(per_thread * (m_hashCheckWorkers + 1), m_maxMemoryUsage / 4);
+}
+
 void
 ChunkManager::insert(ChunkList* chunkList) {
   chunkList->set_manager(this);
@@ -77,14 +106,30 @@ ChunkManager::erase(ChunkList* chunkList) {
   std::iter_swap(itr, --base_type::end());
   base_type::pop_back();
 
+  m_chunkCache->erase(chunkList);
   chunkList->set_manager(NULL);
 }
 
+uint64_t
+ChunkManager::upload_cache_max_size() const {
+  return m_chunkCache->max_size();
+}
+
+void
+ChunkManager::set_upload_cache_max_size(uint64_t bytes) {
+  m_chunkCache->set_max_size(bytes);
+}
+
 bool
 ChunkManager::allocate(uint32_t size, int flags) {
   if (m_memoryUsage + size > (3 * m_maxMemoryUsage) / 4)
     try_free_memory((1 * m_maxMemoryUsage) / 4);
 
+  // Cached upload chunks are given up before failing, including when
+  // the cache itself is making room for a new chunk.
+  if (m_memoryUsage + size > m_maxMemoryUsage)
+    m_chunkCache->evict(m_memoryUsage + size - m_maxMemoryUsage);
+
   if (m_memoryUsage + size > m_maxMemoryUsage) {
     if (!(flags & allocate_dont_log))
       instrumentation_update(INSTRUMENTATION_MINCORE_ALLOC_FAILED, 1);
@@ -144,9 +189,44 @@ ChunkManager::try_free_memory(uint64_t size) {
 
 void
 ChunkManager::periodic_sync() {
+  m_writeBackRemaining = write_back_budget();
+
   sync_all(ChunkList::sync_use_timeout, 0);
 }
 
+// Allow two seconds worth of measured throughput per periodic sync,
+// as flushes started this tick may still be in progress at the next.
+uint64_t
+ChunkManager::write_back_budget() const {
+  return std::max<uint64_t>(16 << 20, m_writeBackRate * 2);
+}
+
+void
+ChunkManager::receive_write_back(uint64_t bytes, uint32_t ranges, std::chrono::microseconds latency) {
+  m_statsWriteBackBytes += bytes;
+  m_statsWriteBackFlushes++;
+  m_statsWriteBackQueueDepth = ranges;
+
+  m_statsWriteBackLatency = m_statsWriteBackFlushes == 1 ? latency.count() : (m_statsWriteBackLatency * 7 + latency.count()) / 8;
+
+  // Very short flushes are mostly overhead, e.g. ranges that were
+  // already written back, and don't show the device throughput.
+  if (latency < std::chrono::milliseconds(1))
+    return;
+
+  uint64_t rate = bytes * 1000000 / latency.count();
+
+  m_writeBackRate = m_writeBackRate == 0 ? rate : (m_writeBackRate * 7 + rate) / 8;
+}
+
+void
+ChunkManager::inc_stats_zerocopy(uint64_t bytes, bool copied) {
+  m_statsZerocopyBytes += bytes;
+
+  if (copied)
+    m_statsZerocopyCopiedBytes += bytes;
+}
+
 void
 ChunkManager::sync_all(int flags, uint64_t target) {
   if (empty())
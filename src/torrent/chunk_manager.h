@@ -1,6 +1,9 @@
 #ifndef LIBTORRENT_CHUNK_MANAGER_H
 #define LIBTORRENT_CHUNK_MANAGER_H
 
+#include <algorithm>
+#include <chrono>
+#include <memory>
 #include <vector>
 #include <torrent/common.h>
 
@@ -9,6 +12,8 @@ namespace torrent {
 // TODO: Currently all chunk lists are inserted, despite the download
 // not being open/active.
 
+class ChunkCache;
+
 class LIBTORRENT_EXPORT ChunkManager : private std::vector<ChunkList*> {
 public:
   using base_type = std::vector<ChunkList*>;
@@ -55,7 +60,9 @@ public:
   uint32_t            timeout_safe_sync() const                 { return m_timeoutSafeSync; }
   void                set_timeout_safe_sync(uint32_t seconds)   { m_timeoutSafeSync = seconds; }
 
-  // Set to 0 to disable preloading.
+  // Set to 0 to disable preloading, 1 to use madvise, 2 to touch the
+  // pages directly and 3 to read ahead asynchronously on the disk
+  // thread.
   //
   // How the value is used is yet to be determined, but it won't be
   // able to use actual requests in the request queue as we can easily
@@ -71,6 +78,43 @@ public:
   uint32_t            preload_required_rate() const             { return m_preloadRequiredRate; }
   void                set_preload_required_rate(uint32_t bytes) { m_preloadRequiredRate = bytes; }
 
+  // Hash pieces as blocks arrive in order, so verifying a completed
+  // chunk does not need to read it back from storage. Off by default,
+  // as the data is then verified as received rather than as stored.
+  bool                hash_on_receive() const                   { return m_hashOnReceive; }
+  void                set_hash_on_receive(bool state)           { m_hashOnReceive = state; }
+
+  // Size of the shared upload cache, set to 0 to disable it. When
+  // enabled it replaces the preload heuristics for uploads. Cached
+  // chunks count towards the memory usage and are evicted before an
+  // allocation fails.
+  uint64_t            upload_cache_max_size() const;
+  void                set_upload_cache_max_size(uint64_t bytes);
+
+  ChunkCache*         chunk_cache()                             { return m_chunkCache.get(); }
+
+  // Send piece data to unencrypted peers with sendfile when the part
+  // is backed by an open file, avoiding the copy from mapped memory.
+  bool                upload_sendfile() const                   { return m_uploadSendfile; }
+  void                set_upload_sendfile(bool state)           { m_uploadSendfile = state; }
+
+  // Send piece data to unencrypted peers with MSG_ZEROCOPY, keeping
+  // chunks mapped until the kernel reports the pages were sent. Takes
+  // precedence over sendfile. Buffered chunks are still copied, as
+  // their memory may be reused before the send completes.
+  bool                upload_zerocopy() const                   { return m_uploadZerocopy; }
+  void                set_upload_zerocopy(bool state)           { m_uploadZerocopy = state; }
+
+  // Number of worker threads hashing chunks in addition to the disk
+  // thread. Set to 0 to only hash on the disk thread.
+  uint32_t            hash_check_workers() const                { return m_hashCheckWorkers; }
+  void                set_hash_check_workers(uint32_t count);
+
+  // The amount of memory hash checking may keep mapped at once, scaled
+  // by the number of hashing threads and capped by the memory budget.
+  // At least one chunk is checked at a time regardless.
+  uint64_t            hash_check_max_memory() const;
+
 
   void                insert(ChunkList* chunkList);
   void                erase(ChunkList* chunkList);
@@ -96,6 +140,29 @@ public:
 
   void                periodic_sync();
 
+  // Periodic syncs flush at most this many bytes per call, based on
+  // the write-back throughput measured so far. Chunks past their sync
+  // timeout are flushed regardless.
+  uint64_t            write_back_budget() const;
+  uint64_t            write_back_remaining() const              { return m_writeBackRemaining; }
+  void                consume_write_back(uint64_t bytes)        { m_writeBackRemaining -= std::min(m_writeBackRemaining, bytes); }
+
+  void                receive_write_back(uint64_t bytes, uint32_t ranges, std::chrono::microseconds latency) LIBTORRENT_NO_EXPORT;
+
+  // Write-back rate in bytes per second and latency of flushes, as
+  // moving averages.
+  uint64_t            write_back_rate() const                   { return m_writeBackRate; }
+  uint64_t            stats_write_back_bytes() const            { return m_statsWriteBackBytes; }
+  uint64_t            stats_write_back_flushes() const          { return m_statsWriteBackFlushes; }
+  uint64_t            stats_write_back_latency() const          { return m_statsWriteBackLatency; }
+  uint32_t            stats_write_back_queue_depth() const      { return m_statsWriteBackQueueDepth; }
+
+  // Bytes of completed zero-copy sends, and the part the kernel
+  // copied anyway, e.g. for loopback or devices without scatter-gather.
+  uint64_t            stats_zerocopy_bytes() const              { return m_statsZerocopyBytes; }
+  uint64_t            stats_zerocopy_copied_bytes() const       { return m_statsZerocopyCopiedBytes; }
+  void                inc_stats_zerocopy(uint64_t bytes, bool copied) LIBTORRENT_NO_EXPORT;
+
   // Not sure if I wnt these here. Consider implementing a generic
   // statistics API.
   uint32_t            stats_preloaded() const                   { return m_statsPreloaded; }
@@ -126,6 +193,24 @@ private:
   uint32_t            m_preloadMinSize{256 << 10};
   uint32_t            m_preloadRequiredRate{5 << 10};
 
+  std::unique_ptr<ChunkCache> m_chunkCache;
+
+  uint64_t            m_writeBackRemaining{0};
+  uint64_t            m_writeBackRate{0};
+  uint64_t            m_statsWriteBackBytes{0};
+  uint64_t            m_statsWriteBackFlushes{0};
+  uint64_t            m_statsWriteBackLatency{0};
+  uint32_t            m_statsWriteBackQueueDepth{0};
+
+  bool                m_hashOnReceive{false};
+  bool                m_uploadSendfile{false};
+  bool                m_uploadZerocopy{false};
+
+  uint32_t            m_hashCheckWorkers{0};
+
+  uint64_t            m_statsZerocopyBytes{0};
+  uint64_t            m_statsZerocopyCopiedBytes{0};
+
   uint32_t            m_statsPreloaded{0};
   uint32_t            m_statsNotPreloaded{0};
 
@@ -46,6 +46,8 @@ class ClientInfo;
 class ClientList;
 class ConnectionList;
 class ConnectionManager;
+class CryptoQueue;
+class DiffieHellmanPool;
 class DhtRouter;
 class Download;
 class DownloadInfo;
@@ -77,6 +79,7 @@ class Throttle;
 class TrackerController;
 class TrackerList;
 class TransferList;
+class UtpContext;
 
 namespace net {
 class HttpGet;
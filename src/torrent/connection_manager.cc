@@ -3,23 +3,40 @@
 #include "torrent/connection_manager.h"
 
 #include "net/listen.h"
+#include "net/utp_context.h"
+#include "protocol/handshake_encryption.h"
 #include "torrent/exceptions.h"
 #include "torrent/net/socket_address.h"
 #include "torrent/net/network_config.h"
+#include "torrent/utils/log.h"
+#include "utils/crypto_queue.h"
+#include "utils/diffie_hellman_pool.h"
 
 namespace torrent {
 
 ConnectionManager::ConnectionManager() :
-  m_listen(new Listen) {
+  m_listen(new Listen),
+  m_utp(new UtpContext),
+  m_crypto_queue(new CryptoQueue),
+  m_diffie_hellman_pool(new DiffieHellmanPool(HandshakeEncryption::dh_prime, HandshakeEncryption::dh_prime_length,
+                                              HandshakeEncryption::dh_generator, HandshakeEncryption::dh_generator_length)) {
 }
 
 ConnectionManager::~ConnectionManager() {
+  delete m_diffie_hellman_pool;
+  delete m_crypto_queue;
+  delete m_utp;
   delete m_listen;
 }
 
 bool
 ConnectionManager::can_connect() const {
-  return m_size < m_maxSize;
+  return size() < m_maxSize;
+}
+
+ConnectionManager::size_type
+ConnectionManager::size() const {
+  return m_size + m_utp->bridge_count();
 }
 
 uint32_t
@@ -71,12 +88,27 @@ ConnectionManager::listen_open(port_type begin, port_type end) {
 
   config::network_config()->set_listen_port(m_listen->port());
 
+  if (m_utp_enabled) {
+    auto utp_address = sa_copy(bind_address.get());
+    sa_set_port(utp_address.get(), m_listen->port());
+
+    if (m_utp->open(utp_address.get()))
+      inc_socket_count();
+    else
+      lt_log_print(LOG_CONNECTION_LISTEN, "failed to open uTP socket on listen port : %s", std::strerror(errno));
+  }
+
   return true;
 }
 
 void
 ConnectionManager::listen_close() {
   m_listen->close();
+
+  if (m_utp->is_open()) {
+    m_utp->close();
+    dec_socket_count();
+  }
 }
 
 void
@@ -87,4 +119,53 @@ ConnectionManager::set_listen_backlog(int v) {
   config::network_config()->set_listen_backlog(v);
 }
 
+void
+ConnectionManager::set_utp_enabled(bool state) {
+  if (m_listen->is_open())
+    throw input_error("uTP must be enabled before listen port is opened");
+
+  m_utp_enabled = state;
+}
+
+void
+ConnectionManager::set_encryption_workers(uint32_t count) {
+  if (count > 64)
+    throw input_error("encryption workers must be between 0 and 64");
+
+  m_encryption_workers = count;
+  m_crypto_queue->set_worker_count(count);
+}
+
+uint32_t
+ConnectionManager::encryption_key_pool_size() const {
+  return m_encryption_key_pool_size;
+}
+
+void
+ConnectionManager::set_encryption_key_pool_size(uint32_t size) {
+  if (size > 1024)
+    throw input_error("encryption key pool size must be between 0 and 1024");
+
+  m_encryption_key_pool_size = size;
+  m_diffie_hellman_pool->set_max_size(size);
+}
+
+uint64_t
+ConnectionManager::encryption_key_pool_hits() const {
+  return m_diffie_hellman_pool->stats_hits();
+}
+
+uint64_t
+ConnectionManager::encryption_key_pool_misses() const {
+  return m_diffie_hellman_pool->stats_misses();
+}
+
+void
+ConnectionManager::set_request_pipeline(int mode) {
+  if (mode != request_pipeline_rate && mode != request_pipeline_bdp && mode != request_pipeline_compare)
+    throw input_error("invalid request pipeline mode");
+
+  m_request_pipeline = mode;
+}
+
 } // namespace torrent
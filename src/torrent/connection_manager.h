@@ -34,6 +34,16 @@ public:
     handshake_retry_encrypted    = 9
   };
 
+  // How deep to pipeline piece requests to each peer. The rate
+  // method scales the depth with the download rate. The bdp method
+  // uses the bandwidth-delay product, with the round-trip time read
+  // from TCP_INFO, falling back to the rate method if it is not
+  // known. Compare uses the rate method while still calculating the
+  // bdp depth, for comparing the two on the same peers.
+  static constexpr int request_pipeline_rate    = 0;
+  static constexpr int request_pipeline_bdp     = 1;
+  static constexpr int request_pipeline_compare = 2;
+
   using slot_filter_type   = std::function<uint32_t(const sockaddr*)>;
   using slot_throttle_type = std::function<ThrottlePair(const sockaddr*)>;
 
@@ -52,7 +62,9 @@ public:
   void                inc_socket_count()                      { m_size++; }
   void                dec_socket_count()                      { m_size--; }
 
-  size_type           size() const                            { return m_size; }
+  // Includes our ends of the local socket pairs bridging uTP
+  // connections.
+  size_type           size() const;
   size_type           max_size() const                        { return m_maxSize; }
 
   void                set_max_size(size_type s)               { m_maxSize = s; }
@@ -67,12 +79,42 @@ public:
 
   void                set_listen_backlog(int backlog);
 
+  // Accept and make uTP connections on a datagram socket bound to the
+  // listen port, falling back to TCP for outgoing connections that
+  // get no reply. DHT must then use a different port. Must be set
+  // before the listen port is opened.
+  bool                is_utp_enabled() const                  { return m_utp_enabled; }
+  void                set_utp_enabled(bool state);
+
+  // Number of worker threads generating RC4 keystream ahead of use
+  // for encrypted peer connections. Zero encrypts inline on the
+  // connection's thread. Applies to new connections.
+  uint32_t            encryption_workers() const              { return m_encryption_workers; }
+  void                set_encryption_workers(uint32_t count);
+
+  // Number of Diffie-Hellman key pairs for encrypted handshakes kept
+  // generated ahead of use by a background thread. Zero generates
+  // each key pair inline.
+  uint32_t            encryption_key_pool_size() const;
+  void                set_encryption_key_pool_size(uint32_t size);
+
+  // Handshakes that took a pooled key pair, and those that found the
+  // pool empty and generated one inline.
+  uint64_t            encryption_key_pool_hits() const;
+  uint64_t            encryption_key_pool_misses() const;
+
+  int                 request_pipeline() const                { return m_request_pipeline; }
+  void                set_request_pipeline(int mode);
+
   // The slot returns a ThrottlePair to use for the given address, or
   // NULLs to use the default throttle.
   slot_throttle_type& address_throttle()  { return m_slot_address_throttle; }
 
   // For internal usage.
   Listen*             listen()            { return m_listen; }
+  UtpContext*         utp()               { return m_utp; }
+  CryptoQueue*        crypto_queue()      { return m_crypto_queue; }
+  DiffieHellmanPool*  diffie_hellman_pool() { return m_diffie_hellman_pool; }
 
 private:
   size_type           m_size{0};
@@ -80,6 +122,17 @@ private:
 
   Listen*             m_listen;
 
+  UtpContext*         m_utp;
+  bool                m_utp_enabled{false};
+
+  CryptoQueue*        m_crypto_queue;
+  uint32_t            m_encryption_workers{0};
+
+  DiffieHellmanPool*  m_diffie_hellman_pool;
+  uint32_t            m_encryption_key_pool_size{0};
+
+  int                 m_request_pipeline{request_pipeline_rate};
+
   slot_filter_type    m_slot_filter;
   slot_throttle_type  m_slot_address_throttle;
 };
@@ -118,7 +118,7 @@ Block::erase(BlockTransfer* transfer) {
   if (transfer->peer_info() != NULL)
     throw internal_error("Block::erase(...) transfer has non-null peer info");
 
-  m_notStalled -= transfer->stall() == 0;
+  remove_not_stalled(transfer);
 
   if (transfer->is_queued()) {
     auto itr = std::find(m_queued.begin(), m_queued.end(), transfer);
@@ -279,7 +279,7 @@ Block::transfer_dissimilar(BlockTransfer* transfer) {
   if (!transfer->is_not_leader() || m_leader == transfer)
     throw internal_error("Block::transfer_dissimilar(...) transfer is the leader.");
 
-  m_notStalled -= transfer->stall() == 0;
+  remove_not_stalled(transfer);
 
   // Why not just delete? Gets done by completed(), though when
   // erasing the leader we need to remove dissimilar unless we have
@@ -304,9 +304,7 @@ Block::stalled_transfer(BlockTransfer* transfer) {
     if (m_notStalled == 0)
       throw internal_error("Block::stalled(...) m_notStalled == 0.");
 
-    m_notStalled--;
-
-    // Do magic here.
+    remove_not_stalled(transfer);
   }
 
   transfer->set_stall(transfer->stall() + 1);
@@ -380,13 +378,26 @@ Block::invalidate_transfer(BlockTransfer* transfer) {
     return; // Consider if this should be an exception.
   }
 
-  m_notStalled -= (transfer->stall() == 0);
+  remove_not_stalled(transfer);
 
   // Do the canceling magic here. 
   if (transfer->peer_info()->connection() != NULL)
     transfer->peer_info()->connection()->cancel_transfer(transfer);
 }
 
+// Once no transfer of an unfinished block is progressing, the block
+// can be delegated again, so let the parent know it is free.
+void
+Block::remove_not_stalled(BlockTransfer* transfer) {
+  if (transfer->stall() != 0)
+    return;
+
+  m_notStalled--;
+
+  if (m_notStalled == 0 && m_state == STATE_INCOMPLETE && !is_finished())
+    m_parent->block_freed(this);
+}
+
 void
 Block::remove_erased_transfers() {
   auto split = std::stable_partition(m_transfers.begin(), m_transfers.end(), std::not_fn(std::mem_fn(&BlockTransfer::is_erased)));
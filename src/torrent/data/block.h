@@ -98,6 +98,7 @@ public:
 private:
 
   void                      invalidate_transfer(BlockTransfer* transfer) LIBTORRENT_NO_EXPORT;
+  void                      remove_not_stalled(BlockTransfer* transfer) LIBTORRENT_NO_EXPORT;
 
   void                      remove_erased_transfers() LIBTORRENT_NO_EXPORT;
   void                      remove_non_leader_transfers() LIBTORRENT_NO_EXPORT;
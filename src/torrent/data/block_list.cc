@@ -41,6 +41,7 @@
 
 #include "block_list.h"
 #include "exceptions.h"
+#include "transfer_list.h"
 
 namespace torrent {
 
@@ -79,6 +80,30 @@ BlockList::do_all_failed() {
   // Clear leaders when we want to redownload the chunk.
   std::for_each(begin(), end(), std::mem_fn(&Block::failed_leader));
   std::for_each(begin(), end(), std::mem_fn(&Block::retry_transfer));
+
+  block_freed(&base_type::front());
+}
+
+void
+BlockList::set_transfer_list(TransferList* t, uint64_t sequence) {
+  m_transferList = t;
+  m_sequence = sequence;
+}
+
+void
+BlockList::block_freed(const Block* block) {
+  uint32_t position = block - &base_type::front();
+
+  if (position >= size())
+    throw internal_error("BlockList::block_freed(...) block not in list.");
+
+  if (position >= m_firstFree)
+    return;
+
+  m_firstFree = position;
+
+  if (m_transferList != nullptr)
+    m_transferList->insert_free(this);
 }
 
 } // namespace torrent
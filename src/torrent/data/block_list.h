@@ -62,6 +62,24 @@ public:
 
   void                do_all_failed();
 
+  // Blocks before 'first_free()' are finished or have a transfer that
+  // isn't stalled, so the Delegator can skip them. It is only a lower
+  // bound, raised by the Delegator as it hands out blocks and lowered
+  // when a block's transfers stall or go away.
+  uint32_t            first_free() const            { return m_firstFree; }
+  bool                has_free() const              { return m_firstFree < size(); }
+  void                set_first_free(uint32_t pos)  { m_firstFree = pos; }
+
+  // Insertion order in the TransferList, which keeps BlockLists with
+  // free blocks in its free lists.
+  uint64_t            sequence() const              { return m_sequence; }
+  bool                is_free_listed() const        { return m_freeListed; }
+
+  void                set_transfer_list(TransferList* t, uint64_t sequence) LIBTORRENT_NO_EXPORT;
+  void                set_free_listed(bool state)   { m_freeListed = state; }
+
+  void                block_freed(const Block* block) LIBTORRENT_NO_EXPORT;
+
 private:
   Piece               m_piece;
   priority_enum       m_priority{PRIORITY_OFF};
@@ -71,6 +89,11 @@ private:
   uint32_t            m_attempt{0};
 
   bool                m_bySeeder{false};
+
+  TransferList*       m_transferList{};
+  uint64_t            m_sequence{0};
+  uint32_t            m_firstFree{0};
+  bool                m_freeListed{false};
 };
 
 } // namespace torrent
@@ -60,14 +60,8 @@ download_data::calc_wanted_chunks() const {
 
   uint32_t result = 0;
 
-  for (const auto& wanted_range : wanted_ranges) {
-    //remaining = completed->count_range(itr->first, itr->second);
-
-    uint32_t idx = wanted_range.first;
-
-    while (idx != wanted_range.second)
-      result += !m_completed_bitfield.get(idx++);
-  }
+  for (const auto& wanted_range : wanted_ranges)
+    result += wanted_range.second - wanted_range.first - m_completed_bitfield.count_range(wanted_range.first, wanted_range.second);
 
   return result;
 }
@@ -3,6 +3,7 @@
 #include "torrent/data/file_list.h"
 
 #include <algorithm>
+#include <cerrno>
 #include <cstdint>
 #include <cstring>
 #include <limits>
@@ -22,6 +23,7 @@
 #include "torrent/data/file.h"
 #include "torrent/data/file_manager.h"
 #include "torrent/utils/log.h"
+#include "utils/bitfield_kernels.h"
 
 #define LT_LOG_FL(log_level, log_fmt, ...)                              \
   lt_log_print_data(LOG_STORAGE_##log_level, (&m_data), "file_list", log_fmt, __VA_ARGS__);
@@ -145,6 +147,14 @@ FileList::set_max_file_size(uint64_t size) {
   m_max_file_size = size;
 }
 
+void
+FileList::set_buffered(bool state) {
+  if (is_open())
+    throw input_error("Tried to change the storage mode for an open download.");
+
+  m_buffered = state;
+}
+
 // This function should really ensure that we arn't dealing files
 // spread over multiple mount-points.
 uint64_t
@@ -547,7 +557,7 @@ FileList::open_file(File* file_node, const Path& lastPath, bool hashing, int fla
 }
 
 MemoryChunk
-FileList::create_chunk_part(FileList::iterator itr, uint64_t offset, uint32_t length, bool hashing, int prot) const {
+FileList::create_chunk_part(FileList::iterator itr, uint64_t offset, uint32_t length, bool hashing, int prot, int* direct_fd) const {
   offset -= (*itr)->offset();
   length = std::min<uint64_t>(length, (*itr)->size_bytes() - offset);
 
@@ -562,6 +572,22 @@ FileList::create_chunk_part(FileList::iterator itr, uint64_t offset, uint32_t le
   if (!(*itr)->prepare(hashing, prot, 0))
     return MemoryChunk();
 
+  // Buffered chunks are filled on the disk thread by ChunkList, hashing
+  // chunks with O_DIRECT into an aligned buffer if 'direct_fd' is set.
+  if (hashing && manager->file_manager()->hashing_direct_io()) {
+    *direct_fd = manager->file_manager()->open_direct(itr->get());
+
+    if (*direct_fd != -1)
+      return SocketFile((*itr)->file_descriptor()).create_aligned_buffer_chunk(offset, length, prot);
+
+    // Closed if it was the least active file when making room.
+    if (!(*itr)->prepare(hashing, prot, 0))
+      return MemoryChunk();
+  }
+
+  if (m_buffered || (manager->file_manager()->hashing_direct_io() && hashing))
+    return SocketFile((*itr)->file_descriptor()).create_buffer_chunk(offset, length, prot);
+
   auto mc = SocketFile((*itr)->file_descriptor()).create_chunk(offset, length, prot, MemoryChunk::map_shared);
 
   if (!mc.is_valid())
@@ -598,6 +624,9 @@ FileList::create_chunk(uint64_t offset, uint32_t length, bool hashing, int prot)
       return file->is_valid_position(offset);
     });
 
+  bool direct_io = hashing && manager->file_manager()->hashing_direct_io();
+  bool buffered  = m_buffered || direct_io;
+
   for (; length != 0; ++itr) {
     if (itr == end())
       throw internal_error("FileList could not find a valid file for chunk", data()->hash());
@@ -605,14 +634,27 @@ FileList::create_chunk(uint64_t offset, uint32_t length, bool hashing, int prot)
     if ((*itr)->size_bytes() == 0)
       continue;
 
-    MemoryChunk mc = create_chunk_part(itr, offset, length, hashing, prot);
+    int direct_fd = -1;
+    MemoryChunk mc = create_chunk_part(itr, offset, length, hashing, prot, &direct_fd);
 
-    if (!mc.is_valid())
+    // Releasing the parts created so far may change errno, which the
+    // caller reports.
+    if (!mc.is_valid()) {
+      int error = errno;
+      chunk.reset();
+      errno = error;
       return nullptr;
+    }
 
-    chunk->push_back(ChunkPart::MAPPED_MMAP, mc);
+    if (buffered && !(*itr)->is_padding())
+      chunk->push_back(ChunkPart::MAPPED_BUFFER, mc);
+    else
+      chunk->push_back(ChunkPart::MAPPED_MMAP, mc);
     chunk->back().set_file(itr->get(), offset - (*itr)->offset());
 
+    if (direct_io && !(*itr)->is_padding())
+      chunk->back().set_uncached(direct_fd);
+
     offset += mc.size();
     length -= mc.size();
   }
@@ -702,9 +744,7 @@ FileList::update_completed() {
 
     auto entryItr = begin();
 
-    for (Bitfield::size_type index = 0; index < bitfield()->size_bits(); ++index)
-      if (bitfield()->get(index))
-        entryItr = inc_completed(entryItr, index);
+    bitfield_for_each(bitfield()->begin(), 0, bitfield()->size_bits(), [&](uint32_t index) { entryItr = inc_completed(entryItr, index); });
   }
 }
 
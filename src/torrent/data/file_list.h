@@ -92,6 +92,12 @@ public:
   uint64_t            max_file_size() const                           { return m_max_file_size; }
   void                set_max_file_size(uint64_t size);
 
+  // Read chunks into buffers with pread and write them back with
+  // pwrite on sync, instead of mapping the files. May only be changed
+  // while the download is closed.
+  bool                is_buffered() const                             { return m_buffered; }
+  void                set_buffered(bool state);
+
   // If the files span multiple disks, the one with the least amount
   // of free diskspace will be returned.
   uint64_t            free_diskspace() const;
@@ -145,7 +151,7 @@ private:
   void                make_directory(Path::const_iterator pathBegin, Path::const_iterator pathEnd, Path::const_iterator startItr) LIBTORRENT_NO_EXPORT;
 
   Chunk*              create_chunk(uint64_t offset, uint32_t length, bool hashing, int prot) LIBTORRENT_NO_EXPORT;
-  MemoryChunk         create_chunk_part(FileList::iterator itr, uint64_t offset, uint32_t length, bool hashing, int prot) const LIBTORRENT_NO_EXPORT;
+  MemoryChunk         create_chunk_part(FileList::iterator itr, uint64_t offset, uint32_t length, bool hashing, int prot, int* direct_fd) const LIBTORRENT_NO_EXPORT;
 
   download_data       m_data;
 
@@ -162,6 +168,8 @@ private:
   // Reorder next minor version bump:
   bool                m_multi_file{false};
   std::string         m_frozen_root_dir;
+
+  bool                m_buffered{false};
 };
 
 } // namespace torrent
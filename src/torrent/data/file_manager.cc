@@ -9,6 +9,7 @@
 
 #include "manager.h"
 #include "data/socket_file.h"
+#include "data/thread_disk.h"
 #include "torrent/exceptions.h"
 #include "torrent/data/file.h"
 
@@ -25,7 +26,7 @@ FileManager::set_max_open_files(size_type s) {
 
   m_max_open_files = s;
 
-  while (size() > m_max_open_files)
+  while (open_files() > m_max_open_files)
     close_least_active();
 }
 
@@ -37,10 +38,10 @@ FileManager::open(value_type file, [[maybe_unused]] bool hashing, int prot, int
   if (file->is_open())
     close(file);
 
-  if (size() > m_max_open_files)
+  if (open_files() > m_max_open_files)
     throw internal_error("FileManager::open_file(...) m_openSize > m_max_open_files.");
 
-  if (size() == m_max_open_files)
+  while (open_files() >= m_max_open_files)
     close_least_active();
 
   SocketFile fd;
@@ -79,7 +80,18 @@ FileManager::close(value_type file) {
   if (file->is_padding())
     return;
 
-  SocketFile(file->file_descriptor()).close();
+  close_fd(file->file_descriptor());
+
+  auto direct_itr = m_direct_fds.find(file);
+
+  if (direct_itr != m_direct_fds.end()) {
+    if (direct_itr->second != -1) {
+      close_fd(direct_itr->second);
+      m_direct_open--;
+    }
+
+    m_direct_fds.erase(direct_itr);
+  }
 
   file->set_protection(0);
   file->set_file_descriptor(-1);
@@ -95,6 +107,41 @@ FileManager::close(value_type file) {
   m_files_closed_counter++;
 }
 
+int
+FileManager::open_direct(value_type file) {
+  if (!file->is_open())
+    throw internal_error("FileManager::open_direct(...) file is not open.");
+
+  auto itr = m_direct_fds.find(file);
+
+  if (itr != m_direct_fds.end())
+    return itr->second;
+
+  while (open_files() >= m_max_open_files)
+    close_least_active();
+
+  // The file itself may have been the least active one.
+  if (!file->is_open())
+    return -1;
+
+  int fd = SocketFile::open_direct(file->frozen_path());
+
+  if (fd != -1)
+    m_direct_open++;
+
+  m_direct_fds.emplace(file, fd);
+  return fd;
+}
+
+// The disk thread may still have requests using the descriptor.
+void
+FileManager::close_fd(int fd) {
+  if (thread_disk() != nullptr)
+    thread_disk()->disk_io()->close_file(fd);
+  else
+    SocketFile(fd).close();
+}
+
 void
 FileManager::close_least_active() {
   File* least = nullptr;
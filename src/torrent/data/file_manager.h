@@ -1,6 +1,7 @@
 #ifndef LIBTORRENT_DATA_FILE_MANAGER_H
 #define LIBTORRENT_DATA_FILE_MANAGER_H
 
+#include <unordered_map>
 #include <vector>
 #include <torrent/common.h>
 
@@ -25,7 +26,8 @@ public:
   FileManager() = default;
   ~FileManager();
 
-  size_type           open_files() const                    { return base_type::size(); }
+  // Includes the O_DIRECT descriptors opened for hashing.
+  size_type           open_files() const                    { return base_type::size() + m_direct_open; }
 
   size_type           max_open_files() const                { return m_max_open_files; }
   void                set_max_open_files(size_type s);
@@ -36,9 +38,21 @@ public:
   bool                advise_random_hashing() const         { return m_advise_random_hashing; }
   void                set_advise_random_hashing(bool state) { m_advise_random_hashing = state; }
 
+  // Hash checking reads chunks into buffers on the disk thread with
+  // O_DIRECT, or drops the pages the reads brought in where that is
+  // not supported, so rechecks do not evict the page cache.
+  bool                hashing_direct_io() const             { return m_hashing_direct_io; }
+  void                set_hashing_direct_io(bool state)     { m_hashing_direct_io = state; }
+
   bool                open(value_type file, bool hashing, int prot, int flags);
   void                close(value_type file);
 
+  // Returns the read-only O_DIRECT descriptor of an open file,
+  // opening it on first use, or -1 if the filesystem does not support
+  // it or the file was closed to make room. It counts against
+  // max_open_files and is closed along with the file.
+  int                 open_direct(value_type file);
+
   // TODO: Close all files held by a download after hashing. Also flush all memory chunks.
 
   void                close_least_active();
@@ -52,9 +66,17 @@ private:
   FileManager(const FileManager&) = delete;
   FileManager& operator=(const FileManager&) = delete;
 
+  static void         close_fd(int fd) LIBTORRENT_NO_EXPORT;
+
   size_type           m_max_open_files{0};
   bool                m_advise_random{false};
   bool                m_advise_random_hashing{false};
+  bool                m_hashing_direct_io{false};
+
+  // The O_DIRECT descriptors by file, with -1 where opening one
+  // failed, and the number actually open.
+  std::unordered_map<File*, int> m_direct_fds;
+  size_type                      m_direct_open{0};
 
   uint64_t            m_files_opened_counter{0};
   uint64_t            m_files_closed_counter{0};
@@ -42,6 +42,9 @@ TransferList::clear() {
   }
 
   base_type::clear();
+
+  m_freeLists[0].clear();
+  m_freeLists[1].clear();
 }
 
 TransferList::iterator
@@ -50,6 +53,7 @@ TransferList::insert(const Piece& piece, uint32_t blockSize) {
     throw internal_error("Delegator::new_chunk(...) received an index that is already delegated.");
 
   auto blockList = new BlockList(piece, blockSize);
+  blockList->set_transfer_list(this, m_sequence++);
 
   m_slot_queued(piece.index());
 
@@ -63,11 +67,41 @@ TransferList::erase(iterator itr) {
   if (itr == end())
     throw internal_error("TransferList::erase(...) itr == m_chunks.end().");
 
+  if ((*itr)->is_free_listed()) {
+    auto& free_list = m_freeLists[(*itr)->priority() == PRIORITY_HIGH];
+    free_list.erase(std::find(free_list.begin(), free_list.end(), *itr));
+  }
+
   delete *itr;
 
   return base_type::erase(itr);
 }
 
+void
+TransferList::insert_free(BlockList* blockList) {
+  if (blockList->is_free_listed() || blockList->priority() == PRIORITY_OFF)
+    return;
+
+  auto& free_list = m_freeLists[blockList->priority() == PRIORITY_HIGH];
+  auto itr = std::upper_bound(free_list.begin(), free_list.end(), blockList, [](BlockList* a, BlockList* b) {
+      return a->sequence() < b->sequence();
+    });
+
+  free_list.insert(itr, blockList);
+  blockList->set_free_listed(true);
+}
+
+void
+TransferList::erase_free(priority_enum p, uint32_t position) {
+  auto& free_list = m_freeLists[p == PRIORITY_HIGH];
+
+  if (position >= free_list.size())
+    throw internal_error("TransferList::erase_free(...) position out of range.");
+
+  free_list[position]->set_free_listed(false);
+  free_list.erase(free_list.begin() + position);
+}
+
 void
 TransferList::finished(BlockTransfer* transfer) {
   if (!transfer->is_valid())
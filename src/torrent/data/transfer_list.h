@@ -11,6 +11,7 @@ class LIBTORRENT_EXPORT TransferList : public std::vector<BlockList*> {
 public:
   using base_type           = std::vector<BlockList*>;
   using completed_list_type = std::vector<std::pair<int64_t, uint32_t>>;
+  using free_list_type      = std::vector<BlockList*>;
 
   using base_type::value_type;
   using base_type::reference;
@@ -52,6 +53,14 @@ public:
 
   void                finished(BlockTransfer* transfer);
 
+  // BlockLists of normal or high priority that may have free blocks,
+  // in insertion order. BlockLists that turn out to be full are
+  // removed by the Delegator as it comes across them.
+  const free_list_type& free_list(priority_enum p) const { return m_freeLists[p == PRIORITY_HIGH]; }
+
+  void                insert_free(BlockList* blockList);
+  void                erase_free(priority_enum p, uint32_t position);
+
   void                hash_succeeded(uint32_t index, Chunk* chunk);
   void                hash_failed(uint32_t index, Chunk* chunk);
 
@@ -76,6 +85,9 @@ private:
 
   completed_list_type m_completedList;
 
+  free_list_type      m_freeLists[2];
+  uint64_t            m_sequence{0};
+
   uint32_t            m_succeededCount{0};
   uint32_t            m_failedCount{0};
 };
@@ -45,6 +45,11 @@ const Bitfield*   Peer::bitfield() const   { return c_ptr()->c_peer_chunks()->bi
 
 uint32_t Peer::incoming_queue_size() const { return c_ptr()->request_list()->queued_size(); }
 uint32_t Peer::outgoing_queue_size() const { return c_ptr()->c_peer_chunks()->upload_queue()->size(); }
+
+uint32_t Peer::incoming_pipe_size() const      { return c_ptr()->request_list()->last_pipe_size(); }
+uint32_t Peer::incoming_pipe_size_rate() const { return c_ptr()->request_list()->last_pipe_size_rate(); }
+uint32_t Peer::incoming_pipe_size_bdp() const  { return c_ptr()->request_list()->last_pipe_size_bdp(); }
+uint32_t Peer::incoming_rtt() const            { return c_ptr()->request_list()->pipe_rtt(); }
 uint32_t Peer::chunks_done() const         { return c_ptr()->c_peer_chunks()->bitfield()->size_set(); }
 
 uint32_t Peer::failed_counter() const      { return peer_info()->failed_counter(); }
@@ -56,6 +56,15 @@ public:
   uint32_t             incoming_queue_size() const;
   uint32_t             outgoing_queue_size() const;
 
+  // Request pipeline depth last used for this peer, and the depths
+  // calculated by each ConnectionManager::request_pipeline_* method.
+  // The bdp depth is zero when not calculated. Round-trip time is in
+  // microseconds.
+  uint32_t             incoming_pipe_size() const;
+  uint32_t             incoming_pipe_size_rate() const;
+  uint32_t             incoming_pipe_size_bdp() const;
+  uint32_t             incoming_rtt() const;
+
   uint32_t             chunks_done() const;
 
   uint32_t             failed_counter() const;
@@ -12,6 +12,7 @@
 #include "torrent/peer/client_list.h"
 #include "torrent/peer/peer_info.h"
 #include "torrent/utils/log.h"
+#include "utils/object_pool.h"
 
 #define LT_LOG_EVENTS(log_fmt, ...)                                     \
   lt_log_print_info(LOG_PEER_LIST_EVENTS, m_info, "peer_list", log_fmt, __VA_ARGS__);
@@ -25,14 +26,15 @@ namespace torrent {
 ipv4_table PeerList::m_ipv4_table;
 
 PeerList::PeerList()
-  : m_available_list(new AvailableList) {
+  : m_available_list(new AvailableList),
+    m_peer_info_pool(new ObjectPool<PeerInfo>) {
 }
 
 PeerList::~PeerList() {
   LT_LOG_EVENTS("deleting list total:%zu available:%zu", size(), m_available_list->size());
 
-  for (const auto& v : *this)
-    delete v.second;
+  for (auto itr = base_type::begin(); itr != base_type::end(); itr++)
+    m_peer_info_pool->destroy(itr.peer_info());
 
   base_type::clear();
 
@@ -55,8 +57,6 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
     return NULL;
   }
 
-  range_type range = base_type::equal_range(sock_key);
-
   auto addr_str = sa_addr_str(sa);
   auto port = sa_port(sa);
 
@@ -65,12 +65,15 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
   //
   // What we do depends on the flags, but for now just allow one
   // PeerInfo per address key and do nothing.
-  if (range.first != range.second) {
+  if (base_type::find(sock_key) != base_type::end()) {
     LT_LOG_EVENTS("address already exists " LT_LOG_SA_FMT, addr_str.c_str(), port);
     return NULL;
   }
 
-  auto peerInfo = new PeerInfo(sa);
+  if (sa->sa_family != AF_INET && sa->sa_family != AF_INET6)
+    throw internal_error("PeerList::insert_address() only AF_INET addresses are supported");
+
+  auto peerInfo = create_peer_info(sa);
   peerInfo->set_listen_port(port);
 
   if (sa->sa_family == AF_INET) {
@@ -82,15 +85,10 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
 
   } else if (sa->sa_family == AF_INET6) {
     // Currently nothing to do for IPv6 addresses.
-
-  } else {
-    throw internal_error("PeerList::insert_address() only AF_INET addresses are supported");
   }
 
   manager->client_list()->retrieve_unknown(&peerInfo->mutable_client_info());
 
-  base_type::insert(range.second, value_type(sock_key, peerInfo));
-
   if ((flags & address_available) && peerInfo->listen_port() != 0) {
     m_available_list->insert_unique(sa);
 
@@ -149,12 +147,12 @@ PeerList::insert_available(const void* al) {
     // ever want to connect. Just update the timer for the last
     // availability notice if the peer isn't really ideal, but might
     // be used in an emergency.
-    range_type range = base_type::equal_range(sock_key);
+    auto itr = base_type::find(sock_key);
 
-    if (range.first != range.second) {
+    if (itr != base_type::end()) {
       // Add some logic here to select the best PeerInfo, but for now
       // just assume the first one is the only one that exists.
-      PeerInfo* peerInfo = range.first->second;
+      PeerInfo* peerInfo = itr->second;
 
       if (peerInfo->listen_port() == 0)
         peerInfo->set_port(port);
@@ -233,18 +231,16 @@ PeerList::connected(const sockaddr* sa, int flags) {
   }
 
   PeerInfo* peerInfo;
-  range_type range = base_type::equal_range(sock_key);
+  auto itr = base_type::find(sock_key);
 
-  if (range.first == range.second) {
+  if (itr == base_type::end()) {
     // Create a new entry.
-    peerInfo = new PeerInfo(sa);
+    peerInfo = create_peer_info(sa);
     peerInfo->set_flags(filter_value & PeerInfo::mask_ip_table);
 
-    base_type::insert(range.second, value_type(sock_key, peerInfo));
-
-  } else if (!range.first->second->is_connected()) {
+  } else if (!itr->second->is_connected()) {
     // Use an old entry.
-    peerInfo = range.first->second;
+    peerInfo = itr->second;
     peerInfo->set_port(port);
 
   } else {
@@ -255,8 +251,8 @@ PeerList::connected(const sockaddr* sa, int flags) {
     // This also ensure we can connect to peers running on the same
     // host as the tracker.
     // if (flags & connect_keep_handshakes &&
-    //     range.first->second->is_handshake() &&
-    //     range.first->second->socket_address()->port() != address->port())
+    //     itr->second->is_handshake() &&
+    //     itr->second->socket_address()->port() != address->port())
     //   m_available_list->buffer()->push_back(*address);
 
     LT_LOG_EVENTS("connecting peer rejected, already connected (buggy, fixme): " LT_LOG_SA_FMT, addr_str.c_str(), port);
@@ -267,10 +263,8 @@ PeerList::connected(const sockaddr* sa, int flags) {
 
     //return NULL;
 
-    peerInfo = new PeerInfo(sa);
+    peerInfo = create_peer_info(sa);
     peerInfo->set_flags(filter_value & PeerInfo::mask_ip_table);
-
-    base_type::insert(range.second, value_type(sock_key, peerInfo));
   }
 
   if (flags & connect_filter_recent &&
@@ -297,15 +291,13 @@ void
 PeerList::disconnected(PeerInfo* p, int flags) {
   socket_address_key sock_key = socket_address_key::from_sockaddr(p->socket_address());
 
-  range_type range = base_type::equal_range(sock_key);
-
-  auto itr = std::find_if(range.first, range.second, [p](auto& v) { return p == v.second; });
+  auto itr = base_type::find(sock_key, p);
 
-  if (itr == range.second) {
-    if (std::none_of(base_type::begin(), base_type::end(), [p](auto& v){ return p == v.second; }))
-      throw internal_error("PeerList::disconnected(...) itr == range.second, doesn't exist.");
+  if (itr == base_type::end()) {
+    if (std::none_of(base_type::begin(), base_type::end(), [p](const auto& v){ return p == v.second; }))
+      throw internal_error("PeerList::disconnected(...) itr == end(), doesn't exist.");
     else
-      throw internal_error("PeerList::disconnected(...) itr == range.second, not in the range.");
+      throw internal_error("PeerList::disconnected(...) itr == end(), not under its address.");
   }
 
   disconnected(itr, flags);
@@ -353,12 +345,14 @@ PeerList::cull_peers(int flags) {
     timer = 0;
 
   for (auto itr = base_type::begin(); itr != base_type::end(); ) {
-    if (itr->second->is_connected() ||
-        itr->second->transfer_counter() != 0 || // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-        itr->second->last_connection() >= timer ||
+    PeerInfo* peerInfo = itr.peer_info();
+
+    if (peerInfo->is_connected() ||
+        peerInfo->transfer_counter() != 0 || // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+        peerInfo->last_connection() >= timer ||
 
         (flags & cull_keep_interesting &&
-         (itr->second->failed_counter() != 0 || itr->second->is_blocked()))) {
+         (peerInfo->failed_counter() != 0 || peerInfo->is_blocked()))) {
       itr++;
       continue;
     }
@@ -366,14 +360,8 @@ PeerList::cull_peers(int flags) {
     // ##################### TODO: LOG CULLING OF PEERS ######################
     //   *** AND STATS OF DISCONNECTING PEERS (the peer info...)...
 
-    // The key is a pointer to a member in the value, although the key
-    // shouldn't actually be used in erase (I think), just ot be safe
-    // we delete it after erase.
-    auto tmp = itr++;
-    PeerInfo* peerInfo = tmp->second;
-
-    base_type::erase(tmp);
-    delete peerInfo;
+    itr = base_type::erase(itr);
+    m_peer_info_pool->destroy(peerInfo);
 
     counter++;
   }
@@ -381,4 +369,23 @@ PeerList::cull_peers(int flags) {
   return counter;
 }
 
+size_t
+PeerList::memory_usage() const {
+  return base_type::memory_usage() + m_peer_info_pool->memory_usage();
+}
+
+PeerInfo*
+PeerList::create_peer_info(const sockaddr* sa) {
+  auto peerInfo = m_peer_info_pool->create(sa);
+
+  try {
+    base_type::insert(peerInfo);
+  } catch (...) {
+    m_peer_info_pool->destroy(peerInfo);
+    throw;
+  }
+
+  return peerInfo;
+}
+
 } // namespace torrent
@@ -1,27 +1,27 @@
 #ifndef LIBTORRENT_PEER_LIST_H
 #define LIBTORRENT_PEER_LIST_H
 
-#include <map>
 #include <memory>
 #include <torrent/common.h>
-#include <torrent/net/socket_address_key.h>
+#include <torrent/peer/peer_table.h>
 #include <torrent/utils/extents.h>
 
 namespace torrent {
 
 class DownloadInfo;
 
+template <typename T> class ObjectPool;
+
 using ipv4_table = extents<uint32_t, int>;
 
-class LIBTORRENT_EXPORT PeerList : private std::multimap<socket_address_key, PeerInfo*> {
+class LIBTORRENT_EXPORT PeerList : private PeerTable {
 public:
   friend class DownloadWrapper;
   friend class Handshake;
   friend class HandshakeManager;
   friend class ConnectionList;
 
-  using base_type  = std::multimap<socket_address_key, PeerInfo*>;
-  using range_type = std::pair<base_type::iterator, base_type::iterator>;
+  using base_type = PeerTable;
 
   using base_type::value_type;
   using base_type::reference;
@@ -65,6 +65,9 @@ public:
 
   uint32_t            cull_peers(int flags);
 
+  // Bytes used by the table and the pooled PeerInfo objects.
+  size_t              memory_usage() const;
+
   const_iterator         begin() const  { return base_type::begin(); }
   const_iterator         end() const    { return base_type::end(); }
   const_reverse_iterator rbegin() const { return base_type::rbegin(); }
@@ -86,8 +89,11 @@ private:
 
   static ipv4_table   m_ipv4_table;
 
-  DownloadInfo*                  m_info;
-  std::unique_ptr<AvailableList> m_available_list;
+  PeerInfo*           create_peer_info(const sockaddr* sa) LIBTORRENT_NO_EXPORT;
+
+  DownloadInfo*                          m_info;
+  std::unique_ptr<AvailableList>         m_available_list;
+  std::unique_ptr<ObjectPool<PeerInfo>>  m_peer_info_pool;
 };
 
 } // namespace torrent
@@ -0,0 +1,153 @@
+#include "config.h"
+
+#include "peer_table.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/random.h"
+
+namespace torrent {
+
+PeerTable::PeerTable() :
+  m_seed((uint64_t{random_uniform_uint32()} << 32) | random_uniform_uint32()) {
+}
+
+PeerTable::~PeerTable() = default;
+
+// Peer addresses come from other peers, so the hash is seeded per
+// table to keep them from choosing addresses that collide.
+uint64_t
+PeerTable::hash(const key_type& key) const {
+  static_assert(sizeof(key_type) <= 2 * sizeof(uint64_t) + sizeof(uint16_t), "socket_address_key is larger than expected");
+
+  uint64_t words[3]{};
+  std::memcpy(words, &key, sizeof(key_type));
+
+  uint64_t value = m_seed;
+
+  for (auto word : words) {
+    value ^= word;
+    value *= 0xbf58476d1ce4e5b9;
+    value ^= value >> 31;
+  }
+
+  return value;
+}
+
+PeerTable::const_iterator
+PeerTable::find(const key_type& key) const {
+  if (m_size == 0)
+    return end();
+
+  uint64_t h = hash(key);
+  uint8_t tag = h & 0x7f;
+
+  for (size_type index = (h >> 7) & (m_capacity - 1); m_ctrl[index] != ctrl_empty; index = (index + 1) & (m_capacity - 1))
+    if (m_ctrl[index] == tag && key_of(m_slots[index]) == key)
+      return const_iterator(this, index);
+
+  return end();
+}
+
+PeerTable::const_iterator
+PeerTable::find(const key_type& key, const PeerInfo* peer_info) const {
+  if (m_size == 0)
+    return end();
+
+  uint64_t h = hash(key);
+  uint8_t tag = h & 0x7f;
+
+  for (size_type index = (h >> 7) & (m_capacity - 1); m_ctrl[index] != ctrl_empty; index = (index + 1) & (m_capacity - 1))
+    if (m_ctrl[index] == tag && m_slots[index] == peer_info)
+      return const_iterator(this, index);
+
+  return end();
+}
+
+PeerTable::const_iterator
+PeerTable::insert(PeerInfo* peer_info) {
+  // Keep at least one slot in eight empty so probing terminates
+  // quickly, growing only if live entries rather than deleted ones
+  // fill the table.
+  if ((m_size + m_deleted + 1) * 8 > m_capacity * 7)
+    rehash((m_size + 1) * 2 > m_capacity ? std::max(m_capacity * 2, min_capacity) : m_capacity);
+
+  uint64_t h = hash(key_of(peer_info));
+  size_type index = (h >> 7) & (m_capacity - 1);
+
+  while (is_full(m_ctrl[index]))
+    index = (index + 1) & (m_capacity - 1);
+
+  if (m_ctrl[index] == ctrl_deleted)
+    m_deleted--;
+
+  m_ctrl[index] = h & 0x7f;
+  m_slots[index] = peer_info;
+  m_size++;
+
+  return const_iterator(this, index);
+}
+
+PeerTable::const_iterator
+PeerTable::erase(const_iterator itr) {
+  size_type index = itr.index();
+
+  if (index >= m_capacity || !is_full(m_ctrl[index]))
+    throw internal_error("PeerTable::erase(...) invalid iterator.");
+
+  // A slot followed by an empty one ends every probe sequence passing
+  // through it, so it can be made empty rather than deleted.
+  if (m_ctrl[(index + 1) & (m_capacity - 1)] == ctrl_empty) {
+    m_ctrl[index] = ctrl_empty;
+  } else {
+    m_ctrl[index] = ctrl_deleted;
+    m_deleted++;
+  }
+
+  m_slots[index] = nullptr;
+  m_size--;
+
+  return const_iterator(this, next_full(index + 1));
+}
+
+void
+PeerTable::clear() {
+  m_size = 0;
+  m_deleted = 0;
+  m_capacity = 0;
+
+  m_ctrl.reset();
+  m_slots.reset();
+}
+
+void
+PeerTable::rehash(size_type capacity) {
+  auto old_ctrl = std::move(m_ctrl);
+  auto old_slots = std::move(m_slots);
+  auto old_capacity = m_capacity;
+
+  m_ctrl = std::make_unique<uint8_t[]>(capacity);
+  m_slots = std::make_unique<PeerInfo*[]>(capacity);
+  m_capacity = capacity;
+  m_deleted = 0;
+
+  std::memset(m_ctrl.get(), ctrl_empty, capacity);
+
+  for (size_type old_index = 0; old_index < old_capacity; old_index++) {
+    if (!is_full(old_ctrl[old_index]))
+      continue;
+
+    uint64_t h = hash(key_of(old_slots[old_index]));
+    size_type index = (h >> 7) & (m_capacity - 1);
+
+    while (m_ctrl[index] != ctrl_empty)
+      index = (index + 1) & (m_capacity - 1);
+
+    m_ctrl[index] = h & 0x7f;
+    m_slots[index] = old_slots[old_index];
+  }
+}
+
+} // namespace torrent
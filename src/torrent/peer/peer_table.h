@@ -0,0 +1,151 @@
+#ifndef LIBTORRENT_PEER_TABLE_H
+#define LIBTORRENT_PEER_TABLE_H
+
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <torrent/common.h>
+#include <torrent/net/socket_address_key.h>
+#include <torrent/peer/peer_info.h>
+
+namespace torrent {
+
+// Open addressing hash table of PeerInfo keyed by socket address, used
+// by PeerList in place of a multimap so the known peers of a torrent
+// cost a pointer and a control byte each instead of a tree node.
+//
+// The key is not stored, but taken from the PeerInfo's address when
+// needed. Each control byte is either empty, deleted, or the low 7 bits
+// of the hash of the key, so probing rarely needs to look at the
+// PeerInfo. Several entries may have the same key.
+//
+// Iterators yield key and PeerInfo pairs by value. Erased slots are
+// marked deleted until the table is rehashed, which keeps iterators
+// other than the erased one valid. Inserts may rehash and invalidate
+// all iterators.
+class LIBTORRENT_EXPORT PeerTable {
+public:
+  using key_type        = socket_address_key;
+  using value_type      = std::pair<socket_address_key, PeerInfo*>;
+  using reference       = value_type;
+  using size_type       = size_t;
+  using difference_type = std::ptrdiff_t;
+
+  class const_iterator;
+  using iterator               = const_iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using reverse_iterator       = const_reverse_iterator;
+
+  static constexpr size_type min_capacity = 16;
+
+  PeerTable();
+  ~PeerTable();
+  PeerTable(const PeerTable&) = delete;
+  PeerTable& operator=(const PeerTable&) = delete;
+
+  bool                empty() const                { return m_size == 0; }
+  size_type           size() const                 { return m_size; }
+  size_type           capacity() const             { return m_capacity; }
+
+  // Bytes used by the table itself, not counting the PeerInfo objects.
+  size_type           memory_usage() const         { return m_capacity * (sizeof(PeerInfo*) + 1); }
+
+  const_iterator      begin() const;
+  const_iterator      end() const;
+  const_reverse_iterator rbegin() const;
+  const_reverse_iterator rend() const;
+
+  // The first entry with 'key', or the one pointing to 'peer_info'.
+  const_iterator      find(const key_type& key) const;
+  const_iterator      find(const key_type& key, const PeerInfo* peer_info) const;
+
+  const_iterator      insert(PeerInfo* peer_info);
+  const_iterator      erase(const_iterator itr);
+
+  void                clear();
+
+private:
+  friend class const_iterator;
+
+  static constexpr uint8_t ctrl_empty   = 0x80;
+  static constexpr uint8_t ctrl_deleted = 0xfe;
+
+  static bool         is_full(uint8_t ctrl)        { return !(ctrl & 0x80); }
+  static key_type     key_of(const PeerInfo* p)    { return socket_address_key::from_sockaddr(p->socket_address()); }
+
+  uint64_t            hash(const key_type& key) const;
+  size_type           next_full(size_type index) const;
+  size_type           prev_full(size_type index) const;
+
+  void                rehash(size_type capacity);
+
+  size_type           m_size{};
+  size_type           m_deleted{};
+  size_type           m_capacity{};
+  uint64_t            m_seed;
+
+  std::unique_ptr<uint8_t[]>    m_ctrl;
+  std::unique_ptr<PeerInfo*[]>  m_slots;
+};
+
+class LIBTORRENT_EXPORT PeerTable::const_iterator {
+public:
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type        = PeerTable::value_type;
+  using difference_type   = std::ptrdiff_t;
+  using reference         = value_type;
+
+  struct pointer {
+    const value_type* operator->() const { return &value; }
+    value_type        value;
+  };
+
+  const_iterator() = default;
+  const_iterator(const PeerTable* table, size_type index) : m_table(table), m_index(index) {}
+
+  reference           operator*() const            { return value_type(key_of(peer_info()), peer_info()); }
+  pointer             operator->() const           { return pointer{**this}; }
+
+  PeerInfo*           peer_info() const            { return m_table->m_slots[m_index]; }
+
+  const_iterator&     operator++()                 { m_index = m_table->next_full(m_index + 1); return *this; }
+  const_iterator      operator++(int)              { auto tmp = *this; ++*this; return tmp; }
+  const_iterator&     operator--()                 { m_index = m_table->prev_full(m_index); return *this; }
+  const_iterator      operator--(int)              { auto tmp = *this; --*this; return tmp; }
+
+  bool                operator==(const const_iterator& itr) const { return m_index == itr.m_index; }
+  bool                operator!=(const const_iterator& itr) const { return m_index != itr.m_index; }
+
+  size_type           index() const                { return m_index; }
+
+private:
+  const PeerTable*    m_table{};
+  size_type           m_index{};
+};
+
+inline PeerTable::const_iterator PeerTable::begin() const { return const_iterator(this, next_full(0)); }
+inline PeerTable::const_iterator PeerTable::end() const   { return const_iterator(this, m_capacity); }
+
+inline PeerTable::const_reverse_iterator PeerTable::rbegin() const { return const_reverse_iterator(end()); }
+inline PeerTable::const_reverse_iterator PeerTable::rend() const   { return const_reverse_iterator(begin()); }
+
+inline PeerTable::size_type
+PeerTable::next_full(size_type index) const {
+  while (index < m_capacity && !is_full(m_ctrl[index]))
+    index++;
+
+  return index;
+}
+
+inline PeerTable::size_type
+PeerTable::prev_full(size_type index) const {
+  do {
+    index--;
+  } while (!is_full(m_ctrl[index]));
+
+  return index;
+}
+
+} // namespace torrent
+
+#endif
@@ -11,10 +11,25 @@ class PollInternal;
 
 class LIBTORRENT_EXPORT Poll {
 public:
+  // BACKEND_IO_URING falls back to the default backend when io_uring
+  // or the kernel features it needs are unavailable.
+  enum backend_type {
+    BACKEND_DEFAULT,
+    BACKEND_IO_URING
+  };
+
+  // Uses the backend set by 'set_default_backend', which applies to
+  // threads started afterwards.
   static std::unique_ptr<Poll> create();
+  static std::unique_ptr<Poll> create(backend_type backend);
+
+  static backend_type default_backend();
+  static void         set_default_backend(backend_type backend);
 
   ~Poll();
 
+  backend_type        backend() const;
+
   // TODO: Make protected.
   unsigned int        do_poll(int64_t timeout_usec);
 
@@ -51,6 +66,40 @@ public:
 
   void                remove_and_close(Event* event);
 
+  // Edge-triggered mode, only supported by epoll and io_uring. Events opened with
+  // 'open_edge' while enabled stay on a ready list across iterations
+  // until their handler reports the socket drained, or removes the
+  // read/write interest. Other events remain level-triggered.
+  bool                is_edge_triggered() const;
+  void                set_edge_triggered(bool state);
+
+  void                open_edge(Event* event);
+
+  // Call when a read or write returned less than requested.
+  void                drained_read(Event* event);
+  void                drained_write(Event* event);
+
+  // Maximum number of events returned by one wakeup.
+  uint32_t            max_events() const;
+  void                set_max_events(uint32_t count);
+
+  // Bytes a connection may transfer in one read or write event
+  // before yielding to other events, zero means no limit.
+  uint32_t            read_budget() const              { return m_read_budget; }
+  void                set_read_budget(uint32_t bytes)  { m_read_budget = bytes; }
+  uint32_t            write_budget() const             { return m_write_budget; }
+  void                set_write_budget(uint32_t bytes) { m_write_budget = bytes; }
+
+  // True if 'bytes' transferred within one event reach the budget,
+  // in which case the handler should return and leave the rest to
+  // later iterations.
+  bool                read_budget_exhausted(uint64_t bytes)  { return budget_exhausted(m_read_budget, bytes); }
+  bool                write_budget_exhausted(uint64_t bytes) { return budget_exhausted(m_write_budget, bytes); }
+
+  uint64_t            stats_wakeups() const            { return m_stats_wakeups; }
+  uint64_t            stats_events() const             { return m_stats_events; }
+  uint64_t            stats_budget_exhausted() const   { return m_stats_budget_exhausted; }
+
   // Add one for HUP? Or would that be in event?
 
 private:
@@ -61,9 +110,27 @@ private:
   int                 poll(int timeout_usec);
   unsigned int        process();
 
+  bool                budget_exhausted(uint32_t budget, uint64_t bytes);
+
   std::unique_ptr<PollInternal> m_internal;
+
+  uint32_t            m_read_budget{0};
+  uint32_t            m_write_budget{0};
+
+  uint64_t            m_stats_wakeups{0};
+  uint64_t            m_stats_events{0};
+  uint64_t            m_stats_budget_exhausted{0};
 };
 
+inline bool
+Poll::budget_exhausted(uint32_t budget, uint64_t bytes) {
+  if (budget == 0 || bytes < budget)
+    return false;
+
+  m_stats_budget_exhausted++;
+  return true;
+}
+
 } // namespace torrent
 
 #endif
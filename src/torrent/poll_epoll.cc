@@ -4,11 +4,15 @@
 
 #include "torrent/poll.h"
 
+#include <atomic>
 #include <cassert>
 #include <cerrno>
+#include <sys/poll.h>
 #include <sys/epoll.h>
 #include <unistd.h>
 
+#include "net/poll_internal.h"
+#include "net/poll_uring.h"
 #include "torrent/exceptions.h"
 #include "torrent/event.h"
 #include "torrent/utils/log.h"
@@ -19,27 +23,111 @@
 
 namespace torrent {
 
-class PollInternal {
+static_assert(EPOLLIN == POLLIN && EPOLLOUT == POLLOUT && EPOLLERR == POLLERR,
+              "PollInternal interest flags must match the epoll flags.");
+
+class PollEpoll : public PollInternal {
 public:
   using Table = std::vector<std::pair<uint32_t, Event*>>;
 
-  inline uint32_t     event_mask(Event* e);
+  // Per file descriptor state of edge-triggered events.
+  static constexpr uint8_t edge_registered = (1 << 0);
+  static constexpr uint8_t edge_read       = (1 << 1);
+  static constexpr uint8_t edge_write      = (1 << 2);
+  static constexpr uint8_t edge_queued     = (1 << 3);
+
+  ~PollEpoll() override;
+
+  // Returns nullptr if epoll_create fails.
+  static std::unique_ptr<PollEpoll> create(uint32_t open_max);
+
+  Poll::backend_type  backend() const override          { return Poll::BACKEND_DEFAULT; }
+
+  uint32_t            open_max() const override         { return m_table.size(); }
+
+  uint32_t            max_events() const override       { return m_max_events; }
+  void                set_max_events(uint32_t count) override;
+
+  uint32_t            event_mask(Event* e) const override;
+
+  void                open(Event* event, bool edge) override;
+  void                close(Event* event) override;
+  void                cleanup_closed(Event* event) override;
+
+  void                insert(Event* event, uint32_t flags) override;
+  void                remove(Event* event, uint32_t flags) override;
+
+  void                drained(Event* event, uint32_t flags) override;
+
+  int                 poll(int64_t timeout_usec) override;
+  unsigned int        process() override;
+
+private:
+  PollEpoll() = default;
+
   inline void         set_event_mask(Event* e, uint32_t m);
 
-  void                flush_events();
   void                modify(torrent::Event* event, unsigned short op, uint32_t mask);
 
-  int                 m_fd;
+  void                set_ready(int fd, uint8_t flags);
+  void                rearm(int fd);
+  unsigned int        process_ready();
+
+  int                 m_fd{-1};
 
-  unsigned int        m_max_events;
+  unsigned int        m_max_events{1024};
   unsigned int        m_waiting_events{};
 
   Table                                 m_table;
   std::unique_ptr<struct epoll_event[]> m_events;
+
+  std::vector<uint8_t>                  m_edge;
+  std::vector<uint8_t>                  m_requeues;
+  std::vector<int>                      m_ready;
+  std::vector<int>                      m_ready_processing;
 };
 
-inline uint32_t
-PollInternal::event_mask(Event* e) {
+static std::atomic<Poll::backend_type> poll_default_backend{Poll::BACKEND_DEFAULT};
+
+PollEpoll::~PollEpoll() {
+  m_table.clear();
+
+  if (m_fd != -1)
+    ::close(m_fd);
+}
+
+std::unique_ptr<PollEpoll>
+PollEpoll::create(uint32_t open_max) {
+  int fd = epoll_create(open_max);
+
+  if (fd == -1)
+    return nullptr;
+
+  std::unique_ptr<PollEpoll> poll(new PollEpoll);
+
+  poll->m_table.resize(open_max);
+  poll->m_edge.resize(open_max);
+  poll->m_requeues.resize(open_max);
+  poll->m_fd = fd;
+  poll->m_events = std::make_unique<struct epoll_event[]>(poll->m_max_events);
+
+  return poll;
+}
+
+void
+PollEpoll::set_max_events(uint32_t count) {
+  if (count == 0 || count > m_table.size())
+    throw input_error("Poll::set_max_events(...) count out of range.");
+
+  if (m_waiting_events != 0)
+    throw internal_error("Poll::set_max_events(...) called while processing events.");
+
+  m_max_events = count;
+  m_events = std::make_unique<struct epoll_event[]>(count);
+}
+
+uint32_t
+PollEpoll::event_mask(Event* e) const {
   assert(e->file_descriptor() != -1);
 
   Table::value_type entry = m_table[e->file_descriptor()];
@@ -47,14 +135,14 @@ PollInternal::event_mask(Event* e) {
 }
 
 inline void
-PollInternal::set_event_mask(Event* e, uint32_t m) {
+PollEpoll::set_event_mask(Event* e, uint32_t m) {
   assert(e->file_descriptor() != -1);
 
   m_table[e->file_descriptor()] = Table::value_type(m, e);
 }
 
 void
-PollInternal::modify(Event* event, unsigned short op, uint32_t mask) {
+PollEpoll::modify(Event* event, unsigned short op, uint32_t mask) {
   if (event_mask(event) == mask)
     return;
 
@@ -65,6 +153,9 @@ PollInternal::modify(Event* event, unsigned short op, uint32_t mask) {
   e.data.fd = event->file_descriptor();
   e.events = mask;
 
+  if (mask != 0 && (m_edge[event->file_descriptor()] & edge_registered))
+    e.events |= EPOLLET;
+
   set_event_mask(event, mask);
 
   if (epoll_ctl(m_fd, op, event->file_descriptor(), &e)) {
@@ -94,81 +185,115 @@ PollInternal::modify(Event* event, unsigned short op, uint32_t mask) {
   }
 }
 
-std::unique_ptr<Poll>
-Poll::create() {
-  auto socket_open_max = sysconf(_SC_OPEN_MAX);
+void
+PollEpoll::set_ready(int fd, uint8_t flags) {
+  m_edge[fd] |= flags;
 
-  if (socket_open_max == -1)
-    throw internal_error("Poll::create(): sysconf(_SC_OPEN_MAX) failed: " + std::string(std::strerror(errno)));
+  if (m_edge[fd] & edge_queued)
+    return;
 
-  int fd = epoll_create(socket_open_max);
+  m_edge[fd] |= edge_queued;
+  m_ready.push_back(fd);
+}
 
-  if (fd == -1)
-    return nullptr;
+// Re-arming an edge-triggered event makes the kernel report it again
+// if it is still ready.
+void
+PollEpoll::rearm(int fd) {
+  epoll_event e;
+  e.data.u64 = 0;
+  e.data.fd = fd;
+  e.events = m_table[fd].first | EPOLLET;
 
-  auto poll = new Poll();
+  if (epoll_ctl(m_fd, EPOLL_CTL_MOD, fd, &e) && errno != ENOENT)
+    throw internal_error("PollEpoll::rearm(...) epoll_ctl failed: " + std::string(std::strerror(errno)));
+}
 
-  poll->m_internal = std::make_unique<PollInternal>();
-  poll->m_internal->m_table.resize(socket_open_max);
-  poll->m_internal->m_fd = fd;
-  poll->m_internal->m_max_events = 1024;
-  poll->m_internal->m_events = std::make_unique<struct epoll_event[]>(poll->m_internal->m_max_events);
+// Each ready event gets one call per iteration, and is requeued unless
+// the handler drained the socket or removed its interest. Handlers
+// are expected to bound the work done in a call, see Poll::read_budget.
+//
+// An event whose handler keeps not draining the socket is taken off
+// the list after 'edge_requeue_max' passes and re-armed, so it can't
+// hold the poll timeout at zero.
+unsigned int
+PollEpoll::process_ready() {
+  unsigned int count = 0;
 
-  return std::unique_ptr<Poll>(poll);
-}
+  m_ready_processing.swap(m_ready);
 
-Poll::~Poll() {
-  m_internal->m_table.clear();
+  for (int fd : m_ready_processing) {
+    m_edge[fd] &= ~edge_queued;
 
-  ::close(m_internal->m_fd);
-}
+    auto evItr = m_table.begin() + fd;
 
-unsigned int
-Poll::do_poll(int64_t timeout_usec) {
-  int status = poll(timeout_usec);
+    if ((m_edge[fd] & edge_read) && evItr->second != nullptr && evItr->first & EPOLLIN) {
+      count++;
+      evItr->second->event_read();
+    }
 
-  if (status == -1) {
-    if (errno != EINTR)
-      throw internal_error("Poll::work(): " + std::string(std::strerror(errno)));
+    if ((m_edge[fd] & edge_write) && evItr->second != nullptr && evItr->first & EPOLLOUT) {
+      count++;
+      evItr->second->event_write();
+    }
 
-    return 0;
+    uint8_t wanted = ((evItr->first & EPOLLIN) ? edge_read : 0) | ((evItr->first & EPOLLOUT) ? edge_write : 0);
+
+    if (evItr->second == nullptr || !(m_edge[fd] & edge_registered)) {
+      m_edge[fd] &= edge_registered;
+      m_requeues[fd] = 0;
+
+    } else if ((m_edge[fd] & wanted) == 0) {
+      m_requeues[fd] = 0;
+
+    } else if (++m_requeues[fd] < edge_requeue_max) {
+      set_ready(fd, 0);
+
+    } else {
+      m_edge[fd] &= ~(edge_read | edge_write);
+      m_requeues[fd] = 0;
+
+      rearm(fd);
+    }
   }
 
-  return process();
+  m_ready_processing.clear();
+  return count;
 }
 
 int
-Poll::poll(int timeout_usec) {
-  int nfds = ::epoll_wait(m_internal->m_fd,
-                          m_internal->m_events.get(),
-                          m_internal->m_max_events,
-                          timeout_usec / 1000);
+PollEpoll::poll(int64_t timeout_usec) {
+  // Events left on the ready list must not wait for new ones.
+  if (!m_ready.empty())
+    timeout_usec = 0;
+
+  int nfds = ::epoll_wait(m_fd, m_events.get(), m_max_events, timeout_usec / 1000);
 
   if (nfds == -1)
     return -1;
 
-  m_internal->m_waiting_events = nfds;
+  m_waiting_events = nfds;
   return nfds;
 }
 
-// We check m_internal->m_table to make sure the Event is still listening to the
+// We check m_table to make sure the Event is still listening to the
 // event, so it is safe to remove Event's while in working.
 //
 // TODO: Do we want to guarantee if the Event has been removed from
 // some event but not closed, it won't call that event? Think so...
 unsigned int
-Poll::process() {
+PollEpoll::process() {
   unsigned int count = 0;
 
-  for (epoll_event *itr = m_internal->m_events.get(), *last = m_internal->m_events.get() + m_internal->m_waiting_events; itr != last; ++itr) {
+  for (epoll_event *itr = m_events.get(), *last = m_events.get() + m_waiting_events; itr != last; ++itr) {
     // TODO: These should be asserts?
-    if (itr->data.fd < 0 || static_cast<size_t>(itr->data.fd) >= m_internal->m_table.size())
+    if (itr->data.fd < 0 || static_cast<size_t>(itr->data.fd) >= m_table.size())
       continue;
 
     if (utils::Thread::self()->callbacks_should_interrupt_polling())
       utils::Thread::self()->process_callbacks(true);
 
-    auto evItr = m_internal->m_table.begin() + itr->data.fd;
+    auto evItr = m_table.begin() + itr->data.fd;
 
     // Each branch must check for data.ptr != nullptr to allow the socket
     // to remove itself between the calls.
@@ -181,6 +306,13 @@ Poll::process() {
       evItr->second->event_error();
     }
 
+    if (m_edge[itr->data.fd] & edge_registered) {
+      set_ready(itr->data.fd,
+                ((itr->events & (EPOLLIN | EPOLLHUP)) ? edge_read : 0) |
+                ((itr->events & EPOLLOUT) ? edge_write : 0));
+      continue;
+    }
+
     if (itr->events & EPOLLIN && evItr->second != nullptr && evItr->first & EPOLLIN) {
       count++;
       evItr->second->event_read();
@@ -192,48 +324,49 @@ Poll::process() {
     }
   }
 
-  m_internal->m_waiting_events = 0;
-  return count;
-}
+  m_waiting_events = 0;
 
-uint32_t
-Poll::open_max() const {
-  return m_internal->m_table.size();
+  return count + process_ready();
 }
 
 void
-Poll::open(Event* event) {
+PollEpoll::open(Event* event, bool edge) {
   LT_LOG_EVENT(event, DEBUG, "open event", 0);
 
-  if (m_internal->event_mask(event) != 0)
+  if (event_mask(event) != 0)
     throw internal_error("Poll::open(...) called but the file descriptor is active");
+
+  if (!edge)
+    return;
+
+  LT_LOG_EVENT(event, DEBUG, "open edge-triggered event", 0);
+
+  m_edge[event->file_descriptor()] |= edge_registered;
 }
 
 void
-Poll::close(Event* event) {
+PollEpoll::close(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "close event", 0);
 
-  if (m_internal->event_mask(event) != 0)
+  if (event_mask(event) != 0)
     throw internal_error("Poll::close(...) called but the file descriptor is active");
 
-  m_internal->m_table[event->file_descriptor()] = PollInternal::Table::value_type();
+  m_table[event->file_descriptor()] = Table::value_type();
+  m_edge[event->file_descriptor()] &= edge_queued;
 
   // Clear the event list just in case we open a new socket with the
   // same fd while in the middle of calling Poll::perform.
   //
   // Removed.
   //
-  // Shouldn't be needed as we unset the read/write/error flags in m_internal->m_events using
+  // Shouldn't be needed as we unset the read/write/error flags in m_events using
   // remove_read/write/error.
 }
 
 void
-Poll::cleanup_closed(Event* event) {
+PollEpoll::cleanup_closed(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "cleanup_closed event", 0);
 
-  // if (m_internal->event_mask(event) != 0)
-  //   throw internal_error("Poll::cleanup_closed(...) called but the file descriptor is active");
-
   // Kernel removes closed FDs automatically, so just clear the mask and remove it from pending calls.
   //
   // Don't touch if the FD was re-used before we received the close notification.
@@ -241,103 +374,195 @@ Poll::cleanup_closed(Event* event) {
   // This should never happen as only the thread that owns event should be dealing with externally
   // owned file descriptors.
 
-  if (m_internal->m_table[event->file_descriptor()].second == event)
-    m_internal->m_table[event->file_descriptor()] = PollInternal::Table::value_type();
+  if (m_table[event->file_descriptor()].second == event) {
+    m_table[event->file_descriptor()] = Table::value_type();
+    m_edge[event->file_descriptor()] &= edge_queued;
+  }
+}
 
-  // Clear the event list just in case we open a new socket with the
-  // same fd while in the middle of calling Poll::perform.
-  //
-  // Removed.
+void
+PollEpoll::insert(Event* event, uint32_t flags) {
+  uint32_t mask = event_mask(event);
+
+  if ((mask & flags) == flags)
+    return;
+
+  LT_LOG_EVENT(event, DEBUG, "insert : flags:%x", flags);
+
+  modify(event, mask ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, mask | flags);
+}
+
+void
+PollEpoll::remove(Event* event, uint32_t flags) {
+  uint32_t mask = event_mask(event);
+
+  if (!(mask & flags))
+    return;
+
+  LT_LOG_EVENT(event, DEBUG, "remove : flags:%x", flags);
+
+  drained(event, flags);
+
+  mask &= ~flags;
+  modify(event, mask ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, mask);
+}
+
+void
+PollEpoll::drained(Event* event, uint32_t flags) {
+  if (m_table[event->file_descriptor()].second != event)
+    return;
+
+  if (flags & EPOLLIN)
+    m_edge[event->file_descriptor()] &= ~edge_read;
+
+  if (flags & EPOLLOUT)
+    m_edge[event->file_descriptor()] &= ~edge_write;
+}
+
+std::unique_ptr<Poll>
+Poll::create() {
+  return create(default_backend());
+}
+
+std::unique_ptr<Poll>
+Poll::create([[maybe_unused]] backend_type backend) {
+  auto socket_open_max = sysconf(_SC_OPEN_MAX);
+
+  if (socket_open_max == -1)
+    throw internal_error("Poll::create(): sysconf(_SC_OPEN_MAX) failed: " + std::string(std::strerror(errno)));
+
+  std::unique_ptr<PollInternal> internal;
+
+#ifdef USE_IO_URING
+  if (backend == BACKEND_IO_URING) {
+    internal = PollUring::create(socket_open_max);
+
+    if (internal == nullptr)
+      lt_log_print(LOG_SOCKET_INFO, "poll: io_uring backend unavailable, using epoll");
+  }
+#endif
+
+  if (internal == nullptr)
+    internal = PollEpoll::create(socket_open_max);
+
+  if (internal == nullptr)
+    return nullptr;
+
+  auto poll = new Poll();
+  poll->m_internal = std::move(internal);
+
+  return std::unique_ptr<Poll>(poll);
+}
+
+Poll::backend_type
+Poll::default_backend() {
+  return poll_default_backend;
+}
+
+void
+Poll::set_default_backend(backend_type backend) {
+  poll_default_backend = backend;
+}
+
+Poll::~Poll() = default;
+
+Poll::backend_type
+Poll::backend() const {
+  return m_internal->backend();
+}
+
+unsigned int
+Poll::do_poll(int64_t timeout_usec) {
+  int status = poll(timeout_usec);
+
+  if (status == -1) {
+    if (errno != EINTR)
+      throw internal_error("Poll::work(): " + std::string(std::strerror(errno)));
+
+    return 0;
+  }
+
+  unsigned int count = process();
+
+  m_stats_wakeups++;
+  m_stats_events += count;
+
+  return count;
+}
+
+int
+Poll::poll(int timeout_usec) {
+  return m_internal->poll(timeout_usec);
+}
+
+unsigned int
+Poll::process() {
+  return m_internal->process();
+}
+
+uint32_t
+Poll::open_max() const {
+  return m_internal->open_max();
+}
+
+void
+Poll::open(Event* event) {
+  m_internal->open(event, false);
+}
+
+void
+Poll::close(Event* event) {
+  m_internal->close(event);
+}
+
+void
+Poll::cleanup_closed(Event* event) {
+  m_internal->cleanup_closed(event);
 }
 
 bool
 Poll::in_read(Event* event) {
-  return m_internal->event_mask(event) & EPOLLIN;
+  return m_internal->event_mask(event) & POLLIN;
 }
 
 bool
 Poll::in_write(Event* event) {
-  return m_internal->event_mask(event) & EPOLLOUT;
+  return m_internal->event_mask(event) & POLLOUT;
 }
 
 bool
 Poll::in_error(Event* event) {
-  return m_internal->event_mask(event) & EPOLLERR;
+  return m_internal->event_mask(event) & POLLERR;
 }
 
 void
 Poll::insert_read(Event* event) {
-  if (m_internal->event_mask(event) & EPOLLIN)
-    return;
-
-  LT_LOG_EVENT(event, DEBUG, "insert read", 0);
-
-  m_internal->modify(event,
-                     m_internal->event_mask(event) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-                     m_internal->event_mask(event) | EPOLLIN);
+  m_internal->insert(event, POLLIN);
 }
 
 void
 Poll::insert_write(Event* event) {
-  if (m_internal->event_mask(event) & EPOLLOUT)
-    return;
-
-  LT_LOG_EVENT(event, DEBUG, "insert write", 0);
-
-  m_internal->modify(event,
-                     m_internal->event_mask(event) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-                     m_internal->event_mask(event) | EPOLLOUT);
+  m_internal->insert(event, POLLOUT);
 }
 
 void
 Poll::insert_error(Event* event) {
-  if (m_internal->event_mask(event) & EPOLLERR)
-    return;
-
-  LT_LOG_EVENT(event, DEBUG, "insert error", 0);
-
-  m_internal->modify(event,
-                     m_internal->event_mask(event) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-                     m_internal->event_mask(event) | EPOLLERR);
+  m_internal->insert(event, POLLERR);
 }
 
 void
 Poll::remove_read(Event* event) {
-  if (!(m_internal->event_mask(event) & EPOLLIN))
-    return;
-
-  LT_LOG_EVENT(event, DEBUG, "remove read", 0);
-
-  uint32_t mask = m_internal->event_mask(event) & ~EPOLLIN;
-  m_internal->modify(event,
-                     mask ? EPOLL_CTL_MOD : EPOLL_CTL_DEL,
-                     mask);
+  m_internal->remove(event, POLLIN);
 }
 
 void
 Poll::remove_write(Event* event) {
-  if (!(m_internal->event_mask(event) & EPOLLOUT))
-    return;
-
-  LT_LOG_EVENT(event, DEBUG, "remove write", 0);
-
-  uint32_t mask = m_internal->event_mask(event) & ~EPOLLOUT;
-  m_internal->modify(event,
-                     mask ? EPOLL_CTL_MOD : EPOLL_CTL_DEL,
-                     mask);
+  m_internal->remove(event, POLLOUT);
 }
 
 void
 Poll::remove_error(Event* event) {
-  if (!(m_internal->event_mask(event) & EPOLLERR))
-    return;
-
-  LT_LOG_EVENT(event, DEBUG, "remove error", 0);
-
-  uint32_t mask = m_internal->event_mask(event) & ~EPOLLERR;
-  m_internal->modify(event,
-                     mask ? EPOLL_CTL_MOD : EPOLL_CTL_DEL,
-                     mask);
+  m_internal->remove(event, POLLERR);
 }
 
 void
@@ -349,6 +574,41 @@ Poll::remove_and_close(Event* event) {
   close(event);
 }
 
+bool
+Poll::is_edge_triggered() const {
+  return m_internal->is_edge_triggered();
+}
+
+void
+Poll::set_edge_triggered(bool state) {
+  m_internal->set_edge_triggered(state);
+}
+
+void
+Poll::open_edge(Event* event) {
+  m_internal->open(event, m_internal->is_edge_triggered());
+}
+
+void
+Poll::drained_read(Event* event) {
+  m_internal->drained(event, POLLIN);
+}
+
+void
+Poll::drained_write(Event* event) {
+  m_internal->drained(event, POLLOUT);
+}
+
+uint32_t
+Poll::max_events() const {
+  return m_internal->max_events();
+}
+
+void
+Poll::set_max_events(uint32_t count) {
+  m_internal->set_max_events(count);
+}
+
 } // namespace torrent
 
 #endif // USE_EPOLL
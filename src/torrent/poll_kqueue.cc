@@ -5,6 +5,7 @@
 #include "poll.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
 #include <sys/event.h>
@@ -46,6 +47,8 @@ public:
   std::unique_ptr<struct kevent[]> m_changes;
 };
 
+static std::atomic<Poll::backend_type> poll_default_backend{Poll::BACKEND_DEFAULT};
+
 inline uint32_t
 PollInternal::event_mask(Event* e) {
   assert(e->file_descriptor() != -1);
@@ -99,6 +102,13 @@ PollInternal::modify(Event* event, unsigned short op, short mask) {
 
 std::unique_ptr<Poll>
 Poll::create() {
+  return create(default_backend());
+}
+
+// Only the kqueue backend is available, other backends fall back to
+// it.
+std::unique_ptr<Poll>
+Poll::create([[maybe_unused]] backend_type backend) {
   auto socket_open_max = sysconf(_SC_OPEN_MAX);
 
   if (socket_open_max == -1)
@@ -123,12 +133,27 @@ Poll::create() {
   return std::unique_ptr<Poll>(poll);
 }
 
+Poll::backend_type
+Poll::default_backend() {
+  return poll_default_backend;
+}
+
+void
+Poll::set_default_backend(backend_type backend) {
+  poll_default_backend = backend;
+}
+
 Poll::~Poll() {
   m_internal->m_table.clear();
 
   ::close(m_internal->m_fd);
 }
 
+Poll::backend_type
+Poll::backend() const {
+  return BACKEND_DEFAULT;
+}
+
 unsigned int
 Poll::do_poll(int64_t timeout_usec) {
   int status = poll(timeout_usec);
@@ -140,7 +165,12 @@ Poll::do_poll(int64_t timeout_usec) {
     return 0;
   }
 
-  return process();
+  unsigned int count = process();
+
+  m_stats_wakeups++;
+  m_stats_events += count;
+
+  return count;
 }
 
 int
@@ -351,6 +381,56 @@ Poll::remove_and_close(Event* event) {
   close(event);
 }
 
+// Edge-triggered mode is not supported, events opened with
+// 'open_edge' are level-triggered.
+bool
+Poll::is_edge_triggered() const {
+  return false;
+}
+
+void
+Poll::set_edge_triggered([[maybe_unused]] bool state) {
+}
+
+void
+Poll::open_edge(Event* event) {
+  open(event);
+}
+
+void
+Poll::drained_read([[maybe_unused]] Event* event) {
+}
+
+void
+Poll::drained_write([[maybe_unused]] Event* event) {
+}
+
+uint32_t
+Poll::max_events() const {
+  return m_internal->m_max_events;
+}
+
+void
+Poll::set_max_events(uint32_t count) {
+  if (count == 0 || count > m_internal->m_table.size())
+    throw input_error("Poll::set_max_events(...) count out of range.");
+
+  if (m_internal->m_waiting_events != 0)
+    throw internal_error("Poll::set_max_events(...) called while processing events.");
+
+  // Changes are flushed once 'max_events' are pending, so those that
+  // would no longer fit are passed to the kernel first.
+  if (m_internal->m_changed_events >= count) {
+    if (::kevent(m_internal->m_fd, m_internal->m_changes.get(), m_internal->m_changed_events, nullptr, 0, nullptr) == -1)
+      throw internal_error("Poll::set_max_events() error: " + std::string(std::strerror(errno)));
+
+    m_internal->m_changed_events = 0;
+  }
+
+  m_internal->m_max_events = count;
+  m_internal->m_events = std::make_unique<struct kevent[]>(count);
+}
+
 }
 
 #endif // USE_KQUEUE
@@ -28,6 +28,12 @@ public:
     unsigned int       errors_received{};
     unsigned int       errors_caught{};
 
+    // Batched UDP io, datagrams per call being the batch size.
+    uint64_t           read_calls{};
+    uint64_t           read_datagrams{};
+    uint64_t           write_calls{};
+    uint64_t           write_datagrams{};
+
     // DHT node info.
     unsigned int       num_nodes{};
     unsigned int       num_buckets{};
@@ -0,0 +1,542 @@
+#include "config.h"
+
+#include "resume_binary.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rak/file_stat.h"
+
+#include "data/transfer_list.h"
+#include "torrent/bitfield.h"
+#include "torrent/download.h"
+#include "torrent/download_info.h"
+#include "torrent/object.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_list.h"
+#include "torrent/utils/log.h"
+
+#define LT_LOG_LOAD(log_fmt, ...)                                       \
+  lt_log_print_info(LOG_RESUME_DATA, download.info(), "resume_binary_load", log_fmt, __VA_ARGS__);
+#define LT_LOG_LOAD_INVALID(log_fmt, ...)                               \
+  lt_log_print_info(LOG_RESUME_DATA, download.info(), "resume_binary_load", "invalid resume data: " log_fmt, __VA_ARGS__);
+#define LT_LOG_LOAD_FILE(log_fmt, ...)                                  \
+  lt_log_print_info(LOG_RESUME_DATA, download.info(), "resume_binary_load", "file[%u]: " log_fmt, \
+                    file_index, __VA_ARGS__);
+#define LT_LOG_SAVE(log_fmt, ...)                                       \
+  lt_log_print_info(LOG_RESUME_DATA, download.info(), "resume_binary_save", log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+namespace {
+
+constexpr char     resume_binary_magic[8] = { 'L', 'T', 'R', 'E', 'S', 'U', 'M', 'E' };
+
+constexpr size_t   header_size       = 48;
+constexpr size_t   header_checksum   = 16;
+constexpr size_t   header_chunks     = 24;
+constexpr size_t   header_files      = 28;
+constexpr size_t   header_uncertain  = 32;
+constexpr size_t   header_timestamp  = 40;
+
+constexpr size_t   file_record_size  = 24;
+
+using file_record = resume_binary_state::file_record;
+
+// Values of 'resume_binary_state::mode', deciding what mtime is
+// recorded for existing files.
+constexpr int      mode_mtime        = 0;
+constexpr int      mode_sync_failed  = 2;
+constexpr int      mode_downloading  = 3;
+
+uint64_t
+read_le(const char* data, unsigned int bytes) {
+  uint64_t value = 0;
+
+  for (unsigned int i = bytes; i != 0; --i)
+    value = (value << 8) | static_cast<uint8_t>(data[i - 1]);
+
+  return value;
+}
+
+void
+write_le(char* data, uint64_t value, unsigned int bytes) {
+  for (unsigned int i = 0; i != bytes; ++i, value >>= 8)
+    data[i] = static_cast<char>(value & 0xff);
+}
+
+uint64_t
+bitfield_padded_size(uint64_t size_bits) {
+  return ((size_bits + 7) / 8 + 3) & ~uint64_t{3};
+}
+
+// FNV-1a, only guarding against truncated and corrupt files.
+uint64_t
+resume_checksum(const char* first, const char* last) {
+  uint64_t hash = 0xcbf29ce484222325;
+
+  for (; first != last; ++first)
+    hash = (hash ^ static_cast<uint8_t>(*first)) * 0x100000001b3;
+
+  return hash;
+}
+
+void
+resume_build(std::string& buffer,
+             const std::vector<file_record>& files,
+             const char* bitfield, uint32_t size_bits,
+             const std::vector<uint32_t>& uncertain, int64_t timestamp) {
+  size_t bitfield_size = (uint64_t{size_bits} + 7) / 8;
+
+  buffer.assign(header_size + files.size() * file_record_size + bitfield_padded_size(size_bits) + uncertain.size() * 4, '\0');
+
+  char* data = buffer.data();
+
+  std::memcpy(data, resume_binary_magic, sizeof(resume_binary_magic));
+  write_le(data + 8, resume_binary_version, 4);
+  write_le(data + header_chunks, size_bits, 4);
+  write_le(data + header_files, files.size(), 4);
+  write_le(data + header_uncertain, uncertain.size(), 4);
+  write_le(data + header_timestamp, timestamp, 8);
+
+  char* itr = data + header_size;
+
+  for (const auto& file : files) {
+    write_le(itr, file.size, 8);
+    write_le(itr + 8, file.mtime, 8);
+    write_le(itr + 16, file.completed, 4);
+    itr += file_record_size;
+  }
+
+  if (bitfield_size != 0)
+    std::memcpy(itr, bitfield, bitfield_size);
+
+  itr += bitfield_padded_size(size_bits);
+
+  for (auto index : uncertain) {
+    write_le(itr, index, 4);
+    itr += 4;
+  }
+
+  write_le(data + header_checksum, resume_checksum(data + header_size, data + buffer.size()), 8);
+}
+
+// Chunks that completed within the last 15 minutes might not have
+// been written to disk, same as 'resume_save_uncertain_pieces'.
+std::vector<uint32_t>
+resume_uncertain_pieces(Download download) {
+  const TransferList::completed_list_type& completedList = download.transfer_list()->completed_list();
+
+  auto itr = std::find_if(completedList.begin(), completedList.end(), [](const auto& v) {
+      return this_thread::cached_time() - 15min <= std::chrono::microseconds(v.first);
+    });
+
+  std::vector<uint32_t> uncertain;
+  uncertain.reserve(std::distance(itr, completedList.end()));
+
+  while (itr != completedList.end())
+    uncertain.push_back((itr++)->second);
+
+  std::sort(uncertain.begin(), uncertain.end());
+  return uncertain;
+}
+
+} // namespace
+
+bool
+resume_binary_is_valid(const char* data, size_t length) {
+  if (length < header_size ||
+      std::memcmp(data, resume_binary_magic, sizeof(resume_binary_magic)) != 0 ||
+      read_le(data + 8, 4) != resume_binary_version)
+    return false;
+
+  uint64_t size_bits = read_le(data + header_chunks, 4);
+  uint64_t files     = read_le(data + header_files, 4);
+  uint64_t uncertain = read_le(data + header_uncertain, 4);
+
+  // Check each section against what is left of the file, so corrupt
+  // counts are rejected before being used to compute offsets.
+  uint64_t remaining = length - header_size;
+
+  if (files > remaining / file_record_size)
+    return false;
+
+  remaining -= files * file_record_size;
+
+  if (bitfield_padded_size(size_bits) > remaining)
+    return false;
+
+  remaining -= bitfield_padded_size(size_bits);
+
+  if (remaining != uncertain * 4)
+    return false;
+
+  if (read_le(data + header_checksum, 8) != resume_checksum(data + header_size, data + length))
+    return false;
+
+  // Stray bits past the last chunk would be counted as completed.
+  if (size_bits % 8 != 0) {
+    const char* last_byte = data + header_size + files * file_record_size + (size_bits - 1) / 8;
+
+    if (static_cast<uint8_t>(*last_byte) & (0xff >> (size_bits % 8)))
+      return false;
+  }
+
+  return true;
+}
+
+bool
+resume_binary_load(Download download, const char* data, size_t length) {
+  if (!resume_binary_is_valid(data, length)) {
+    LT_LOG_LOAD_INVALID("bad header, size or checksum", 0);
+    return false;
+  }
+
+  FileList* fileList = download.file_list();
+
+  uint32_t size_bits = read_le(data + header_chunks, 4);
+  uint32_t files     = read_le(data + header_files, 4);
+  uint32_t uncertain = read_le(data + header_uncertain, 4);
+
+  if (size_bits != fileList->bitfield()->size_bits() || files != fileList->size_files()) {
+    LT_LOG_LOAD_INVALID("number of chunks or files does not match torrent", 0);
+    return false;
+  }
+
+  const char* records  = data + header_size;
+  const char* bitfield = records + files * file_record_size;
+
+  LT_LOG_LOAD("restoring bitfield", 0);
+
+  download.set_bitfield(reinterpret_cast<const uint8_t*>(bitfield),
+                        reinterpret_cast<const uint8_t*>(bitfield) + fileList->bitfield()->size_bytes());
+
+  // Same rules as 'resume_load_progress', except that the recorded
+  // size must match both the file on disk and the torrent.
+  for (auto listItr = fileList->begin(), listLast = fileList->end(); listItr != listLast; ++listItr, records += file_record_size) {
+    File*        file       = listItr->get();
+    unsigned int file_index = std::distance(fileList->begin(), listItr);
+
+    uint64_t size      = read_le(records, 8);
+    int64_t  mtime     = read_le(records + 8, 8);
+    uint32_t completed = read_le(records + 16, 4);
+
+    file->set_completed_chunks(completed <= file->size_chunks() ? completed : 0);
+
+    if (file->is_padding())
+      continue;
+
+    rak::file_stat fs;
+    bool fileExists = fs.update(fileList->root_dir() + file->path()->as_string());
+
+    file->unset_flags(File::flag_create_queued | File::flag_resize_queued);
+
+    if (mtime == ~int64_t{0} || mtime == ~int64_t{1}) {
+      if (mtime == ~int64_t{0}) {
+        LT_LOG_LOAD_FILE("file not created by client, file:create|resize range:clear|(recheck)", 0);
+        file->set_flags(File::flag_create_queued | File::flag_resize_queued);
+      } else {
+        LT_LOG_LOAD_FILE("do not create file, file:- range:clear|(recheck)", 0);
+      }
+
+      download.update_range(Download::update_range_clear | (fileExists ? Download::update_range_recheck : 0),
+                            file->range().first, file->range().second);
+      continue;
+    }
+
+    if (static_cast<uint64_t>(fs.size()) != file->size_bytes() || size != file->size_bytes()) {
+      LT_LOG_LOAD_FILE("file has the wrong size, file:resize range:clear|recheck", 0);
+
+      file->set_flags(File::flag_resize_queued);
+      download.update_range(Download::update_range_clear | Download::update_range_recheck,
+                            file->range().first, file->range().second);
+      continue;
+    }
+
+    if (mtime == ~int64_t{3}) {
+      LT_LOG_LOAD_FILE("file was downloading", 0);
+      continue;
+    }
+
+    if (mtime == ~int64_t{2} || mtime != fs.modified_time()) {
+      LT_LOG_LOAD_FILE("mtime does not match, range:clear|recheck", 0);
+      download.update_range(Download::update_range_clear | Download::update_range_recheck,
+                            file->range().first, file->range().second);
+      continue;
+    }
+
+    LT_LOG_LOAD_FILE("no recheck needed", 0);
+  }
+
+  // Don't rehash when loading resume data within the same session.
+  if (uncertain == 0)
+    return true;
+
+  if (static_cast<int64_t>(read_le(data + header_timestamp, 8)) >= static_cast<int64_t>(download.info()->load_date())) {
+    LT_LOG_LOAD_INVALID("invalid information on uncertain pieces", 0);
+    return true;
+  }
+
+  LT_LOG_LOAD("found %" PRIu32 " uncertain pieces", uncertain);
+
+  const char* itr = bitfield + bitfield_padded_size(size_bits);
+
+  for (const char* last = itr + uncertain * 4; itr != last; itr += 4) {
+    uint32_t index = read_le(itr, 4);
+
+    if (index < size_bits)
+      download.update_range(Download::update_range_recheck | Download::update_range_clear, index, index + 1);
+  }
+
+  return true;
+}
+
+bool
+resume_binary_load_file(Download download, const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+
+  if (fd == -1) {
+    LT_LOG_LOAD("could not open '%s': %s", path.c_str(), std::strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) == -1 || st.st_size < static_cast<off_t>(header_size)) {
+    ::close(fd);
+    LT_LOG_LOAD_INVALID("file '%s' is too small", path.c_str());
+    return false;
+  }
+
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (data == MAP_FAILED) {
+    LT_LOG_LOAD("could not map '%s': %s", path.c_str(), std::strerror(errno));
+    return false;
+  }
+
+  bool result = resume_binary_load(download, static_cast<const char*>(data), st.st_size);
+
+  munmap(data, st.st_size);
+  return result;
+}
+
+bool
+resume_binary_save(Download download, std::string& buffer) {
+  resume_binary_state state;
+
+  return resume_binary_save(download, buffer, state);
+}
+
+bool
+resume_binary_save(Download download, std::string& buffer, resume_binary_state& state) {
+  // Keep the old data, as the client may not have finished the check
+  // this time.
+  if (!download.is_hash_checked()) {
+    LT_LOG_SAVE("hash not checked, no progress saved", 0);
+    return false;
+  }
+
+  download.sync_chunks();
+
+  // If syncing failed, mark every file as untrusted so it gets
+  // rechecked.
+  bool syncFailed = !download.is_hash_checked();
+
+  if (syncFailed)
+    LT_LOG_SAVE("sync failed, invalidating resume data", 0);
+
+  FileList*       fileList = download.file_list();
+  const Bitfield* bitfield = fileList->bitfield();
+
+  int mode = mode_downloading;
+
+  if (syncFailed)
+    mode = mode_sync_failed;
+  else if (bitfield->is_all_set() || !download.info()->is_active())
+    mode = mode_mtime;
+
+  // Files are only written to when chunks complete, so a file whose
+  // completed count is unchanged keeps its size and mtime. Missing
+  // files are always checked as they may have been created.
+  if (state.mode != mode || state.files.size() != fileList->size_files()) {
+    state.files.assign(fileList->size_files(), file_record{0, ~int64_t{0}, ~uint32_t{0}});
+    state.mode = mode;
+  }
+
+  unsigned int dirty_files = 0;
+  auto         recordItr   = state.files.begin();
+
+  for (auto listItr = fileList->begin(), listLast = fileList->end(); listItr != listLast; ++listItr, ++recordItr) {
+    File* file = listItr->get();
+
+    if (recordItr->completed == file->completed_chunks() &&
+        recordItr->mtime != ~int64_t{0} && recordItr->mtime != ~int64_t{1})
+      continue;
+
+    rak::file_stat fs;
+    file_record    record{0, 0, file->completed_chunks()};
+
+    dirty_files++;
+
+    if (!fs.update(fileList->root_dir() + file->path()->as_string())) {
+      record.mtime = file->is_create_queued() ? ~int64_t{0} : ~int64_t{1};
+      *recordItr = record;
+      continue;
+    }
+
+    record.size = fs.size();
+    record.mtime = mode == mode_mtime ? fs.modified_time() : ~int64_t{mode};
+    *recordItr = record;
+  }
+
+  LT_LOG_SAVE("updated %u of %zu files", dirty_files, state.files.size());
+
+  resume_build(buffer, state.files, reinterpret_cast<const char*>(bitfield->begin()), bitfield->size_bits(),
+               resume_uncertain_pieces(download), this_thread::cached_seconds().count());
+  return true;
+}
+
+bool
+resume_binary_save_file(Download download, const std::string& path) {
+  resume_binary_state state;
+
+  return resume_binary_save_file(download, path, state);
+}
+
+bool
+resume_binary_save_file(Download download, const std::string& path, resume_binary_state& state) {
+  std::string buffer;
+
+  if (!resume_binary_save(download, buffer, state))
+    return false;
+
+  // Compare against the checksum of the existing file, so unchanged
+  // downloads cost a stat of each file and a single read.
+  int fd = ::open(path.c_str(), O_RDONLY);
+
+  if (fd != -1) {
+    char header[header_size];
+    // The uncertain pieces timestamp is left out, an older one is
+    // still valid for the same pieces.
+    bool unchanged = ::pread(fd, header, header_size, 0) == static_cast<ssize_t>(header_size) &&
+      std::memcmp(header, buffer.data(), header_timestamp) == 0;
+
+    ::close(fd);
+
+    if (unchanged) {
+      LT_LOG_SAVE("resume data unchanged, not writing '%s'", path.c_str());
+      return false;
+    }
+  }
+
+  std::string tmp_path = path + ".new";
+
+  fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+  if (fd == -1) {
+    LT_LOG_SAVE("could not open '%s': %s", tmp_path.c_str(), std::strerror(errno));
+    return false;
+  }
+
+  // The data must be on disk before the rename, or a crash could
+  // leave an empty file in place of the old resume data.
+  bool written = ::write(fd, buffer.data(), buffer.size()) == static_cast<ssize_t>(buffer.size()) &&
+    ::fsync(fd) == 0;
+
+  if (::close(fd) == -1 || !written || ::rename(tmp_path.c_str(), path.c_str()) == -1) {
+    LT_LOG_SAVE("could not write '%s': %s", path.c_str(), std::strerror(errno));
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+
+  // Make the rename itself durable.
+  std::string::size_type slash = path.find_last_of('/');
+  std::string            dir   = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+
+  int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if (dir_fd == -1 || ::fsync(dir_fd) == -1)
+    LT_LOG_SAVE("could not sync directory '%s': %s", dir.c_str(), std::strerror(errno));
+
+  if (dir_fd != -1)
+    ::close(dir_fd);
+
+  return true;
+}
+
+bool
+resume_binary_convert(Download download, const Object& object, std::string& buffer) {
+  FileList* fileList = download.file_list();
+  Bitfield  bitfield;
+
+  bitfield.set_size_bits(fileList->bitfield()->size_bits());
+  bitfield.allocate();
+
+  if (object.has_key_string("bitfield") && object.get_key_string("bitfield").size() == bitfield.size_bytes()) {
+    bitfield.from_c_str(object.get_key_string("bitfield").c_str());
+
+  } else if (object.has_key_value("bitfield") && object.get_key_value("bitfield") == bitfield.size_bits()) {
+    bitfield.set_all();
+
+  } else if (object.has_key_value("bitfield") && object.get_key_value("bitfield") == 0) {
+    bitfield.unset_all();
+
+  } else {
+    LT_LOG_LOAD_INVALID("valid 'bitfield' not found, cannot convert", 0);
+    return false;
+  }
+
+  if (!object.has_key_list("files") || object.get_key_list("files").size() != fileList->size_files()) {
+    LT_LOG_LOAD_INVALID("number of resumable files does not match files in torrent, cannot convert", 0);
+    return false;
+  }
+
+  std::vector<file_record> files;
+  files.reserve(fileList->size_files());
+
+  auto filesItr = object.get_key_list("files").begin();
+
+  // The bencoded format has no file sizes, and only records an mtime
+  // if the size matched the torrent.
+  for (auto listItr = fileList->begin(), listLast = fileList->end(); listItr != listLast; ++listItr, ++filesItr) {
+    file_record record{(*listItr)->size_bytes(), ~int64_t{0}, 0};
+
+    if (filesItr->has_key_value("mtime"))
+      record.mtime = filesItr->get_key_value("mtime");
+
+    if (filesItr->has_key_value("completed") &&
+        filesItr->get_key_value("completed") >= 0 && filesItr->get_key_value("completed") <= (*listItr)->size_chunks())
+      record.completed = filesItr->get_key_value("completed");
+
+    files.push_back(record);
+  }
+
+  std::vector<uint32_t> uncertain;
+  int64_t               timestamp = 0;
+
+  if (object.has_key_string("uncertain_pieces") && object.has_key_value("uncertain_pieces.timestamp")) {
+    const Object::string_type& pieces = object.get_key_string("uncertain_pieces");
+
+    for (size_t i = 0; i + sizeof(uint32_t) <= pieces.size(); i += sizeof(uint32_t)) {
+      uint32_t index;
+      std::memcpy(&index, pieces.c_str() + i, sizeof(uint32_t));
+
+      uncertain.push_back(ntohl(index));
+    }
+
+    timestamp = object.get_key_value("uncertain_pieces.timestamp");
+  }
+
+  resume_build(buffer, files, reinterpret_cast<const char*>(bitfield.begin()), bitfield.size_bits(), uncertain, timestamp);
+  return true;
+}
+
+} // namespace torrent
@@ -0,0 +1,66 @@
+// Compact binary alternative to the bencoded progress saved by
+// 'resume_save_progress'. Holds the bitfield, a size and mtime
+// fingerprint for each file and the uncertain pieces, in a fixed
+// little-endian layout that is loaded directly from a mapped file
+// without building an Object tree.
+//
+// Layout, all integers little-endian:
+//
+//   header    magic "LTRESUME", version, flags, checksum, chunks,
+//             files, uncertain pieces, reserved, uncertain timestamp
+//   files     size, mtime, completed chunks, reserved (24 bytes each)
+//   bitfield  padded to a multiple of 4 bytes
+//   uncertain piece indices, 4 bytes each
+//
+// The checksum covers everything following the header. The 'mtime'
+// field uses the same sentinel values as the bencoded format.
+
+#ifndef LIBTORRENT_UTILS_RESUME_BINARY_H
+#define LIBTORRENT_UTILS_RESUME_BINARY_H
+
+#include <string>
+#include <vector>
+#include <torrent/common.h>
+
+namespace torrent {
+
+constexpr uint32_t resume_binary_version = 1;
+
+// Kept by the client between saves of a download, so only files whose
+// completed chunk count changed are stat'ed again. Clear it after
+// loading resume data, rechecking or moving the files.
+struct LIBTORRENT_EXPORT resume_binary_state {
+  struct file_record {
+    uint64_t size;
+    int64_t  mtime;
+    uint32_t completed;
+  };
+
+  void clear() { files.clear(); mode = -1; }
+
+  std::vector<file_record> files;
+  int                      mode{-1};
+};
+
+bool resume_binary_is_valid(const char* data, size_t length) LIBTORRENT_EXPORT;
+
+bool resume_binary_load(Download download, const char* data, size_t length) LIBTORRENT_EXPORT;
+bool resume_binary_load_file(Download download, const std::string& path) LIBTORRENT_EXPORT;
+
+// Returns false if the download has no progress to save, leaving
+// 'buffer' untouched.
+bool resume_binary_save(Download download, std::string& buffer) LIBTORRENT_EXPORT;
+bool resume_binary_save(Download download, std::string& buffer, resume_binary_state& state) LIBTORRENT_EXPORT;
+
+// Only writes the file if its content changed since the last save,
+// replacing it atomically. Returns true if the file was written.
+bool resume_binary_save_file(Download download, const std::string& path) LIBTORRENT_EXPORT;
+bool resume_binary_save_file(Download download, const std::string& path, resume_binary_state& state) LIBTORRENT_EXPORT;
+
+// Converts the progress in bencoded resume data, as written by
+// 'resume_save_progress' and 'resume_save_uncertain_pieces'.
+bool resume_binary_convert(Download download, const Object& object, std::string& buffer) LIBTORRENT_EXPORT;
+
+} // namespace torrent
+
+#endif
@@ -11,6 +11,8 @@
 #include <torrent/utils/signal_bitfield.h>
 
 namespace torrent {
+class PollEpoll;
+class PollUring;
 class SignalInterrupt;
 } // namespace torrent
 
@@ -91,6 +93,8 @@ public:
 
 protected:
   friend class torrent::Poll;
+  friend class torrent::PollEpoll;
+  friend class torrent::PollUring;
   friend class ThreadInternal;
 
   net::Resolver*      resolver()  { return m_resolver.get(); }
@@ -246,11 +246,19 @@ TrackerUdp::start_announce() {
 
 void
 TrackerUdp::event_read() {
-  auto read_size = read_datagram(m_read_buffer->begin(), m_read_buffer->reserved());
+  // Drain stale and malformed replies in one wakeup. Stop at the
+  // first reply acted on, as that may close the socket.
+  while (true) {
+    auto read_size = read_datagram(m_read_buffer->begin(), m_read_buffer->reserved());
 
-  if (read_size < 0)
-    return;
+    if (read_size < 0 || process_reply(read_size))
+      return;
+  }
+}
 
+// Returns true if the reply was acted on.
+bool
+TrackerUdp::process_reply(int read_size) {
   m_read_buffer->reset_position();
   m_read_buffer->set_end(read_size);
 
@@ -258,13 +266,13 @@ TrackerUdp::event_read() {
   LT_LOG_DUMP(reinterpret_cast<const char*>(m_read_buffer->begin()), read_size, "received reply", 0);
 
   if (read_size < 4)
-    return;
+    return false;
 
   // Do something with the content here.
   switch (m_read_buffer->read_32()) {
   case 0:
     if (m_action != 0 || !process_connect_output())
-      return;
+      return false;
 
     prepare_announce_input();
 
@@ -272,22 +280,16 @@ TrackerUdp::event_read() {
 
     m_tries = udp_tries;
     this_thread::event_insert_write(this);
-    return;
+    return true;
 
   case 1:
-    if (m_action != 1 || !process_announce_output())
-      return;
-
-    return;
+    return m_action == 1 && process_announce_output();
 
   case 3:
-    if (!process_error_output())
-      return;
-
-    return;
+    return process_error_output();
 
   default:
-    return;
+    return false;
   }
 }
 
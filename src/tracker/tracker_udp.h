@@ -10,6 +10,8 @@
 #include "torrent/utils/scheduler.h"
 #include "tracker/tracker_worker.h"
 
+class test_tracker_udp;
+
 namespace torrent {
 
 class TrackerUdp : public SocketDatagram, public TrackerWorker {
@@ -43,6 +45,8 @@ public:
   void                event_error() override;
 
 private:
+  friend class ::test_tracker_udp;
+
   void                close_directly();
 
   void                receive_failed(const std::string& msg);
@@ -54,6 +58,7 @@ private:
   void                prepare_connect_input();
   void                prepare_announce_input();
 
+  bool                process_reply(int read_size);
   bool                process_connect_output();
   bool                process_announce_output();
   bool                process_error_output();
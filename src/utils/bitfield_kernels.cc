@@ -0,0 +1,301 @@
+#include "config.h"
+
+#include "utils/bitfield_kernels.h"
+
+#ifdef USE_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LT_BITFIELD_NEON 1
+#endif
+
+namespace torrent {
+
+namespace {
+
+enum { op_copy, op_and, op_and_not };
+
+bool bitfield_simd_enabled = true;
+
+#ifdef USE_AVX2
+
+// Called lazily rather than from a static initializer, as
+// __builtin_cpu_supports needs __builtin_cpu_init to have run first.
+bool
+bitfield_cpu_has_avx2() {
+  __builtin_cpu_init();
+
+  return __builtin_cpu_supports("avx2");
+}
+
+inline bool
+bitfield_use_avx2() {
+  static const bool has_avx2 = bitfield_cpu_has_avx2();
+
+  return has_avx2 && bitfield_simd_enabled;
+}
+
+#endif
+
+inline uint32_t
+first_bit8(uint8_t value) {
+  return __builtin_clz(value) - 24;
+}
+
+inline uint8_t
+mask_from(uint32_t bit) {
+  return uint8_t{0xff} >> bit;
+}
+
+inline uint8_t
+mask_before(uint32_t bit) {
+  return uint8_t{0xff} << (8 - bit);
+}
+
+template <int Op, typename Type>
+inline Type
+apply(Type a, Type b) {
+  if constexpr (Op == op_and)
+    return a & b;
+  else if constexpr (Op == op_and_not)
+    return a & ~b;
+  else
+    return a;
+}
+
+// Returns the first byte at or after 'byte' that starts a block of
+// the result with a set bit, or where fewer than a block of bytes
+// remain before 'end'.
+
+#ifdef USE_AVX2
+
+template <int Op>
+__attribute__((target("avx2")))
+uint32_t
+skip_zero_avx2(const uint8_t* a, const uint8_t* b, uint32_t byte, uint32_t end) {
+  for (; byte + 32 <= end; byte += 32) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + byte));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + byte));
+    __m256i v;
+
+    if constexpr (Op == op_and)
+      v = _mm256_and_si256(va, vb);
+    else if constexpr (Op == op_and_not)
+      v = _mm256_andnot_si256(vb, va);
+    else
+      v = va;
+
+    if (!_mm256_testz_si256(v, v))
+      break;
+  }
+
+  return byte;
+}
+
+// Nibble lookup popcount, summing each block's byte counts with
+// sad_epu8.
+__attribute__((target("avx2")))
+uint32_t
+count_avx2(const uint8_t* data, uint32_t& byte, uint32_t end) {
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+
+  __m256i total = _mm256_setzero_si256();
+
+  for (; byte + 32 <= end; byte += 32) {
+    __m256i v  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + byte));
+    __m256i lo = _mm256_and_si256(v, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+
+    __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+  }
+
+  return _mm256_extract_epi64(total, 0) + _mm256_extract_epi64(total, 1) +
+    _mm256_extract_epi64(total, 2) + _mm256_extract_epi64(total, 3);
+}
+
+#endif
+
+#ifdef LT_BITFIELD_NEON
+
+template <int Op>
+uint32_t
+skip_zero_neon(const uint8_t* a, const uint8_t* b, uint32_t byte, uint32_t end) {
+  for (; byte + 16 <= end; byte += 16) {
+    uint8x16_t v = vld1q_u8(a + byte);
+
+    if constexpr (Op == op_and)
+      v = vandq_u8(v, vld1q_u8(b + byte));
+    else if constexpr (Op == op_and_not)
+      v = vbicq_u8(v, vld1q_u8(b + byte));
+
+    if (vmaxvq_u8(v) != 0)
+      break;
+  }
+
+  return byte;
+}
+
+uint32_t
+count_neon(const uint8_t* data, uint32_t& byte, uint32_t end) {
+  uint32_t total = 0;
+
+  for (; byte + 16 <= end; byte += 16)
+    total += vaddlvq_u8(vcntq_u8(vld1q_u8(data + byte)));
+
+  return total;
+}
+
+#endif
+
+template <int Op>
+inline uint32_t
+skip_zero(const uint8_t* a, const uint8_t* b, uint32_t byte, uint32_t end) {
+#if defined(USE_AVX2)
+  if (bitfield_use_avx2())
+    return skip_zero_avx2<Op>(a, b, byte, end);
+#elif defined(LT_BITFIELD_NEON)
+  if (bitfield_simd_enabled)
+    return skip_zero_neon<Op>(a, b, byte, end);
+#endif
+
+  return byte;
+}
+
+template <int Op>
+uint32_t
+find(const uint8_t* a, const uint8_t* b, uint32_t first, uint32_t last) {
+  if (first >= last)
+    return last;
+
+  uint32_t byte = first / 8;
+  uint32_t full_end = last / 8;
+
+  // Check the word starting at 'first', so iterating over dense
+  // bitfields finds the next bit right away.
+  if (byte + 8 <= full_end) {
+    uint64_t value = apply<Op>(bitfield_load_be64(a + byte), bitfield_load_be64(b + byte)) << (first % 8);
+
+    if (value != 0)
+      return first + __builtin_clzll(value);
+
+    byte += 8;
+
+  } else if (first % 8 != 0) {
+    uint8_t value = apply<Op>(a[byte], b[byte]) & mask_from(first % 8);
+
+    if (byte == full_end)
+      value &= mask_before(last % 8);
+
+    if (value != 0)
+      return byte * 8 + first_bit8(value);
+
+    if (byte == full_end)
+      return last;
+
+    byte++;
+  }
+
+  byte = skip_zero<Op>(a, b, byte, full_end);
+
+  for (; byte + 8 <= full_end; byte += 8) {
+    uint64_t value = apply<Op>(bitfield_load_be64(a + byte), bitfield_load_be64(b + byte));
+
+    if (value != 0)
+      return byte * 8 + __builtin_clzll(value);
+  }
+
+  for (; byte < full_end; byte++) {
+    uint8_t value = apply<Op>(a[byte], b[byte]);
+
+    if (value != 0)
+      return byte * 8 + first_bit8(value);
+  }
+
+  if (last % 8 != 0) {
+    uint8_t value = apply<Op>(a[byte], b[byte]) & mask_before(last % 8);
+
+    if (value != 0)
+      return byte * 8 + first_bit8(value);
+  }
+
+  return last;
+}
+
+} // namespace
+
+uint32_t
+bitfield_count(const uint8_t* data, uint32_t first, uint32_t last) {
+  if (first >= last)
+    return 0;
+
+  uint32_t byte = first / 8;
+  uint32_t full_end = last / 8;
+  uint32_t total = 0;
+
+  if (first % 8 != 0) {
+    uint8_t value = data[byte] & mask_from(first % 8);
+
+    if (byte == full_end)
+      return __builtin_popcount(value & mask_before(last % 8));
+
+    total += __builtin_popcount(value);
+    byte++;
+  }
+
+#if defined(USE_AVX2)
+  if (bitfield_use_avx2())
+    total += count_avx2(data, byte, full_end);
+#elif defined(LT_BITFIELD_NEON)
+  if (bitfield_simd_enabled)
+    total += count_neon(data, byte, full_end);
+#endif
+
+  for (; byte + 8 <= full_end; byte += 8)
+    total += __builtin_popcountll(bitfield_load_be64(data + byte));
+
+  for (; byte < full_end; byte++)
+    total += __builtin_popcount(data[byte]);
+
+  if (last % 8 != 0)
+    total += __builtin_popcount(data[byte] & mask_before(last % 8));
+
+  return total;
+}
+
+uint32_t
+bitfield_find(const uint8_t* a, uint32_t first, uint32_t last) {
+  return find<op_copy>(a, a, first, last);
+}
+
+uint32_t
+bitfield_find_and(const uint8_t* a, const uint8_t* b, uint32_t first, uint32_t last) {
+  return find<op_and>(a, b, first, last);
+}
+
+uint32_t
+bitfield_find_and_not(const uint8_t* a, const uint8_t* b, uint32_t first, uint32_t last) {
+  return find<op_and_not>(a, b, first, last);
+}
+
+bool
+bitfield_has_simd() {
+#if defined(USE_AVX2)
+  return bitfield_use_avx2();
+#elif defined(LT_BITFIELD_NEON)
+  return bitfield_simd_enabled;
+#else
+  return false;
+#endif
+}
+
+void
+bitfield_set_simd(bool enabled) {
+  bitfield_simd_enabled = enabled;
+}
+
+} // namespace torrent
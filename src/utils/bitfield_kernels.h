@@ -0,0 +1,76 @@
+#ifndef LIBTORRENT_UTILS_BITFIELD_KERNELS_H
+#define LIBTORRENT_UTILS_BITFIELD_KERNELS_H
+
+#include <cinttypes>
+#include <cstring>
+
+namespace torrent {
+
+// Word-wide operations on Bitfield data, using AVX2 or NEON for long
+// runs when available. Bits are numbered from the most significant
+// bit of the first byte, and 'first' and 'last' give the half-open
+// range of bits to consider.
+
+// Number of set bits.
+uint32_t bitfield_count(const uint8_t* data, uint32_t first, uint32_t last);
+
+// Position of the first bit that is set in 'a', set in both 'a' and
+// 'b', or set in 'a' and not in 'b'. Returns 'last' if there is none.
+uint32_t bitfield_find(const uint8_t* a, uint32_t first, uint32_t last);
+uint32_t bitfield_find_and(const uint8_t* a, const uint8_t* b, uint32_t first, uint32_t last);
+uint32_t bitfield_find_and_not(const uint8_t* a, const uint8_t* b, uint32_t first, uint32_t last);
+
+// True if SIMD kernels are used on this cpu.
+bool     bitfield_has_simd();
+
+// Allows tests to compare the SIMD kernels with the scalar path.
+void     bitfield_set_simd(bool enabled);
+
+// Calls 'func' with the position of each set bit in 'data', in order.
+// Bits within a word are taken directly from it rather than searched
+// for one at a time, as dense bitfields are common.
+template <typename Func>
+void     bitfield_for_each(const uint8_t* data, uint32_t first, uint32_t last, Func func);
+
+inline uint64_t
+bitfield_load_be64(const uint8_t* data) {
+  uint64_t value;
+  std::memcpy(&value, data, sizeof(value));
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return __builtin_bswap64(value);
+#else
+  return value;
+#endif
+}
+
+template <typename Func>
+inline void
+bitfield_for_each(const uint8_t* data, uint32_t first, uint32_t last, Func func) {
+  uint32_t index = bitfield_find(data, first, last);
+
+  while (index != last) {
+    uint32_t byte = index / 8;
+
+    if ((byte + 8) * 8 > last) {
+      func(index);
+      index = bitfield_find(data, index + 1, last);
+      continue;
+    }
+
+    uint64_t word = bitfield_load_be64(data + byte) << (index % 8);
+
+    while (word != 0) {
+      uint32_t bit = __builtin_clzll(word);
+
+      func(index + bit);
+      word &= ~(uint64_t{1} << (63 - bit));
+    }
+
+    index = bitfield_find(data, (byte + 8) * 8, last);
+  }
+}
+
+} // namespace torrent
+
+#endif
@@ -0,0 +1,87 @@
+#include "config.h"
+
+#include "utils/crypto_queue.h"
+
+#include <pthread.h>
+
+namespace torrent {
+
+CryptoQueue::~CryptoQueue() {
+  set_worker_count(0);
+}
+
+unsigned int
+CryptoQueue::worker_count() {
+  auto lock = std::scoped_lock(m_workers_lock);
+
+  return m_workers.size();
+}
+
+void
+CryptoQueue::set_worker_count(unsigned int count) {
+  auto workers_lock = std::scoped_lock(m_workers_lock);
+
+  if (count == m_workers.size())
+    return;
+
+  if (!m_workers.empty()) {
+    {
+      auto lock = std::scoped_lock(m_lock);
+      m_workers_stop = true;
+      m_accepting = false;
+      m_jobs.clear();
+    }
+
+    m_cv.notify_all();
+
+    for (auto& worker : m_workers)
+      worker.join();
+
+    m_workers.clear();
+    m_workers_stop = false;
+  }
+
+  while (m_workers.size() < count)
+    m_workers.emplace_back(&CryptoQueue::worker_loop, this);
+
+  auto lock = std::scoped_lock(m_lock);
+  m_accepting = count != 0;
+}
+
+void
+CryptoQueue::push_back(job_type&& job) {
+  auto lock = std::scoped_lock(m_lock);
+
+  if (!m_accepting)
+    return;
+
+  m_jobs.push_back(std::move(job));
+  m_cv.notify_one();
+}
+
+void
+CryptoQueue::worker_loop() {
+#if defined(HAS_PTHREAD_SETNAME_NP_DARWIN)
+  pthread_setname_np("rtorrent crypto");
+#elif defined(HAS_PTHREAD_SETNAME_NP_GENERIC)
+  pthread_setname_np(pthread_self(), "rtorrent crypto");
+#endif
+
+  auto lock = std::unique_lock(m_lock);
+
+  while (true) {
+    m_cv.wait(lock, [this] { return m_workers_stop || !m_jobs.empty(); });
+
+    if (m_workers_stop)
+      return;
+
+    auto job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+
+    lock.unlock();
+    job();
+    lock.lock();
+  }
+}
+
+} // namespace torrent
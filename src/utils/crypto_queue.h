@@ -0,0 +1,48 @@
+#ifndef LIBTORRENT_UTILS_CRYPTO_QUEUE_H
+#define LIBTORRENT_UTILS_CRYPTO_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace torrent {
+
+// Worker threads running connection encryption jobs, such as
+// generating RC4 keystream ahead of use. Jobs must not depend on
+// being run, as they are dropped when the workers are stopped.
+class CryptoQueue {
+public:
+  using job_type = std::function<void()>;
+
+  CryptoQueue() = default;
+  ~CryptoQueue();
+
+  CryptoQueue(const CryptoQueue&) = delete;
+  CryptoQueue& operator=(const CryptoQueue&) = delete;
+
+  // Changing the count stops and joins any existing workers.
+  unsigned int        worker_count();
+  void                set_worker_count(unsigned int count);
+
+  // Dropped if there are no workers.
+  void                push_back(job_type&& job);
+
+private:
+  void                worker_loop();
+
+  std::mutex               m_lock;
+  std::condition_variable  m_cv;
+  std::deque<job_type>     m_jobs;
+  bool                     m_accepting{false};
+
+  std::mutex               m_workers_lock;
+  std::vector<std::thread> m_workers;
+  bool                     m_workers_stop{false};
+};
+
+} // namespace torrent
+
+#endif
@@ -0,0 +1,121 @@
+#include "config.h"
+
+#include "utils/diffie_hellman_pool.h"
+
+#include <pthread.h>
+
+#include "utils/diffie_hellman.h"
+
+namespace torrent {
+
+DiffieHellmanPool::DiffieHellmanPool(const unsigned char prime[], int primeLength,
+                                     const unsigned char generator[], int generatorLength) :
+  m_prime(prime),
+  m_prime_length(primeLength),
+  m_generator(generator),
+  m_generator_length(generatorLength) {
+}
+
+DiffieHellmanPool::~DiffieHellmanPool() {
+  set_max_size(0);
+}
+
+unsigned int
+DiffieHellmanPool::max_size() {
+  auto lock = std::scoped_lock(m_lock);
+
+  return m_max_size;
+}
+
+void
+DiffieHellmanPool::set_max_size(unsigned int size) {
+  auto thread_lock = std::scoped_lock(m_thread_lock);
+
+  {
+    auto lock = std::scoped_lock(m_lock);
+
+    m_max_size = size;
+    m_stop = size == 0;
+
+    if (m_keys.size() > size)
+      m_keys.resize(size);
+  }
+
+  m_cv.notify_all();
+
+  if (size == 0) {
+    if (m_thread.joinable())
+      m_thread.join();
+
+    return;
+  }
+
+  if (!m_thread.joinable())
+    m_thread = std::thread(&DiffieHellmanPool::refill_loop, this);
+}
+
+unsigned int
+DiffieHellmanPool::size() {
+  auto lock = std::scoped_lock(m_lock);
+
+  return m_keys.size();
+}
+
+DiffieHellmanPool::key_type
+DiffieHellmanPool::take() {
+  {
+    auto lock = std::scoped_lock(m_lock);
+
+    if (!m_keys.empty()) {
+      auto key = std::move(m_keys.back());
+      m_keys.pop_back();
+
+      m_stats_hits++;
+      m_cv.notify_one();
+      return key;
+    }
+
+    // A disabled pool is not missing keys.
+    if (m_max_size != 0)
+      m_stats_misses++;
+  }
+
+  return generate();
+}
+
+DiffieHellmanPool::key_type
+DiffieHellmanPool::generate() const {
+  return std::make_unique<DiffieHellman>(m_prime, m_prime_length, m_generator, m_generator_length);
+}
+
+void
+DiffieHellmanPool::refill_loop() {
+#if defined(HAS_PTHREAD_SETNAME_NP_DARWIN)
+  pthread_setname_np("rtorrent dh");
+#elif defined(HAS_PTHREAD_SETNAME_NP_GENERIC)
+  pthread_setname_np(pthread_self(), "rtorrent dh");
+#endif
+
+  auto lock = std::unique_lock(m_lock);
+
+  while (true) {
+    m_cv.wait(lock, [this] { return m_stop || m_keys.size() < m_max_size; });
+
+    if (m_stop)
+      return;
+
+    lock.unlock();
+    auto key = generate();
+    lock.lock();
+
+    if (!key->is_valid()) {
+      m_cv.wait_for(lock, refill_retry_delay, [this] { return m_stop; });
+      continue;
+    }
+
+    if (m_keys.size() < m_max_size)
+      m_keys.push_back(std::move(key));
+  }
+}
+
+} // namespace torrent
@@ -0,0 +1,71 @@
+#ifndef LIBTORRENT_UTILS_DIFFIE_HELLMAN_POOL_H
+#define LIBTORRENT_UTILS_DIFFIE_HELLMAN_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace torrent {
+
+class DiffieHellman;
+
+// Key pairs generated ahead of use by a background thread, so
+// encrypted handshakes do not pay for key generation when
+// connections arrive in bursts. Each key pair is handed out once.
+class DiffieHellmanPool {
+public:
+  using key_type = std::unique_ptr<DiffieHellman>;
+
+  DiffieHellmanPool(const unsigned char prime[], int primeLength,
+                    const unsigned char generator[], int generatorLength);
+  ~DiffieHellmanPool();
+
+  DiffieHellmanPool(const DiffieHellmanPool&) = delete;
+  DiffieHellmanPool& operator=(const DiffieHellmanPool&) = delete;
+
+  // Zero stops the refill thread and drops pooled keys.
+  unsigned int        max_size();
+  void                set_max_size(unsigned int size);
+
+  // Number of pooled key pairs waiting to be taken.
+  unsigned int        size();
+
+  // Generates the key pair inline if the pool is empty. Only counted
+  // as a miss while the pool is enabled.
+  key_type            take();
+  key_type            generate() const;
+
+  uint64_t            stats_hits() const   { return m_stats_hits; }
+  uint64_t            stats_misses() const { return m_stats_misses; }
+
+private:
+  // Wait after a failed key generation before trying again.
+  static constexpr std::chrono::milliseconds refill_retry_delay{1000};
+
+  void                refill_loop();
+
+  const unsigned char*  m_prime;
+  int                   m_prime_length;
+  const unsigned char*  m_generator;
+  int                   m_generator_length;
+
+  std::mutex               m_lock;
+  std::condition_variable  m_cv;
+  std::vector<key_type>    m_keys;
+  unsigned int             m_max_size{0};
+  bool                     m_stop{false};
+
+  std::mutex               m_thread_lock;
+  std::thread              m_thread;
+
+  std::atomic<uint64_t>    m_stats_hits{0};
+  std::atomic<uint64_t>    m_stats_misses{0};
+};
+
+} // namespace torrent
+
+#endif
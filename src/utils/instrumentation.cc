@@ -18,12 +18,13 @@ instrumentation_fetch_and_clear(instrumentation_enum type) {
 void
 instrumentation_tick() {
   lt_log_print(LOG_INSTRUMENTATION_MEMORY,
-               "%" PRIi64 " %" PRIi64 " %" PRIi64  " %" PRIi64 " %" PRIi64,
+               "%" PRIi64 " %" PRIi64 " %" PRIi64  " %" PRIi64 " %" PRIi64 " %" PRIi64,
                instrumentation_values[INSTRUMENTATION_MEMORY_CHUNK_USAGE].load(),
                instrumentation_values[INSTRUMENTATION_MEMORY_CHUNK_COUNT].load(),
                instrumentation_values[INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE].load(),
                instrumentation_values[INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT].load(),
-               instrumentation_values[INSTRUMENTATION_MEMORY_BITFIELDS].load());
+               instrumentation_values[INSTRUMENTATION_MEMORY_BITFIELDS].load(),
+               instrumentation_values[INSTRUMENTATION_MEMORY_BITFIELDS_SHARED].load());
 
   lt_log_print(LOG_INSTRUMENTATION_MINCORE,
                "%"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
@@ -12,6 +12,7 @@ namespace torrent {
 
 enum instrumentation_enum {
   INSTRUMENTATION_MEMORY_BITFIELDS,
+  INSTRUMENTATION_MEMORY_BITFIELDS_SHARED,
   INSTRUMENTATION_MEMORY_CHUNK_USAGE,
   INSTRUMENTATION_MEMORY_CHUNK_COUNT,
   INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE,
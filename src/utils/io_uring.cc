@@ -0,0 +1,183 @@
+#include "config.h"
+
+#include "utils/io_uring.h"
+
+#ifdef USE_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace torrent {
+
+static void*
+io_uring_mmap(int fd, size_t size, off_t offset) {
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+
+  return ptr != MAP_FAILED ? ptr : nullptr;
+}
+
+IoUring::~IoUring() {
+  if (m_sqes != nullptr)
+    munmap(m_sqes, m_sqes_size);
+
+  if (m_cq_ptr != nullptr && m_cq_ptr != m_sq_ptr)
+    munmap(m_cq_ptr, m_cq_size);
+
+  if (m_sq_ptr != nullptr)
+    munmap(m_sq_ptr, m_sq_size);
+
+  if (m_fd != -1)
+    ::close(m_fd);
+}
+
+std::unique_ptr<IoUring>
+IoUring::create(unsigned int entries, unsigned int cq_entries) {
+  std::unique_ptr<IoUring> ring(new IoUring);
+  io_uring_params params{};
+
+  if (cq_entries != 0) {
+    params.flags      |= IORING_SETUP_CQSIZE;
+    params.cq_entries  = cq_entries;
+  }
+
+  ring->m_sq_ptr = nullptr;
+  ring->m_cq_ptr = nullptr;
+  ring->m_sqes   = nullptr;
+
+  ring->m_fd = syscall(__NR_io_uring_setup, entries, &params);
+
+  if (ring->m_fd == -1)
+    return nullptr;
+
+  ring->m_features   = params.features;
+  ring->m_sq_entries = params.sq_entries;
+  ring->m_cq_entries = params.cq_entries;
+  ring->m_sq_size    = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  ring->m_cq_size    = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    ring->m_sq_size = ring->m_cq_size = std::max(ring->m_sq_size, ring->m_cq_size);
+
+  if ((ring->m_sq_ptr = io_uring_mmap(ring->m_fd, ring->m_sq_size, IORING_OFF_SQ_RING)) == nullptr)
+    return nullptr;
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    ring->m_cq_ptr = ring->m_sq_ptr;
+  else if ((ring->m_cq_ptr = io_uring_mmap(ring->m_fd, ring->m_cq_size, IORING_OFF_CQ_RING)) == nullptr)
+    return nullptr;
+
+  ring->m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+  if ((ring->m_sqes = static_cast<io_uring_sqe*>(io_uring_mmap(ring->m_fd, ring->m_sqes_size, IORING_OFF_SQES))) == nullptr)
+    return nullptr;
+
+  auto sq = static_cast<char*>(ring->m_sq_ptr);
+  auto cq = static_cast<char*>(ring->m_cq_ptr);
+
+  ring->m_sq_head  = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+  ring->m_sq_tail  = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+  ring->m_sq_mask  = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+  ring->m_sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+
+  ring->m_cq_head  = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+  ring->m_cq_tail  = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+  ring->m_cq_mask  = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+  ring->m_cqes     = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  return ring;
+}
+
+bool
+IoUring::register_eventfd(int event_fd) {
+  return syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_EVENTFD, &event_fd, 1) != -1;
+}
+
+io_uring_sqe*
+IoUring::next_sqe() {
+  unsigned int head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+  unsigned int tail = *m_sq_tail + m_sq_queued;
+
+  if (tail - head >= m_sq_entries)
+    return nullptr;
+
+  unsigned int index = tail & *m_sq_mask;
+  io_uring_sqe* sqe = &m_sqes[index];
+
+  std::memset(sqe, 0, sizeof(io_uring_sqe));
+  m_sq_array[index] = index;
+  m_sq_queued++;
+
+  return sqe;
+}
+
+void
+IoUring::flush_sq() {
+  __atomic_store_n(m_sq_tail, *m_sq_tail + m_sq_queued, __ATOMIC_RELEASE);
+}
+
+unsigned int
+IoUring::unsubmitted() const {
+  return *m_sq_tail + m_sq_queued - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+}
+
+int
+IoUring::submit() {
+  unsigned int to_submit = unsubmitted();
+
+  flush_sq();
+  m_sq_queued = 0;
+
+  int result;
+
+  do {
+    result = syscall(__NR_io_uring_enter, m_fd, to_submit, 0, 0, nullptr, 0);
+  } while (result == -1 && errno == EINTR);
+
+  return result;
+}
+
+int
+IoUring::submit_and_wait(int64_t timeout_usec) {
+  unsigned int to_submit = unsubmitted();
+
+  flush_sq();
+  m_sq_queued = 0;
+
+  if (timeout_usec < 0)
+    return syscall(__NR_io_uring_enter, m_fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+  __kernel_timespec ts{};
+  ts.tv_sec  = timeout_usec / 1000000;
+  ts.tv_nsec = (timeout_usec % 1000000) * 1000;
+
+  io_uring_getevents_arg arg{};
+  arg.ts = reinterpret_cast<uintptr_t>(&ts);
+
+  return syscall(__NR_io_uring_enter, m_fd, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+bool
+IoUring::has_cqe() const {
+  return *m_cq_head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+}
+
+bool
+IoUring::peek_cqe(io_uring_cqe* cqe) {
+  unsigned int head = *m_cq_head;
+
+  if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+    return false;
+
+  *cqe = m_cqes[head & *m_cq_mask];
+  __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+} // namespace torrent
+
+#endif // USE_IO_URING
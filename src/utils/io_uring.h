@@ -0,0 +1,92 @@
+#ifndef LIBTORRENT_UTILS_IO_URING_H
+#define LIBTORRENT_UTILS_IO_URING_H
+
+#include <cinttypes>
+#include <memory>
+
+#ifdef USE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+namespace torrent {
+
+#ifdef USE_IO_URING
+
+// Minimal io_uring wrapper using the raw system calls, shared by
+// DiskIo and the io_uring Poll backend. Not thread-safe.
+class IoUring {
+public:
+  ~IoUring();
+
+  // Returns nullptr with errno set if io_uring is unavailable. A zero
+  // 'cq_entries' uses the kernel default.
+  static std::unique_ptr<IoUring> create(unsigned int entries, unsigned int cq_entries = 0);
+
+  int                 fd() const         { return m_fd; }
+  uint32_t            features() const   { return m_features; }
+  unsigned int        cq_entries() const { return m_cq_entries; }
+
+  bool                register_eventfd(int event_fd);
+
+  // Returns nullptr when the submission queue is full, call submit
+  // and retry.
+  io_uring_sqe*       next_sqe();
+  unsigned int        queued() const   { return m_sq_queued; }
+
+  // Queued entries plus those left in the ring by a failed or partial
+  // submit, which are retried by the next submit.
+  unsigned int        unsubmitted() const;
+
+  // Submits all unsubmitted entries. Returns -1 and sets errno on
+  // failure.
+  int                 submit();
+
+  // Submits queued entries and waits for at least one completion, or
+  // until 'timeout_usec' passes if non-negative. Timeouts need
+  // IORING_FEAT_EXT_ARG. Returns -1 with errno set to ETIME on
+  // timeout.
+  int                 submit_and_wait(int64_t timeout_usec = -1);
+
+  bool                has_cqe() const;
+  bool                peek_cqe(io_uring_cqe* cqe);
+
+private:
+  IoUring() = default;
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  void                flush_sq();
+
+  int                 m_fd{-1};
+  uint32_t            m_features{0};
+  unsigned int        m_sq_entries{0};
+  unsigned int        m_cq_entries{0};
+  unsigned int        m_sq_queued{0};
+
+  void*               m_sq_ptr;
+  size_t              m_sq_size{0};
+  void*               m_cq_ptr;
+  size_t              m_cq_size{0};
+  io_uring_sqe*       m_sqes;
+  size_t              m_sqes_size{0};
+
+  unsigned int*       m_sq_head;
+  unsigned int*       m_sq_tail;
+  unsigned int*       m_sq_mask;
+  unsigned int*       m_sq_array;
+
+  unsigned int*       m_cq_head;
+  unsigned int*       m_cq_tail;
+  unsigned int*       m_cq_mask;
+  io_uring_cqe*       m_cqes;
+};
+
+#else
+
+class IoUring {};
+
+#endif
+
+} // namespace torrent
+
+#endif
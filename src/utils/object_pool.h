@@ -0,0 +1,86 @@
+#ifndef LIBTORRENT_UTILS_OBJECT_POOL_H
+#define LIBTORRENT_UTILS_OBJECT_POOL_H
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace torrent {
+
+// Allocates objects from blocks of 'block_size' slots, reusing
+// destroyed ones, so large numbers of small long-lived objects don't
+// each pay for a heap allocation. Blocks are only freed with the pool,
+// which must outlive all objects created from it.
+template <typename T>
+class ObjectPool {
+public:
+  static constexpr size_t block_size = 256;
+
+  ObjectPool() = default;
+  ObjectPool(const ObjectPool&) = delete;
+  ObjectPool& operator=(const ObjectPool&) = delete;
+
+  size_t              memory_usage() const          { return m_blocks.size() * block_size * sizeof(slot_type); }
+
+  template <typename... Args>
+  T*                  create(Args&&... args);
+  void                destroy(T* object);
+
+private:
+  union slot_type {
+    slot_type*        next;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  void                grow();
+
+  std::vector<std::unique_ptr<slot_type[]>> m_blocks;
+  slot_type*                                m_free{};
+};
+
+template <typename T>
+template <typename... Args>
+T*
+ObjectPool<T>::create(Args&&... args) {
+  if (m_free == nullptr)
+    grow();
+
+  slot_type* slot = m_free;
+  m_free = slot->next;
+
+  try {
+    return new (slot->storage) T(std::forward<Args>(args)...);
+  } catch (...) {
+    slot->next = m_free;
+    m_free = slot;
+    throw;
+  }
+}
+
+template <typename T>
+void
+ObjectPool<T>::destroy(T* object) {
+  object->~T();
+
+  auto slot = reinterpret_cast<slot_type*>(object);
+  slot->next = m_free;
+  m_free = slot;
+}
+
+template <typename T>
+void
+ObjectPool<T>::grow() {
+  m_blocks.emplace_back(new slot_type[block_size]);
+
+  slot_type* block = m_blocks.back().get();
+
+  for (size_t i = 0; i < block_size; i++)
+    block[i].next = i + 1 < block_size ? &block[i + 1] : m_free;
+
+  m_free = block;
+}
+
+} // namespace torrent
+
+#endif
@@ -0,0 +1,98 @@
+#include "config.h"
+
+#include "utils/rc4.h"
+
+#include <cstring>
+
+namespace torrent {
+
+RC4::RC4(const unsigned char key[], int len) {
+  for (uint32_t i = 0; i < 256; i++)
+    m_state[i] = i;
+
+  uint32_t j = 0;
+
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t tmp = m_state[i];
+
+    j = (j + tmp + key[i % len]) & 0xff;
+
+    m_state[i] = m_state[j];
+    m_state[j] = tmp;
+  }
+}
+
+void
+RC4::crypt(const void* indata, void* outdata, unsigned int length) {
+  auto in  = static_cast<const uint8_t*>(indata);
+  auto out = static_cast<uint8_t*>(outdata);
+
+  uint32_t x = m_x;
+  uint32_t y = m_y;
+  uint32_t* state = m_state;
+
+  for (unsigned int i = 0; i < length; i++) {
+    x = (x + 1) & 0xff;
+    uint32_t tx = state[x];
+
+    y = (y + tx) & 0xff;
+    uint32_t ty = state[y];
+
+    state[x] = ty;
+    state[y] = tx;
+
+    out[i] = in[i] ^ state[(tx + ty) & 0xff];
+  }
+
+  m_x = x;
+  m_y = y;
+}
+
+void
+RC4::keystream(void* outdata, unsigned int length) {
+  auto out = static_cast<uint8_t*>(outdata);
+
+  uint32_t x = m_x;
+  uint32_t y = m_y;
+  uint32_t* state = m_state;
+
+  for (unsigned int i = 0; i < length; i++) {
+    x = (x + 1) & 0xff;
+    uint32_t tx = state[x];
+
+    y = (y + tx) & 0xff;
+    uint32_t ty = state[y];
+
+    state[x] = ty;
+    state[y] = tx;
+
+    out[i] = state[(tx + ty) & 0xff];
+  }
+
+  m_x = x;
+  m_y = y;
+}
+
+void
+RC4::xor_keystream(const void* indata, const void* keystream, void* outdata, unsigned int length) {
+  auto in  = static_cast<const uint8_t*>(indata);
+  auto ks  = static_cast<const uint8_t*>(keystream);
+  auto out = static_cast<uint8_t*>(outdata);
+
+  unsigned int i = 0;
+
+  for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+    uint64_t a, b;
+
+    std::memcpy(&a, in + i, sizeof(a));
+    std::memcpy(&b, ks + i, sizeof(b));
+
+    a ^= b;
+    std::memcpy(out + i, &a, sizeof(a));
+  }
+
+  for (; i < length; i++)
+    out[i] = in[i] ^ ks[i];
+}
+
+} // namespace torrent
@@ -37,27 +37,33 @@
 #ifndef LIBTORRENT_RC4_H
 #define LIBTORRENT_RC4_H
 
-#include "config.h"
-
-#include <openssl/rc4.h>
+#include <cstdint>
 
 namespace torrent {
 
+// RC4 as used by the MSE handshake, replacing the deprecated OpenSSL
+// RC4 interface. The state is kept as 32 bit words, which avoids
+// partial register stalls when indexing.
 class RC4 {
 public:
-  RC4()                                                               { }
+  RC4() = default;
+  RC4(const unsigned char key[], int len);
 
-#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
-  RC4(const unsigned char key[], int len)                             { RC4_set_key(&m_key, len, key); }
+  void                crypt(const void* indata, void* outdata, unsigned int length);
+  void                crypt(void* data, unsigned int length)    { crypt(data, data, length); }
 
-  void crypt(const void* indata, void* outdata, unsigned int length)  { ::RC4(&m_key, length, static_cast<const unsigned char*>(indata), static_cast<unsigned char*>(outdata)); }
-  void crypt(void* data, unsigned int length)                         { ::RC4(&m_key, length, static_cast<unsigned char*>(data), static_cast<unsigned char*>(data)); }
+  // Writes the next 'length' bytes of the keystream, to be combined
+  // with the data later using xor_keystream.
+  void                keystream(void* outdata, unsigned int length);
 
-private:
-  RC4_KEY m_key;
+  static void         xor_keystream(const void* indata, const void* keystream, void* outdata, unsigned int length);
 
+private:
+  uint32_t            m_state[256];
+  uint32_t            m_x{0};
+  uint32_t            m_y{0};
 };
 
-};
+} // namespace torrent
 
 #endif
@@ -0,0 +1,121 @@
+#include "config.h"
+
+#include "utils/rc4_prefetch.h"
+
+#include <algorithm>
+
+#include "torrent/exceptions.h"
+#include "utils/crypto_queue.h"
+
+namespace torrent {
+
+RC4Prefetch::RC4Prefetch(const RC4& rc4, CryptoQueue* queue) :
+  m_queue(queue),
+  m_shared(std::make_shared<shared_type>()) {
+
+  m_shared->rc4 = rc4;
+}
+
+RC4Prefetch::~RC4Prefetch() {
+  auto lock = std::scoped_lock(m_shared->lock);
+
+  // A worker that already started finishes into the shared state.
+  if (m_shared->state == shared_type::queued)
+    m_shared->state = shared_type::idle;
+}
+
+void
+RC4Prefetch::crypt(const void* indata, void* outdata, unsigned int length) {
+  auto in  = static_cast<const uint8_t*>(indata);
+  auto out = static_cast<uint8_t*>(outdata);
+
+  while (length != 0) {
+    if (m_position == m_block_size)
+      take_block();
+
+    uint32_t bytes = std::min<uint32_t>(length, m_block_size - m_position);
+
+    RC4::xor_keystream(in, m_block.get() + m_position, out, bytes);
+
+    m_position += bytes;
+    in += bytes;
+    out += bytes;
+    length -= bytes;
+  }
+}
+
+void
+RC4Prefetch::generate(shared_type& shared) {
+  auto block = std::unique_ptr<uint8_t[]>(new uint8_t[shared.block_size]);
+  shared.rc4.keystream(block.get(), shared.block_size);
+
+  auto lock = std::scoped_lock(shared.lock);
+
+  shared.block = std::move(block);
+  shared.state = shared_type::done;
+  shared.cv.notify_all();
+}
+
+void
+RC4Prefetch::request_block() {
+  {
+    auto lock = std::scoped_lock(m_shared->lock);
+
+    if (m_shared->state != shared_type::idle)
+      throw internal_error("RC4Prefetch::request_block() called with a block pending.");
+
+    m_shared->state = shared_type::queued;
+    m_shared->block_size = m_next_size;
+  }
+
+  m_queue->push_back([shared = m_shared]() {
+      {
+        auto lock = std::scoped_lock(shared->lock);
+
+        if (shared->state != shared_type::queued)
+          return;
+
+        shared->state = shared_type::running;
+      }
+
+      generate(*shared);
+    });
+}
+
+void
+RC4Prefetch::take_block() {
+  auto lock = std::unique_lock(m_shared->lock);
+
+  // The first block is generated inline, as there is no prefetch
+  // until the direction carries traffic.
+  if (m_shared->state == shared_type::idle) {
+    m_shared->state = shared_type::running;
+    m_shared->block_size = m_next_size;
+
+    lock.unlock();
+    generate(*m_shared);
+    lock.lock();
+
+  } else if (m_shared->state == shared_type::queued) {
+    m_shared->state = shared_type::running;
+
+    lock.unlock();
+    generate(*m_shared);
+    lock.lock();
+
+  } else {
+    m_shared->cv.wait(lock, [this] { return m_shared->state == shared_type::done; });
+  }
+
+  m_block = std::move(m_shared->block);
+  m_block_size = m_shared->block_size;
+  m_position = 0;
+
+  m_shared->state = shared_type::idle;
+  lock.unlock();
+
+  m_next_size = std::min(m_block_size * 2, max_block_size);
+  request_block();
+}
+
+} // namespace torrent
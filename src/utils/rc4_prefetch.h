@@ -0,0 +1,67 @@
+#ifndef LIBTORRENT_UTILS_RC4_PREFETCH_H
+#define LIBTORRENT_UTILS_RC4_PREFETCH_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "utils/rc4.h"
+
+namespace torrent {
+
+class CryptoQueue;
+
+// Generates the RC4 keystream a block ahead of use on CryptoQueue
+// workers, leaving only the xor with the data to the connection's
+// thread. A block still queued when the current one runs out is
+// taken back and generated inline, so progress never depends on the
+// workers.
+//
+// Nothing is prefetched until the first block is used, so idle
+// directions hold no keystream. Blocks start small and double each
+// time one is used up.
+class RC4Prefetch {
+public:
+  static constexpr uint32_t min_block_size = 4 << 10;
+  static constexpr uint32_t max_block_size = 16 << 10;
+
+  RC4Prefetch(const RC4& rc4, CryptoQueue* queue);
+  ~RC4Prefetch();
+
+  RC4Prefetch(const RC4Prefetch&) = delete;
+  RC4Prefetch& operator=(const RC4Prefetch&) = delete;
+
+  void                crypt(const void* indata, void* outdata, unsigned int length);
+
+private:
+  // Shared with queued jobs, which may outlive this object.
+  struct shared_type {
+    enum state_type { idle, queued, running, done };
+
+    std::mutex                 lock;
+    std::condition_variable    cv;
+    state_type                 state{idle};
+
+    RC4                        rc4;
+    std::unique_ptr<uint8_t[]> block;
+    uint32_t                   block_size{0};
+  };
+
+  static void         generate(shared_type& shared);
+
+  void                request_block();
+  void                take_block();
+
+  CryptoQueue*                 m_queue;
+  std::shared_ptr<shared_type> m_shared;
+
+  std::unique_ptr<uint8_t[]>   m_block;
+  uint32_t                     m_block_size{0};
+  uint32_t                     m_position{0};
+  uint32_t                     m_next_size{min_block_size};
+};
+
+} // namespace torrent
+
+#endif
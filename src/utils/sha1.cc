@@ -0,0 +1,503 @@
+#include "config.h"
+
+#include "utils/sha1.h"
+
+#include <algorithm>
+
+#ifdef USE_SHA_NI
+#include <cpuid.h>
+#endif
+
+#if defined(USE_SHA_NI) || defined(USE_AVX2)
+#include <immintrin.h>
+#endif
+
+namespace torrent {
+
+#ifdef USE_SHA_NI
+
+namespace {
+
+// Called lazily rather than from a static initializer, as
+// __builtin_cpu_supports needs __builtin_cpu_init to have run first.
+bool
+sha1_cpu_has_sha_ni() {
+  unsigned int eax, ebx, ecx, edx;
+
+  __builtin_cpu_init();
+
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    return false;
+
+  return (ebx & bit_SHA) && __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3");
+}
+
+// Processes whole 64 byte blocks using the SHA extensions. Each
+// iteration of the inner loop does four rounds, rotating through the
+// four message schedule registers.
+__attribute__((target("sha,sse4.1")))
+void
+sha1_transform(uint32_t state[5], const uint8_t* data, size_t blocks) {
+  const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+  __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1b);
+  __m128i e0   = _mm_set_epi32(state[4], 0, 0, 0);
+  __m128i e1;
+  __m128i msg[4];
+
+  for (; blocks != 0; blocks--, data += 64) {
+    __m128i abcd_save = abcd;
+    __m128i e0_save   = e0;
+
+    msg[0] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), mask);
+    e0     = _mm_add_epi32(e0, msg[0]);
+    e1     = abcd;
+    abcd   = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+#pragma GCC unroll 19
+    for (int i = 1; i < 20; i++) {
+      int m = i % 4;
+
+      if (i < 4)
+        msg[m] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), mask);
+
+      __m128i& e_current = (i % 2) ? e1 : e0;
+      __m128i& e_next    = (i % 2) ? e0 : e1;
+
+      e_current = _mm_sha1nexte_epu32(e_current, msg[m]);
+      e_next    = abcd;
+
+      if (i >= 3 && i <= 18)
+        msg[(m + 1) % 4] = _mm_sha1msg2_epu32(msg[(m + 1) % 4], msg[m]);
+
+      switch (i / 5) {
+      case 0:  abcd = _mm_sha1rnds4_epu32(abcd, e_current, 0); break;
+      case 1:  abcd = _mm_sha1rnds4_epu32(abcd, e_current, 1); break;
+      case 2:  abcd = _mm_sha1rnds4_epu32(abcd, e_current, 2); break;
+      default: abcd = _mm_sha1rnds4_epu32(abcd, e_current, 3); break;
+      }
+
+      if (i <= 16)
+        msg[(m + 3) % 4] = _mm_sha1msg1_epu32(msg[(m + 3) % 4], msg[m]);
+
+      if (i >= 2 && i <= 17)
+        msg[(m + 2) % 4] = _mm_xor_si128(msg[(m + 2) % 4], msg[m]);
+    }
+
+    e0   = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1b));
+  state[4] = _mm_extract_epi32(e0, 3);
+}
+
+} // namespace
+
+bool
+Sha1::is_accelerated() {
+  static const bool has_sha_ni = sha1_cpu_has_sha_ni();
+
+  return has_sha_ni;
+}
+
+void
+Sha1::native_init() {
+  m_state[0] = 0x67452301;
+  m_state[1] = 0xefcdab89;
+  m_state[2] = 0x98badcfe;
+  m_state[3] = 0x10325476;
+  m_state[4] = 0xc3d2e1f0;
+  m_length   = 0;
+}
+
+void
+Sha1::native_update(const void* data, unsigned int length) {
+  auto     src  = static_cast<const uint8_t*>(data);
+  uint32_t used = m_length % 64;
+
+  m_length += length;
+
+  if (used != 0) {
+    uint32_t fill = std::min<uint32_t>(64 - used, length);
+
+    std::memcpy(m_buffer + used, src, fill);
+    src    += fill;
+    length -= fill;
+
+    if (used + fill < 64)
+      return;
+
+    sha1_transform(m_state, m_buffer, 1);
+  }
+
+  sha1_transform(m_state, src, length / 64);
+  std::memcpy(m_buffer, src + (length & ~63u), length % 64);
+}
+
+void
+Sha1::native_final(void* buffer) {
+  uint64_t bits = m_length * 8;
+  uint32_t used = m_length % 64;
+
+  m_buffer[used++] = 0x80;
+
+  if (used > 56) {
+    std::memset(m_buffer + used, 0, 64 - used);
+    sha1_transform(m_state, m_buffer, 1);
+    used = 0;
+  }
+
+  std::memset(m_buffer + used, 0, 56 - used);
+
+  for (int i = 0; i < 8; i++)
+    m_buffer[63 - i] = bits >> (8 * i);
+
+  sha1_transform(m_state, m_buffer, 1);
+
+  auto dest = static_cast<uint8_t*>(buffer);
+
+  for (int i = 0; i < 5; i++) {
+    dest[4 * i + 0] = m_state[i] >> 24;
+    dest[4 * i + 1] = m_state[i] >> 16;
+    dest[4 * i + 2] = m_state[i] >> 8;
+    dest[4 * i + 3] = m_state[i];
+  }
+}
+
+#else
+
+bool Sha1::is_accelerated() { return false; }
+
+void Sha1::native_init() { throw internal_error("Sha1::native_init() called without SHA extensions support."); }
+void Sha1::native_update(const void*, unsigned int) { throw internal_error("Sha1::native_update() called without SHA extensions support."); }
+void Sha1::native_final(void*) { throw internal_error("Sha1::native_final() called without SHA extensions support."); }
+
+#endif
+
+#ifdef USE_AVX2
+
+namespace {
+
+bool
+sha1_cpu_has_avx2() {
+  __builtin_cpu_init();
+
+  return __builtin_cpu_supports("avx2");
+}
+
+// Lanes without data hash this and have their results discarded.
+alignas(32) const uint8_t sha1_multi_idle_block[64] = {};
+
+template <int bits>
+__attribute__((target("avx2")))
+inline __m256i
+sha1_multi_rotl(__m256i x) {
+  return _mm256_or_si256(_mm256_slli_epi32(x, bits), _mm256_srli_epi32(x, 32 - bits));
+}
+
+// Turns eight rows of eight words, one row per lane, into eight rows
+// each holding the same word of every lane.
+__attribute__((target("avx2")))
+inline void
+sha1_multi_transpose(__m256i* r) {
+  __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+  __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+  __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+  __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+  __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+  __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+  __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+  __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+  __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+  __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+  __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+  __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+  __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+  __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+  __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+  __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+  r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+  r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+  r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+  r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+  r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+  r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+  r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+  r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+// Processes 'blocks' consecutive 64 byte blocks in each of the eight
+// lanes, advancing each lane's data by its stride after every block.
+// Only lanes set in 'active' have their state updated.
+__attribute__((target("avx2")))
+void
+sha1_multi_transform(uint32_t state[5][8], const uint8_t* const* data, const uint32_t* stride, size_t blocks, uint32_t active) {
+  const __m256i bswap     = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                            12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  const __m256i lane_bits = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+  const __m256i mask      = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(active), lane_bits), lane_bits);
+
+  __m256i s[5];
+  const uint8_t* p[8];
+
+  for (int i = 0; i < 5; i++)
+    s[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(state[i]));
+
+  std::copy(data, data + 8, p);
+
+  for (; blocks != 0; blocks--) {
+    __m256i w[16];
+
+    for (int l = 0; l < 8; l++) {
+      w[l]     = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p[l]));
+      w[l + 8] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p[l] + 32));
+      p[l] += stride[l];
+    }
+
+    sha1_multi_transpose(w);
+    sha1_multi_transpose(w + 8);
+
+    for (int i = 0; i < 16; i++)
+      w[i] = _mm256_shuffle_epi8(w[i], bswap);
+
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4];
+
+#pragma GCC unroll 80
+    for (int t = 0; t < 80; t++) {
+      __m256i wt = w[t & 15];
+
+      if (t >= 16) {
+        wt = _mm256_xor_si256(_mm256_xor_si256(w[(t - 3) & 15], w[(t - 8) & 15]), _mm256_xor_si256(w[(t - 14) & 15], wt));
+        wt = sha1_multi_rotl<1>(wt);
+        w[t & 15] = wt;
+      }
+
+      __m256i f, k;
+
+      if (t < 20) {
+        f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+        k = _mm256_set1_epi32(0x5a827999);
+      } else if (t < 40) {
+        f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+        k = _mm256_set1_epi32(0x6ed9eba1);
+      } else if (t < 60) {
+        f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+        k = _mm256_set1_epi32(0x8f1bbcdc);
+      } else {
+        f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+        k = _mm256_set1_epi32(0xca62c1d6);
+      }
+
+      __m256i temp = _mm256_add_epi32(_mm256_add_epi32(sha1_multi_rotl<5>(a), f), _mm256_add_epi32(_mm256_add_epi32(e, k), wt));
+
+      e = d;
+      d = c;
+      c = sha1_multi_rotl<30>(b);
+      b = a;
+      a = temp;
+    }
+
+    s[0] = _mm256_blendv_epi8(s[0], _mm256_add_epi32(s[0], a), mask);
+    s[1] = _mm256_blendv_epi8(s[1], _mm256_add_epi32(s[1], b), mask);
+    s[2] = _mm256_blendv_epi8(s[2], _mm256_add_epi32(s[2], c), mask);
+    s[3] = _mm256_blendv_epi8(s[3], _mm256_add_epi32(s[3], d), mask);
+    s[4] = _mm256_blendv_epi8(s[4], _mm256_add_epi32(s[4], e), mask);
+  }
+
+  for (int i = 0; i < 5; i++)
+    _mm256_store_si256(reinterpret_cast<__m256i*>(state[i]), s[i]);
+}
+
+} // namespace
+
+bool
+Sha1Multi::is_available() {
+  static const bool has_avx2 = sha1_cpu_has_avx2();
+
+  return has_avx2;
+}
+
+// Each round of the lanes keeps running until the lane with the fewest
+// contiguous blocks left runs out, then those lanes are refilled.
+// Lanes that have finished keep hashing the idle block, with their
+// state masked out.
+void
+Sha1Multi::finalize() {
+  cursor_type cursors[max_lanes];
+
+  for (unsigned int lane = 0; lane < m_lanes; lane++) {
+    cursors[lane].blocks  = 0;
+    cursors[lane].segment = 0;
+    cursors[lane].offset  = 0;
+    cursors[lane].padded  = false;
+  }
+
+  while (true) {
+    const uint8_t* data[max_lanes];
+    uint32_t       stride[max_lanes];
+    uint32_t       active = 0;
+    uint32_t       blocks = ~uint32_t();
+
+    for (unsigned int lane = 0; lane < max_lanes; lane++) {
+      data[lane]   = sha1_multi_idle_block;
+      stride[lane] = 0;
+
+      if (lane >= m_lanes)
+        continue;
+
+      auto& cursor = cursors[lane];
+
+      if (cursor.blocks == 0 && !next_blocks(lane, cursor))
+        continue;
+
+      data[lane]   = cursor.data;
+      stride[lane] = 64;
+      active |= 1 << lane;
+      blocks = std::min(blocks, cursor.blocks);
+    }
+
+    if (active == 0)
+      break;
+
+    sha1_multi_transform(m_state, data, stride, blocks, active);
+
+    for (unsigned int lane = 0; lane < m_lanes; lane++) {
+      if (!(active & (1 << lane)))
+        continue;
+
+      auto& cursor = cursors[lane];
+
+      cursor.data   += 64 * blocks;
+      cursor.blocks -= blocks;
+
+      if (cursor.in_segment)
+        cursor.offset += 64 * blocks;
+    }
+  }
+}
+
+#else
+
+bool Sha1Multi::is_available() { return false; }
+
+void Sha1Multi::finalize() { throw internal_error("Sha1Multi::finalize() called without AVX2 support."); }
+
+#endif
+
+// With every lane busy this runs at about 1.7x the SHA extensions and
+// 2.7x OpenSSL without them, and the rate drops with the number of
+// lanes used.
+unsigned int
+Sha1Multi::min_lanes() {
+  if (!is_available())
+    return ~0u;
+
+  return Sha1::is_accelerated() ? 5 : 3;
+}
+
+void
+Sha1Multi::init(unsigned int lanes) {
+  if (lanes > max_lanes)
+    throw internal_error("Sha1Multi::init() called with too many lanes.");
+
+  m_lanes = lanes;
+
+  for (unsigned int lane = 0; lane < max_lanes; lane++) {
+    m_segments[lane].clear();
+    m_length[lane] = 0;
+
+    m_state[0][lane] = 0x67452301;
+    m_state[1][lane] = 0xefcdab89;
+    m_state[2][lane] = 0x98badcfe;
+    m_state[3][lane] = 0x10325476;
+    m_state[4][lane] = 0xc3d2e1f0;
+  }
+}
+
+void
+Sha1Multi::update(unsigned int lane, const void* data, unsigned int length) {
+  if (lane >= m_lanes)
+    throw internal_error("Sha1Multi::update() called with an invalid lane.");
+
+  if (length == 0)
+    return;
+
+  m_segments[lane].emplace_back(static_cast<const uint8_t*>(data), length);
+  m_length[lane] += length;
+}
+
+void
+Sha1Multi::digest(unsigned int lane, void* buffer) const {
+  auto dest = static_cast<uint8_t*>(buffer);
+
+  for (int i = 0; i < 5; i++) {
+    dest[4 * i + 0] = m_state[i][lane] >> 24;
+    dest[4 * i + 1] = m_state[i][lane] >> 16;
+    dest[4 * i + 2] = m_state[i][lane] >> 8;
+    dest[4 * i + 3] = m_state[i][lane];
+  }
+}
+
+// Points the cursor at the next run of whole blocks in the current
+// segment. Blocks that straddle segments are gathered into the cursor's
+// buffer, as is the final partial block along with the padding.
+bool
+Sha1Multi::next_blocks(unsigned int lane, cursor_type& cursor) {
+  if (cursor.padded)
+    return false;
+
+  const auto& segments = m_segments[lane];
+
+  while (cursor.segment < segments.size() && cursor.offset == segments[cursor.segment].second) {
+    cursor.segment++;
+    cursor.offset = 0;
+  }
+
+  if (cursor.segment < segments.size() && segments[cursor.segment].second - cursor.offset >= 64) {
+    cursor.data       = segments[cursor.segment].first + cursor.offset;
+    cursor.blocks     = (segments[cursor.segment].second - cursor.offset) / 64;
+    cursor.in_segment = true;
+    return true;
+  }
+
+  uint32_t used = 0;
+
+  while (used < 64 && cursor.segment < segments.size()) {
+    uint32_t fill = std::min<uint32_t>(64 - used, segments[cursor.segment].second - cursor.offset);
+
+    std::memcpy(cursor.buffer + used, segments[cursor.segment].first + cursor.offset, fill);
+    used          += fill;
+    cursor.offset += fill;
+
+    if (cursor.offset == segments[cursor.segment].second) {
+      cursor.segment++;
+      cursor.offset = 0;
+    }
+  }
+
+  cursor.data       = cursor.buffer;
+  cursor.in_segment = false;
+
+  if (used == 64) {
+    cursor.blocks = 1;
+    return true;
+  }
+
+  uint64_t bits = m_length[lane] * 8;
+  uint32_t end  = used + 1 > 56 ? 128 : 64;
+
+  cursor.buffer[used] = 0x80;
+  std::memset(cursor.buffer + used + 1, 0, end - used - 1);
+
+  for (int i = 0; i < 8; i++)
+    cursor.buffer[end - 1 - i] = bits >> (8 * i);
+
+  cursor.blocks = end / 64;
+  cursor.padded = true;
+  return true;
+}
+
+} // namespace torrent
@@ -1,8 +1,10 @@
 #ifndef LIBTORRENT_HASH_COMPUTE_H
 #define LIBTORRENT_HASH_COMPUTE_H
 
+#include <cstdint>
 #include <cstring>
 #include <memory>
+#include <vector>
 #include <openssl/evp.h>
 
 #include "torrent/exceptions.h"
@@ -15,18 +17,80 @@ struct sha1_deleter {
   void operator()(const EVP_MD_CTX* ctx) const { EVP_MD_CTX_free(const_cast<EVP_MD_CTX*>(ctx)); }
 };
 
+// Uses the built-in SHA extensions backend when the CPU supports it,
+// else falls back to OpenSSL. The backend is picked once at runtime.
 class Sha1 {
 public:
   void init();
   void update(const void* data, unsigned int length);
   void final_c(void* buffer);
 
+  static bool is_accelerated();
+
 private:
+  void native_init();
+  void native_update(const void* data, unsigned int length);
+  void native_final(void* buffer);
+
   std::unique_ptr<EVP_MD_CTX, sha1_deleter> m_ctx;
+
+  bool     m_native{false};
+  uint32_t m_state[5];
+  uint64_t m_length;
+  uint8_t  m_buffer[64];
+};
+
+// Hashes up to 'max_lanes' independent messages at once, one per AVX2
+// lane, for CPUs without the SHA extensions. The data passed to
+// update() is not copied and must stay valid until finalize().
+class Sha1Multi {
+public:
+  static constexpr unsigned int max_lanes = 8;
+
+  static bool is_available();
+
+  // The fewest messages for which hashing them together beats hashing
+  // each with Sha1, going by extra/sha1_benchmark.cc.
+  static unsigned int min_lanes();
+
+  void init(unsigned int lanes);
+  void update(unsigned int lane, const void* data, unsigned int length);
+  void finalize();
+
+  void digest(unsigned int lane, void* buffer) const;
+
+  unsigned int lanes() const { return m_lanes; }
+
+private:
+  using segment_type = std::pair<const uint8_t*, uint32_t>;
+
+  struct cursor_type {
+    const uint8_t* data;
+    uint32_t       blocks;
+    size_t         segment;
+    uint32_t       offset;
+    bool           in_segment;
+    bool           padded;
+
+    alignas(32) uint8_t buffer[128];
+  };
+
+  bool next_blocks(unsigned int lane, cursor_type& cursor);
+
+  unsigned int              m_lanes{0};
+  std::vector<segment_type> m_segments[max_lanes];
+  uint64_t                  m_length[max_lanes];
+
+  alignas(32) uint32_t      m_state[5][max_lanes];
 };
 
 inline void
 Sha1::init() {
+  m_native = is_accelerated();
+
+  if (m_native)
+    return native_init();
+
   if (m_ctx == nullptr)
     m_ctx.reset(EVP_MD_CTX_new());
   else
@@ -38,12 +102,18 @@ Sha1::init() {
 
 inline void
 Sha1::update(const void* data, unsigned int length) {
+  if (m_native)
+    return native_update(data, length);
+
   if (EVP_DigestUpdate(m_ctx.get(), data, length) == 0)
     throw internal_error("Sha1::update() failed to update SHA-1 context.");
 }
 
 inline void
 Sha1::final_c(void* buffer) {
+  if (m_native)
+    return native_final(buffer);
+
   if (EVP_DigestFinal(m_ctx.get(), static_cast<unsigned char*>(buffer), nullptr) == 0)
     throw internal_error("Sha1::final_c() failed to finalize SHA-1 context.");
 }
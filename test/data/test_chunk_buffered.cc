@@ -0,0 +1,661 @@
+#include "config.h"
+
+#include "test/data/test_chunk_buffered.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <rak/error_number.h>
+
+#include "data/buffer_pool.h"
+#include "data/chunk.h"
+#include "data/chunk_list.h"
+#include "data/socket_file.h"
+#include "data/thread_disk.h"
+#include "test/helpers/test_utils.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/file.h"
+#include "torrent/exceptions.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_chunk_buffered, "data");
+
+namespace {
+
+constexpr uint32_t chunk_size  = 1 << 16;
+constexpr uint32_t chunk_count = 4;
+constexpr uint32_t part_size   = chunk_size / 2;
+
+// An unlinked temporary file where every byte of chunk 'i' is 'i'.
+// The descriptor may be opened read-only to make writes fail.
+struct test_file {
+  test_file(bool read_only = false);
+  ~test_file();
+
+  bool                has_content(uint32_t index, char value);
+
+  int                 fd{-1};
+  int                 direct_fd{-1};
+  torrent::File       file;
+};
+
+test_file::test_file(bool read_only) {
+  char path[] = "/tmp/libtorrent_test_chunk_buffered.XXXXXX";
+
+  if ((fd = ::mkstemp(path)) == -1)
+    throw torrent::internal_error("test_file: mkstemp failed");
+
+  for (uint32_t index = 0; index != chunk_count; index++) {
+    std::string data(chunk_size, static_cast<char>(index));
+
+    if (::pwrite(fd, data.data(), data.size(), uint64_t{index} * chunk_size) != static_cast<ssize_t>(data.size()))
+      throw torrent::internal_error("test_file: pwrite failed");
+  }
+
+  if (read_only) {
+    int read_fd = ::open(path, O_RDONLY);
+    ::close(fd);
+    fd = read_fd;
+  }
+
+  direct_fd = torrent::SocketFile::open_direct(path);
+  ::unlink(path);
+
+  // Claim write permission so File::prepare doesn't try to reopen it.
+  file.set_file_descriptor(fd);
+  file.set_protection(torrent::MemoryChunk::prot_read | torrent::MemoryChunk::prot_write);
+}
+
+test_file::~test_file() {
+  torrent::thread_disk()->disk_io()->close_file(fd);
+
+  if (direct_fd != -1)
+    torrent::thread_disk()->disk_io()->close_file(direct_fd);
+
+  file.set_file_descriptor(-1);
+}
+
+bool
+test_file::has_content(uint32_t index, char value) {
+  std::string data(chunk_size, '\0');
+
+  if (::pread(fd, data.data(), data.size(), uint64_t{index} * chunk_size) != static_cast<ssize_t>(data.size()))
+    return false;
+
+  return data == std::string(chunk_size, value);
+}
+
+// Two parts so that reads and writes complete only once both do.
+torrent::Chunk*
+create_buffered_chunk(test_file* f, uint32_t index, int prot) {
+  auto chunk = new torrent::Chunk;
+
+  for (uint64_t offset = uint64_t{index} * chunk_size; offset != uint64_t{index + 1} * chunk_size; offset += part_size) {
+    chunk->push_back(torrent::ChunkPart::MAPPED_BUFFER, torrent::SocketFile(f->fd).create_buffer_chunk(offset, part_size, prot));
+    chunk->back().set_file(&f->file, offset);
+  }
+
+  return chunk;
+}
+
+// Hashing chunks read around the page cache, using the direct
+// descriptor if not -1. Parts start 100 bytes before chunk 'index' to
+// check that direct reads into aligned buffers handle the offset.
+torrent::Chunk*
+create_uncached_chunk(test_file* f, uint32_t index, int direct_fd) {
+  auto chunk = new torrent::Chunk;
+
+  for (uint64_t offset = uint64_t{index} * chunk_size - 100; offset < uint64_t{index + 1} * chunk_size; offset += part_size) {
+    uint32_t length = std::min<uint64_t>(part_size, uint64_t{index + 1} * chunk_size - offset);
+
+    if (direct_fd != -1)
+      chunk->push_back(torrent::ChunkPart::MAPPED_BUFFER, torrent::SocketFile(f->fd).create_aligned_buffer_chunk(offset, length, torrent::MemoryChunk::prot_read));
+    else
+      chunk->push_back(torrent::ChunkPart::MAPPED_BUFFER, torrent::SocketFile(f->fd).create_buffer_chunk(offset, length, torrent::MemoryChunk::prot_read));
+
+    chunk->back().set_file(&f->file, offset);
+    chunk->back().set_uncached(direct_fd);
+  }
+
+  return chunk;
+}
+
+bool
+uncached_chunk_has_content(torrent::Chunk* chunk, uint32_t index) {
+  std::string expected = std::string(100, static_cast<char>(index - 1)) + std::string(chunk_size, static_cast<char>(index));
+  std::string data;
+
+  for (auto& part : *chunk)
+    data.append(part.chunk().begin(), part.chunk().end());
+
+  return data == expected;
+}
+
+bool
+chunk_has_content(torrent::Chunk* chunk, char value) {
+  return std::all_of(chunk->begin(), chunk->end(), [value](auto& part) {
+      return std::all_of(part.chunk().begin(), part.chunk().end(), [value](char c) { return c == value; });
+    });
+}
+
+void
+set_chunk_content(torrent::Chunk* chunk, char value) {
+  for (auto& part : *chunk)
+    std::fill(part.chunk().begin(), part.chunk().end(), value);
+}
+
+// Chunks are filled by the disk thread when got from the chunk list.
+struct test_chunk_list {
+  test_chunk_list(test_file* f);
+
+  torrent::ChunkListNode* node(uint32_t index) { return &list[index]; }
+
+  torrent::ChunkManager    manager;
+  torrent::ChunkList       list;
+  std::vector<std::string> errors;
+};
+
+test_chunk_list::test_chunk_list(test_file* f) {
+  list.set_manager(&manager);
+  list.set_chunk_size(chunk_size);
+  list.resize(chunk_count);
+
+  list.slot_create_chunk() = [f](uint32_t index, int prot) {
+      return create_buffered_chunk(f, index, prot);
+    };
+  list.slot_create_hashing_chunk() = [f](uint32_t index, int prot) {
+      return create_buffered_chunk(f, index, prot);
+    };
+
+  list.slot_free_diskspace() = []() { return uint64_t{0}; };
+  list.slot_storage_error() = [this](const std::string& message) { errors.push_back(message); };
+}
+
+// The whole chunk is replaced, so it isn't read in first.
+void
+write_chunk(torrent::ChunkList* list, uint32_t index, char value) {
+  auto handle = list->get(index, torrent::ChunkList::get_not_hashing | torrent::ChunkList::get_writable | torrent::ChunkList::get_dont_fill);
+
+  if (!handle.is_valid())
+    throw torrent::internal_error("write_chunk: could not get chunk");
+
+  set_chunk_content(handle.chunk(), value);
+  list->release(&handle, torrent::ChunkList::release_default);
+}
+
+// Without sync_all, which waits for the disk thread.
+const auto sync_flags = torrent::ChunkList::sync_force | torrent::ChunkList::sync_sloppy;
+
+} // namespace
+
+void
+test_chunk_buffered::test_fill() {
+  test_file f;
+  std::atomic<bool> filled{false};
+  std::unique_ptr<torrent::Chunk> chunk(create_buffered_chunk(&f, 1, torrent::MemoryChunk::prot_read));
+
+  {
+    TestBlockDiskThread block;
+
+    chunk->fill_async([&filled]() { filled = true; });
+    CPPUNIT_ASSERT(!chunk->is_filled());
+  }
+
+  CPPUNIT_ASSERT(wait_for_true([&filled]() { return filled.load(); }));
+  CPPUNIT_ASSERT(chunk->is_filled());
+  CPPUNIT_ASSERT(chunk_has_content(chunk.get(), 1));
+}
+
+void
+test_chunk_buffered::test_fill_clear_pending() {
+  test_file f;
+  std::atomic<bool> filled{false};
+  auto chunk = create_buffered_chunk(&f, 2, torrent::MemoryChunk::prot_read);
+
+  torrent::BufferPool::clear();
+
+  {
+    TestBlockDiskThread block;
+
+    chunk->fill_async([&filled]() { filled = true; });
+
+    // Returns while the reads are pending, leaving the buffers to the
+    // last read to release.
+    delete chunk;
+
+    CPPUNIT_ASSERT(torrent::BufferPool::pooled_bytes() == 0);
+  }
+
+  CPPUNIT_ASSERT(wait_for_true([&filled]() { return filled.load(); }));
+  CPPUNIT_ASSERT(torrent::BufferPool::pooled_bytes() == chunk_size);
+
+  torrent::BufferPool::clear();
+}
+
+void
+test_chunk_buffered::test_fill_uncached() {
+  test_file f;
+  std::atomic<bool> filled{false};
+  std::unique_ptr<torrent::Chunk> chunk(create_uncached_chunk(&f, 2, -1));
+
+  chunk->fill_async([&filled]() { filled = true; });
+
+  CPPUNIT_ASSERT(wait_for_true([&filled]() { return filled.load(); }));
+  CPPUNIT_ASSERT(chunk->is_filled());
+  CPPUNIT_ASSERT(uncached_chunk_has_content(chunk.get(), 2));
+}
+
+void
+test_chunk_buffered::test_fill_direct() {
+  test_file f;
+
+  if (f.direct_fd == -1)
+    return; // O_DIRECT is not supported by the filesystem.
+
+  // The last chunk checks a direct read ending at the end of the file.
+  for (uint32_t index : { 1u, chunk_count - 1 }) {
+    std::atomic<bool> filled{false};
+    std::unique_ptr<torrent::Chunk> chunk(create_uncached_chunk(&f, index, f.direct_fd));
+
+    chunk->fill_async([&filled]() { filled = true; });
+
+    CPPUNIT_ASSERT(wait_for_true([&filled]() { return filled.load(); }));
+    CPPUNIT_ASSERT(chunk->is_filled());
+    CPPUNIT_ASSERT(uncached_chunk_has_content(chunk.get(), index));
+  }
+}
+
+void
+test_chunk_buffered::test_get_unfilled() {
+  test_file f;
+  test_chunk_list cl(&f);
+
+  {
+    TestBlockDiskThread block;
+
+    auto handle = cl.list.get(1, torrent::ChunkList::get_hashing);
+    CPPUNIT_ASSERT(handle.is_valid());
+    CPPUNIT_ASSERT(!handle.chunk()->is_filled());
+
+    auto unfilled = cl.list.get(1, torrent::ChunkList::get_not_hashing);
+    CPPUNIT_ASSERT(!unfilled.is_valid());
+    CPPUNIT_ASSERT(unfilled.error_number().value() == rak::error_number::e_again);
+
+    cl.list.release(&handle, torrent::ChunkList::release_default);
+    CPPUNIT_ASSERT(!cl.node(1)->is_valid());
+  }
+
+  // The read of the released chunk completes without reviving it.
+  CPPUNIT_ASSERT(wait_for_true([]() { return torrent::thread_disk()->disk_io()->pending_size() == 0; }));
+  m_main_thread->test_process_events_without_cached_time();
+
+  CPPUNIT_ASSERT(!cl.node(1)->is_valid());
+  CPPUNIT_ASSERT(cl.manager.memory_usage() == 0);
+}
+
+void
+test_chunk_buffered::test_get_fill() {
+  test_file f;
+  test_chunk_list cl(&f);
+  std::vector<uint32_t> filled;
+  torrent::ChunkHandle handle;
+
+  // Tries again once filled, as peer connections do.
+  cl.list.slot_chunk_filled() = [&](uint32_t index) {
+      filled.push_back(index);
+
+      if (!handle.is_valid())
+        handle = cl.list.get(index, torrent::ChunkList::get_not_hashing);
+    };
+
+  {
+    TestBlockDiskThread block;
+
+    auto unfilled = cl.list.get(2, torrent::ChunkList::get_not_hashing);
+    CPPUNIT_ASSERT(!unfilled.is_valid());
+    CPPUNIT_ASSERT(unfilled.error_number().value() == rak::error_number::e_again);
+
+    // The node owns the chunk being filled without any references.
+    CPPUNIT_ASSERT(cl.node(2)->is_valid() && cl.node(2)->references() == 0);
+
+    auto writable = cl.list.get(2, torrent::ChunkList::get_not_hashing | torrent::ChunkList::get_writable);
+    CPPUNIT_ASSERT(!writable.is_valid());
+    CPPUNIT_ASSERT(writable.error_number().value() == rak::error_number::e_again);
+  }
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return handle.is_valid();
+      }));
+
+  CPPUNIT_ASSERT(filled == std::vector<uint32_t>{2});
+  CPPUNIT_ASSERT(chunk_has_content(handle.chunk(), 2));
+  CPPUNIT_ASSERT(cl.node(2)->references() == 1);
+
+  cl.list.release(&handle, torrent::ChunkList::release_default);
+
+  CPPUNIT_ASSERT(!cl.node(2)->is_valid());
+  CPPUNIT_ASSERT(cl.manager.memory_usage() == 0);
+}
+
+void
+test_chunk_buffered::test_get_fill_unused() {
+  test_file f;
+  test_chunk_list cl(&f);
+  std::vector<uint32_t> filled;
+
+  cl.list.slot_chunk_filled() = [&filled](uint32_t index) { filled.push_back(index); };
+
+  auto handle = cl.list.get(3, torrent::ChunkList::get_not_hashing);
+  CPPUNIT_ASSERT(handle.error_number().value() == rak::error_number::e_again);
+
+  // Released once filled if nobody took it.
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return !filled.empty();
+      }));
+
+  CPPUNIT_ASSERT(!cl.node(3)->is_valid());
+  CPPUNIT_ASSERT(cl.manager.memory_usage() == 0);
+
+  // Writable chunks replaced in whole are not read in.
+  handle = cl.list.get(3, torrent::ChunkList::get_not_hashing | torrent::ChunkList::get_writable | torrent::ChunkList::get_dont_fill);
+  CPPUNIT_ASSERT(handle.is_valid());
+  CPPUNIT_ASSERT(handle.chunk()->is_filled());
+
+  cl.list.release(&handle, torrent::ChunkList::release_default);
+  cl.list.clear();
+
+  CPPUNIT_ASSERT(cl.manager.memory_usage() == 0);
+}
+
+void
+test_chunk_buffered::test_get_fill_error() {
+  test_file f;
+  test_chunk_list cl(&f);
+  torrent::File dir_file;
+  torrent::ChunkHandle handle;
+  bool filled = false;
+
+  // Reading a directory fails.
+  dir_file.set_file_descriptor(::open("/", O_RDONLY | O_DIRECTORY));
+  dir_file.set_protection(torrent::MemoryChunk::prot_read);
+  CPPUNIT_ASSERT(dir_file.file_descriptor() != -1);
+
+  cl.list.slot_create_chunk() = [&](uint32_t index, int prot) {
+      auto chunk = create_buffered_chunk(&f, index, prot);
+
+      for (auto& part : *chunk)
+        part.set_file(&dir_file, part.file_offset());
+
+      return chunk;
+    };
+  cl.list.slot_create_hashing_chunk() = cl.list.slot_create_chunk();
+  cl.list.slot_chunk_filled() = [&](uint32_t index) {
+      filled = true;
+      handle = cl.list.get(index, torrent::ChunkList::get_not_hashing);
+    };
+
+  CPPUNIT_ASSERT(cl.list.get(1, torrent::ChunkList::get_not_hashing).error_number().value() == rak::error_number::e_again);
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return filled;
+      }));
+
+  // The error is returned instead of the chunk, which is released.
+  CPPUNIT_ASSERT(!handle.is_valid());
+  CPPUNIT_ASSERT(handle.error_number().is_valid());
+  CPPUNIT_ASSERT(handle.error_number().value() != rak::error_number::e_again);
+  CPPUNIT_ASSERT(!cl.node(1)->is_valid());
+  CPPUNIT_ASSERT(cl.manager.memory_usage() == 0);
+
+  // The hash checker gets the chunk, and checks the error once filled.
+  filled = false;
+  cl.list.slot_chunk_filled() = [&filled](uint32_t) { filled = true; };
+
+  handle = cl.list.get(2, torrent::ChunkList::get_hashing);
+  CPPUNIT_ASSERT(handle.is_valid());
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return filled;
+      }));
+
+  CPPUNIT_ASSERT(handle.chunk()->is_filled());
+  CPPUNIT_ASSERT(handle.chunk()->fill_error() != 0);
+
+  cl.list.release(&handle, torrent::ChunkList::release_default);
+
+  torrent::thread_disk()->disk_io()->close_file(dir_file.file_descriptor());
+  dir_file.set_file_descriptor(-1);
+}
+
+void
+test_chunk_buffered::test_write_back() {
+  test_file f;
+  test_chunk_list cl(&f);
+
+  write_chunk(&cl.list, 0, 'a');
+  write_chunk(&cl.list, 3, 'b');
+
+  CPPUNIT_ASSERT(cl.list.queue_size() == 2);
+
+  {
+    TestBlockDiskThread block;
+
+    CPPUNIT_ASSERT(cl.list.sync_chunks(sync_flags) == 0);
+
+    // Nodes stay queued and keep their buffers until the jobs are
+    // processed.
+    CPPUNIT_ASSERT(cl.list.queue_size() == 2);
+    CPPUNIT_ASSERT(cl.node(0)->is_valid() && cl.node(0)->is_write_pending());
+    CPPUNIT_ASSERT(cl.node(3)->is_valid() && cl.node(3)->is_write_pending());
+    CPPUNIT_ASSERT(!cl.node(0)->chunk()->is_dirty());
+  }
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return cl.list.queue_size() == 0;
+      }));
+
+  CPPUNIT_ASSERT(!cl.node(0)->is_valid() && !cl.node(0)->is_write_pending());
+  CPPUNIT_ASSERT(!cl.node(3)->is_valid() && !cl.node(3)->is_write_pending());
+  CPPUNIT_ASSERT(cl.manager.memory_usage() == 0);
+  CPPUNIT_ASSERT(cl.errors.empty());
+
+  CPPUNIT_ASSERT(f.has_content(0, 'a'));
+  CPPUNIT_ASSERT(f.has_content(1, 1));
+  CPPUNIT_ASSERT(f.has_content(3, 'b'));
+}
+
+void
+test_chunk_buffered::test_write_back_failure() {
+  test_file f(true);
+  test_chunk_list cl(&f);
+
+  write_chunk(&cl.list, 1, 'a');
+
+  {
+    TestBlockDiskThread block;
+
+    CPPUNIT_ASSERT(cl.list.sync_chunks(sync_flags) == 0);
+    CPPUNIT_ASSERT(cl.node(1)->is_write_pending());
+  }
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return !cl.node(1)->is_write_pending();
+      }));
+
+  // Failed chunks are kept queued and dirty so the next sync retries
+  // them.
+  CPPUNIT_ASSERT(cl.errors.size() == 1);
+  CPPUNIT_ASSERT(cl.list.queue_size() == 1);
+  CPPUNIT_ASSERT(cl.node(1)->is_valid());
+  CPPUNIT_ASSERT(cl.node(1)->chunk()->is_dirty());
+  CPPUNIT_ASSERT(f.has_content(1, 1));
+
+  {
+    TestBlockDiskThread block;
+
+    CPPUNIT_ASSERT(cl.list.sync_chunks(sync_flags) == 0);
+    CPPUNIT_ASSERT(cl.node(1)->is_write_pending());
+  }
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return !cl.node(1)->is_write_pending();
+      }));
+
+  CPPUNIT_ASSERT(cl.errors.size() == 2);
+  CPPUNIT_ASSERT(cl.list.queue_size() == 1);
+}
+
+// Syncing everything returns once the writes still in flight, and
+// those it submits, are done.
+void
+test_chunk_buffered::test_write_back_sync_all() {
+  test_file f;
+  test_chunk_list cl(&f);
+
+  write_chunk(&cl.list, 0, 'a');
+
+  {
+    TestBlockDiskThread block;
+
+    CPPUNIT_ASSERT(cl.list.sync_chunks(sync_flags) == 0);
+    CPPUNIT_ASSERT(cl.node(0)->is_write_pending());
+  }
+
+  write_chunk(&cl.list, 3, 'b');
+
+  CPPUNIT_ASSERT(cl.list.sync_chunks(sync_flags | torrent::ChunkList::sync_all) == 0);
+
+  CPPUNIT_ASSERT(cl.list.queue_size() == 0);
+  CPPUNIT_ASSERT(!cl.node(0)->is_valid() && !cl.node(0)->is_write_pending());
+  CPPUNIT_ASSERT(!cl.node(3)->is_valid() && !cl.node(3)->is_write_pending());
+  CPPUNIT_ASSERT(cl.manager.memory_usage() == 0);
+  CPPUNIT_ASSERT(cl.errors.empty());
+
+  CPPUNIT_ASSERT(f.has_content(0, 'a'));
+  CPPUNIT_ASSERT(f.has_content(3, 'b'));
+}
+
+// The failure is counted and reported with the error of the write.
+void
+test_chunk_buffered::test_write_back_sync_all_failure() {
+  test_file f(true);
+  test_chunk_list cl(&f);
+
+  write_chunk(&cl.list, 1, 'a');
+
+  CPPUNIT_ASSERT(cl.list.sync_chunks(sync_flags | torrent::ChunkList::sync_all) == 1);
+
+  CPPUNIT_ASSERT(!cl.node(1)->is_write_pending());
+  CPPUNIT_ASSERT(cl.list.queue_size() == 1);
+  CPPUNIT_ASSERT(cl.errors.size() == 1);
+  CPPUNIT_ASSERT_EQUAL(std::string("Could not sync chunk: ") + std::strerror(EBADF), cl.errors.front());
+}
+
+void
+test_chunk_buffered::test_write_back_ignore_error() {
+  test_file f(true);
+  test_chunk_list cl(&f);
+
+  write_chunk(&cl.list, 1, 'a');
+
+  {
+    TestBlockDiskThread block;
+
+    CPPUNIT_ASSERT(cl.list.sync_chunks(sync_flags | torrent::ChunkList::sync_ignore_error) == 0);
+  }
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return !cl.node(1)->is_write_pending();
+      }));
+
+  CPPUNIT_ASSERT(cl.errors.empty());
+  CPPUNIT_ASSERT(cl.list.queue_size() == 1);
+  CPPUNIT_ASSERT(cl.node(1)->chunk()->is_dirty());
+}
+
+void
+test_chunk_buffered::test_write_back_modified() {
+  test_file f;
+  test_chunk_list cl(&f);
+
+  write_chunk(&cl.list, 2, 'a');
+
+  {
+    TestBlockDiskThread block;
+
+    CPPUNIT_ASSERT(cl.list.sync_chunks(sync_flags) == 0);
+    CPPUNIT_ASSERT(cl.node(2)->is_write_pending());
+
+    // Pending chunks are skipped by later syncs.
+    CPPUNIT_ASSERT(cl.list.sync_chunks(sync_flags) == 0);
+
+    write_chunk(&cl.list, 2, 'b');
+    CPPUNIT_ASSERT(cl.node(2)->chunk()->is_dirty());
+  }
+
+  // Modified while being written, so it is left for the next sync.
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return !cl.node(2)->is_write_pending();
+      }));
+
+  CPPUNIT_ASSERT(cl.list.queue_size() == 1);
+  CPPUNIT_ASSERT(cl.node(2)->is_valid());
+  CPPUNIT_ASSERT(cl.node(2)->references() == 1 && cl.node(2)->writable() == 1);
+
+  cl.list.sync_chunks(sync_flags);
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return cl.list.queue_size() == 0;
+      }));
+
+  CPPUNIT_ASSERT(!cl.node(2)->is_valid());
+  CPPUNIT_ASSERT(f.has_content(2, 'b'));
+}
+
+void
+test_chunk_buffered::test_write_back_clear_pending() {
+  test_file f;
+  auto cl = std::make_unique<test_chunk_list>(&f);
+
+  write_chunk(&cl->list, 0, 'a');
+  write_chunk(&cl->list, 1, 'b');
+
+  torrent::BufferPool::clear();
+
+  {
+    TestBlockDiskThread block;
+
+    CPPUNIT_ASSERT(cl->list.sync_chunks(sync_flags) == 0);
+
+    // Returns while the writes are pending, the chunks are released
+    // by the disk thread once they are done.
+    cl.reset();
+
+    CPPUNIT_ASSERT(torrent::BufferPool::pooled_bytes() == 0);
+  }
+
+  CPPUNIT_ASSERT(wait_for_true([]() { return torrent::BufferPool::pooled_bytes() == 2 * chunk_size; }));
+
+  // Nothing is posted back to the deleted chunk list.
+  m_main_thread->test_process_events_without_cached_time();
+
+  CPPUNIT_ASSERT(f.has_content(0, 'a'));
+  CPPUNIT_ASSERT(f.has_content(1, 'b'));
+
+  torrent::BufferPool::clear();
+}
@@ -0,0 +1,47 @@
+#ifndef TEST_DATA_CHUNK_BUFFERED_H
+#define TEST_DATA_CHUNK_BUFFERED_H
+
+#include "helpers/test_main_thread.h"
+
+class test_chunk_buffered : public TestFixtureWithMainAndDiskThread {
+  CPPUNIT_TEST_SUITE(test_chunk_buffered);
+
+  CPPUNIT_TEST(test_fill);
+  CPPUNIT_TEST(test_fill_clear_pending);
+  CPPUNIT_TEST(test_fill_uncached);
+  CPPUNIT_TEST(test_fill_direct);
+  CPPUNIT_TEST(test_get_unfilled);
+  CPPUNIT_TEST(test_get_fill);
+  CPPUNIT_TEST(test_get_fill_unused);
+  CPPUNIT_TEST(test_get_fill_error);
+
+  CPPUNIT_TEST(test_write_back);
+  CPPUNIT_TEST(test_write_back_failure);
+  CPPUNIT_TEST(test_write_back_sync_all);
+  CPPUNIT_TEST(test_write_back_sync_all_failure);
+  CPPUNIT_TEST(test_write_back_ignore_error);
+  CPPUNIT_TEST(test_write_back_modified);
+  CPPUNIT_TEST(test_write_back_clear_pending);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_fill();
+  void test_fill_clear_pending();
+  void test_fill_uncached();
+  void test_fill_direct();
+  void test_get_unfilled();
+  void test_get_fill();
+  void test_get_fill_unused();
+  void test_get_fill_error();
+
+  void test_write_back();
+  void test_write_back_failure();
+  void test_write_back_sync_all();
+  void test_write_back_sync_all_failure();
+  void test_write_back_ignore_error();
+  void test_write_back_modified();
+  void test_write_back_clear_pending();
+};
+
+#endif // TEST_DATA_CHUNK_BUFFERED_H
@@ -0,0 +1,244 @@
+#include "config.h"
+
+#include "test_chunk_cache.h"
+
+#include "data/chunk_cache.h"
+#include "data/chunk_list.h"
+#include "torrent/chunk_manager.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_chunk_cache, "data");
+
+// All chunks are 100 bytes with room for three in the cache.
+#define SETUP_CHUNK_CACHE()                     \
+  torrent::ChunkList chunk_list;                \
+  torrent::ChunkCache cache;                    \
+  cache.set_max_size(300);
+
+static void
+insert_chunk(torrent::ChunkCache* cache, torrent::ChunkList* chunk_list, uint32_t index, bool prefetched = false) {
+  cache->insert(chunk_list, index, torrent::ChunkCache::buffer_type(new char[100]), 100, prefetched);
+}
+
+void
+test_chunk_cache::test_basic() {
+  SETUP_CHUNK_CACHE();
+
+  CPPUNIT_ASSERT(cache.is_enabled());
+  CPPUNIT_ASSERT(cache.is_missing(&chunk_list, 0));
+  CPPUNIT_ASSERT(cache.find(&chunk_list, 0) == nullptr);
+
+  insert_chunk(&cache, &chunk_list, 0);
+
+  CPPUNIT_ASSERT(!cache.is_missing(&chunk_list, 0));
+  CPPUNIT_ASSERT(cache.size() == 100);
+  CPPUNIT_ASSERT(cache.recent_size() == 100);
+
+  // A second use promotes the chunk to the frequent list.
+  CPPUNIT_ASSERT(cache.find(&chunk_list, 0) != nullptr);
+  CPPUNIT_ASSERT(cache.recent_size() == 0);
+  CPPUNIT_ASSERT(cache.frequent_size() == 100);
+
+  CPPUNIT_ASSERT(cache.find(&chunk_list, 0) != nullptr);
+  CPPUNIT_ASSERT(cache.frequent_size() == 100);
+
+  CPPUNIT_ASSERT(cache.stats_hits() == 2);
+  CPPUNIT_ASSERT(cache.stats_misses() == 1);
+  CPPUNIT_ASSERT(chunk_list.stats_cache_hits() == 2);
+  CPPUNIT_ASSERT(chunk_list.stats_cache_misses() == 1);
+
+  cache.set_max_size(0);
+
+  CPPUNIT_ASSERT(!cache.is_enabled());
+  CPPUNIT_ASSERT(cache.size() == 0);
+}
+
+// Cache with chunk 0 in the frequent list and chunks 2 and 3 in the
+// recent list, chunk 1 having been evicted to the recent ghost list.
+static void
+fill_chunk_cache(torrent::ChunkCache* cache, torrent::ChunkList* chunk_list) {
+  insert_chunk(cache, chunk_list, 0);
+  cache->find(chunk_list, 0);
+
+  for (uint32_t i = 1; i < 4; i++)
+    insert_chunk(cache, chunk_list, i);
+}
+
+void
+test_chunk_cache::test_evict_recent() {
+  SETUP_CHUNK_CACHE();
+
+  fill_chunk_cache(&cache, &chunk_list);
+
+  // The least recently inserted chunk becomes a ghost.
+  CPPUNIT_ASSERT(cache.size() == 300);
+  CPPUNIT_ASSERT(cache.recent_size() == 200);
+  CPPUNIT_ASSERT(cache.frequent_size() == 100);
+  CPPUNIT_ASSERT(cache.recent_ghost_size() == 100);
+
+  CPPUNIT_ASSERT(!cache.is_missing(&chunk_list, 0));
+  CPPUNIT_ASSERT(cache.is_missing(&chunk_list, 1));
+  CPPUNIT_ASSERT(!cache.is_missing(&chunk_list, 2));
+
+  // The recent list and its ghosts are bounded by the cache size, so
+  // the oldest ghost is dropped.
+  insert_chunk(&cache, &chunk_list, 4);
+
+  CPPUNIT_ASSERT(cache.recent_size() == 200);
+  CPPUNIT_ASSERT(cache.recent_ghost_size() == 100);
+  CPPUNIT_ASSERT(cache.is_missing(&chunk_list, 2));
+
+  // Chunk 1 is no longer a ghost, so a request for it does not adapt
+  // the target.
+  CPPUNIT_ASSERT(cache.find(&chunk_list, 1) == nullptr);
+  CPPUNIT_ASSERT(cache.target_recent_size() == 0);
+}
+
+void
+test_chunk_cache::test_ghost_promotion() {
+  SETUP_CHUNK_CACHE();
+
+  fill_chunk_cache(&cache, &chunk_list);
+
+  // Ghost hit on the recent list raises its target.
+  CPPUNIT_ASSERT(cache.find(&chunk_list, 1) == nullptr);
+  CPPUNIT_ASSERT(cache.target_recent_size() == 100);
+
+  // Chunk 1 was seen before so it goes straight to the frequent list,
+  // and the recent list is above its target so it loses its least
+  // recent chunk to make room.
+  insert_chunk(&cache, &chunk_list, 1);
+
+  CPPUNIT_ASSERT(cache.frequent_size() == 200);
+  CPPUNIT_ASSERT(cache.recent_size() == 100);
+  CPPUNIT_ASSERT(cache.recent_ghost_size() == 100);
+
+  CPPUNIT_ASSERT(!cache.is_missing(&chunk_list, 1));
+  CPPUNIT_ASSERT(cache.is_missing(&chunk_list, 2));
+
+  // Inserting a cached chunk again changes nothing.
+  insert_chunk(&cache, &chunk_list, 3);
+
+  CPPUNIT_ASSERT(cache.frequent_size() == 200);
+  CPPUNIT_ASSERT(cache.recent_size() == 100);
+}
+
+void
+test_chunk_cache::test_evict_frequent() {
+  SETUP_CHUNK_CACHE();
+
+  fill_chunk_cache(&cache, &chunk_list);
+
+  CPPUNIT_ASSERT(cache.find(&chunk_list, 1) == nullptr);
+  insert_chunk(&cache, &chunk_list, 1);
+
+  CPPUNIT_ASSERT(cache.find(&chunk_list, 3) != nullptr);
+  CPPUNIT_ASSERT(cache.recent_size() == 0);
+  CPPUNIT_ASSERT(cache.frequent_size() == 300);
+
+  // With the recent list at its target the least recent frequent
+  // chunk is evicted.
+  insert_chunk(&cache, &chunk_list, 4);
+
+  CPPUNIT_ASSERT(cache.recent_size() == 100);
+  CPPUNIT_ASSERT(cache.frequent_size() == 200);
+  CPPUNIT_ASSERT(cache.frequent_ghost_size() == 100);
+
+  CPPUNIT_ASSERT(cache.is_missing(&chunk_list, 0));
+  CPPUNIT_ASSERT(!cache.is_missing(&chunk_list, 1));
+  CPPUNIT_ASSERT(!cache.is_missing(&chunk_list, 3));
+  CPPUNIT_ASSERT(!cache.is_missing(&chunk_list, 4));
+
+  // Ghost hit on the frequent list lowers the recent target.
+  CPPUNIT_ASSERT(cache.find(&chunk_list, 0) == nullptr);
+  CPPUNIT_ASSERT(cache.target_recent_size() == 0);
+}
+
+void
+test_chunk_cache::test_prefetched() {
+  SETUP_CHUNK_CACHE();
+
+  insert_chunk(&cache, &chunk_list, 0, true);
+
+  // The first use of a chunk read ahead keeps it in the recent list.
+  CPPUNIT_ASSERT(cache.find(&chunk_list, 0) != nullptr);
+  CPPUNIT_ASSERT(cache.recent_size() == 100);
+  CPPUNIT_ASSERT(cache.frequent_size() == 0);
+
+  CPPUNIT_ASSERT(cache.find(&chunk_list, 0) != nullptr);
+  CPPUNIT_ASSERT(cache.recent_size() == 0);
+  CPPUNIT_ASSERT(cache.frequent_size() == 100);
+}
+
+void
+test_chunk_cache::test_erase() {
+  SETUP_CHUNK_CACHE();
+
+  torrent::ChunkList other_list;
+
+  insert_chunk(&cache, &chunk_list, 0);
+  cache.find(&chunk_list, 0);
+
+  insert_chunk(&cache, &chunk_list, 1);
+  insert_chunk(&cache, &other_list, 0);
+  insert_chunk(&cache, &chunk_list, 2);
+
+  CPPUNIT_ASSERT(cache.size() == 300);
+  CPPUNIT_ASSERT(cache.recent_ghost_size() == 100);
+
+  cache.erase(&chunk_list);
+
+  CPPUNIT_ASSERT(cache.size() == 100);
+  CPPUNIT_ASSERT(cache.recent_ghost_size() == 0);
+
+  CPPUNIT_ASSERT(cache.is_missing(&chunk_list, 0));
+  CPPUNIT_ASSERT(!cache.is_missing(&other_list, 0));
+}
+
+void
+test_chunk_cache::test_memory_budget() {
+  torrent::ChunkList chunk_list;
+  torrent::ChunkManager manager;
+
+  manager.set_max_memory_usage(1000);
+  manager.set_upload_cache_max_size(300);
+
+  auto cache = manager.chunk_cache();
+
+  for (uint32_t i = 0; i < 4; i++)
+    insert_chunk(cache, &chunk_list, i);
+
+  // Chunks evicted to the ghost lists are no longer charged.
+  CPPUNIT_ASSERT(cache->size() == 300);
+  CPPUNIT_ASSERT(manager.memory_usage() == 300);
+  CPPUNIT_ASSERT(manager.memory_block_count() == 3);
+
+  // Allocations past the budget evict cached chunks first.
+  CPPUNIT_ASSERT(manager.allocate(800));
+  CPPUNIT_ASSERT(cache->size() == 200);
+  CPPUNIT_ASSERT(manager.memory_usage() == 1000);
+
+  // The cache makes room from its own chunks.
+  insert_chunk(cache, &chunk_list, 4);
+  CPPUNIT_ASSERT(cache->size() == 200);
+  CPPUNIT_ASSERT(!cache->is_missing(&chunk_list, 4));
+  CPPUNIT_ASSERT(manager.memory_usage() == 1000);
+
+  CPPUNIT_ASSERT(manager.allocate(200));
+  CPPUNIT_ASSERT(cache->size() == 0);
+  CPPUNIT_ASSERT(manager.memory_usage() == 1000);
+
+  // With nothing left to evict the chunk is not cached.
+  insert_chunk(cache, &chunk_list, 5);
+  CPPUNIT_ASSERT(cache->is_missing(&chunk_list, 5));
+  CPPUNIT_ASSERT(manager.memory_usage() == 1000);
+
+  manager.deallocate(800);
+  manager.deallocate(200);
+
+  insert_chunk(cache, &chunk_list, 5);
+  CPPUNIT_ASSERT(manager.memory_usage() == 100);
+
+  manager.set_upload_cache_max_size(0);
+  CPPUNIT_ASSERT(manager.memory_usage() == 0);
+  CPPUNIT_ASSERT(manager.memory_block_count() == 0);
+}
@@ -0,0 +1,24 @@
+#include "helpers/test_main_thread.h"
+
+class test_chunk_cache : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(test_chunk_cache);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_evict_recent);
+  CPPUNIT_TEST(test_evict_frequent);
+  CPPUNIT_TEST(test_ghost_promotion);
+  CPPUNIT_TEST(test_prefetched);
+  CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_memory_budget);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_evict_recent();
+  void test_evict_frequent();
+  void test_ghost_promotion();
+  void test_prefetched();
+  void test_erase();
+  void test_memory_budget();
+};
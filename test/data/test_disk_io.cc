@@ -0,0 +1,281 @@
+#include "config.h"
+
+#include "test/data/test_disk_io.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "data/disk_io.h"
+#include "data/memory_chunk.h"
+#include "data/socket_file.h"
+#include "data/thread_disk.h"
+#include "test/helpers/test_utils.h"
+#include "torrent/exceptions.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_disk_io, "data");
+
+using torrent::DiskIo;
+
+namespace {
+
+// An unlinked temporary file of 'size' bytes, all 'a'.
+int
+create_file(uint32_t size, int flags = O_RDWR) {
+  char path[] = "/tmp/libtorrent_test_disk_io.XXXXXX";
+  int fd = ::mkstemp(path);
+
+  if (fd == -1)
+    throw torrent::internal_error("create_file: mkstemp failed");
+
+  std::string data(size, 'a');
+
+  if (::pwrite(fd, data.data(), data.size(), 0) != static_cast<ssize_t>(data.size()))
+    throw torrent::internal_error("create_file: pwrite failed");
+
+  if (flags != O_RDWR) {
+    int other_fd = ::open(path, flags);
+    ::close(fd);
+    fd = other_fd;
+  }
+
+  ::unlink(path);
+  return fd;
+}
+
+bool
+is_open_fd(int fd) {
+  return ::fcntl(fd, F_GETFD) != -1;
+}
+
+DiskIo::buffer_type
+create_buffer(uint32_t size, char value) {
+  DiskIo::buffer_type buffer(new char[size]);
+  std::memset(buffer.get(), value, size);
+
+  return buffer;
+}
+
+struct test_result {
+  DiskIo::slot_done slot() {
+    return [this](int r, DiskIo::buffer_type b) { buffer = b; result = r; done = true; };
+  }
+
+  bool wait() { return wait_for_true([this]() { return done.load(); }); }
+
+  std::atomic<bool>   done{false};
+  std::atomic<int>    result{0};
+  DiskIo::buffer_type buffer;
+};
+
+DiskIo* disk_io() { return torrent::thread_disk()->disk_io(); }
+
+} // namespace
+
+void
+test_disk_io::test_write_read() {
+  int fd = create_file(8192);
+
+  test_result write_result;
+  disk_io()->write(fd, 1000, create_buffer(4096, 'b'), 4096, nullptr, nullptr, write_result.slot());
+
+  CPPUNIT_ASSERT(write_result.wait());
+  CPPUNIT_ASSERT(write_result.result == 4096);
+
+  test_result read_result;
+  disk_io()->read(fd, 0, create_buffer(8192, 0), 8192, nullptr, nullptr, read_result.slot());
+
+  CPPUNIT_ASSERT(read_result.wait());
+  CPPUNIT_ASSERT(read_result.result == 8192);
+  CPPUNIT_ASSERT(std::string(read_result.buffer.get(), 1000) == std::string(1000, 'a'));
+  CPPUNIT_ASSERT(std::string(read_result.buffer.get() + 1000, 4096) == std::string(4096, 'b'));
+  CPPUNIT_ASSERT(std::string(read_result.buffer.get() + 5096, 3096) == std::string(3096, 'a'));
+
+  disk_io()->close_file(fd);
+}
+
+void
+test_disk_io::test_read_end_of_file() {
+  int fd = create_file(100);
+
+  test_result result;
+  disk_io()->read(fd, 0, create_buffer(4096, 0), 4096, nullptr, nullptr, result.slot());
+
+  CPPUNIT_ASSERT(result.wait());
+  CPPUNIT_ASSERT(result.result == 100);
+
+  test_result past_end;
+  disk_io()->read(fd, 200, create_buffer(4096, 0), 4096, nullptr, nullptr, past_end.slot());
+
+  CPPUNIT_ASSERT(past_end.wait());
+  CPPUNIT_ASSERT(past_end.result == 0);
+
+  disk_io()->close_file(fd);
+}
+
+void
+test_disk_io::test_read_uncached() {
+  const uint32_t page_size = torrent::MemoryChunk::page_size();
+  const uint32_t size = 16 * page_size;
+
+  int fd = create_file(size);
+  torrent::SocketFile file(fd);
+
+  // Start with only the first page cached.
+  CPPUNIT_ASSERT(file.sync_data());
+  ::posix_fadvise(fd, 0, size, POSIX_FADV_DONTNEED);
+
+  char page[1];
+  CPPUNIT_ASSERT(::pread(fd, page, 1, 0) == 1);
+
+  auto before = file.resident_pages(0, size);
+
+  test_result result;
+  disk_io()->read_uncached(fd, 0, create_buffer(size, 0), size, nullptr, nullptr, result.slot());
+
+  CPPUNIT_ASSERT(result.wait());
+  CPPUNIT_ASSERT(result.result == static_cast<int>(size));
+  CPPUNIT_ASSERT(std::string(result.buffer.get(), size) == std::string(size, 'a'));
+
+  // The first page, and any read ahead with it, stays cached. This
+  // can't be checked where the pages could not be dropped.
+  if (before.size() == 16 && (before[0] & 0x1) && !(before[15] & 0x1)) {
+    auto after = file.resident_pages(0, size);
+
+    CPPUNIT_ASSERT(after.size() == 16);
+
+    for (uint32_t i = 0; i != 16; i++)
+      CPPUNIT_ASSERT((after[i] & 0x1) == (before[i] & 0x1));
+  }
+
+  disk_io()->close_file(fd);
+}
+
+void
+test_disk_io::test_read_uncached_end_of_file() {
+  int fd = create_file(100);
+
+  test_result result;
+  disk_io()->read_uncached(fd, 0, create_buffer(4096, 0), 4096, nullptr, nullptr, result.slot());
+
+  CPPUNIT_ASSERT(result.wait());
+  CPPUNIT_ASSERT(result.result == 100);
+  CPPUNIT_ASSERT(std::string(result.buffer.get(), 100) == std::string(100, 'a'));
+
+  disk_io()->close_file(fd);
+}
+
+void
+test_disk_io::test_error() {
+  test_result bad_fd;
+  disk_io()->read(-1, 0, create_buffer(4096, 0), 4096, nullptr, nullptr, bad_fd.slot());
+
+  CPPUNIT_ASSERT(bad_fd.wait());
+  CPPUNIT_ASSERT(bad_fd.result == -EBADF);
+
+  int fd = create_file(4096, O_RDONLY);
+
+  test_result read_only;
+  disk_io()->write(fd, 0, create_buffer(4096, 'b'), 4096, nullptr, nullptr, read_only.slot());
+
+  CPPUNIT_ASSERT(read_only.wait());
+  CPPUNIT_ASSERT(read_only.result == -EBADF);
+
+  disk_io()->close_file(fd);
+
+  CPPUNIT_ASSERT_THROW(disk_io()->read(0, 0, DiskIo::buffer_type(), 4096, nullptr, nullptr, DiskIo::slot_done()), torrent::internal_error);
+}
+
+void
+test_disk_io::test_fsync() {
+  int fd = create_file(4096);
+
+  test_result write_result;
+  disk_io()->write_sync(fd, 0, create_buffer(4096, 'b'), 4096, nullptr, nullptr, write_result.slot());
+
+  CPPUNIT_ASSERT(write_result.wait());
+  CPPUNIT_ASSERT(write_result.result == 4096);
+
+  test_result fsync_result;
+  disk_io()->fsync(fd, nullptr, nullptr, fsync_result.slot());
+
+  CPPUNIT_ASSERT(fsync_result.wait());
+  CPPUNIT_ASSERT(fsync_result.result == 0);
+
+  disk_io()->close_file(fd);
+}
+
+void
+test_disk_io::test_callback() {
+  int fd = create_file(4096);
+
+  test_result result;
+
+  {
+    TestBlockDiskThread block;
+
+    disk_io()->read(fd, 0, create_buffer(4096, 0), 4096, m_main_thread.get(), this, result.slot());
+    CPPUNIT_ASSERT(disk_io()->pending_size() == 1);
+  }
+
+  // Completions are only called once the target thread processes its
+  // callbacks.
+  CPPUNIT_ASSERT(wait_for_true([]() { return disk_io()->pending_size() == 0; }));
+  usleep(20 * 1000);
+  CPPUNIT_ASSERT(!result.done);
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return result.done.load();
+      }));
+
+  CPPUNIT_ASSERT(result.result == 4096);
+
+  disk_io()->close_file(fd);
+}
+
+void
+test_disk_io::test_close_file() {
+  int fd = create_file(4096);
+
+  test_result result;
+  disk_io()->read(fd, 0, create_buffer(4096, 0), 4096, nullptr, nullptr, result.slot());
+
+  CPPUNIT_ASSERT(result.wait());
+  CPPUNIT_ASSERT(is_open_fd(fd));
+
+  disk_io()->close_file(fd);
+  CPPUNIT_ASSERT(!is_open_fd(fd));
+
+  // Files without requests are closed directly.
+  fd = create_file(4096);
+
+  disk_io()->close_file(fd);
+  CPPUNIT_ASSERT(!is_open_fd(fd));
+}
+
+void
+test_disk_io::test_close_file_pending() {
+  int fd = create_file(4096);
+
+  test_result result;
+
+  {
+    TestBlockDiskThread block;
+
+    disk_io()->read(fd, 0, create_buffer(4096, 0), 4096, nullptr, nullptr, result.slot());
+    disk_io()->close_file(fd);
+
+    // The descriptor is kept open, so the number can't be reused,
+    // until the pending request is done.
+    CPPUNIT_ASSERT(is_open_fd(fd));
+  }
+
+  CPPUNIT_ASSERT(result.wait());
+  CPPUNIT_ASSERT(result.result == 4096);
+
+  CPPUNIT_ASSERT(wait_for_true([fd]() { return !is_open_fd(fd); }));
+}
@@ -0,0 +1,33 @@
+#ifndef TEST_DATA_DISK_IO_H
+#define TEST_DATA_DISK_IO_H
+
+#include "helpers/test_main_thread.h"
+
+class test_disk_io : public TestFixtureWithMainAndDiskThread {
+  CPPUNIT_TEST_SUITE(test_disk_io);
+
+  CPPUNIT_TEST(test_write_read);
+  CPPUNIT_TEST(test_read_end_of_file);
+  CPPUNIT_TEST(test_read_uncached);
+  CPPUNIT_TEST(test_read_uncached_end_of_file);
+  CPPUNIT_TEST(test_error);
+  CPPUNIT_TEST(test_fsync);
+  CPPUNIT_TEST(test_callback);
+  CPPUNIT_TEST(test_close_file);
+  CPPUNIT_TEST(test_close_file_pending);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_write_read();
+  void test_read_end_of_file();
+  void test_read_uncached();
+  void test_read_uncached_end_of_file();
+  void test_error();
+  void test_fsync();
+  void test_callback();
+  void test_close_file();
+  void test_close_file_pending();
+};
+
+#endif // TEST_DATA_DISK_IO_H
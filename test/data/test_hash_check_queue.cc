@@ -7,8 +7,10 @@
 
 #include <functional>
 #include <csignal>
+#include <mutex>
 
 #include "data/chunk_handle.h"
+#include "data/hash_torrent.h"
 #include "data/thread_disk.h"
 #include "utils/sha1.h"
 #include "torrent/chunk_manager.h"
@@ -27,6 +29,15 @@ chunk_done(done_chunks_type* done_chunks, torrent::HashChunk* hash_chunk, const
   (*done_chunks)[hash_chunk->handle().index()] = hash_value;
   pthread_mutex_unlock(&done_chunks_lock);
 }
+
+size_t
+done_chunks_size(const done_chunks_type* done_chunks) {
+  pthread_mutex_lock(&done_chunks_lock);
+  size_t result = done_chunks->size();
+  pthread_mutex_unlock(&done_chunks_lock);
+
+  return result;
+}
 } // namespace
 
 torrent::HashString
@@ -185,3 +196,238 @@ test_hash_check_queue::test_thread_interrupt() {
 
   CLEANUP_CHUNK_LIST();
 }
+
+// Chunks queued before a single worker starts are hashed in the order
+// they were added.
+void
+test_hash_check_queue::test_worker_order() {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+
+  std::mutex order_lock;
+  std::vector<uint32_t> order;
+
+  hash_queue.slot_chunk_done() = [&](torrent::HashChunk* hash_chunk, const torrent::HashString& hash) {
+      CPPUNIT_ASSERT(hash == hash_for_index(hash_chunk->handle().index()));
+
+      auto lock = std::scoped_lock(order_lock);
+      order.push_back(hash_chunk->handle().index());
+    };
+
+  handle_list handles;
+
+  for (unsigned int i = 0; i < 20; i++) {
+    handles.push_back(chunk_list->get(19 - i, torrent::ChunkList::get_not_hashing | torrent::ChunkList::get_blocking));
+    hash_queue.push_back(new torrent::HashChunk(handles.back()));
+  }
+
+  hash_queue.set_worker_count(1);
+  CPPUNIT_ASSERT(hash_queue.worker_count() == 1);
+
+  CPPUNIT_ASSERT(wait_for_true([&]() { auto lock = std::scoped_lock(order_lock); return order.size() == 20; }));
+
+  hash_queue.stop_workers();
+  CPPUNIT_ASSERT(hash_queue.worker_count() == 0);
+  CPPUNIT_ASSERT(hash_queue.empty());
+
+  for (unsigned int i = 0; i < 20; i++)
+    CPPUNIT_ASSERT(order[i] == 19 - i);
+
+  for (auto& handle : handles)
+    chunk_list->release(&handle, torrent::ChunkList::release_default);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+// Several workers and perform() on the calling thread pull from the
+// same queue, each chunk being hashed exactly once.
+void
+test_hash_check_queue::test_workers() {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+
+  std::mutex count_lock;
+  std::map<uint32_t, int> counts;
+
+  hash_queue.slot_chunk_done() = [&](torrent::HashChunk* hash_chunk, const torrent::HashString& hash) {
+      CPPUNIT_ASSERT(hash == hash_for_index(hash_chunk->handle().index()));
+
+      auto lock = std::scoped_lock(count_lock);
+      counts[hash_chunk->handle().index()]++;
+    };
+
+  hash_queue.set_worker_count(4);
+  CPPUNIT_ASSERT(hash_queue.worker_count() == 4);
+
+  handle_list handles;
+
+  for (unsigned int i = 0; i < 32; i++) {
+    handles.push_back(chunk_list->get(i, torrent::ChunkList::get_not_hashing | torrent::ChunkList::get_blocking));
+    hash_queue.push_back(new torrent::HashChunk(handles.back()));
+
+    if (i % 8 == 0)
+      hash_queue.perform();
+  }
+
+  hash_queue.perform();
+
+  auto all_done = [&]() {
+      auto lock = std::scoped_lock(count_lock);
+      return counts.size() == 32;
+    };
+
+  CPPUNIT_ASSERT(wait_for_true(all_done));
+
+  // Changing the count restarts the workers without losing queued
+  // chunks.
+  hash_queue.set_worker_count(2);
+  CPPUNIT_ASSERT(hash_queue.worker_count() == 2);
+
+  hash_queue.stop_workers();
+
+  for (auto& count : counts)
+    CPPUNIT_ASSERT(count.second == 1);
+
+  for (auto& handle : handles)
+    chunk_list->release(&handle, torrent::ChunkList::release_default);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+// An exception on a worker is passed to slot_worker_error, and the
+// worker keeps hashing the remaining chunks. A single worker makes sure
+// the pool doesn't rely on others to finish the queue.
+void
+test_hash_check_queue::test_worker_error() {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+
+  done_chunks_type done_chunks;
+  std::mutex error_lock;
+  std::vector<std::exception_ptr> errors;
+
+  hash_queue.slot_chunk_done() = [&done_chunks](torrent::HashChunk* hash_chunk, const torrent::HashString& hash) {
+      if (hash_chunk->handle().index() == 3 || hash_chunk->handle().index() == 6)
+        throw torrent::internal_error("test_worker_error");
+
+      chunk_done(&done_chunks, hash_chunk, hash);
+    };
+
+  hash_queue.slot_worker_error() = [&](std::exception_ptr e) {
+      auto lock = std::scoped_lock(error_lock);
+      errors.push_back(e);
+    };
+
+  handle_list handles;
+
+  for (unsigned int i = 0; i < 10; i++) {
+    handles.push_back(chunk_list->get(i, torrent::ChunkList::get_not_hashing | torrent::ChunkList::get_blocking));
+    hash_queue.push_back(new torrent::HashChunk(handles.back()));
+  }
+
+  hash_queue.set_worker_count(1);
+
+  CPPUNIT_ASSERT(wait_for_true([&]() { return done_chunks_size(&done_chunks) == 8; }));
+  CPPUNIT_ASSERT(wait_for_true([&]() { auto lock = std::scoped_lock(error_lock); return errors.size() == 2; }));
+  CPPUNIT_ASSERT(hash_queue.worker_count() == 1);
+
+  hash_queue.stop_workers();
+
+  CPPUNIT_ASSERT(hash_queue.empty());
+  CPPUNIT_ASSERT(done_chunks.find(3) == done_chunks.end());
+  CPPUNIT_ASSERT(done_chunks.find(6) == done_chunks.end());
+
+  bool rethrown = false;
+
+  try {
+    std::rethrow_exception(errors.front());
+  } catch (const torrent::internal_error& e) {
+    rethrown = std::string(e.what()) == "test_worker_error";
+  }
+
+  CPPUNIT_ASSERT(rethrown);
+
+  for (auto& handle : handles)
+    chunk_list->release(&handle, torrent::ChunkList::release_default);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_hash_check_queue::test_max_memory() {
+  torrent::ChunkManager chunk_manager;
+
+  chunk_manager.set_max_memory_usage(uint64_t{1} << 20);
+  CPPUNIT_ASSERT(chunk_manager.hash_check_max_memory() == uint64_t{256} << 10);
+
+  chunk_manager.set_max_memory_usage(uint64_t{16} << 30);
+  CPPUNIT_ASSERT(chunk_manager.hash_check_max_memory() == uint64_t{128} << 20);
+
+  chunk_manager.set_hash_check_workers(3);
+  CPPUNIT_ASSERT(chunk_manager.hash_check_max_memory() == uint64_t{512} << 20);
+  CPPUNIT_ASSERT(torrent::thread_disk()->hash_check_queue()->worker_count() == 3);
+
+  // The memory budget caps the per-thread allowance.
+  chunk_manager.set_max_memory_usage(uint64_t{1} << 30);
+  CPPUNIT_ASSERT(chunk_manager.hash_check_max_memory() == uint64_t{256} << 20);
+
+  chunk_manager.set_hash_check_workers(0);
+  CPPUNIT_ASSERT(torrent::thread_disk()->hash_check_queue()->worker_count() == 0);
+}
+
+// HashTorrent keeps no more chunks outstanding than the hash check
+// memory allows, but always at least one.
+void
+test_hash_check_queue::test_hash_torrent_max_memory() {
+  SETUP_CHUNK_LIST();
+  chunk_list->slot_create_hashing_chunk() = std::bind(&func_create_chunk, std::placeholders::_1, std::placeholders::_2);
+
+  handle_list handles;
+
+  // Chunks larger than the limit are still checked one at a time.
+  chunk_manager->set_max_memory_usage(uint64_t{128} << 10);
+
+  {
+    torrent::HashTorrent hash_torrent(chunk_list);
+    hash_torrent.slot_check_chunk() = [&handles](torrent::ChunkHandle handle) { handles.push_back(handle); };
+    hash_torrent.hashing_ranges().insert(0, chunk_list->size());
+
+    CPPUNIT_ASSERT(!hash_torrent.start(false));
+    CPPUNIT_ASSERT(hash_torrent.outstanding() == 1);
+    CPPUNIT_ASSERT(handles.size() == 1);
+
+    hash_torrent.clear();
+  }
+
+  for (auto& handle : handles)
+    chunk_list->release(&handle, torrent::ChunkList::release_default);
+
+  handles.clear();
+
+  // A quarter of 1 MiB fits four 64 KiB chunks.
+  chunk_manager->set_max_memory_usage(uint64_t{1} << 20);
+
+  {
+    torrent::HashTorrent hash_torrent(chunk_list);
+    hash_torrent.slot_check_chunk() = [&handles](torrent::ChunkHandle handle) { handles.push_back(handle); };
+    hash_torrent.hashing_ranges().insert(0, chunk_list->size());
+
+    CPPUNIT_ASSERT(!hash_torrent.start(false));
+    CPPUNIT_ASSERT(hash_torrent.outstanding() == 4);
+    CPPUNIT_ASSERT(handles.size() == 4);
+
+    chunk_list->release(&handles.front(), torrent::ChunkList::release_default);
+    hash_torrent.receive_chunkdone(0);
+
+    CPPUNIT_ASSERT(hash_torrent.outstanding() == 4);
+    CPPUNIT_ASSERT(handles.size() == 5);
+    CPPUNIT_ASSERT(handles.back().index() == 4);
+
+    hash_torrent.clear();
+  }
+
+  for (auto itr = handles.begin() + 1; itr != handles.end(); ++itr)
+    chunk_list->release(&*itr, torrent::ChunkList::release_default);
+
+  CLEANUP_CHUNK_LIST();
+}
@@ -18,6 +18,12 @@ class test_hash_check_queue : public TestFixtureWithMainAndDiskThread {
 
   CPPUNIT_TEST(test_thread_interrupt);
 
+  CPPUNIT_TEST(test_worker_order);
+  CPPUNIT_TEST(test_workers);
+  CPPUNIT_TEST(test_worker_error);
+  CPPUNIT_TEST(test_max_memory);
+  CPPUNIT_TEST(test_hash_torrent_max_memory);
+
   CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -26,6 +32,12 @@ public:
   void test_erase();
 
   void test_thread_interrupt();
+
+  void test_worker_order();
+  void test_workers();
+  void test_worker_error();
+  void test_max_memory();
+  void test_hash_torrent_max_memory();
 };
 
 typedef std::map<int, torrent::HashString> done_chunks_type;
@@ -143,6 +143,64 @@ test_hash_queue::test_erase_stress() {
   CLEANUP_CHUNK_LIST();
 }
 
+// Chunks hashed as their data was received are passed on with the
+// given hash, without being read back by the disk thread.
+void
+test_hash_queue::test_hashed() {
+  SETUP_CHUNK_LIST();
+  SETUP_HASH_QUEUE();
+
+  torrent::HashString wrong_hash = hash_for_index(3);
+
+  hash_queue->push_back(chunk_list->get(0, torrent::ChunkList::get_not_hashing | torrent::ChunkList::get_blocking),
+                        NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2));
+  hash_queue->push_back_hashed(chunk_list->get(1, torrent::ChunkList::get_not_hashing | torrent::ChunkList::get_blocking),
+                               NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2),
+                               hash_for_index(1));
+  hash_queue->push_back_hashed(chunk_list->get(2, torrent::ChunkList::get_not_hashing | torrent::ChunkList::get_blocking),
+                               NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2),
+                               wrong_hash);
+
+  CPPUNIT_ASSERT(hash_queue->size() == 3);
+  CPPUNIT_ASSERT(hash_queue->has(NULL, 1) && hash_queue->has(NULL, 2));
+
+  for (unsigned int i = 0; i < 3; i++)
+    CPPUNIT_ASSERT(wait_for_true(std::bind(&check_for_chunk_done, hash_queue, &done_chunks, i)));
+
+  CPPUNIT_ASSERT(done_chunks[0] == hash_for_index(0));
+  CPPUNIT_ASSERT(done_chunks[1] == hash_for_index(1));
+  CPPUNIT_ASSERT(done_chunks[2] == wrong_hash);
+
+  CPPUNIT_ASSERT(hash_queue->empty());
+  CPPUNIT_ASSERT(torrent::thread_disk()->hash_check_queue()->empty());
+  delete hash_queue;
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_hash_queue::test_hashed_erase() {
+  SETUP_CHUNK_LIST();
+  SETUP_HASH_QUEUE();
+
+  for (unsigned int i = 0; i < 20; i++)
+    hash_queue->push_back_hashed(chunk_list->get(i, torrent::ChunkList::get_not_hashing | torrent::ChunkList::get_blocking),
+                                 NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2),
+                                 hash_for_index(i));
+
+  hash_queue->remove(NULL);
+  CPPUNIT_ASSERT(hash_queue->empty());
+  CPPUNIT_ASSERT(done_chunks.empty());
+
+  // The done chunks were dropped with their nodes.
+  hash_queue->work();
+  CPPUNIT_ASSERT(done_chunks.empty());
+
+  delete hash_queue;
+
+  CLEANUP_CHUNK_LIST();
+}
+
 // Test erase of different id's.
 
 // Current code doesn't work well if we remove a hash...
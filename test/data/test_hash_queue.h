@@ -7,6 +7,8 @@ class test_hash_queue : public TestFixtureWithMainAndDiskThread {
   CPPUNIT_TEST(test_multiple);
   CPPUNIT_TEST(test_erase);
   CPPUNIT_TEST(test_erase_stress);
+  CPPUNIT_TEST(test_hashed);
+  CPPUNIT_TEST(test_hashed_erase);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -15,5 +17,7 @@ public:
   void test_multiple();
   void test_erase();
   void test_erase_stress();
+  void test_hashed();
+  void test_hashed_erase();
 };
 
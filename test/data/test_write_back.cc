@@ -0,0 +1,368 @@
+#include "config.h"
+
+#include "test/data/test_write_back.h"
+
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+#include "data/chunk.h"
+#include "data/chunk_list.h"
+#include "data/socket_file.h"
+#include "data/thread_disk.h"
+#include "data/write_back.h"
+#include "test/helpers/test_utils.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/file.h"
+#include "torrent/exceptions.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_write_back, "data");
+
+namespace {
+
+constexpr uint32_t chunk_size  = 1 << 16;
+constexpr uint32_t chunk_count = 4;
+
+// An unlinked temporary file with a shared mapping per chunk.
+struct test_file {
+  test_file();
+  ~test_file();
+
+  bool                has_content(uint32_t index, char value);
+
+  int                 fd{-1};
+  torrent::File       file;
+};
+
+test_file::test_file() {
+  char path[] = "/tmp/libtorrent_test_write_back.XXXXXX";
+
+  if ((fd = ::mkstemp(path)) == -1)
+    throw torrent::internal_error("test_file: mkstemp failed");
+
+  ::unlink(path);
+
+  if (::ftruncate(fd, chunk_size * chunk_count) == -1)
+    throw torrent::internal_error("test_file: ftruncate failed");
+
+  file.set_file_descriptor(fd);
+  file.set_protection(torrent::MemoryChunk::prot_read | torrent::MemoryChunk::prot_write);
+}
+
+test_file::~test_file() {
+  torrent::thread_disk()->disk_io()->close_file(fd);
+
+  file.set_file_descriptor(-1);
+}
+
+bool
+test_file::has_content(uint32_t index, char value) {
+  std::string data(chunk_size, '\0');
+
+  if (::pread(fd, data.data(), data.size(), uint64_t{index} * chunk_size) != static_cast<ssize_t>(data.size()))
+    return false;
+
+  return data == std::string(chunk_size, value);
+}
+
+struct test_chunk_list {
+  test_chunk_list(test_file* f);
+
+  torrent::ChunkListNode* node(uint32_t index) { return &list[index]; }
+
+  torrent::ChunkManager    manager;
+  torrent::ChunkList       list;
+  std::vector<std::string> errors;
+};
+
+test_chunk_list::test_chunk_list(test_file* f) {
+  list.set_manager(&manager);
+  list.set_chunk_size(chunk_size);
+  list.resize(chunk_count);
+
+  list.slot_create_chunk() = [f](uint32_t index, int prot) {
+      auto chunk = new torrent::Chunk;
+
+      chunk->push_back(torrent::ChunkPart::MAPPED_MMAP,
+                       torrent::SocketFile(f->fd).create_chunk(uint64_t{index} * chunk_size, chunk_size, prot, torrent::MemoryChunk::map_shared));
+      chunk->back().set_file(&f->file, uint64_t{index} * chunk_size);
+
+      return chunk;
+    };
+
+  list.slot_free_diskspace() = []() { return uint64_t{0}; };
+  list.slot_storage_error() = [this](const std::string& message) { errors.push_back(message); };
+}
+
+void
+write_chunk(torrent::ChunkList* list, uint32_t index, char value) {
+  auto handle = list->get(index, torrent::ChunkList::get_not_hashing | torrent::ChunkList::get_writable);
+
+  if (!handle.is_valid())
+    throw torrent::internal_error("write_chunk: could not get chunk");
+
+  std::fill(handle.chunk()->front().chunk().begin(), handle.chunk()->front().chunk().end(), value);
+  list->release(&handle, torrent::ChunkList::release_default);
+}
+
+const auto sync_flags      = torrent::ChunkList::sync_all | torrent::ChunkList::sync_force | torrent::ChunkList::sync_sloppy;
+// Without sync_all, which waits for the disk thread.
+const auto sync_safe_flags = torrent::ChunkList::sync_force | torrent::ChunkList::sync_safe;
+
+} // namespace
+
+void
+test_write_back::test_budget() {
+  torrent::ChunkManager manager;
+
+  CPPUNIT_ASSERT(manager.write_back_rate() == 0);
+  CPPUNIT_ASSERT(manager.write_back_budget() == 16 << 20);
+
+  manager.receive_write_back(64 << 20, 4, std::chrono::milliseconds(500));
+
+  CPPUNIT_ASSERT(manager.write_back_rate() == 128 << 20);
+  CPPUNIT_ASSERT(manager.write_back_budget() == 256 << 20);
+
+  CPPUNIT_ASSERT(manager.stats_write_back_bytes() == 64 << 20);
+  CPPUNIT_ASSERT(manager.stats_write_back_flushes() == 1);
+  CPPUNIT_ASSERT(manager.stats_write_back_queue_depth() == 4);
+  CPPUNIT_ASSERT(manager.stats_write_back_latency() == 500000);
+
+  // Moving average with a 1/8 weight for new samples.
+  manager.receive_write_back(8 << 20, 2, std::chrono::milliseconds(1000));
+
+  CPPUNIT_ASSERT(manager.write_back_rate() == ((128 << 20) * 7 + (8 << 20)) / 8);
+  CPPUNIT_ASSERT(manager.write_back_budget() == manager.write_back_rate() * 2);
+  CPPUNIT_ASSERT(manager.stats_write_back_latency() == (500000 * 7 + 1000000) / 8);
+
+  // The budget never drops below the minimum.
+  for (int i = 0; i < 100; i++)
+    manager.receive_write_back(1 << 10, 1, std::chrono::milliseconds(1000));
+
+  CPPUNIT_ASSERT(manager.write_back_budget() == 16 << 20);
+}
+
+// Flushes shorter than a millisecond are counted, but don't show the
+// device throughput.
+void
+test_write_back::test_budget_short_flush() {
+  torrent::ChunkManager manager;
+
+  manager.receive_write_back(64 << 20, 1, std::chrono::microseconds(500));
+
+  CPPUNIT_ASSERT(manager.write_back_rate() == 0);
+  CPPUNIT_ASSERT(manager.write_back_budget() == 16 << 20);
+  CPPUNIT_ASSERT(manager.stats_write_back_bytes() == 64 << 20);
+  CPPUNIT_ASSERT(manager.stats_write_back_flushes() == 1);
+}
+
+void
+test_write_back::test_flush_merge() {
+  if (!torrent::WriteBack::is_supported())
+    return;
+
+  test_file f;
+  test_file g;
+  torrent::WriteBack write_back;
+
+  CPPUNIT_ASSERT(write_back.flush());
+  CPPUNIT_ASSERT(write_back.ranges() == 0);
+
+  // Overlapping and adjacent ranges of a file are merged, in any
+  // order.
+  write_back.insert(f.fd, 2 * chunk_size, chunk_size);
+  write_back.insert(f.fd, 0, chunk_size);
+  write_back.insert(f.fd, chunk_size / 2, chunk_size);
+  write_back.insert(f.fd, 3 * chunk_size, 100);
+  write_back.insert(g.fd, 0, chunk_size);
+  write_back.insert(g.fd, chunk_size, 0);
+
+  CPPUNIT_ASSERT_THROW(write_back.insert(-1, 0, chunk_size), torrent::internal_error);
+
+  CPPUNIT_ASSERT(write_back.flush());
+  CPPUNIT_ASSERT(write_back.empty());
+
+  CPPUNIT_ASSERT(write_back.ranges() == 3);
+  CPPUNIT_ASSERT(write_back.bytes() == chunk_size * 3 / 2 + chunk_size + 100 + chunk_size);
+  CPPUNIT_ASSERT(!write_back.is_failed(f.fd) && !write_back.is_failed(g.fd));
+}
+
+void
+test_write_back::test_flush_failed() {
+  if (!torrent::WriteBack::is_supported())
+    return;
+
+  test_file f;
+  int pipe_fds[2];
+  torrent::WriteBack write_back;
+
+  CPPUNIT_ASSERT(::pipe(pipe_fds) == 0);
+
+  write_back.insert(f.fd, 0, chunk_size);
+  write_back.insert(pipe_fds[1], 0, chunk_size);
+
+  CPPUNIT_ASSERT(!write_back.flush());
+  CPPUNIT_ASSERT(write_back.is_failed(pipe_fds[1]));
+  CPPUNIT_ASSERT(!write_back.is_failed(f.fd));
+
+  ::close(pipe_fds[0]);
+  ::close(pipe_fds[1]);
+}
+
+// The slot is called on the given thread once the disk thread has
+// waited for the flushed ranges, failed files are left out.
+void
+test_write_back::test_wait_async() {
+  if (!torrent::WriteBack::is_supported())
+    return;
+
+  test_file f;
+  int pipe_fds[2];
+  torrent::WriteBack write_back;
+
+  CPPUNIT_ASSERT(::pipe(pipe_fds) == 0);
+
+  write_back.insert(f.fd, 0, chunk_size);
+  write_back.insert(f.fd, 2 * chunk_size, chunk_size);
+  write_back.insert(pipe_fds[1], 0, chunk_size);
+  write_back.flush();
+
+  uint64_t bytes = 0;
+  uint32_t ranges = 0;
+  bool called = false;
+
+  write_back.wait_async(m_main_thread.get(), this, [&](uint64_t b, uint32_t r, std::chrono::microseconds) {
+      bytes = b;
+      ranges = r;
+      called = true;
+    });
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return called;
+      }));
+
+  CPPUNIT_ASSERT(bytes == 2 * chunk_size);
+  CPPUNIT_ASSERT(ranges == 2);
+
+  ::close(pipe_fds[0]);
+  ::close(pipe_fds[1]);
+}
+
+// Chunks that don't need to be durable are done once the writeback
+// is queued, and the flush is measured once it completes.
+void
+test_write_back::test_sync_async() {
+  test_file f;
+  test_chunk_list cl(&f);
+
+  write_chunk(&cl.list, 0, 'a');
+  write_chunk(&cl.list, 1, 'b');
+
+  CPPUNIT_ASSERT(cl.list.sync_chunks(sync_flags) == 0);
+  CPPUNIT_ASSERT(cl.list.queue_size() == 0);
+  CPPUNIT_ASSERT(!cl.node(0)->is_valid() && !cl.node(1)->is_valid());
+
+  if (torrent::WriteBack::is_supported()) {
+    CPPUNIT_ASSERT(wait_for_true([&]() {
+          m_main_thread->test_process_events_without_cached_time();
+          return cl.manager.stats_write_back_flushes() == 1;
+        }));
+
+    CPPUNIT_ASSERT(cl.manager.stats_write_back_bytes() == 2 * chunk_size);
+    CPPUNIT_ASSERT(cl.manager.stats_write_back_queue_depth() == 1);
+  }
+
+  CPPUNIT_ASSERT(f.has_content(0, 'a'));
+  CPPUNIT_ASSERT(f.has_content(1, 'b'));
+  CPPUNIT_ASSERT(cl.errors.empty());
+}
+
+// Chunks that must be durable stay queued while the disk thread syncs
+// their files, so the main thread doesn't wait on fdatasync.
+void
+test_write_back::test_sync_durable() {
+  if (!torrent::WriteBack::is_supported())
+    return;
+
+  test_file f;
+  test_chunk_list cl(&f);
+
+  write_chunk(&cl.list, 0, 'a');
+  write_chunk(&cl.list, 2, 'b');
+
+  {
+    TestBlockDiskThread block;
+
+    CPPUNIT_ASSERT(cl.list.sync_chunks(sync_safe_flags) == 0);
+
+    CPPUNIT_ASSERT(cl.list.queue_size() == 2);
+    CPPUNIT_ASSERT(cl.node(0)->is_valid() && cl.node(0)->is_write_pending());
+    CPPUNIT_ASSERT(cl.node(2)->is_valid() && cl.node(2)->is_write_pending());
+
+    // Pending chunks are skipped by later syncs.
+    CPPUNIT_ASSERT(cl.list.sync_chunks(sync_safe_flags) == 0);
+    CPPUNIT_ASSERT(cl.list.queue_size() == 2);
+  }
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        m_main_thread->test_process_events_without_cached_time();
+        return cl.list.queue_size() == 0;
+      }));
+
+  CPPUNIT_ASSERT(!cl.node(0)->is_valid() && !cl.node(0)->is_write_pending());
+  CPPUNIT_ASSERT(!cl.node(2)->is_valid() && !cl.node(2)->is_write_pending());
+  CPPUNIT_ASSERT(cl.manager.memory_usage() == 0);
+  CPPUNIT_ASSERT(cl.errors.empty());
+
+  CPPUNIT_ASSERT(f.has_content(0, 'a'));
+  CPPUNIT_ASSERT(f.has_content(2, 'b'));
+}
+
+// Syncing everything returns once the files are synced.
+void
+test_write_back::test_sync_durable_all() {
+  if (!torrent::WriteBack::is_supported())
+    return;
+
+  test_file f;
+  test_chunk_list cl(&f);
+
+  write_chunk(&cl.list, 0, 'a');
+  write_chunk(&cl.list, 2, 'b');
+
+  CPPUNIT_ASSERT(cl.list.sync_chunks(sync_safe_flags | torrent::ChunkList::sync_all) == 0);
+
+  CPPUNIT_ASSERT(cl.list.queue_size() == 0);
+  CPPUNIT_ASSERT(!cl.node(0)->is_valid() && !cl.node(2)->is_valid());
+  CPPUNIT_ASSERT(cl.manager.memory_usage() == 0);
+  CPPUNIT_ASSERT(cl.errors.empty());
+}
+
+void
+test_write_back::test_sync_durable_clear() {
+  if (!torrent::WriteBack::is_supported())
+    return;
+
+  test_file f;
+  auto cl = std::make_unique<test_chunk_list>(&f);
+
+  write_chunk(&cl->list, 1, 'a');
+
+  {
+    TestBlockDiskThread block;
+
+    CPPUNIT_ASSERT(cl->list.sync_chunks(sync_safe_flags) == 0);
+    CPPUNIT_ASSERT(cl->node(1)->is_write_pending());
+
+    // The chunk is kept mapped until the sync is done.
+    cl.reset();
+  }
+
+  CPPUNIT_ASSERT(wait_for_true([]() { return torrent::thread_disk()->disk_io()->pending_size() == 0; }));
+
+  // Nothing is posted back to the deleted chunk list.
+  m_main_thread->test_process_events_without_cached_time();
+
+  CPPUNIT_ASSERT(f.has_content(1, 'a'));
+}
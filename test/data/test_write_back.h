@@ -0,0 +1,37 @@
+#ifndef TEST_DATA_WRITE_BACK_H
+#define TEST_DATA_WRITE_BACK_H
+
+#include "helpers/test_main_thread.h"
+
+class test_write_back : public TestFixtureWithMainAndDiskThread {
+  CPPUNIT_TEST_SUITE(test_write_back);
+
+  CPPUNIT_TEST(test_budget);
+  CPPUNIT_TEST(test_budget_short_flush);
+
+  CPPUNIT_TEST(test_flush_merge);
+  CPPUNIT_TEST(test_flush_failed);
+  CPPUNIT_TEST(test_wait_async);
+
+  CPPUNIT_TEST(test_sync_async);
+  CPPUNIT_TEST(test_sync_durable);
+  CPPUNIT_TEST(test_sync_durable_all);
+  CPPUNIT_TEST(test_sync_durable_clear);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_budget();
+  void test_budget_short_flush();
+
+  void test_flush_merge();
+  void test_flush_failed();
+  void test_wait_async();
+
+  void test_sync_async();
+  void test_sync_durable();
+  void test_sync_durable_all();
+  void test_sync_durable_clear();
+};
+
+#endif // TEST_DATA_WRITE_BACK_H
@@ -0,0 +1,339 @@
+#include "config.h"
+
+#include "test/download/test_chunk_selector.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "download/chunk_selector.h"
+#include "download/chunk_statistics.h"
+#include "protocol/peer_chunks.h"
+#include "rak/partial_queue.h"
+#include "torrent/bitfield.h"
+#include "torrent/data/download_data.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestChunkSelector);
+
+using torrent::ChunkSelector;
+
+namespace {
+
+struct test_data : public torrent::download_data {
+  using download_data::mutable_completed_bitfield;
+  using download_data::mutable_high_priority;
+  using download_data::mutable_normal_priority;
+};
+
+struct test_download {
+  test_download(uint32_t size, uint32_t completed_percent);
+  ~test_download();
+
+  uint32_t              size() const { return data.completed_bitfield()->size_bits(); }
+
+  torrent::PeerChunks*  add_peer(uint32_t percent);
+  void                  remove_peer(uint32_t position);
+
+  bool                  is_high(uint32_t index) const { return data.high_priority()->has(index); }
+
+  test_data                data;
+  torrent::ChunkStatistics statistics;
+  ChunkSelector            selector{&data};
+
+  std::vector<std::unique_ptr<torrent::PeerChunks>> peers;
+};
+
+test_download::test_download(uint32_t size, uint32_t completed_percent) {
+  auto completed = data.mutable_completed_bitfield();
+
+  completed->set_size_bits(size);
+  completed->allocate();
+  completed->unset_all();
+
+  for (uint32_t index = 0; index < size; index++)
+    if (static_cast<uint32_t>(random() % 100) < completed_percent)
+      completed->set(index);
+
+  statistics.initialize(size);
+}
+
+test_download::~test_download() {
+  for (auto& peer : peers)
+    statistics.received_disconnect(peer.get());
+
+  selector.cleanup();
+  statistics.clear();
+}
+
+// Seeders are added with 100 percent.
+torrent::PeerChunks*
+test_download::add_peer(uint32_t percent) {
+  auto peer = std::make_unique<torrent::PeerChunks>();
+  auto bitfield = peer->mutable_bitfield();
+
+  bitfield->set_size_bits(data.completed_bitfield()->size_bits());
+  bitfield->allocate();
+  bitfield->unset_all();
+
+  for (uint32_t index = 0; index < bitfield->size_bits(); index++)
+    if (static_cast<uint32_t>(random() % 100) < percent)
+      bitfield->set(index);
+
+  statistics.received_connect(peer.get());
+  peers.push_back(std::move(peer));
+
+  return peers.back().get();
+}
+
+void
+test_download::remove_peer(uint32_t position) {
+  statistics.received_disconnect(peers[position].get());
+  peers.erase(peers.begin() + position);
+}
+
+// The linear scan ChunkSelector used before the rarity index. The
+// rarest chunks the peer has are collected in a partial_queue from
+// 'position' onwards and wrapping around, high priority ranges first.
+bool
+linear_search(rak::partial_queue* queue, const test_download& d, const torrent::Bitfield* bf,
+              const torrent::download_data::priority_ranges* ranges, uint32_t first, uint32_t last) {
+  for (auto itr = ranges->find(first); itr != ranges->end() && itr->first < last; ++itr) {
+    for (uint32_t index = std::max(first, itr->first); index < std::min(last, itr->second); index++) {
+      if (!bf->get(index) || !d.data.untouched_bitfield()->get(index))
+        continue;
+
+      if (!queue->insert(d.statistics.rarity(index), index) && queue->is_full())
+        return false;
+    }
+  }
+
+  return true;
+}
+
+uint32_t
+linear_find(const test_download& d, const torrent::Bitfield* bf, uint32_t position) {
+  rak::partial_queue queue;
+  queue.enable(8);
+
+  for (auto ranges : { d.data.high_priority(), d.data.normal_priority() }) {
+    queue.clear();
+
+    (linear_search(&queue, d, bf, ranges, position, d.size()) &&
+     linear_search(&queue, d, bf, ranges, 0, position));
+
+    if (queue.prepare_pop())
+      return queue.pop();
+  }
+
+  return ChunkSelector::invalid_chunk;
+}
+
+// The lowest rarity of the wanted chunks the peer has in the same
+// priority class as 'index'.
+uint32_t
+min_rarity(const test_download& d, const torrent::Bitfield* bf, bool high) {
+  uint32_t result = ~uint32_t();
+
+  for (uint32_t index = 0; index < d.size(); index++)
+    if (bf->get(index) && d.selector.is_wanted(index) && d.is_high(index) == high)
+      result = std::min<uint32_t>(result, d.statistics.rarity(index));
+
+  return result;
+}
+
+// The index may pick a different chunk than the linear scan, as ties
+// are broken randomly and the scan only orders chunks by powers of two
+// of rarity, but never a chunk of a lower priority or higher rarity.
+void
+verify_find(test_download& d, torrent::PeerChunks* pc) {
+  uint32_t index = d.selector.find(pc, false);
+  uint32_t expected = linear_find(d, pc->bitfield(), random() % d.size());
+
+  if (expected == ChunkSelector::invalid_chunk) {
+    CPPUNIT_ASSERT(index == ChunkSelector::invalid_chunk);
+    return;
+  }
+
+  CPPUNIT_ASSERT(index != ChunkSelector::invalid_chunk);
+  CPPUNIT_ASSERT(pc->bitfield()->get(index));
+  CPPUNIT_ASSERT(d.selector.is_wanted(index));
+
+  CPPUNIT_ASSERT(d.is_high(index) == d.is_high(expected));
+  CPPUNIT_ASSERT(d.statistics.rarity(index) <= d.statistics.rarity(expected));
+  CPPUNIT_ASSERT(d.statistics.rarity(index) == min_rarity(d, pc->bitfield(), d.is_high(index)));
+}
+
+void
+verify_all_peers(test_download& d) {
+  for (auto& peer : d.peers)
+    verify_find(d, peer.get());
+}
+
+void
+setup_random_download(test_download& d) {
+  d.data.mutable_normal_priority()->insert(0, d.size());
+  d.data.mutable_high_priority()->insert(d.size() / 4, d.size() / 4 + d.size() / 10);
+  d.data.mutable_high_priority()->insert(d.size() * 3 / 4, d.size() * 3 / 4 + d.size() / 40);
+
+  // Some peers are counted before the selector takes the initial
+  // rarities, the rest update the index as they connect.
+  for (int i = 0; i < 30; i++)
+    d.add_peer(2 + random() % 90);
+
+  d.selector.initialize(&d.statistics);
+  d.selector.update_priorities();
+
+  for (int i = 0; i < 30; i++)
+    d.add_peer(2 + random() % 90);
+
+  d.add_peer(100);
+  d.add_peer(100);
+}
+
+}
+
+void
+TestChunkSelector::test_empty() {
+  srandom(1);
+
+  test_download d(64, 100);
+  d.data.mutable_normal_priority()->insert(0, 64);
+
+  d.selector.initialize(&d.statistics);
+  d.selector.update_priorities();
+
+  CPPUNIT_ASSERT(d.selector.find(d.add_peer(100), false) == ChunkSelector::invalid_chunk);
+  CPPUNIT_ASSERT(d.selector.find(d.add_peer(50), false) == ChunkSelector::invalid_chunk);
+}
+
+void
+TestChunkSelector::test_rarest_first() {
+  test_download d(16, 0);
+  d.data.mutable_normal_priority()->insert(0, 16);
+
+  d.selector.initialize(&d.statistics);
+  d.selector.update_priorities();
+
+  auto set_range = [](torrent::PeerChunks* pc, uint32_t first, uint32_t last) {
+      for (uint32_t index = first; index < last; index++)
+        pc->mutable_bitfield()->set(index);
+    };
+
+  // Rarity 1 for 0-3 and 12-15, 3 for 4-7 and 2 for 8-11.
+  auto peer_a = d.add_peer(0);
+  auto peer_b = d.add_peer(0);
+  auto peer_c = d.add_peer(0);
+
+  for (auto& peer : d.peers)
+    d.statistics.received_disconnect(peer.get());
+
+  set_range(peer_a, 0, 8);
+  set_range(peer_b, 4, 12);
+  set_range(peer_c, 4, 16);
+
+  for (auto& peer : d.peers)
+    d.statistics.received_connect(peer.get());
+
+  for (int i = 0; i < 16; i++) {
+    uint32_t index_b = d.selector.find(peer_b, false);
+    uint32_t index_c = d.selector.find(peer_c, false);
+
+    CPPUNIT_ASSERT(index_b >= 8 && index_b < 12);
+    CPPUNIT_ASSERT(index_c >= 12 && index_c < 16);
+  }
+
+  // High priority chunks are picked regardless of rarity.
+  d.data.mutable_high_priority()->insert(4, 8);
+  d.selector.update_priorities();
+
+  for (int i = 0; i < 16; i++) {
+    uint32_t index_c = d.selector.find(peer_c, false);
+
+    CPPUNIT_ASSERT(index_c >= 4 && index_c < 8);
+  }
+
+  for (uint32_t index = 4; index < 8; index++)
+    d.selector.using_index(index);
+
+  uint32_t index_c = d.selector.find(peer_c, false);
+  CPPUNIT_ASSERT(index_c >= 12 && index_c < 16);
+}
+
+void
+TestChunkSelector::test_linear_scan_random() {
+  srandom(2);
+
+  for (uint32_t size : { 1u, 7u, 64u, 1000u, 4099u }) {
+    test_download d(size, 25);
+    setup_random_download(d);
+
+    for (int i = 0; i < 4; i++)
+      verify_all_peers(d);
+  }
+}
+
+// Compares the two after each kind of change that updates the index
+// incrementally.
+void
+TestChunkSelector::test_linear_scan_updates() {
+  srandom(3);
+
+  test_download d(2000, 25);
+  setup_random_download(d);
+
+  std::vector<uint32_t> used;
+
+  for (int step = 0; step < 2000; step++) {
+    switch (random() % 6) {
+    case 0: {
+      uint32_t index = random() % d.size();
+
+      if (d.data.untouched_bitfield()->get(index)) {
+        d.selector.using_index(index);
+        used.push_back(index);
+      }
+      break;
+    }
+    case 1:
+      if (!used.empty()) {
+        uint32_t position = random() % used.size();
+
+        d.selector.not_using_index(used[position]);
+        used.erase(used.begin() + position);
+      }
+      break;
+
+    case 2: {
+      auto peer = d.peers[random() % d.peers.size()].get();
+      uint32_t index = random() % d.size();
+
+      if (!peer->bitfield()->get(index))
+        d.statistics.received_have_chunk(peer, index, 1 << 14);
+      break;
+    }
+    case 3:
+      if (d.peers.size() > 10)
+        d.remove_peer(random() % d.peers.size());
+      break;
+
+    case 4:
+      d.add_peer(random() % 100);
+      break;
+
+    case 5:
+      if (random() % 20 == 0) {
+        uint32_t first = random() % d.size();
+
+        d.data.mutable_high_priority()->insert(first, std::min(first + 1 + static_cast<uint32_t>(random() % 100), d.size()));
+        d.selector.update_priorities();
+      }
+      break;
+    }
+
+    if (step % 50 == 0)
+      verify_all_peers(d);
+  }
+
+  verify_all_peers(d);
+}
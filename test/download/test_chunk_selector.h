@@ -0,0 +1,18 @@
+#include "helpers/test_main_thread.h"
+
+class TestChunkSelector : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(TestChunkSelector);
+
+  CPPUNIT_TEST(test_empty);
+  CPPUNIT_TEST(test_rarest_first);
+  CPPUNIT_TEST(test_linear_scan_random);
+  CPPUNIT_TEST(test_linear_scan_updates);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_empty();
+  void test_rarest_first();
+  void test_linear_scan_random();
+  void test_linear_scan_updates();
+};
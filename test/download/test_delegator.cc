@@ -0,0 +1,605 @@
+#include "config.h"
+
+#include "test/download/test_delegator.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "download/delegator.h"
+#include "protocol/peer_chunks.h"
+#include "test/helpers/network.h"
+#include "torrent/bitfield.h"
+#include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
+#include "torrent/data/block_transfer.h"
+#include "torrent/data/transfer_list.h"
+#include "torrent/peer/peer_info.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestDelegator);
+
+using torrent::Block;
+using torrent::BlockList;
+using torrent::BlockTransfer;
+using torrent::Delegator;
+using torrent::TransferList;
+
+namespace {
+
+constexpr uint32_t chunk_count   = 48;
+constexpr uint32_t invalid_chunk = ~uint32_t();
+
+struct test_peer {
+  test_peer(uint32_t percent, std::mt19937& rng);
+
+  std::unique_ptr<torrent::PeerInfo> info;
+  torrent::PeerChunks                chunks;
+  std::vector<BlockTransfer*>        transfers;
+};
+
+struct test_download {
+  test_download();
+  ~test_download();
+
+  TransferList*       transfer_list() { return delegator.transfer_list(); }
+
+  test_peer*          add_peer(uint32_t percent);
+
+  std::vector<BlockTransfer*> delegate(test_peer* peer, uint32_t affinity, uint32_t max);
+  BlockList*          start(test_peer* peer, uint32_t index);
+
+  void                release(test_peer* peer, BlockTransfer* transfer);
+  void                complete(test_peer* peer, BlockTransfer* transfer);
+  void                fail(BlockList* block_list);
+  void                erase(BlockList* block_list);
+
+  static bool         is_high(uint32_t index) { return index % 4 == 0; }
+
+  std::mt19937        rng;
+  Delegator           delegator;
+
+  // Chunks handed out as new pieces, in order, by the chunk selector
+  // slot.
+  std::vector<uint32_t> pending;
+
+  std::vector<std::unique_ptr<test_peer>> peers;
+
+  // Leaders of pieces that failed the hash check are left in their
+  // blocks, the peer connection no longer knows of them.
+  std::vector<BlockTransfer*> failed;
+};
+
+test_peer::test_peer(uint32_t percent, std::mt19937& rng) :
+  info(std::make_unique<torrent::PeerInfo>(wrap_ai_get_first_sa("1.2.3.4", "5000").get())) {
+
+  auto bitfield = chunks.mutable_bitfield();
+
+  bitfield->set_size_bits(chunk_count);
+  bitfield->allocate();
+  bitfield->unset_all();
+
+  for (uint32_t index = 0; index < chunk_count; index++)
+    if (rng() % 100 < percent)
+      bitfield->set(index);
+
+  // Seeders are delegated in a different order.
+  bitfield->unset(rng() % chunk_count);
+
+  chunks.set_peer_info(info.get());
+}
+
+test_download::test_download() {
+  delegator.slot_chunk_find() = [this](torrent::PeerChunks* pc, bool high) {
+      auto itr = std::find_if(pending.begin(), pending.end(), [pc, high](uint32_t index) {
+          return is_high(index) == high && pc->bitfield()->get(index);
+        });
+
+      if (itr == pending.end())
+        return invalid_chunk;
+
+      uint32_t index = *itr;
+      pending.erase(itr);
+
+      return index;
+    };
+
+  // Pieces of two to five blocks, some with a short last block.
+  delegator.slot_chunk_size() = [](uint32_t index) {
+      return (2 + index % 4) * Delegator::block_size - (index % 3) * 1000;
+    };
+
+  transfer_list()->slot_canceled()  = [](uint32_t) {};
+  transfer_list()->slot_completed() = [](uint32_t) {};
+  transfer_list()->slot_queued()    = [](uint32_t) {};
+  transfer_list()->slot_corrupt()   = [](torrent::PeerInfo*) {};
+}
+
+test_download::~test_download() {
+  transfer_list()->clear();
+
+  // Transfers still held are invalidated when their blocks go away.
+  for (auto& peer : peers)
+    for (auto transfer : peer->transfers)
+      Block::release(transfer);
+
+  for (auto transfer : failed)
+    Block::release(transfer);
+}
+
+test_peer*
+test_download::add_peer(uint32_t percent) {
+  peers.push_back(std::make_unique<test_peer>(percent, rng));
+
+  return peers.back().get();
+}
+
+std::vector<BlockTransfer*>
+test_download::delegate(test_peer* peer, uint32_t affinity, uint32_t max) {
+  auto transfers = delegator.delegate(&peer->chunks, affinity, max);
+
+  peer->transfers.insert(peer->transfers.end(), transfers.begin(), transfers.end());
+  return transfers;
+}
+
+BlockList*
+test_download::start(test_peer* peer, uint32_t index) {
+  pending.push_back(index);
+  delegate(peer, invalid_chunk, 64);
+
+  CPPUNIT_ASSERT(pending.empty());
+
+  auto itr = transfer_list()->find(index);
+  CPPUNIT_ASSERT(itr != transfer_list()->end());
+
+  return *itr;
+}
+
+void
+test_download::release(test_peer* peer, BlockTransfer* transfer) {
+  peer->transfers.erase(std::find(peer->transfers.begin(), peer->transfers.end(), transfer));
+  Block::release(transfer);
+}
+
+// The transfer becomes the leader if it isn't, and finishes the block.
+// The block keeps the finished leader.
+void
+test_download::complete(test_peer* peer, BlockTransfer* transfer) {
+  if (transfer->is_queued())
+    CPPUNIT_ASSERT(transfer->block()->transfering(transfer));
+
+  CPPUNIT_ASSERT(transfer->is_leader());
+
+  transfer->adjust_position(transfer->piece().length() - transfer->position());
+  transfer_list()->finished(transfer);
+
+  peer->transfers.erase(std::find(peer->transfers.begin(), peer->transfers.end(), transfer));
+}
+
+void
+test_download::fail(BlockList* block_list) {
+  CPPUNIT_ASSERT(block_list->is_all_finished());
+
+  for (auto& block : *block_list)
+    failed.push_back(block.leader());
+
+  block_list->do_all_failed();
+}
+
+void
+test_download::erase(BlockList* block_list) {
+  CPPUNIT_ASSERT(block_list->is_all_finished());
+
+  transfer_list()->erase(transfer_list()->find(block_list->index()));
+}
+
+// The blocks the Delegator handed out before it kept an index of free
+// blocks, found by scanning every block of the affinity piece and of
+// each partial piece the peer has, high priority first. Matches only
+// for peers that aren't seeders, when no new pieces are started.
+std::vector<const Block*>
+scan_delegate(const TransferList* transfer_list, const test_peer* peer, uint32_t affinity, uint32_t max) {
+  std::vector<const Block*> result;
+
+  auto is_taken = [&](const Block& block) {
+      return std::find(result.begin(), result.end(), &block) != result.end();
+    };
+
+  auto scan_block_list = [&](const BlockList* block_list) {
+      for (auto& block : *block_list)
+        if (result.size() < max && !block.is_finished() && block.is_stalled() && block.size_all() == 0 && !is_taken(block))
+          result.push_back(&block);
+
+      for (auto& block : *block_list)
+        if (result.size() < max && !block.is_finished() && block.is_stalled() &&
+            block.find(peer->info.get()) == nullptr && !is_taken(block))
+          result.push_back(&block);
+    };
+
+  for (auto block_list : *transfer_list)
+    if (block_list->index() == affinity)
+      scan_block_list(block_list);
+
+  for (auto priority : { torrent::PRIORITY_HIGH, torrent::PRIORITY_NORMAL })
+    for (auto block_list : *transfer_list)
+      if (block_list->priority() == priority && peer->chunks.bitfield()->get(block_list->index()))
+        scan_block_list(block_list);
+
+  return result;
+}
+
+bool
+is_free(const Block& block) {
+  return !block.is_finished() && block.is_stalled();
+}
+
+// Every BlockList's first free block is at or after first_free(), and
+// those with a free block are in the free list of their priority, in
+// insertion order.
+void
+check_index(const TransferList* transfer_list) {
+  for (auto block_list : *transfer_list) {
+    uint32_t position = std::find_if(block_list->begin(), block_list->end(), is_free) - block_list->begin();
+
+    CPPUNIT_ASSERT(block_list->first_free() <= position);
+
+    if (block_list->priority() == torrent::PRIORITY_OFF) {
+      CPPUNIT_ASSERT(!block_list->is_free_listed());
+      continue;
+    }
+
+    const auto& free_list = transfer_list->free_list(block_list->priority());
+    bool listed = std::find(free_list.begin(), free_list.end(), block_list) != free_list.end();
+
+    CPPUNIT_ASSERT(listed == block_list->is_free_listed());
+    CPPUNIT_ASSERT(listed || position == block_list->size());
+  }
+
+  for (auto priority : { torrent::PRIORITY_HIGH, torrent::PRIORITY_NORMAL }) {
+    const auto& free_list = transfer_list->free_list(priority);
+
+    for (auto itr = free_list.begin(); itr != free_list.end(); ++itr) {
+      CPPUNIT_ASSERT(std::find(transfer_list->begin(), transfer_list->end(), *itr) != transfer_list->end());
+      CPPUNIT_ASSERT((*itr)->priority() == priority);
+      CPPUNIT_ASSERT(itr == free_list.begin() || (*(itr - 1))->sequence() < (*itr)->sequence());
+    }
+  }
+}
+
+std::vector<BlockTransfer*>
+check_delegate(test_download& d, test_peer* peer, uint32_t affinity, uint32_t max) {
+  auto expected = scan_delegate(d.transfer_list(), peer, affinity, max);
+  auto transfers = d.delegate(peer, affinity, max);
+
+  CPPUNIT_ASSERT(transfers.size() == expected.size());
+
+  for (size_t i = 0; i < transfers.size(); i++)
+    CPPUNIT_ASSERT(transfers[i]->block() == expected[i]);
+
+  check_index(d.transfer_list());
+  return transfers;
+}
+
+// Gives peers all chunks but the last, so none is a seeder.
+void
+add_peers(test_download& d, unsigned int count) {
+  for (unsigned int i = 0; i < count; i++) {
+    auto bitfield = d.add_peer(0)->chunks.mutable_bitfield();
+
+    bitfield->set_all();
+    bitfield->unset(chunk_count - 1);
+  }
+}
+
+} // namespace
+
+void
+TestDelegator::test_stall() {
+  test_download d;
+  add_peers(d, 3);
+
+  auto peer_a = d.peers[0].get();
+  auto peer_b = d.peers[1].get();
+  auto peer_c = d.peers[2].get();
+
+  auto block_list = d.start(peer_a, 2);
+
+  CPPUNIT_ASSERT(block_list->size() == 4);
+  CPPUNIT_ASSERT(peer_a->transfers.size() == 4);
+  CPPUNIT_ASSERT(!block_list->has_free());
+
+  // Full pieces are dropped from the free list as they are visited.
+  CPPUNIT_ASSERT(check_delegate(d, peer_b, invalid_chunk, 8).empty());
+  CPPUNIT_ASSERT(!block_list->is_free_listed());
+
+  Block::stalled(peer_a->transfers[2]);
+
+  CPPUNIT_ASSERT(block_list->first_free() == 2);
+  CPPUNIT_ASSERT(block_list->is_free_listed());
+
+  // Stalling it again changes nothing.
+  Block::stalled(peer_a->transfers[2]);
+  CPPUNIT_ASSERT(block_list->first_free() == 2);
+
+  auto transfers = check_delegate(d, peer_b, invalid_chunk, 8);
+
+  CPPUNIT_ASSERT(transfers.size() == 1);
+  CPPUNIT_ASSERT(transfers[0]->block() == &*(block_list->begin() + 2));
+
+  Block::stalled(transfers[0]);
+  CPPUNIT_ASSERT(check_delegate(d, peer_c, invalid_chunk, 8).size() == 1);
+
+  Block::stalled(peer_a->transfers[1]);
+  Block::stalled(peer_a->transfers[3]);
+
+  CPPUNIT_ASSERT(block_list->first_free() == 1);
+
+  // The peer that stalled doesn't get its blocks again.
+  CPPUNIT_ASSERT(check_delegate(d, peer_a, invalid_chunk, 8).empty());
+  CPPUNIT_ASSERT(check_delegate(d, peer_b, invalid_chunk, 8).size() == 2);
+  CPPUNIT_ASSERT(!block_list->has_free());
+}
+
+void
+TestDelegator::test_erase_invalidate() {
+  test_download d;
+  add_peers(d, 3);
+
+  auto peer_a = d.peers[0].get();
+  auto peer_b = d.peers[1].get();
+  auto peer_c = d.peers[2].get();
+
+  auto block_list = d.start(peer_a, 3);
+
+  CPPUNIT_ASSERT(block_list->size() == 5);
+  CPPUNIT_ASSERT(check_delegate(d, peer_b, invalid_chunk, 8).empty());
+
+  // Erasing a queued transfer frees its block.
+  d.release(peer_a, peer_a->transfers[3]);
+
+  CPPUNIT_ASSERT(block_list->first_free() == 3);
+
+  auto transfers = check_delegate(d, peer_b, invalid_chunk, 8);
+  CPPUNIT_ASSERT(transfers.size() == 1);
+
+  // Erasing the leader promotes a transfer that isn't stalled, which
+  // keeps the block taken.
+  auto leader = peer_a->transfers[0];
+  auto block = leader->block();
+
+  CPPUNIT_ASSERT(block->transfering(leader));
+  Block::stalled(leader);
+
+  transfers = check_delegate(d, peer_b, invalid_chunk, 1);
+  CPPUNIT_ASSERT(transfers.size() == 1 && transfers[0]->block() == block);
+  CPPUNIT_ASSERT(!block->transfering(transfers[0]));
+
+  d.release(peer_a, leader);
+
+  CPPUNIT_ASSERT(block->leader() == transfers[0]);
+  CPPUNIT_ASSERT(check_delegate(d, peer_c, invalid_chunk, 8).empty());
+
+  // Erasing the last progressing transfer, a promoted leader, frees
+  // the block again.
+  d.release(peer_b, transfers[0]);
+
+  CPPUNIT_ASSERT(block_list->first_free() == 0);
+  CPPUNIT_ASSERT(check_delegate(d, peer_c, invalid_chunk, 8).size() == 1);
+
+  // Finishing a block invalidates the other transfers of it, which
+  // doesn't free a finished block.
+  auto stalled = peer_a->transfers[1];
+  Block::stalled(stalled);
+
+  transfers = check_delegate(d, peer_b, invalid_chunk, 8);
+  CPPUNIT_ASSERT(transfers.size() == 1 && transfers[0]->block() == stalled->block());
+
+  d.complete(peer_b, transfers[0]);
+
+  CPPUNIT_ASSERT(!stalled->is_valid());
+  CPPUNIT_ASSERT(check_delegate(d, peer_c, invalid_chunk, 8).empty());
+
+  d.release(peer_a, stalled);
+  check_index(d.transfer_list());
+}
+
+void
+TestDelegator::test_all_failed() {
+  test_download d;
+  add_peers(d, 3);
+
+  auto peer_a = d.peers[0].get();
+  auto peer_b = d.peers[1].get();
+  auto peer_c = d.peers[2].get();
+
+  auto high_list = d.start(peer_a, 4);
+  auto normal_list = d.start(peer_a, 5);
+
+  CPPUNIT_ASSERT(high_list->priority() == torrent::PRIORITY_HIGH);
+  CPPUNIT_ASSERT(normal_list->priority() == torrent::PRIORITY_NORMAL);
+
+  while (!peer_a->transfers.empty())
+    d.complete(peer_a, peer_a->transfers.front());
+
+  CPPUNIT_ASSERT(high_list->is_all_finished() && normal_list->is_all_finished());
+  CPPUNIT_ASSERT(check_delegate(d, peer_b, invalid_chunk, 16).empty());
+  CPPUNIT_ASSERT(!high_list->is_free_listed() && !normal_list->is_free_listed());
+
+  d.fail(normal_list);
+
+  CPPUNIT_ASSERT(normal_list->first_free() == 0);
+  CPPUNIT_ASSERT(normal_list->is_free_listed());
+  check_index(d.transfer_list());
+
+  // The blocks are downloaded again, though not from the peer that
+  // sent them the last time.
+  CPPUNIT_ASSERT(check_delegate(d, peer_a, invalid_chunk, 16).empty());
+  CPPUNIT_ASSERT(check_delegate(d, peer_b, invalid_chunk, 16).size() == normal_list->size());
+
+  while (!peer_b->transfers.empty())
+    d.complete(peer_b, peer_b->transfers.front());
+
+  auto third_list = d.start(peer_b, 8);
+  CPPUNIT_ASSERT(third_list->priority() == torrent::PRIORITY_HIGH);
+
+  while (!peer_b->transfers.empty())
+    d.complete(peer_b, peer_b->transfers.front());
+
+  // Pieces failing out of order go back to the free list in the order
+  // they were started.
+  d.fail(third_list);
+  d.fail(normal_list);
+  d.fail(high_list);
+
+  const auto& free_list = d.transfer_list()->free_list(torrent::PRIORITY_HIGH);
+
+  CPPUNIT_ASSERT(free_list.size() == 2 && free_list[0] == high_list && free_list[1] == third_list);
+  check_index(d.transfer_list());
+
+  auto transfers = check_delegate(d, peer_c, invalid_chunk, 64);
+
+  CPPUNIT_ASSERT(transfers.size() == high_list->size() + third_list->size() + normal_list->size());
+  CPPUNIT_ASSERT(transfers.front()->block() == &*high_list->begin());
+
+  while (!peer_c->transfers.empty())
+    d.complete(peer_c, peer_c->transfers.front());
+
+  d.erase(normal_list);
+  d.erase(high_list);
+  check_index(d.transfer_list());
+}
+
+void
+TestDelegator::test_priority_off() {
+  test_download d;
+  add_peers(d, 2);
+
+  auto peer_a = d.peers[0].get();
+  auto peer_b = d.peers[1].get();
+
+  auto normal_list = d.start(peer_a, 1);
+  auto off_list = *d.transfer_list()->insert(torrent::Piece(3, 0, d.delegator.slot_chunk_size()(3)), Delegator::block_size);
+
+  CPPUNIT_ASSERT(off_list->priority() == torrent::PRIORITY_OFF);
+  CPPUNIT_ASSERT(off_list->has_free());
+  CPPUNIT_ASSERT(!off_list->is_free_listed());
+
+  Block::stalled(peer_a->transfers[0]);
+
+  // Pieces without a priority are only delegated by affinity.
+  auto transfers = check_delegate(d, peer_b, invalid_chunk, 16);
+
+  CPPUNIT_ASSERT(transfers.size() == 1);
+  CPPUNIT_ASSERT(transfers[0]->block()->parent() == normal_list);
+
+  transfers = check_delegate(d, peer_b, off_list->index(), 1);
+
+  CPPUNIT_ASSERT(transfers.size() == 1);
+  CPPUNIT_ASSERT(transfers[0]->block()->parent() == off_list);
+
+  // Freed blocks don't put them in a free list.
+  Block::stalled(transfers[0]);
+  d.release(peer_b, transfers[0]);
+
+  CPPUNIT_ASSERT(!off_list->is_free_listed());
+  check_index(d.transfer_list());
+
+  CPPUNIT_ASSERT(check_delegate(d, peer_a, invalid_chunk, 16).empty());
+}
+
+// Random delegation, stalls, erases, completions and hash failures,
+// comparing each delegation to a scan of all partial pieces.
+void
+TestDelegator::test_random() {
+  for (unsigned int seed = 0; seed < 8; seed++) {
+    test_download d;
+    d.rng.seed(seed);
+
+    for (unsigned int i = 0; i < 5; i++)
+      d.add_peer(40 + 10 * i);
+
+    auto& rng = d.rng;
+    auto random_list = [&]() -> BlockList* {
+        if (d.transfer_list()->empty())
+          return nullptr;
+
+        return *(d.transfer_list()->begin() + rng() % d.transfer_list()->size());
+      };
+
+    for (unsigned int step = 0; step < 3000; step++) {
+      auto peer = d.peers[rng() % d.peers.size()].get();
+      auto transfer = peer->transfers.empty() ? nullptr : peer->transfers[rng() % peer->transfers.size()];
+
+      switch (rng() % 16) {
+      case 0: {
+        uint32_t index = rng() % chunk_count;
+
+        if (d.transfer_list()->find(index) == d.transfer_list()->end() && peer->chunks.bitfield()->get(index))
+          d.start(peer, index);
+
+        break;
+      }
+      case 1:
+      case 2:
+      case 3:
+      case 4: {
+        auto affinity_list = rng() % 4 == 0 ? random_list() : nullptr;
+
+        check_delegate(d, peer, affinity_list != nullptr ? affinity_list->index() : invalid_chunk, 1 + rng() % 8);
+        break;
+      }
+      case 5:
+      case 6:
+      case 7:
+        if (transfer != nullptr)
+          Block::stalled(transfer);
+
+        break;
+
+      case 8:
+      case 9:
+      case 10:
+        if (transfer != nullptr && transfer->is_valid() && transfer->is_queued())
+          transfer->block()->transfering(transfer);
+        else if (transfer != nullptr && transfer->is_valid() && transfer->is_leader())
+          d.complete(peer, transfer);
+
+        break;
+
+      case 11:
+      case 12:
+        if (transfer != nullptr)
+          d.release(peer, transfer);
+
+        break;
+
+      case 13: {
+        auto block_list = random_list();
+
+        if (block_list != nullptr && block_list->is_all_finished())
+          d.fail(block_list);
+
+        break;
+      }
+      case 14: {
+        auto block_list = random_list();
+
+        if (block_list != nullptr && block_list->is_all_finished())
+          d.erase(block_list);
+
+        break;
+      }
+      case 15: {
+        uint32_t index = rng() % chunk_count;
+
+        if (rng() % 8 == 0 && d.transfer_list()->find(index) == d.transfer_list()->end())
+          d.transfer_list()->insert(torrent::Piece(index, 0, d.delegator.slot_chunk_size()(index)), Delegator::block_size);
+
+        break;
+      }
+      }
+
+      check_index(d.transfer_list());
+    }
+  }
+}
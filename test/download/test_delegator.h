@@ -0,0 +1,20 @@
+#include "helpers/test_main_thread.h"
+
+class TestDelegator : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(TestDelegator);
+
+  CPPUNIT_TEST(test_stall);
+  CPPUNIT_TEST(test_erase_invalidate);
+  CPPUNIT_TEST(test_all_failed);
+  CPPUNIT_TEST(test_priority_off);
+  CPPUNIT_TEST(test_random);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_stall();
+  void test_erase_invalidate();
+  void test_all_failed();
+  void test_priority_off();
+  void test_random();
+};
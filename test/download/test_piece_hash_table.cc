@@ -0,0 +1,164 @@
+#include "config.h"
+
+#include "test/download/test_piece_hash_table.h"
+
+#include <string>
+
+#include "download/piece_hash_table.h"
+#include "torrent/exceptions.h"
+#include "torrent/hash_string.h"
+#include "utils/sha1.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPieceHashTable);
+
+using torrent::PieceHashTable;
+
+namespace {
+
+constexpr uint32_t piece_length = 4 * 1000;
+
+std::string
+piece_data(uint32_t index) {
+  std::string data(piece_length, '\0');
+
+  for (uint32_t i = 0; i < piece_length; i++)
+    data[i] = static_cast<char>(index * 7 + i);
+
+  return data;
+}
+
+torrent::HashString
+piece_hash(const std::string& data) {
+  torrent::Sha1 sha1;
+  torrent::HashString hash;
+
+  sha1.init();
+  sha1.update(data.data(), data.size());
+  sha1.final_c(hash.data());
+
+  return hash;
+}
+
+void
+update_block(PieceHashTable& table, uint32_t index, const std::string& data, uint32_t block) {
+  table.update(index, piece_length, block * 1000, data.data() + block * 1000, 1000);
+}
+
+} // namespace
+
+void
+TestPieceHashTable::test_in_order() {
+  PieceHashTable table;
+  auto data = piece_data(1);
+
+  for (uint32_t block = 0; block < 4; block++) {
+    CPPUNIT_ASSERT(!table.is_complete(1, piece_length));
+
+    update_block(table, 1, data, block);
+    CPPUNIT_ASSERT(table.position(1) == (block + 1) * 1000);
+  }
+
+  CPPUNIT_ASSERT(table.is_complete(1, piece_length));
+  CPPUNIT_ASSERT(!table.is_complete(2, piece_length));
+
+  torrent::HashString hash;
+  CPPUNIT_ASSERT(table.final(1, piece_length, hash.data()));
+  CPPUNIT_ASSERT(hash == piece_hash(data));
+
+  CPPUNIT_ASSERT_THROW(table.update(1, piece_length, 3500, data.data(), 1000), torrent::internal_error);
+}
+
+// Blocks arriving out of order leave a gap that is only read back by
+// the full hash check.
+void
+TestPieceHashTable::test_gap() {
+  PieceHashTable table;
+  auto data = piece_data(2);
+
+  update_block(table, 2, data, 0);
+  update_block(table, 2, data, 2);
+  CPPUNIT_ASSERT(table.position(2) == 1000);
+
+  update_block(table, 2, data, 1);
+  update_block(table, 2, data, 3);
+  CPPUNIT_ASSERT(table.position(2) == 2000);
+  CPPUNIT_ASSERT(!table.is_complete(2, piece_length));
+
+  torrent::HashString hash;
+  CPPUNIT_ASSERT(!table.final(2, piece_length, hash.data()));
+}
+
+// Writes before the hashed position, e.g. from a replaced leader,
+// invalidate the piece until it is erased.
+void
+TestPieceHashTable::test_rewrite() {
+  PieceHashTable table;
+  auto data = piece_data(3);
+
+  update_block(table, 3, data, 0);
+  update_block(table, 3, data, 1);
+  update_block(table, 3, data, 0);
+
+  for (uint32_t block = 2; block < 4; block++)
+    update_block(table, 3, data, block);
+
+  CPPUNIT_ASSERT(!table.is_complete(3, piece_length));
+
+  // A failed hash check also invalidates the piece.
+  auto data_4 = piece_data(4);
+
+  for (uint32_t block = 0; block < 4; block++)
+    update_block(table, 4, data_4, block);
+
+  table.invalidate(4);
+  CPPUNIT_ASSERT(!table.is_complete(4, piece_length));
+
+  update_block(table, 4, data_4, 0);
+  CPPUNIT_ASSERT(!table.is_complete(4, piece_length));
+}
+
+// The hash is only taken once, a re-check of the chunk reads it back.
+void
+TestPieceHashTable::test_final() {
+  PieceHashTable table;
+  auto data = piece_data(5);
+  torrent::HashString hash;
+
+  for (uint32_t block = 0; block < 3; block++)
+    update_block(table, 5, data, block);
+
+  CPPUNIT_ASSERT(!table.final(5, piece_length, hash.data()));
+
+  update_block(table, 5, data, 3);
+  CPPUNIT_ASSERT(!table.final(5, piece_length - 1, hash.data()));
+
+  CPPUNIT_ASSERT(table.final(5, piece_length, hash.data()));
+  CPPUNIT_ASSERT(hash == piece_hash(data));
+
+  CPPUNIT_ASSERT(!table.final(5, piece_length, hash.data()));
+  CPPUNIT_ASSERT(!table.final(6, piece_length, hash.data()));
+}
+
+void
+TestPieceHashTable::test_erase() {
+  PieceHashTable table;
+  auto data = piece_data(6);
+
+  update_block(table, 6, data, 0);
+  update_block(table, 7, data, 0);
+  table.invalidate(6);
+
+  CPPUNIT_ASSERT(table.size() == 2);
+
+  table.erase(6);
+  CPPUNIT_ASSERT(table.size() == 1);
+  CPPUNIT_ASSERT(table.position(6) == 0);
+
+  for (uint32_t block = 0; block < 4; block++)
+    update_block(table, 6, data, block);
+
+  CPPUNIT_ASSERT(table.is_complete(6, piece_length));
+
+  table.clear();
+  CPPUNIT_ASSERT(table.empty());
+}
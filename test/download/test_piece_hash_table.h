@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class TestPieceHashTable : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestPieceHashTable);
+
+  CPPUNIT_TEST(test_in_order);
+  CPPUNIT_TEST(test_gap);
+  CPPUNIT_TEST(test_rewrite);
+  CPPUNIT_TEST(test_final);
+  CPPUNIT_TEST(test_erase);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_in_order();
+  void test_gap();
+  void test_rewrite();
+  void test_final();
+  void test_erase();
+};
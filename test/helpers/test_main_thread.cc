@@ -7,6 +7,7 @@
 #include "data/thread_disk.h"
 #include "net/thread_net.h"
 #include "test/helpers/mock_function.h"
+#include "test/helpers/test_utils.h"
 #include "torrent/exceptions.h"
 #include "torrent/net/resolver.h"
 #include "torrent/utils/log.h"
@@ -90,6 +91,20 @@ TestFixtureWithMainAndDiskThread::tearDown() {
   test_fixture::tearDown();
 }
 
+TestBlockDiskThread::TestBlockDiskThread() {
+  auto blocked = std::make_shared<std::atomic<bool>>(false);
+
+  torrent::thread_disk()->callback(this, [blocked, released = m_released]() {
+      *blocked = true;
+
+      while (!*released)
+        usleep(1000);
+    });
+
+  if (!wait_for_true([blocked]() { return blocked->load(); }))
+    throw torrent::internal_error("TestBlockDiskThread: disk thread did not block");
+}
+
 void
 TestFixtureWithMainAndTrackerThread::setUp() {
   test_fixture::setUp();
@@ -1,6 +1,7 @@
 #ifndef TEST_HELPERS_TEST_MAIN_THREAD_H
 #define TEST_HELPERS_TEST_MAIN_THREAD_H
 
+#include <atomic>
 #include <memory>
 
 #include "test/helpers/test_fixture.h"
@@ -45,6 +46,19 @@ public:
   std::unique_ptr<TestMainThread> m_main_thread;
 };
 
+// Holds the disk thread in a callback so that its requests stay
+// pending until released.
+class TestBlockDiskThread {
+public:
+  TestBlockDiskThread();
+  ~TestBlockDiskThread() { release(); }
+
+  void release() { *m_released = true; }
+
+private:
+  std::shared_ptr<std::atomic<bool>> m_released{std::make_shared<std::atomic<bool>>(false)};
+};
+
 class TestFixtureWithMainAndTrackerThread : public test_fixture {
 public:
   void setUp() override;
@@ -0,0 +1,220 @@
+#include "config.h"
+
+#include "test_socket_datagram.h"
+
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net/socket_datagram.h"
+#include "net/socket_fd.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(TestSocketDatagram, "net");
+
+using datagram_type = torrent::SocketDatagram::datagram_type;
+
+namespace {
+
+class test_datagram : public torrent::SocketDatagram {
+public:
+  test_datagram(bool use_mmsg) { m_use_mmsg = use_mmsg; }
+  ~test_datagram() override    { get_fd().close(); get_fd().clear(); }
+
+  void                event_read() override  {}
+  void                event_write() override {}
+  void                event_error() override {}
+};
+
+// Batched io through recvmmsg/sendmmsg when configured, and always
+// through the call per datagram fallback.
+std::vector<bool>
+mmsg_modes() {
+#ifdef USE_MMSG
+  return {true, false};
+#else
+  return {false};
+#endif
+}
+
+sockaddr_in
+bind_loopback(int fd) {
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(sa);
+
+  CPPUNIT_ASSERT(::bind(fd, reinterpret_cast<sockaddr*>(&sa), length) == 0);
+  CPPUNIT_ASSERT(::getsockname(fd, reinterpret_cast<sockaddr*>(&sa), &length) == 0);
+
+  return sa;
+}
+
+int
+open_inet() {
+  int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+
+  CPPUNIT_ASSERT(fd != -1);
+  return fd;
+}
+
+// Loopback datagrams are queued on the receiving socket before the
+// send returns, so nothing needs to wait.
+std::string
+receive(int fd) {
+  char buffer[2048];
+  auto length = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+  return length > 0 ? std::string(buffer, length) : std::string();
+}
+
+}
+
+void
+TestSocketDatagram::test_read_batch() {
+  for (bool use_mmsg : mmsg_modes()) {
+    test_datagram socket(use_mmsg);
+    socket.set_fd(torrent::SocketFd(open_inet(), false));
+
+    auto socket_address = bind_loopback(socket.get_fd().get_fd());
+
+    int sender = open_inet();
+    auto sender_address = bind_loopback(sender);
+
+    for (int i = 0; i < 5; i++) {
+      std::string data(i + 1, 'a' + i);
+      CPPUNIT_ASSERT(::sendto(sender, data.data(), data.size(), 0, reinterpret_cast<sockaddr*>(&socket_address), sizeof(socket_address)) == i + 1);
+    }
+
+    char buffers[8][64];
+    sockaddr_in addresses[8];
+    datagram_type datagrams[8];
+
+    auto reset = [&] {
+        for (int i = 0; i < 8; i++) {
+          addresses[i] = sockaddr_in{};
+          datagrams[i] = datagram_type{buffers[i], sizeof(buffers[i]), reinterpret_cast<sockaddr*>(&addresses[i]), sizeof(sockaddr_in)};
+        }
+      };
+
+    // Fewer requested than queued.
+    reset();
+    CPPUNIT_ASSERT(socket.read_datagrams_sa(datagrams, 3) == 3);
+
+    for (int i = 0; i < 3; i++) {
+      CPPUNIT_ASSERT(std::string(buffers[i], datagrams[i].length) == std::string(i + 1, 'a' + i));
+      CPPUNIT_ASSERT(datagrams[i].address_length == sizeof(sockaddr_in));
+      CPPUNIT_ASSERT(addresses[i].sin_port == sender_address.sin_port);
+    }
+
+    // Fewer queued than requested.
+    reset();
+    CPPUNIT_ASSERT(socket.read_datagrams_sa(datagrams, 8) == 2);
+
+    for (int i = 0; i < 2; i++)
+      CPPUNIT_ASSERT(std::string(buffers[i], datagrams[i].length) == std::string(i + 4, 'a' + i + 3));
+
+    reset();
+    CPPUNIT_ASSERT(socket.read_datagrams_sa(datagrams, 8) == -1 && errno == EAGAIN);
+
+    CPPUNIT_ASSERT(socket.stats_read_calls() == 3);
+    CPPUNIT_ASSERT(socket.stats_read_datagrams() == 5);
+
+    ::close(sender);
+  }
+}
+
+void
+TestSocketDatagram::test_write_batch() {
+  for (bool use_mmsg : mmsg_modes()) {
+    test_datagram socket(use_mmsg);
+    socket.set_fd(torrent::SocketFd(open_inet(), false));
+
+    int receivers[2] = {open_inet(), open_inet()};
+    sockaddr_in addresses[2] = {bind_loopback(receivers[0]), bind_loopback(receivers[1])};
+
+    std::string data[4];
+    datagram_type datagrams[4];
+
+    for (int i = 0; i < 4; i++) {
+      data[i] = std::string(10 * (i + 1), 'a' + i);
+      datagrams[i] = datagram_type{data[i].data(), static_cast<unsigned int>(data[i].size()), reinterpret_cast<sockaddr*>(&addresses[i % 2]), 0};
+    }
+
+    CPPUNIT_ASSERT(socket.write_datagrams_sa(datagrams, 4) == 4);
+
+    for (int i = 0; i < 4; i++) {
+      CPPUNIT_ASSERT(datagrams[i].length == data[i].size());
+      CPPUNIT_ASSERT(receive(receivers[i % 2]) == data[i]);
+    }
+
+    CPPUNIT_ASSERT(socket.stats_write_calls() == 1);
+    CPPUNIT_ASSERT(socket.stats_write_datagrams() == 4);
+
+    ::close(receivers[0]);
+    ::close(receivers[1]);
+  }
+}
+
+// A datagram the kernel rejects ends the batch, and is reported as
+// the error of the next call starting with it.
+void
+TestSocketDatagram::test_write_partial() {
+  for (bool use_mmsg : mmsg_modes()) {
+    test_datagram socket(use_mmsg);
+    socket.set_fd(torrent::SocketFd(open_inet(), false));
+
+    int receiver = open_inet();
+    auto address = bind_loopback(receiver);
+
+    std::string data[4] = {std::string(10, 'a'), std::string(20, 'b'), std::string(1 << 17, 'c'), std::string(40, 'd')};
+    datagram_type datagrams[4];
+
+    for (int i = 0; i < 4; i++)
+      datagrams[i] = datagram_type{data[i].data(), static_cast<unsigned int>(data[i].size()), reinterpret_cast<sockaddr*>(&address), 0};
+
+    CPPUNIT_ASSERT(socket.write_datagrams_sa(datagrams, 4) == 2);
+    CPPUNIT_ASSERT(socket.write_datagrams_sa(datagrams + 2, 2) == -1 && errno == EMSGSIZE);
+    CPPUNIT_ASSERT(socket.write_datagrams_sa(datagrams + 3, 1) == 1);
+
+    CPPUNIT_ASSERT(receive(receiver) == data[0]);
+    CPPUNIT_ASSERT(receive(receiver) == data[1]);
+    CPPUNIT_ASSERT(receive(receiver) == data[3]);
+    CPPUNIT_ASSERT(receive(receiver).empty());
+
+    CPPUNIT_ASSERT(socket.stats_write_calls() == 3);
+    CPPUNIT_ASSERT(socket.stats_write_datagrams() == 3);
+
+    ::close(receiver);
+  }
+}
+
+// IPv4 destinations are mapped when sending from an inet6 socket.
+void
+TestSocketDatagram::test_write_v4mapped() {
+  for (bool use_mmsg : mmsg_modes()) {
+    test_datagram socket(use_mmsg);
+
+    CPPUNIT_ASSERT(socket.get_fd().open_datagram() && socket.get_fd().set_nonblock());
+    CPPUNIT_ASSERT(socket.get_fd().is_ipv6_socket());
+
+    int receiver = open_inet();
+    auto address = bind_loopback(receiver);
+
+    std::string data[2] = {std::string(10, 'a'), std::string(20, 'b')};
+    datagram_type datagrams[2];
+
+    for (int i = 0; i < 2; i++)
+      datagrams[i] = datagram_type{data[i].data(), static_cast<unsigned int>(data[i].size()), reinterpret_cast<sockaddr*>(&address), 0};
+
+    CPPUNIT_ASSERT(socket.write_datagrams_sa(datagrams, 2) == 2);
+    CPPUNIT_ASSERT(address.sin_family == AF_INET);
+
+    CPPUNIT_ASSERT(receive(receiver) == data[0]);
+    CPPUNIT_ASSERT(receive(receiver) == data[1]);
+
+    ::close(receiver);
+  }
+}
@@ -0,0 +1,18 @@
+#include "helpers/test_fixture.h"
+
+class TestSocketDatagram : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestSocketDatagram);
+
+  CPPUNIT_TEST(test_read_batch);
+  CPPUNIT_TEST(test_write_batch);
+  CPPUNIT_TEST(test_write_partial);
+  CPPUNIT_TEST(test_write_v4mapped);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_read_batch();
+  void test_write_batch();
+  void test_write_partial();
+  void test_write_v4mapped();
+};
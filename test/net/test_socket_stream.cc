@@ -0,0 +1,496 @@
+#include "config.h"
+
+#include "test_socket_stream.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "data/chunk.h"
+#include "data/chunk_list_node.h"
+#include "data/socket_file.h"
+#include "net/socket_fd.h"
+#include "net/socket_stream.h"
+#include "net/throttle_list.h"
+#include "protocol/peer_connection_base.h"
+#include "test/helpers/test_utils.h"
+#include "torrent/data/file.h"
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(TestSocketStream, "net");
+
+namespace {
+
+constexpr uint32_t part_size = 4096;
+
+// A connected loopback TCP pair with a non-blocking sending side.
+struct loopback_pair {
+  loopback_pair();
+  ~loopback_pair();
+
+  std::string         receive(uint32_t length);
+
+  int                 send_fd{-1};
+  int                 recv_fd{-1};
+};
+
+loopback_pair::loopback_pair() {
+  int listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t sa_length = sizeof(sa);
+
+  CPPUNIT_ASSERT(::bind(listen_fd, reinterpret_cast<sockaddr*>(&sa), sa_length) == 0);
+  CPPUNIT_ASSERT(::listen(listen_fd, 1) == 0);
+  CPPUNIT_ASSERT(::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&sa), &sa_length) == 0);
+
+  send_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+  CPPUNIT_ASSERT(::connect(send_fd, reinterpret_cast<sockaddr*>(&sa), sa_length) == 0);
+  CPPUNIT_ASSERT((recv_fd = ::accept(listen_fd, nullptr, nullptr)) != -1);
+  CPPUNIT_ASSERT(::fcntl(send_fd, F_SETFL, O_NONBLOCK) == 0);
+
+  ::close(listen_fd);
+
+  timeval timeout{1, 0};
+  ::setsockopt(recv_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+loopback_pair::~loopback_pair() {
+  ::close(send_fd);
+  ::close(recv_fd);
+}
+
+std::string
+loopback_pair::receive(uint32_t length) {
+  std::string data(length, '\0');
+  uint32_t done = 0;
+
+  while (done != length) {
+    ssize_t r = ::recv(recv_fd, &data[done], length - done, 0);
+
+    if (r <= 0)
+      break;
+
+    done += r;
+  }
+
+  data.resize(done);
+  return data;
+}
+
+class test_stream : public torrent::SocketStream {
+public:
+  test_stream(int fd) { set_fd(torrent::SocketFd(fd)); }
+  ~test_stream() override { set_fd(torrent::SocketFd()); }
+
+  void event_read() override {}
+  void event_write() override {}
+  void event_error() override {}
+};
+
+// An unlinked temporary file of 'size' bytes, all 'value'.
+int
+create_file(uint32_t size, char value) {
+  char path[] = "/tmp/libtorrent_test_socket_stream.XXXXXX";
+  int fd = ::mkstemp(path);
+
+  CPPUNIT_ASSERT(fd != -1);
+  ::unlink(path);
+
+  std::string data(size, value);
+  CPPUNIT_ASSERT(::pwrite(fd, data.data(), data.size(), 0) == static_cast<ssize_t>(data.size()));
+
+  return fd;
+}
+
+std::string
+file_data(int fd, uint64_t offset, uint32_t length) {
+  std::string data(length, '\0');
+  data.resize(std::max<ssize_t>(::pread(fd, &data[0], length, offset), 0));
+
+  return data;
+}
+
+// A connection writing to 'fd', with messages queued ahead of the
+// piece being uploaded.
+struct test_peer_connection : public torrent::PeerConnectionBase {
+  using PeerConnectionBase::write_chunk_sendfile;
+
+  test_peer_connection(int fd);
+  ~test_peer_connection() override { set_fd(torrent::SocketFd()); }
+
+  void                initialize_custom() override {}
+  void                update_interested() override {}
+  bool                receive_keepalive() override { return true; }
+
+  void                event_read() override        {}
+  void                event_write() override       {}
+
+  void                queue_messages(const std::string& messages);
+  void                set_cached_piece(const std::string& data);
+  void                set_chunk_piece(torrent::Chunk* chunk, uint32_t offset, uint32_t length);
+
+  uint32_t            buffered()                 { return m_up->buffer()->remaining(); }
+  uint32_t            gather(uint32_t length)    { return up_chunk_gather(length); }
+  bool                write_chunk()              { return up_chunk(); }
+
+  torrent::ThrottleNode* throttle_node()         { return m_peerChunks.upload_throttle(); }
+
+  torrent::ThrottleList  throttle;
+  torrent::ChunkListNode node;
+};
+
+test_peer_connection::test_peer_connection(int fd) {
+  set_fd(torrent::SocketFd(fd));
+
+  m_up->set_throttle(&throttle);
+  throttle_node()->set_list_iterator(throttle.end());
+}
+
+void
+test_peer_connection::queue_messages(const std::string& messages) {
+  CPPUNIT_ASSERT(messages.size() <= m_up->buffer()->reserved_left());
+  m_up->buffer()->write_range(messages.begin(), messages.end());
+}
+
+void
+test_peer_connection::set_cached_piece(const std::string& data) {
+  m_upCache = std::shared_ptr<char[]>(new char[data.size()]);
+  std::copy(data.begin(), data.end(), m_upCache.get());
+
+  m_upPiece = torrent::Piece(0, 0, data.size());
+}
+
+void
+test_peer_connection::set_chunk_piece(torrent::Chunk* chunk, uint32_t offset, uint32_t length) {
+  node.set_chunk(chunk);
+
+  m_upChunk = torrent::ChunkHandle(&node);
+  m_upPiece = torrent::Piece(0, offset, length);
+}
+
+// Parts are 'f' in the file and 'm' in memory, so the received data
+// shows which parts were sent from the file.
+struct test_chunk {
+  test_chunk();
+  ~test_chunk();
+
+  void                push_mapped(torrent::File* file, char value);
+
+  int                 fd;
+
+  torrent::File       file;
+  torrent::File       padding;
+  torrent::File       closed;
+
+  torrent::Chunk      chunk;
+};
+
+test_chunk::test_chunk() :
+    fd(create_file(4 * part_size, 'f')) {
+
+  file.set_file_descriptor(fd);
+  padding.set_flags(torrent::File::flag_attr_padding);
+  padding.set_file_descriptor(fd);
+
+  push_mapped(&file, 'm');
+
+  chunk.push_back(torrent::ChunkPart::MAPPED_MMAP, torrent::SocketFile::create_padding_chunk(part_size, torrent::MemoryChunk::prot_read, torrent::MemoryChunk::map_shared));
+  chunk.back().set_file(&padding, 0);
+
+  push_mapped(&closed, 'u');
+
+  chunk.push_back(torrent::ChunkPart::MAPPED_BUFFER, torrent::SocketFile(fd).create_buffer_chunk(3 * part_size, part_size, torrent::MemoryChunk::prot_read));
+  chunk.back().set_file(&file, 3 * part_size);
+  std::fill(chunk.back().chunk().begin(), chunk.back().chunk().end(), 'b');
+}
+
+test_chunk::~test_chunk() {
+  chunk.clear();
+
+  file.set_file_descriptor(-1);
+  ::close(fd);
+}
+
+void
+test_chunk::push_mapped(torrent::File* f, char value) {
+  uint64_t offset = chunk.chunk_size();
+  auto memory = torrent::SocketFile(fd).create_chunk(offset, part_size, torrent::MemoryChunk::prot_read | torrent::MemoryChunk::prot_write, MAP_PRIVATE);
+
+  CPPUNIT_ASSERT(memory.is_valid());
+  std::fill(memory.begin(), memory.end(), value);
+
+  chunk.push_back(torrent::ChunkPart::MAPPED_MMAP, memory);
+  chunk.back().set_file(f, offset);
+}
+
+} // namespace
+
+void
+TestSocketStream::test_write_file() {
+  loopback_pair pair;
+  test_stream stream(pair.send_fd);
+
+  int fd = create_file(16 << 10, 'a');
+  CPPUNIT_ASSERT(::pwrite(fd, "0123456789", 10, 1000) == 10);
+
+  CPPUNIT_ASSERT(stream.write_file_throws(fd, 1000, 5000) == 5000);
+  CPPUNIT_ASSERT(pair.receive(5000) == file_data(fd, 1000, 5000));
+
+  ::close(fd);
+}
+
+void
+TestSocketStream::test_write_file_end_of_file() {
+  loopback_pair pair;
+  test_stream stream(pair.send_fd);
+
+  int fd = create_file(4096, 'a');
+
+  // Files truncated behind our back.
+  CPPUNIT_ASSERT_THROW(stream.write_file_throws(fd, 8192, 100), torrent::storage_error);
+  CPPUNIT_ASSERT_THROW(stream.write_file_throws(fd, 0, 0), torrent::internal_error);
+
+  ::close(fd);
+}
+
+void
+TestSocketStream::test_write_file_blocked() {
+  loopback_pair pair;
+  test_stream stream(pair.send_fd);
+
+  constexpr uint32_t size = 16 << 20;
+
+  int fd = create_file(size, 'a');
+  uint64_t offset = 0;
+
+  int send_buffer = 4096;
+  ::setsockopt(pair.send_fd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+
+  // Fills the socket buffers until sendfile would block, which
+  // returns zero rather than throwing.
+  while (offset != size) {
+    uint32_t written = stream.write_file_throws(fd, offset, size - offset);
+
+    if (written == 0)
+      break;
+
+    offset += written;
+  }
+
+  CPPUNIT_ASSERT(offset != 0 && offset < size);
+  CPPUNIT_ASSERT(pair.receive(offset) == file_data(fd, 0, offset));
+
+  ::close(fd);
+}
+
+void
+TestSocketStream::test_write_chunk_sendfile() {
+  loopback_pair pair;
+  test_stream stream(pair.send_fd);
+  test_chunk c;
+
+  CPPUNIT_ASSERT(test_peer_connection::write_chunk_sendfile(&stream, &c.chunk, 0, 4 * part_size) == 4 * part_size);
+
+  // Only the mapped part of the open file is sent from the file, the
+  // padding, closed file and buffered parts are sent from memory.
+  CPPUNIT_ASSERT(pair.receive(4 * part_size) ==
+                 std::string(part_size, 'f') + std::string(part_size, '\0') + std::string(part_size, 'u') + std::string(part_size, 'b'));
+}
+
+void
+TestSocketStream::test_write_chunk_sendfile_offset() {
+  loopback_pair pair;
+  test_stream stream(pair.send_fd);
+  test_chunk c;
+
+  CPPUNIT_ASSERT(::pwrite(c.fd, "0123456789", 10, part_size / 2) == 10);
+
+  CPPUNIT_ASSERT(test_peer_connection::write_chunk_sendfile(&stream, &c.chunk, part_size / 2, 2 * part_size) == 2 * part_size);
+
+  CPPUNIT_ASSERT(pair.receive(2 * part_size) ==
+                 file_data(c.fd, part_size / 2, part_size / 2) + std::string(part_size, '\0') + std::string(part_size / 2, 'u'));
+}
+
+// Completions of zero-copy sends are read from the socket error queue
+// once the data has been acknowledged. Loopback sends are always
+// reported as copied.
+void
+TestSocketStream::test_write_zerocopy() {
+  if (!torrent::SocketStream::has_zerocopy())
+    return;
+
+  loopback_pair pair;
+  test_stream stream(pair.send_fd);
+
+  CPPUNIT_ASSERT(stream.enable_zerocopy());
+
+  std::string data;
+
+  for (char value = 'a'; value != 'd'; value++) {
+    std::string part(part_size, value);
+    bool zerocopy = false;
+
+    CPPUNIT_ASSERT(stream.write_stream_zerocopy_throws(part.data(), part.size(), &zerocopy) == part_size);
+    CPPUNIT_ASSERT(zerocopy);
+
+    data += part;
+  }
+
+  CPPUNIT_ASSERT(pair.receive(3 * part_size) == data);
+
+  std::vector<bool> completed(3, false);
+  bool all_copied = true;
+
+  auto slot = [&](uint32_t first, uint32_t last, bool copied) {
+      CPPUNIT_ASSERT(first <= last && last < completed.size());
+
+      for (uint32_t index = first; index <= last; index++) {
+        CPPUNIT_ASSERT(!completed[index]);
+        completed[index] = true;
+      }
+
+      all_copied = all_copied && copied;
+    };
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        stream.read_zerocopy_completions(slot);
+        return std::find(completed.begin(), completed.end(), false) == completed.end();
+      }));
+
+  CPPUNIT_ASSERT(all_copied);
+}
+
+// Queued messages, ending with the piece header, go out in the same
+// writev as the piece, and are charged as unthrottled.
+void
+TestSocketStream::test_write_gather() {
+  const std::string messages = std::string(5, 'h') + std::string(13, 'p');
+
+  {
+    loopback_pair pair;
+    test_peer_connection connection(pair.send_fd);
+
+    std::string data(3 * part_size, 'd');
+
+    connection.queue_messages(messages);
+    connection.set_cached_piece(data);
+
+    CPPUNIT_ASSERT(connection.gather(data.size()) == data.size());
+    CPPUNIT_ASSERT(connection.buffered() == 0);
+    CPPUNIT_ASSERT(connection.throttle.rate_added() == messages.size());
+
+    CPPUNIT_ASSERT(pair.receive(messages.size() + data.size()) == messages + data);
+  }
+
+  {
+    loopback_pair pair;
+    test_peer_connection connection(pair.send_fd);
+    test_chunk c;
+
+    connection.queue_messages(messages);
+    connection.set_chunk_piece(&c.chunk, part_size / 2, 3 * part_size);
+
+    CPPUNIT_ASSERT(connection.gather(3 * part_size) == 3 * part_size);
+    CPPUNIT_ASSERT(connection.buffered() == 0);
+
+    CPPUNIT_ASSERT(pair.receive(messages.size() + 3 * part_size) ==
+                   messages + std::string(part_size / 2, 'm') + std::string(part_size, '\0') + std::string(part_size, 'u') + std::string(part_size / 2, 'b'));
+  }
+}
+
+// A write ending inside the queued messages sends none of the piece,
+// and the rest of the messages go out ahead of it on the next write.
+//
+// A pipe write first tops up the last partially filled page with the
+// write size modulo the page size, if it fits, and returns that when
+// the pipe is otherwise full.
+void
+TestSocketStream::test_write_gather_partial() {
+  uint32_t page_size = ::sysconf(_SC_PAGESIZE);
+
+  int fds[2];
+  CPPUNIT_ASSERT(::pipe2(fds, O_NONBLOCK) == 0);
+  CPPUNIT_ASSERT(::fcntl(fds[1], F_SETPIPE_SZ, page_size) == static_cast<int>(page_size));
+
+  std::string fill(page_size - 100, 'x');
+  CPPUNIT_ASSERT(::write(fds[1], fill.data(), fill.size()) == static_cast<ssize_t>(fill.size()));
+
+  std::string messages;
+
+  for (int i = 0; i < 300; i++)
+    messages += 'a' + i % 26;
+
+  std::string data(page_size + 50 - messages.size(), 'd');
+
+  test_peer_connection connection(fds[1]);
+
+  connection.queue_messages(messages);
+  connection.set_cached_piece(data);
+
+  CPPUNIT_ASSERT(connection.gather(data.size()) == 0);
+  CPPUNIT_ASSERT(connection.buffered() == messages.size() - 50);
+  CPPUNIT_ASSERT(connection.throttle.rate_added() == 50);
+
+  std::string received(2 * page_size, '\0');
+  received.resize(std::max<ssize_t>(::read(fds[0], &received[0], received.size()), 0));
+
+  CPPUNIT_ASSERT(received == fill + messages.substr(0, 50));
+
+  CPPUNIT_ASSERT(connection.gather(data.size()) == data.size());
+  CPPUNIT_ASSERT(connection.buffered() == 0);
+  CPPUNIT_ASSERT(connection.throttle.rate_added() == messages.size() - 50);
+
+  received.resize(2 * page_size);
+  received.resize(std::max<ssize_t>(::read(fds[0], &received[0], received.size()), 0));
+
+  CPPUNIT_ASSERT(received == messages.substr(50) + data);
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+// Without upload quota the queued messages are still written, after
+// which the connection stops polling for writes until it gets quota.
+void
+TestSocketStream::test_write_flush_no_quota() {
+  loopback_pair pair;
+  test_peer_connection connection(pair.send_fd);
+
+  const std::string messages = std::string(5, 'h') + std::string(13, 'p');
+
+  connection.throttle.enable();
+  connection.throttle.insert(connection.throttle_node());
+
+  connection.queue_messages(messages);
+  connection.set_cached_piece(std::string(part_size, 'd'));
+
+  auto poll = torrent::this_thread::poll();
+
+  poll->open(&connection);
+  poll->insert_write(&connection);
+
+  CPPUNIT_ASSERT(!connection.write_chunk());
+  CPPUNIT_ASSERT(connection.buffered() == 0);
+
+  CPPUNIT_ASSERT(!poll->in_write(&connection));
+  CPPUNIT_ASSERT(connection.throttle.is_inactive(connection.throttle_node()));
+
+  CPPUNIT_ASSERT(pair.receive(messages.size()) == messages);
+
+  char buffer[16];
+  CPPUNIT_ASSERT(::recv(pair.recv_fd, buffer, sizeof(buffer), MSG_DONTWAIT) == -1);
+
+  connection.throttle.erase(connection.throttle_node());
+  poll->close(&connection);
+}
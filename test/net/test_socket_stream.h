@@ -0,0 +1,28 @@
+#include "helpers/test_main_thread.h"
+
+class TestSocketStream : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(TestSocketStream);
+
+  CPPUNIT_TEST(test_write_file);
+  CPPUNIT_TEST(test_write_file_end_of_file);
+  CPPUNIT_TEST(test_write_file_blocked);
+  CPPUNIT_TEST(test_write_chunk_sendfile);
+  CPPUNIT_TEST(test_write_chunk_sendfile_offset);
+  CPPUNIT_TEST(test_write_zerocopy);
+  CPPUNIT_TEST(test_write_gather);
+  CPPUNIT_TEST(test_write_gather_partial);
+  CPPUNIT_TEST(test_write_flush_no_quota);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_write_file();
+  void test_write_file_end_of_file();
+  void test_write_file_blocked();
+  void test_write_chunk_sendfile();
+  void test_write_chunk_sendfile_offset();
+  void test_write_zerocopy();
+  void test_write_gather();
+  void test_write_gather_partial();
+  void test_write_flush_no_quota();
+};
@@ -0,0 +1,638 @@
+#include "config.h"
+
+#include "test_utp.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "helpers/mock_function.h"
+#include "net/utp_context.h"
+#include "net/utp_socket.h"
+#include "torrent/net/fd.h"
+#include "torrent/net/socket_address.h"
+#include "torrent/poll.h"
+#include "torrent/utils/chrono.h"
+#include "torrent/utils/random.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(TestUtp, "net");
+
+using torrent::UtpContext;
+using torrent::UtpSocket;
+
+namespace {
+
+uint64_t
+now_usec() {
+  return torrent::utils::time_since_epoch().count();
+}
+
+torrent::sa_unique_ptr
+bound_address(int fd) {
+  sockaddr_storage ss{};
+  socklen_t length = sizeof(ss);
+
+  CPPUNIT_ASSERT(::getsockname(fd, reinterpret_cast<sockaddr*>(&ss), &length) == 0);
+  return torrent::sa_copy(reinterpret_cast<sockaddr*>(&ss));
+}
+
+void
+open_loopback(UtpContext& context) {
+  auto sa = torrent::sa_make_inet_h(INADDR_LOOPBACK, 0);
+
+  CPPUNIT_ASSERT(context.open(sa.get()));
+}
+
+const UtpSocket*
+first_socket(const UtpContext& context) {
+  return context.sockets().empty() ? nullptr : context.sockets().begin()->second.get();
+}
+
+// Forwards datagrams between a single client and 'server', optionally
+// dropping, rewriting or delaying those sent to the server.
+class UtpRelay {
+public:
+  using drop_type    = std::function<bool(const char*, uint32_t)>;
+  using rewrite_type = std::function<void(std::string&)>;
+
+  UtpRelay(const sockaddr* server);
+  ~UtpRelay();
+
+  const sockaddr*     address() const                 { return m_address.get(); }
+
+  drop_type&          drop_to_server()                { return m_drop_to_server; }
+  rewrite_type&       rewrite_to_server()             { return m_rewrite_to_server; }
+  void                set_delay_to_server(uint64_t t) { m_delay_to_server = t; }
+
+  unsigned int        dropped() const                 { return m_dropped; }
+  unsigned int        sacks_to_client() const         { return m_sacks_to_client; }
+
+  void                pump();
+
+private:
+  struct packet_type {
+    uint64_t    release;
+    std::string data;
+  };
+
+  int                     m_client_fd;
+  int                     m_server_fd;
+
+  torrent::sa_unique_ptr  m_address;
+  torrent::sa_unique_ptr  m_server;
+  sockaddr_storage        m_client{};
+
+  drop_type               m_drop_to_server;
+  rewrite_type            m_rewrite_to_server;
+  uint64_t                m_delay_to_server{0};
+  std::deque<packet_type> m_queue;
+
+  unsigned int            m_dropped{0};
+  unsigned int            m_sacks_to_client{0};
+};
+
+UtpRelay::UtpRelay(const sockaddr* server) :
+    m_client_fd(::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)),
+    m_server_fd(::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)),
+    m_server(torrent::sa_copy(server)) {
+  auto sa = torrent::sa_make_inet_h(INADDR_LOOPBACK, 0);
+
+  CPPUNIT_ASSERT(::bind(m_client_fd, sa.get(), torrent::sa_length(sa.get())) == 0);
+  CPPUNIT_ASSERT(::bind(m_server_fd, sa.get(), torrent::sa_length(sa.get())) == 0);
+
+  m_address = bound_address(m_client_fd);
+}
+
+UtpRelay::~UtpRelay() {
+  ::close(m_client_fd);
+  ::close(m_server_fd);
+}
+
+void
+UtpRelay::pump() {
+  char buffer[4096];
+  uint64_t now = now_usec();
+
+  while (true) {
+    socklen_t length = sizeof(m_client);
+    auto size = ::recvfrom(m_client_fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&m_client), &length);
+
+    if (size <= 0)
+      break;
+
+    if (m_drop_to_server && m_drop_to_server(buffer, size)) {
+      m_dropped++;
+      continue;
+    }
+
+    m_queue.push_back(packet_type{now + m_delay_to_server, std::string(buffer, size)});
+
+    if (m_rewrite_to_server)
+      m_rewrite_to_server(m_queue.back().data);
+  }
+
+  while (true) {
+    auto size = ::recv(m_server_fd, buffer, sizeof(buffer), 0);
+
+    if (size <= 0)
+      break;
+
+    if (size >= UtpSocket::header_size &&
+        (buffer[0] >> 4) == UtpSocket::ST_STATE && buffer[1] == UtpSocket::extension_sack)
+      m_sacks_to_client++;
+
+    ::sendto(m_client_fd, buffer, size, 0, reinterpret_cast<sockaddr*>(&m_client), sizeof(sockaddr_in));
+  }
+
+  while (!m_queue.empty() && m_queue.front().release <= now) {
+    auto& packet = m_queue.front();
+
+    ::sendto(m_server_fd, packet.data.data(), packet.data.size(), 0, m_server.get(), torrent::sa_length(m_server.get()));
+    m_queue.pop_front();
+  }
+}
+
+// Open file descriptors of the process.
+unsigned int
+count_open_fds() {
+  DIR* dir = ::opendir("/proc/self/fd");
+  CPPUNIT_ASSERT(dir != nullptr);
+
+  unsigned int count = 0;
+
+  while (auto entry = ::readdir(dir))
+    if (entry->d_name[0] != '.')
+      count++;
+
+  ::closedir(dir);
+
+  // Not counting the descriptor of 'dir' itself.
+  return count - 1;
+}
+
+// Reads until end-of-file or an error, returning false if the
+// connection is still open.
+bool
+read_closed(int fd) {
+  char buffer[16384];
+
+  while (true) {
+    auto size = ::read(fd, buffer, sizeof(buffer));
+
+    if (size == 0 || (size == -1 && errno != EAGAIN && errno != EINTR))
+      return true;
+
+    if (size == -1)
+      return false;
+  }
+}
+
+// Writes a pattern to one end of a connection and checks it is read
+// unchanged from the other.
+class UtpStream {
+public:
+  UtpStream(int out, int in, uint32_t size) : m_out(out), m_in(in), m_size(size) {}
+
+  bool                is_done() const  { return m_read == m_size; }
+  bool                is_valid() const { return m_valid; }
+
+  void                pump();
+
+private:
+  static char         pattern(uint32_t position) { return position * 7 % 251; }
+
+  int                 m_out;
+  int                 m_in;
+  uint32_t            m_size;
+  uint32_t            m_written{0};
+  uint32_t            m_read{0};
+  bool                m_valid{true};
+};
+
+void
+UtpStream::pump() {
+  char buffer[16384];
+
+  while (m_written != m_size) {
+    uint32_t length = std::min<uint32_t>(sizeof(buffer), m_size - m_written);
+
+    for (uint32_t i = 0; i < length; i++)
+      buffer[i] = pattern(m_written + i);
+
+    auto size = ::write(m_out, buffer, length);
+
+    if (size <= 0)
+      break;
+
+    m_written += size;
+  }
+
+  while (true) {
+    auto size = ::read(m_in, buffer, sizeof(buffer));
+
+    if (size <= 0)
+      break;
+
+    for (ssize_t i = 0; i < size; i++)
+      m_valid = m_valid && buffer[i] == pattern(m_read + i);
+
+    m_read += size;
+  }
+}
+
+bool
+run_until(TestMainThread* thread, const std::function<bool()>& done, UtpRelay* relay = nullptr, uint64_t timeout = 10000000) {
+  uint64_t start = now_usec();
+  uint64_t last = start;
+
+  while (!done()) {
+    uint64_t now = now_usec();
+
+    if (now - start > timeout)
+      return false;
+
+    torrent::this_thread::poll()->do_poll(1000);
+
+    if (relay != nullptr)
+      relay->pump();
+
+    now = now_usec();
+
+    thread->test_add_cached_time(std::chrono::microseconds(now - last));
+    thread->test_process_events_without_cached_time();
+
+    last = now;
+  }
+
+  return true;
+}
+
+// Opens 'server' and 'client', connecting them directly or through
+// 'relay', and returns our ends of the connection.
+struct utp_pair {
+  int client_fd{-1};
+  int server_fd{-1};
+};
+
+utp_pair
+connect_pair(TestMainThread* thread, UtpContext& server, UtpContext& client, const sockaddr* server_address, UtpRelay* relay = nullptr) {
+  utp_pair pair;
+
+  server.slot_accepted() = [&pair](int fd, const sockaddr*) { pair.server_fd = fd; };
+
+  pair.client_fd = client.connect(relay != nullptr ? relay->address() : server_address);
+  CPPUNIT_ASSERT(pair.client_fd != -1);
+
+  CPPUNIT_ASSERT(run_until(thread, [&] {
+      return pair.server_fd != -1 && first_socket(client)->state() == UtpSocket::STATE_CONNECTED;
+    }, relay));
+
+  return pair;
+}
+
+}
+
+void
+TestUtp::setUp() {
+  TestFixtureWithMainThread::setUp();
+
+  mock_redirect(torrent::fd__bind, std::function<int(int, const sockaddr*, socklen_t)>([](int socket, const sockaddr* address, socklen_t address_len) {
+        return ::bind(socket, address, address_len);
+      }));
+
+  // Connection ids and initial sequence numbers.
+  uint16_t next_random = 1000;
+
+  mock_redirect(torrent::random_uniform_uint16, std::function<uint16_t(uint16_t, uint16_t)>([next_random](uint16_t, uint16_t) mutable {
+        return next_random += 1009;
+      }));
+}
+
+void
+TestUtp::test_handshake() {
+  UtpContext server;
+  UtpContext client;
+
+  open_loopback(server);
+  open_loopback(client);
+
+  auto server_address = bound_address(server.file_descriptor());
+  auto pair = connect_pair(m_main_thread.get(), server, client, server_address.get());
+
+  CPPUNIT_ASSERT(server.size() == 1 && server.bridge_count() == 1);
+  CPPUNIT_ASSERT(client.size() == 1 && client.bridge_count() == 1);
+  CPPUNIT_ASSERT(first_socket(server)->state() == UtpSocket::STATE_CONNECTED);
+
+  // Closing both local ends exchanges FINs and forgets the connection.
+  ::close(pair.client_fd);
+  ::close(pair.server_fd);
+
+  CPPUNIT_ASSERT(run_until(m_main_thread.get(), [&] { return server.size() == 0 && client.size() == 0; }));
+  CPPUNIT_ASSERT(server.bridge_count() == 0 && client.bridge_count() == 0);
+}
+
+void
+TestUtp::test_accept_filter() {
+  UtpContext server;
+  UtpContext client;
+
+  open_loopback(server);
+  open_loopback(client);
+
+  auto server_address = bound_address(server.file_descriptor());
+
+  int filtered = 0;
+  int accepted = 0;
+  int failed_fd = -1;
+
+  server.slot_accept_filter() = [&filtered](const sockaddr*) { filtered++; return false; };
+  server.slot_accepted() = [&accepted](int fd, const sockaddr*) { accepted++; ::close(fd); };
+  client.slot_connect_failed() = [&failed_fd](int fd) { failed_fd = fd; };
+
+  int fd = client.connect(server_address.get());
+  CPPUNIT_ASSERT(fd != -1);
+
+  // The reset makes the client give up without waiting for timeouts.
+  CPPUNIT_ASSERT(run_until(m_main_thread.get(), [&] { return failed_fd != -1; }, nullptr, 1000000));
+
+  CPPUNIT_ASSERT(failed_fd == fd);
+  CPPUNIT_ASSERT(filtered == 1);
+  CPPUNIT_ASSERT(accepted == 0);
+  CPPUNIT_ASSERT(server.size() == 0 && server.bridge_count() == 0);
+  CPPUNIT_ASSERT(client.size() == 0 && client.bridge_count() == 0);
+
+  ::close(fd);
+}
+
+void
+TestUtp::test_transfer() {
+  UtpContext server;
+  UtpContext client;
+
+  open_loopback(server);
+  open_loopback(client);
+
+  auto server_address = bound_address(server.file_descriptor());
+  auto pair = connect_pair(m_main_thread.get(), server, client, server_address.get());
+
+  UtpStream upload(pair.client_fd, pair.server_fd, 4 << 20);
+  UtpStream download(pair.server_fd, pair.client_fd, 1 << 20);
+
+  CPPUNIT_ASSERT(run_until(m_main_thread.get(), [&] {
+      upload.pump();
+      download.pump();
+      return upload.is_done() && download.is_done();
+    }));
+
+  CPPUNIT_ASSERT(upload.is_valid());
+  CPPUNIT_ASSERT(download.is_valid());
+
+  ::close(pair.client_fd);
+  ::close(pair.server_fd);
+}
+
+// Dropped data packets are reported by selective acks and resent
+// without losing or reordering the stream.
+void
+TestUtp::test_transfer_loss() {
+  UtpContext server;
+  UtpContext client;
+
+  open_loopback(server);
+  open_loopback(client);
+
+  auto server_address = bound_address(server.file_descriptor());
+
+  UtpRelay relay(server_address.get());
+  unsigned int data_packets = 0;
+
+  relay.drop_to_server() = [&data_packets](const char* data, uint32_t) {
+      return (data[0] >> 4) == UtpSocket::ST_DATA && ++data_packets % 20 == 0;
+    };
+
+  auto pair = connect_pair(m_main_thread.get(), server, client, server_address.get(), &relay);
+
+  UtpStream upload(pair.client_fd, pair.server_fd, 1 << 20);
+
+  CPPUNIT_ASSERT(run_until(m_main_thread.get(), [&] {
+      upload.pump();
+      return upload.is_done();
+    }, &relay));
+
+  CPPUNIT_ASSERT(upload.is_valid());
+  CPPUNIT_ASSERT(relay.dropped() != 0);
+  CPPUNIT_ASSERT(relay.sacks_to_client() != 0);
+
+  ::close(pair.client_fd);
+  ::close(pair.server_fd);
+}
+
+// Data packets carrying extensions deliver only the payload after the
+// chain, and packets with a truncated chain are dropped and resent.
+void
+TestUtp::test_data_extensions() {
+  UtpContext server;
+  UtpContext client;
+
+  open_loopback(server);
+  open_loopback(client);
+
+  auto server_address = bound_address(server.file_descriptor());
+
+  UtpRelay relay(server_address.get());
+  unsigned int data_packets = 0;
+  unsigned int truncated = 0;
+
+  relay.rewrite_to_server() = [&](std::string& packet) {
+      if ((packet[0] >> 4) != UtpSocket::ST_DATA || packet.size() <= UtpSocket::header_size)
+        return;
+
+      // An empty selective ack ahead of the existing chain.
+      char sack[] = { packet[1], 4, 0, 0, 0, 0 };
+
+      packet.insert(UtpSocket::header_size, sack, sizeof(sack));
+      packet[1] = UtpSocket::extension_sack;
+
+      if (++data_packets % 10 != 0)
+        return;
+
+      // Cut short inside an extension following the selective ack.
+      char overrun[] = { 0, static_cast<char>(0xff) };
+
+      packet[UtpSocket::header_size] = 2;
+      packet.insert(UtpSocket::header_size + sizeof(sack), overrun, sizeof(overrun));
+      packet.resize(std::min<size_t>(packet.size(), UtpSocket::header_size + sizeof(sack) + sizeof(overrun) + 16));
+      truncated++;
+    };
+
+  auto pair = connect_pair(m_main_thread.get(), server, client, server_address.get(), &relay);
+
+  UtpStream upload(pair.client_fd, pair.server_fd, 256 << 10);
+
+  CPPUNIT_ASSERT(run_until(m_main_thread.get(), [&] {
+      upload.pump();
+      return upload.is_done();
+    }, &relay));
+
+  CPPUNIT_ASSERT(upload.is_valid());
+  CPPUNIT_ASSERT(truncated != 0);
+
+  ::close(pair.client_fd);
+  ::close(pair.server_fd);
+}
+
+// The window grows while the path adds no delay, and shrinks once the
+// queuing delay exceeds the target.
+void
+TestUtp::test_ledbat() {
+  UtpContext server;
+  UtpContext client;
+
+  open_loopback(server);
+  open_loopback(client);
+
+  auto server_address = bound_address(server.file_descriptor());
+
+  UtpRelay relay(server_address.get());
+
+  auto pair = connect_pair(m_main_thread.get(), server, client, server_address.get(), &relay);
+  auto socket = first_socket(client);
+
+  UtpStream upload(pair.client_fd, pair.server_fd, 256 << 20);
+
+  run_until(m_main_thread.get(), [&] { upload.pump(); return false; }, &relay, 300000);
+
+  uint32_t grown_cwnd = socket->cwnd();
+
+  CPPUNIT_ASSERT(grown_cwnd > UtpSocket::min_cwnd);
+
+  relay.set_delay_to_server(3 * UtpSocket::target_delay);
+
+  run_until(m_main_thread.get(), [&] { upload.pump(); return false; }, &relay, 2000000);
+
+  CPPUNIT_ASSERT(socket->cwnd() < grown_cwnd);
+  CPPUNIT_ASSERT(upload.is_valid());
+
+  ::close(pair.client_fd);
+  ::close(pair.server_fd);
+}
+
+// Each connection holds one end of a local socket pair in the context
+// and hands the other to the caller, and both are released once the
+// connection is gone.
+void
+TestUtp::test_bridge_fds() {
+  UtpContext server;
+  UtpContext client;
+
+  open_loopback(server);
+  open_loopback(client);
+
+  auto server_address = bound_address(server.file_descriptor());
+  auto baseline = count_open_fds();
+
+  std::vector<utp_pair> pairs;
+
+  for (int i = 0; i < 8; i++)
+    pairs.push_back(connect_pair(m_main_thread.get(), server, client, server_address.get()));
+
+  CPPUNIT_ASSERT(server.size() == 8 && server.bridge_count() == 8);
+  CPPUNIT_ASSERT(client.size() == 8 && client.bridge_count() == 8);
+  CPPUNIT_ASSERT(count_open_fds() == baseline + 8 * 4);
+
+  for (auto& pair : pairs) {
+    ::close(pair.client_fd);
+    ::close(pair.server_fd);
+  }
+
+  CPPUNIT_ASSERT(run_until(m_main_thread.get(), [&] { return server.size() == 0 && client.size() == 0; }));
+  CPPUNIT_ASSERT(server.bridge_count() == 0 && client.bridge_count() == 0);
+  CPPUNIT_ASSERT(count_open_fds() == baseline);
+}
+
+// Connections torn down with data queued in both directions, in the
+// local socket pairs and in the uTP buffers, release their bridges on
+// both sides without leaking descriptors.
+void
+TestUtp::test_teardown_under_load() {
+  UtpContext server;
+  UtpContext client;
+
+  // Closing the contexts also closes their UDP sockets.
+  auto baseline = count_open_fds();
+
+  open_loopback(server);
+  open_loopback(client);
+
+  auto server_address = bound_address(server.file_descriptor());
+
+  std::vector<utp_pair> pairs;
+  std::vector<std::unique_ptr<UtpStream>> streams;
+
+  for (int i = 0; i < 4; i++) {
+    auto pair = connect_pair(m_main_thread.get(), server, client, server_address.get());
+
+    pairs.push_back(pair);
+    streams.push_back(std::make_unique<UtpStream>(pair.client_fd, pair.server_fd, 256 << 20));
+    streams.push_back(std::make_unique<UtpStream>(pair.server_fd, pair.client_fd, 256 << 20));
+  }
+
+  auto pump_from = [&](unsigned int first) {
+      for (unsigned int i = first * 2; i != streams.size(); i++)
+        streams[i]->pump();
+    };
+
+  run_until(m_main_thread.get(), [&] { pump_from(0); return false; }, nullptr, 200000);
+
+  // Both ends of the first connection are closed at once.
+  ::close(pairs[0].client_fd);
+  ::close(pairs[0].server_fd);
+
+  // Only the client end of the second, the server end sees the
+  // connection close while still sending. The client's reset may be
+  // dropped when the UDP socket is busy, after which the reply to the
+  // next data packet closes the connection.
+  ::close(pairs[1].client_fd);
+
+  CPPUNIT_ASSERT(run_until(m_main_thread.get(), [&] {
+      pump_from(2);
+      ::send(pairs[1].server_fd, "x", 1, MSG_NOSIGNAL);
+      return read_closed(pairs[1].server_fd);
+    }));
+
+  ::close(pairs[1].server_fd);
+
+  CPPUNIT_ASSERT(run_until(m_main_thread.get(), [&] {
+      pump_from(2);
+      return server.size() == 2 && client.size() == 2;
+    }));
+
+  CPPUNIT_ASSERT(server.bridge_count() == 2 && client.bridge_count() == 2);
+
+  // Closing a context drops the remaining connections and closes its
+  // ends at once, which the caller sees as end-of-file.
+  client.close();
+
+  CPPUNIT_ASSERT(client.size() == 0 && client.bridge_count() == 0);
+  CPPUNIT_ASSERT(read_closed(pairs[2].client_fd) && read_closed(pairs[3].client_fd));
+
+  server.close();
+
+  CPPUNIT_ASSERT(server.size() == 0 && server.bridge_count() == 0);
+  CPPUNIT_ASSERT(read_closed(pairs[2].server_fd) && read_closed(pairs[3].server_fd));
+
+  for (int i = 2; i < 4; i++) {
+    ::close(pairs[i].client_fd);
+    ::close(pairs[i].server_fd);
+  }
+
+  CPPUNIT_ASSERT(count_open_fds() == baseline);
+}
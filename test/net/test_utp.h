@@ -0,0 +1,28 @@
+#include "helpers/test_main_thread.h"
+
+class TestUtp : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(TestUtp);
+
+  CPPUNIT_TEST(test_handshake);
+  CPPUNIT_TEST(test_accept_filter);
+  CPPUNIT_TEST(test_transfer);
+  CPPUNIT_TEST(test_transfer_loss);
+  CPPUNIT_TEST(test_data_extensions);
+  CPPUNIT_TEST(test_ledbat);
+  CPPUNIT_TEST(test_bridge_fds);
+  CPPUNIT_TEST(test_teardown_under_load);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() override;
+
+  void test_handshake();
+  void test_accept_filter();
+  void test_transfer();
+  void test_transfer_loss();
+  void test_data_extensions();
+  void test_ledbat();
+  void test_bridge_fds();
+  void test_teardown_under_load();
+};
@@ -0,0 +1,262 @@
+#include "config.h"
+
+#include "test/protocol/test_peer_chunks.h"
+
+#include <memory>
+
+#include "download/chunk_statistics.h"
+#include "protocol/peer_chunks.h"
+#include "torrent/bitfield.h"
+#include "utils/instrumentation.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPeerChunks);
+
+using torrent::Bitfield;
+using torrent::PeerChunks;
+
+static constexpr uint32_t chunk_count = 100;
+
+static void
+make_bitfield(Bitfield* bitfield, uint32_t size, bool all_set) {
+  bitfield->set_size_bits(size);
+  bitfield->allocate();
+
+  if (all_set)
+    bitfield->set_all();
+  else
+    bitfield->unset_all();
+}
+
+static int64_t
+instrumentation_value(torrent::instrumentation_enum type) {
+  return torrent::instrumentation_values[type].load();
+}
+
+void
+TestPeerChunks::test_share_on_connect() {
+  Bitfield seed;
+  Bitfield bitfield;
+  PeerChunks peer_chunks;
+
+  make_bitfield(&seed, chunk_count, true);
+  make_bitfield(&bitfield, chunk_count, true);
+
+  peer_chunks.set_bitfield(&bitfield, &seed);
+
+  CPPUNIT_ASSERT(peer_chunks.is_bitfield_shared());
+  CPPUNIT_ASSERT(peer_chunks.is_seeder());
+  CPPUNIT_ASSERT(peer_chunks.bitfield() == &seed);
+
+  // The peer's copy is released rather than kept alongside the seed
+  // bitfield.
+  CPPUNIT_ASSERT(bitfield.empty());
+
+  // Already set chunks don't unshare.
+  peer_chunks.set_chunk(0);
+  peer_chunks.set_chunk(chunk_count - 1);
+
+  CPPUNIT_ASSERT(peer_chunks.is_bitfield_shared());
+}
+
+void
+TestPeerChunks::test_share_on_last_have() {
+  Bitfield seed;
+  Bitfield bitfield;
+  PeerChunks peer_chunks;
+
+  make_bitfield(&seed, chunk_count, true);
+  make_bitfield(&bitfield, chunk_count, false);
+  bitfield.set_range(0, chunk_count / 2);
+
+  peer_chunks.set_bitfield(&bitfield, &seed);
+
+  CPPUNIT_ASSERT(!peer_chunks.is_bitfield_shared());
+  CPPUNIT_ASSERT(peer_chunks.bitfield() != &seed);
+  CPPUNIT_ASSERT(peer_chunks.bitfield()->size_set() == chunk_count / 2);
+
+  for (uint32_t index = chunk_count / 2; index < chunk_count - 1; index++) {
+    peer_chunks.set_chunk(index);
+
+    CPPUNIT_ASSERT(!peer_chunks.is_bitfield_shared());
+    CPPUNIT_ASSERT(peer_chunks.bitfield()->get(index));
+  }
+
+  peer_chunks.set_chunk(chunk_count - 1);
+
+  CPPUNIT_ASSERT(peer_chunks.is_bitfield_shared());
+  CPPUNIT_ASSERT(peer_chunks.is_seeder());
+  CPPUNIT_ASSERT(peer_chunks.bitfield() == &seed);
+}
+
+void
+TestPeerChunks::test_share_statistics() {
+  Bitfield seed;
+  Bitfield bitfield;
+  PeerChunks peer_chunks;
+  torrent::ChunkStatistics statistics;
+
+  statistics.initialize(chunk_count);
+
+  make_bitfield(&seed, chunk_count, true);
+  make_bitfield(&bitfield, chunk_count, false);
+  bitfield.set_range(0, chunk_count - 2);
+
+  peer_chunks.set_bitfield(&bitfield, &seed);
+  statistics.received_connect(&peer_chunks);
+
+  CPPUNIT_ASSERT(statistics.accounted() == 1);
+  CPPUNIT_ASSERT(statistics.complete() == 0);
+
+  statistics.received_have_chunk(&peer_chunks, chunk_count - 2, 1 << 14);
+  CPPUNIT_ASSERT(!peer_chunks.is_bitfield_shared());
+
+  // The HAVE completing the bitfield turns the peer into a seeder
+  // sharing the seed bitfield.
+  statistics.received_have_chunk(&peer_chunks, chunk_count - 1, 1 << 14);
+
+  CPPUNIT_ASSERT(peer_chunks.is_bitfield_shared());
+  CPPUNIT_ASSERT(statistics.accounted() == 0);
+  CPPUNIT_ASSERT(statistics.complete() == 1);
+
+  for (uint32_t index = 0; index < chunk_count; index++)
+    CPPUNIT_ASSERT(statistics.rarity(index) == 0);
+
+  statistics.received_disconnect(&peer_chunks);
+
+  CPPUNIT_ASSERT(statistics.complete() == 0);
+  CPPUNIT_ASSERT(!peer_chunks.using_counter());
+
+  statistics.clear();
+}
+
+void
+TestPeerChunks::test_mutable_copy() {
+  Bitfield seed;
+  Bitfield bitfield;
+  PeerChunks peer_chunks;
+
+  make_bitfield(&seed, chunk_count, true);
+  make_bitfield(&bitfield, chunk_count, true);
+
+  peer_chunks.set_bitfield(&bitfield, &seed);
+  CPPUNIT_ASSERT(peer_chunks.is_bitfield_shared());
+
+  Bitfield* copy = peer_chunks.mutable_bitfield();
+
+  CPPUNIT_ASSERT(!peer_chunks.is_bitfield_shared());
+  CPPUNIT_ASSERT(copy != &seed);
+  CPPUNIT_ASSERT(peer_chunks.bitfield() == copy);
+  CPPUNIT_ASSERT(copy->size_bits() == chunk_count);
+  CPPUNIT_ASSERT(copy->is_all_set());
+
+  // Writes to the private copy never reach the seed bitfield.
+  copy->unset(7);
+
+  CPPUNIT_ASSERT(!peer_chunks.bitfield()->get(7));
+  CPPUNIT_ASSERT(!peer_chunks.is_seeder());
+  CPPUNIT_ASSERT(seed.get(7));
+  CPPUNIT_ASSERT(seed.is_all_set());
+
+  CPPUNIT_ASSERT(peer_chunks.mutable_bitfield() == copy);
+
+  peer_chunks.set_chunk(7);
+
+  CPPUNIT_ASSERT(peer_chunks.is_bitfield_shared());
+  CPPUNIT_ASSERT(peer_chunks.bitfield() == &seed);
+}
+
+void
+TestPeerChunks::test_size_mismatch() {
+  Bitfield seed;
+
+  make_bitfield(&seed, chunk_count, true);
+
+  // The bitfield faked for meta-data downloads has a single bit.
+  {
+    Bitfield bitfield;
+    PeerChunks peer_chunks;
+
+    make_bitfield(&bitfield, 1, true);
+    peer_chunks.set_bitfield(&bitfield, &seed);
+
+    CPPUNIT_ASSERT(!peer_chunks.is_bitfield_shared());
+    CPPUNIT_ASSERT(peer_chunks.is_seeder());
+    CPPUNIT_ASSERT(peer_chunks.bitfield()->size_bits() == 1);
+  }
+
+  {
+    Bitfield bitfield;
+    PeerChunks peer_chunks;
+
+    make_bitfield(&bitfield, chunk_count + 8, false);
+    bitfield.set_range(0, chunk_count + 7);
+    peer_chunks.set_bitfield(&bitfield, &seed);
+    peer_chunks.set_chunk(chunk_count + 7);
+
+    CPPUNIT_ASSERT(!peer_chunks.is_bitfield_shared());
+    CPPUNIT_ASSERT(peer_chunks.is_seeder());
+  }
+
+  // Without a seed bitfield nothing is shared.
+  {
+    Bitfield bitfield;
+    PeerChunks peer_chunks;
+
+    make_bitfield(&bitfield, chunk_count, true);
+    peer_chunks.set_bitfield(&bitfield, nullptr);
+
+    CPPUNIT_ASSERT(!peer_chunks.is_bitfield_shared());
+    CPPUNIT_ASSERT(peer_chunks.is_seeder());
+  }
+}
+
+void
+TestPeerChunks::test_instrumentation() {
+  Bitfield seed;
+
+  make_bitfield(&seed, chunk_count, true);
+
+  // Only the shared counter is checked, as Bitfield allocations are
+  // counted inside the library.
+  int64_t shared = instrumentation_value(torrent::INSTRUMENTATION_MEMORY_BITFIELDS_SHARED);
+
+  {
+    Bitfield bitfield;
+    auto peer_chunks = std::make_unique<PeerChunks>();
+
+    make_bitfield(&bitfield, chunk_count, true);
+    peer_chunks->set_bitfield(&bitfield, &seed);
+
+#ifdef LT_INSTRUMENTATION
+    CPPUNIT_ASSERT(instrumentation_value(torrent::INSTRUMENTATION_MEMORY_BITFIELDS_SHARED) == shared + seed.size_bytes());
+#endif
+
+    peer_chunks->mutable_bitfield();
+
+#ifdef LT_INSTRUMENTATION
+    CPPUNIT_ASSERT(instrumentation_value(torrent::INSTRUMENTATION_MEMORY_BITFIELDS_SHARED) == shared);
+#endif
+
+    peer_chunks->mutable_bitfield()->unset(0);
+    peer_chunks->set_chunk(0);
+
+    CPPUNIT_ASSERT(peer_chunks->is_bitfield_shared());
+#ifdef LT_INSTRUMENTATION
+    CPPUNIT_ASSERT(instrumentation_value(torrent::INSTRUMENTATION_MEMORY_BITFIELDS_SHARED) == shared + seed.size_bytes());
+#endif
+
+    // Destroying a sharing PeerChunks gives back its shared bytes.
+    peer_chunks.reset();
+
+    CPPUNIT_ASSERT(instrumentation_value(torrent::INSTRUMENTATION_MEMORY_BITFIELDS_SHARED) == shared);
+
+    // A private bitfield isn't counted as shared.
+    peer_chunks = std::make_unique<PeerChunks>();
+    make_bitfield(&bitfield, chunk_count, false);
+    peer_chunks->set_bitfield(&bitfield, &seed);
+
+    CPPUNIT_ASSERT(instrumentation_value(torrent::INSTRUMENTATION_MEMORY_BITFIELDS_SHARED) == shared);
+  }
+
+  CPPUNIT_ASSERT(instrumentation_value(torrent::INSTRUMENTATION_MEMORY_BITFIELDS_SHARED) == shared);
+}
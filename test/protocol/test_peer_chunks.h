@@ -0,0 +1,22 @@
+#include "test/helpers/test_fixture.h"
+
+class TestPeerChunks : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestPeerChunks);
+
+  CPPUNIT_TEST(test_share_on_connect);
+  CPPUNIT_TEST(test_share_on_last_have);
+  CPPUNIT_TEST(test_share_statistics);
+  CPPUNIT_TEST(test_mutable_copy);
+  CPPUNIT_TEST(test_size_mismatch);
+  CPPUNIT_TEST(test_instrumentation);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_share_on_connect();
+  void test_share_on_last_have();
+  void test_share_statistics();
+  void test_mutable_copy();
+  void test_size_mismatch();
+  void test_instrumentation();
+};
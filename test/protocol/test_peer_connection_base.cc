@@ -0,0 +1,289 @@
+#include "config.h"
+
+#include "test/protocol/test_peer_connection_base.h"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "helpers/mock_function.h"
+#include "manager.h"
+#include "data/chunk.h"
+#include "data/chunk_list_node.h"
+#include "data/socket_file.h"
+#include "download/delegator.h"
+#include "download/download_main.h"
+#include "download/piece_hash_table.h"
+#include "net/socket_fd.h"
+#include "net/throttle_list.h"
+#include "protocol/peer_connection_base.h"
+#include "test/helpers/network.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/hash_string.h"
+#include "torrent/peer/peer_info.h"
+#include "torrent/utils/random.h"
+#include "utils/rc4.h"
+#include "utils/sha1.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPeerConnectionBase);
+
+namespace {
+
+constexpr uint32_t block_size = torrent::Delegator::block_size;
+constexpr uint32_t chunk_size = 2 * block_size;
+
+// The chunk is mapped in two parts split inside the second block, so
+// reading that block from the socket crosses parts.
+constexpr uint32_t part_split = block_size + 5000;
+
+const unsigned char rc4_key[] = "test_peer_connection_base";
+
+std::string
+chunk_data() {
+  std::string data(chunk_size, '\0');
+
+  for (uint32_t i = 0; i < chunk_size; i++)
+    data[i] = static_cast<char>(i * 7 + i / 251);
+
+  return data;
+}
+
+torrent::HashString
+chunk_hash(const std::string& data) {
+  torrent::Sha1 sha1;
+  torrent::HashString hash;
+
+  sha1.init();
+  sha1.update(data.data(), data.size());
+  sha1.final_c(hash.data());
+
+  return hash;
+}
+
+// A downloading connection reading from 'fd' into chunk 0, whose
+// pieces are handed out by its own Delegator.
+struct test_peer_connection : public torrent::PeerConnectionBase {
+  test_peer_connection(torrent::DownloadMain* download, int fd);
+  ~test_peer_connection() override;
+
+  void                initialize_custom() override {}
+  void                update_interested() override {}
+  bool                receive_keepalive() override { return true; }
+
+  void                event_read() override        {}
+  void                event_write() override       {}
+
+  void                set_encryption();
+
+  std::vector<const torrent::Piece*> delegate()    { return m_request_list.delegate(2); }
+
+  // Reads the piece as the PIECE message handler does, first what the
+  // header read left in the buffer and then the rest from the socket.
+  void                read_piece(const torrent::Piece& piece, const std::string& buffered);
+
+  std::string         stored_data() const;
+
+  int                           file_fd;
+  torrent::MemoryChunk          memory[2];
+  torrent::Chunk                chunk;
+  torrent::ChunkListNode        node;
+
+  torrent::Delegator            delegator;
+  std::unique_ptr<torrent::PeerInfo> info;
+  torrent::ThrottleList         throttle;
+};
+
+test_peer_connection::test_peer_connection(torrent::DownloadMain* download, int fd) {
+  char path[] = "/tmp/libtorrent_test_peer_connection_base.XXXXXX";
+
+  file_fd = ::mkstemp(path);
+  CPPUNIT_ASSERT(file_fd != -1);
+  CPPUNIT_ASSERT(::ftruncate(file_fd, chunk_size) == 0);
+  ::unlink(path);
+
+  int prot = torrent::MemoryChunk::prot_read | torrent::MemoryChunk::prot_write;
+
+  memory[0] = torrent::SocketFile(file_fd).create_chunk(0, part_split, prot, MAP_SHARED);
+  memory[1] = torrent::SocketFile(file_fd).create_chunk(part_split, chunk_size - part_split, prot, MAP_SHARED);
+  CPPUNIT_ASSERT(memory[0].is_valid() && memory[1].is_valid());
+
+  chunk.push_back(torrent::ChunkPart::MAPPED_MMAP, memory[0]);
+  chunk.push_back(torrent::ChunkPart::MAPPED_MMAP, memory[1]);
+
+  node.set_index(0);
+  node.set_chunk(&chunk);
+
+  delegator.slot_chunk_find() = [next = uint32_t{0}](auto, auto) mutable { return next++ == 0 ? 0 : ~uint32_t{0}; };
+  delegator.slot_chunk_size() = [](auto) { return chunk_size; };
+  delegator.transfer_list()->slot_canceled()  = [](auto) {};
+  delegator.transfer_list()->slot_queued()    = [](auto) {};
+  delegator.transfer_list()->slot_completed() = [](auto) {};
+  delegator.transfer_list()->slot_corrupt()   = [](auto) {};
+
+  info = std::make_unique<torrent::PeerInfo>(wrap_ai_get_first_sa("1.2.3.4", "5000").get());
+
+  m_download = download;
+  m_peerChunks.set_peer_info(info.get());
+  m_request_list.set_delegator(&delegator);
+  m_request_list.set_peer_chunks(&m_peerChunks);
+
+  m_down->set_throttle(&throttle);
+  m_peerChunks.download_throttle()->set_list_iterator(throttle.end());
+  throttle.insert(m_peerChunks.download_throttle());
+
+  set_fd(torrent::SocketFd(fd));
+}
+
+test_peer_connection::~test_peer_connection() {
+  set_fd(torrent::SocketFd());
+
+  throttle.erase(m_peerChunks.download_throttle());
+
+  m_downChunk.clear();
+  m_request_list.clear();
+  delegator.transfer_list()->clear();
+
+  chunk.clear();
+  ::close(file_fd);
+}
+
+void
+test_peer_connection::set_encryption() {
+  torrent::RC4 rc4(rc4_key, sizeof(rc4_key));
+
+  m_encryption.set_encrypt(rc4);
+  m_encryption.set_decrypt(rc4);
+}
+
+void
+test_peer_connection::read_piece(const torrent::Piece& piece, const std::string& buffered) {
+  CPPUNIT_ASSERT(m_request_list.downloading(piece));
+  m_downChunk = torrent::ChunkHandle(&node, true);
+
+  // The buffer holds data already decrypted by the message reader.
+  std::string plain = buffered;
+
+  if (is_encrypted())
+    m_encryption.decrypt(plain.data(), plain.size());
+
+  push_unread(plain.data(), plain.size());
+
+  bool finished = down_chunk_from_buffer();
+
+  m_down->buffer()->reset();
+
+  for (int i = 0; i < 100 && !finished; i++)
+    finished = down_chunk();
+
+  CPPUNIT_ASSERT(finished);
+  m_request_list.finished();
+}
+
+std::string
+test_peer_connection::stored_data() const {
+  return std::string(memory[0].begin(), memory[0].end()) + std::string(memory[1].begin(), memory[1].end());
+}
+
+// Sends the chunk's blocks as the payload of PIECE messages, with the
+// first 'buffered' bytes of each handed to the connection's buffer.
+void
+read_chunk(test_peer_connection& connection, int fd, const std::string& data, uint32_t buffered, bool encrypted) {
+  std::string stream = data;
+
+  if (encrypted)
+    torrent::RC4(rc4_key, sizeof(rc4_key)).crypt(stream.data(), stream.size());
+
+  auto pieces = connection.delegate();
+  CPPUNIT_ASSERT(pieces.size() == 2);
+
+  for (auto piece : pieces) {
+    CPPUNIT_ASSERT(piece->index() == 0 && piece->length() == block_size);
+
+    std::string block = stream.substr(piece->offset(), piece->length());
+
+    CPPUNIT_ASSERT(::send(fd, block.data() + buffered, block.size() - buffered, 0) == static_cast<ssize_t>(block.size() - buffered));
+    connection.read_piece(*piece, block.substr(0, buffered));
+  }
+}
+
+} // namespace
+
+void
+TestPeerConnectionBase::setUp() {
+  TestFixtureWithMainThread::setUp();
+
+  // Seeds the manager's peer table.
+  mock_redirect(torrent::random_uniform_uint32, std::function<uint32_t(uint32_t, uint32_t)>([](uint32_t, uint32_t) {
+        return 0;
+      }));
+
+  torrent::manager = new torrent::Manager;
+  torrent::manager->chunk_manager()->set_hash_on_receive(true);
+}
+
+void
+TestPeerConnectionBase::tearDown() {
+  delete torrent::manager;
+  torrent::manager = nullptr;
+
+  TestFixtureWithMainThread::tearDown();
+}
+
+// Blocks read directly from the socket are hashed as they arrive, one
+// update per chunk part.
+void
+TestPeerConnectionBase::test_down_chunk_hash() {
+  int fds[2];
+  CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+
+  torrent::DownloadMain download;
+  std::string data = chunk_data();
+
+  {
+    test_peer_connection connection(&download, fds[0]);
+
+    read_chunk(connection, fds[1], data, 100, false);
+
+    CPPUNIT_ASSERT(connection.stored_data() == data);
+  }
+
+  torrent::HashString hash;
+
+  CPPUNIT_ASSERT(download.piece_hash_table()->final(0, chunk_size, hash.data()));
+  CPPUNIT_ASSERT(hash == chunk_hash(data));
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+// Encrypted blocks are hashed after being decrypted.
+void
+TestPeerConnectionBase::test_down_chunk_hash_encrypted() {
+  int fds[2];
+  CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+
+  torrent::DownloadMain download;
+  std::string data = chunk_data();
+
+  {
+    test_peer_connection connection(&download, fds[0]);
+    connection.set_encryption();
+
+    read_chunk(connection, fds[1], data, 100, true);
+
+    CPPUNIT_ASSERT(connection.stored_data() == data);
+  }
+
+  torrent::HashString hash;
+
+  CPPUNIT_ASSERT(download.piece_hash_table()->final(0, chunk_size, hash.data()));
+  CPPUNIT_ASSERT(hash == chunk_hash(data));
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
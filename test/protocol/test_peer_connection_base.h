@@ -0,0 +1,17 @@
+#include "helpers/test_main_thread.h"
+
+class TestPeerConnectionBase : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(TestPeerConnectionBase);
+
+  CPPUNIT_TEST(test_down_chunk_hash);
+  CPPUNIT_TEST(test_down_chunk_hash_encrypted);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() override;
+  void tearDown() override;
+
+  void test_down_chunk_hash();
+  void test_down_chunk_hash_encrypted();
+};
@@ -263,3 +263,68 @@ TestRequestList::test_choke_unchoke_transfer() {
 
   CLEAR_TRANSFERS();
 }
+
+//
+// Pipe size tests:
+//
+
+void
+TestRequestList::test_pipe_size_bdp() {
+  SETUP_ALL(basic);
+
+  // Without a round-trip time the rate based depth is used.
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(1 << 20, torrent::ConnectionManager::request_pipeline_bdp) == 222);
+  CPPUNIT_ASSERT(request_list->last_pipe_size_bdp() == 0);
+
+  // 2 * 100ms + 500ms at 1 MiB/s covers 44 blocks, plus two.
+  request_list->update_pipe_rtt(100000);
+
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(1 << 20, torrent::ConnectionManager::request_pipeline_bdp) == 46);
+  CPPUNIT_ASSERT(request_list->last_pipe_size_rate() == 222);
+  CPPUNIT_ASSERT(request_list->last_pipe_size_bdp() == 46);
+
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(10 << 10, torrent::ConnectionManager::request_pipeline_bdp) == 2);
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(1 << 30, torrent::ConnectionManager::request_pipeline_bdp) == torrent::RequestList::pipe_size_max);
+
+  // Compare uses the rate based depth but still calculates the other.
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(1 << 20, torrent::ConnectionManager::request_pipeline_compare) == 222);
+  CPPUNIT_ASSERT(request_list->last_pipe_size_bdp() == 46);
+
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(1 << 20) == 222);
+  CPPUNIT_ASSERT(request_list->last_pipe_size_bdp() == 0);
+}
+
+void
+TestRequestList::test_pipe_size_bdp_aggressive() {
+  SETUP_ALL(basic);
+
+  delegator->set_aggressive(true);
+  request_list->update_pipe_rtt(100000);
+
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(1 << 20, torrent::ConnectionManager::request_pipeline_bdp) == 104);
+  CPPUNIT_ASSERT(request_list->last_pipe_size_bdp() == 0);
+}
+
+void
+TestRequestList::test_pipe_rtt() {
+  SETUP_ALL(basic);
+
+  CPPUNIT_ASSERT(request_list->pipe_rtt() == 0);
+  CPPUNIT_ASSERT(request_list->is_pipe_rtt_stale());
+
+  request_list->update_pipe_rtt(100000);
+  CPPUNIT_ASSERT(request_list->pipe_rtt() == 100000);
+  CPPUNIT_ASSERT(!request_list->is_pipe_rtt_stale());
+
+  // Samples are already smoothed by the kernel and replace the last.
+  request_list->update_pipe_rtt(20000);
+  CPPUNIT_ASSERT(request_list->pipe_rtt() == 20000);
+
+  test_main_thread->test_set_cached_time(torrent::RequestList::pipe_rtt_interval);
+  CPPUNIT_ASSERT(request_list->is_pipe_rtt_stale());
+
+  // Unknown samples keep the last value and restart the interval.
+  request_list->update_pipe_rtt(0);
+  CPPUNIT_ASSERT(request_list->pipe_rtt() == 20000);
+  CPPUNIT_ASSERT(!request_list->is_pipe_rtt_stale());
+}
@@ -11,6 +11,10 @@ class TestRequestList : public test_fixture {
   CPPUNIT_TEST(test_choke_unchoke_discard);
   CPPUNIT_TEST(test_choke_unchoke_transfer);
 
+  CPPUNIT_TEST(test_pipe_size_bdp);
+  CPPUNIT_TEST(test_pipe_size_bdp_aggressive);
+  CPPUNIT_TEST(test_pipe_rtt);
+
   CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -22,4 +26,8 @@ public:
   void test_choke_normal();
   void test_choke_unchoke_discard();
   void test_choke_unchoke_transfer();
+
+  void test_pipe_size_bdp();
+  void test_pipe_size_bdp_aggressive();
+  void test_pipe_rtt();
 };
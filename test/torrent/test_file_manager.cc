@@ -0,0 +1,179 @@
+#include "config.h"
+
+#include "test/torrent/test_file_manager.h"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "data/memory_chunk.h"
+#include "torrent/exceptions.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_manager.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_file_manager);
+
+using torrent::FileManager;
+
+namespace {
+
+constexpr int prot_read = torrent::MemoryChunk::prot_read;
+
+struct test_file : public torrent::File {
+  test_file(uint64_t touched);
+  ~test_file();
+
+  std::string path;
+};
+
+test_file::test_file(uint64_t touched) {
+  char name[] = "/tmp/libtorrent_test_file_manager.XXXXXX";
+  int fd = ::mkstemp(name);
+
+  if (fd == -1)
+    throw torrent::internal_error("test_file: mkstemp failed");
+
+  std::string data(1 << 12, 'a');
+
+  if (::pwrite(fd, data.data(), data.size(), 0) != static_cast<ssize_t>(data.size()))
+    throw torrent::internal_error("test_file: pwrite failed");
+
+  ::close(fd);
+
+  path = name;
+  set_frozen_path(path);
+  set_last_touched(touched);
+}
+
+test_file::~test_file() {
+  ::unlink(path.c_str());
+}
+
+bool
+is_open_fd(int fd) {
+  return ::fcntl(fd, F_GETFD) != -1;
+}
+
+// Files are closed before the manager is destroyed.
+struct test_manager {
+  test_manager(uint32_t count, uint32_t max_open);
+  ~test_manager();
+
+  FileManager                             manager;
+  std::vector<std::unique_ptr<test_file>> files;
+};
+
+test_manager::test_manager(uint32_t count, uint32_t max_open) {
+  manager.set_max_open_files(max_open);
+
+  for (uint32_t i = 0; i != count; i++)
+    files.push_back(std::make_unique<test_file>(i + 1));
+}
+
+test_manager::~test_manager() {
+  for (auto& f : files)
+    manager.close(f.get());
+}
+
+} // namespace
+
+void
+test_file_manager::test_open_close() {
+  test_manager m(5, 4);
+
+  for (auto& f : m.files)
+    CPPUNIT_ASSERT(m.manager.open(f.get(), false, prot_read, 0));
+
+  // The least recently touched file was closed to stay within the limit.
+  CPPUNIT_ASSERT(m.manager.open_files() == 4);
+  CPPUNIT_ASSERT(!m.files[0]->is_open());
+  CPPUNIT_ASSERT(m.files[4]->is_open());
+
+  m.manager.close(m.files[4].get());
+
+  CPPUNIT_ASSERT(m.manager.open_files() == 3);
+  CPPUNIT_ASSERT(!m.files[4]->is_open());
+}
+
+void
+test_file_manager::test_open_direct() {
+  test_manager m(1, 4);
+  auto file = m.files[0].get();
+
+  CPPUNIT_ASSERT(m.manager.open(file, true, prot_read, 0));
+
+  int fd = m.manager.open_direct(file);
+
+  if (fd == -1)
+    return; // O_DIRECT is not supported by the filesystem.
+
+  CPPUNIT_ASSERT(fd != file->file_descriptor());
+  CPPUNIT_ASSERT(m.manager.open_direct(file) == fd);
+  CPPUNIT_ASSERT(m.manager.open_files() == 2);
+
+  m.manager.close(file);
+
+  CPPUNIT_ASSERT(!is_open_fd(fd));
+  CPPUNIT_ASSERT(m.manager.open_files() == 0);
+}
+
+void
+test_file_manager::test_open_direct_max_open_files() {
+  test_manager m(4, 4);
+
+  for (auto& f : m.files)
+    CPPUNIT_ASSERT(m.manager.open(f.get(), true, prot_read, 0));
+
+  int fd = m.manager.open_direct(m.files[3].get());
+
+  if (fd == -1)
+    return;
+
+  // The direct descriptor takes the place of the least active file.
+  CPPUNIT_ASSERT(m.manager.open_files() == 4);
+  CPPUNIT_ASSERT(!m.files[0]->is_open());
+  CPPUNIT_ASSERT(m.files[3]->is_open());
+
+  // Making room closes files along with their direct descriptors.
+  m.files[3]->set_last_touched(0);
+  m.files[1]->set_last_touched(10);
+  m.files[2]->set_last_touched(10);
+
+  CPPUNIT_ASSERT(m.manager.open(m.files[0].get(), true, prot_read, 0));
+
+  CPPUNIT_ASSERT(!m.files[3]->is_open());
+  CPPUNIT_ASSERT(m.manager.open_files() == 3);
+}
+
+void
+test_file_manager::test_open_direct_close_self() {
+  test_manager m(4, 4);
+
+  for (auto& f : m.files)
+    CPPUNIT_ASSERT(m.manager.open(f.get(), true, prot_read, 0));
+
+  // Making room for the direct descriptor closes the file itself.
+  m.files[0]->set_last_touched(10);
+
+  auto file = m.files[1].get();
+  file->set_last_touched(0);
+
+  CPPUNIT_ASSERT(m.manager.open_direct(file) == -1);
+  CPPUNIT_ASSERT(!file->is_open());
+  CPPUNIT_ASSERT(m.manager.open_files() == 3);
+
+  // Not cached as unsupported once the file is reopened.
+  CPPUNIT_ASSERT(m.manager.open(file, true, prot_read, 0));
+  file->set_last_touched(20);
+
+  int fd = m.manager.open_direct(file);
+
+  if (fd == -1)
+    return;
+
+  CPPUNIT_ASSERT(file->is_open());
+  CPPUNIT_ASSERT(m.manager.open_files() == 4);
+}
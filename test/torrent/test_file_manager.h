@@ -0,0 +1,18 @@
+#include "helpers/test_main_thread.h"
+
+class test_file_manager : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(test_file_manager);
+
+  CPPUNIT_TEST(test_open_close);
+  CPPUNIT_TEST(test_open_direct);
+  CPPUNIT_TEST(test_open_direct_max_open_files);
+  CPPUNIT_TEST(test_open_direct_close_self);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_open_close();
+  void test_open_direct();
+  void test_open_direct_max_open_files();
+  void test_open_direct_close_self();
+};
@@ -0,0 +1,275 @@
+#include "config.h"
+
+#include "test/torrent/test_peer_table.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "test/helpers/mock_function.h"
+#include "torrent/net/socket_address.h"
+#include "torrent/peer/peer_info.h"
+#include "torrent/peer/peer_table.h"
+#include "torrent/utils/random.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_peer_table);
+
+using torrent::PeerInfo;
+using torrent::PeerTable;
+
+namespace {
+
+// The key only includes the address, so peers with the same address
+// and different ports have the same key.
+std::unique_ptr<PeerInfo>
+make_peer(uint32_t address, uint16_t port = 6881) {
+  return std::make_unique<PeerInfo>(torrent::sa_make_inet_h(0x0a000000 + address, port).get());
+}
+
+PeerTable::key_type
+key_of(const PeerInfo* peer_info) {
+  return torrent::socket_address_key::from_sockaddr(peer_info->socket_address());
+}
+
+std::multiset<PeerInfo*>
+table_contents(const PeerTable& table) {
+  std::multiset<PeerInfo*> result;
+
+  for (auto itr = table.begin(); itr != table.end(); ++itr) {
+    CPPUNIT_ASSERT(itr->first == key_of(itr->second));
+    result.insert(itr.peer_info());
+  }
+
+  return result;
+}
+
+// Checks iteration in both directions and that every peer is found
+// both by key and by key and pointer.
+void
+verify_table(const PeerTable& table, const std::set<PeerInfo*>& expected) {
+  CPPUNIT_ASSERT(table.size() == expected.size());
+  CPPUNIT_ASSERT(table.empty() == expected.empty());
+
+  auto contents = table_contents(table);
+  CPPUNIT_ASSERT(contents == std::multiset<PeerInfo*>(expected.begin(), expected.end()));
+
+  CPPUNIT_ASSERT(static_cast<size_t>(std::distance(table.rbegin(), table.rend())) == expected.size());
+
+  for (auto peer_info : expected) {
+    auto itr = table.find(key_of(peer_info));
+
+    CPPUNIT_ASSERT(itr != table.end());
+    CPPUNIT_ASSERT(itr->first == key_of(peer_info));
+
+    itr = table.find(key_of(peer_info), peer_info);
+
+    CPPUNIT_ASSERT(itr != table.end());
+    CPPUNIT_ASSERT(itr.peer_info() == peer_info);
+  }
+}
+
+}
+
+void
+test_peer_table::setUp() {
+  TestFixtureWithMainThread::setUp();
+
+  mock_redirect(torrent::random_uniform_uint32, std::function<uint32_t(uint32_t, uint32_t)>([](uint32_t, uint32_t) {
+        return 0x5eed1234;
+      }));
+}
+
+void
+test_peer_table::test_basic() {
+  PeerTable table;
+
+  CPPUNIT_ASSERT(table.empty());
+  CPPUNIT_ASSERT(table.begin() == table.end());
+  CPPUNIT_ASSERT(table.find(key_of(make_peer(1).get())) == table.end());
+
+  auto peer_1 = make_peer(1);
+  auto peer_2 = make_peer(2);
+
+  CPPUNIT_ASSERT(table.insert(peer_1.get()).peer_info() == peer_1.get());
+  CPPUNIT_ASSERT(table.insert(peer_2.get()).peer_info() == peer_2.get());
+  CPPUNIT_ASSERT(table.capacity() == PeerTable::min_capacity);
+
+  verify_table(table, { peer_1.get(), peer_2.get() });
+
+  CPPUNIT_ASSERT(table.find(key_of(make_peer(3).get())) == table.end());
+  CPPUNIT_ASSERT(table.find(key_of(peer_1.get()), peer_2.get()) == table.end());
+
+  table.erase(table.find(key_of(peer_1.get())));
+  verify_table(table, { peer_2.get() });
+
+  CPPUNIT_ASSERT(table.find(key_of(peer_1.get())) == table.end());
+
+  table.clear();
+  verify_table(table, {});
+
+  CPPUNIT_ASSERT(table.capacity() == 0);
+  CPPUNIT_ASSERT(table.find(key_of(peer_2.get())) == table.end());
+}
+
+void
+test_peer_table::test_duplicate_address() {
+  PeerTable table;
+  std::vector<std::unique_ptr<PeerInfo>> peers;
+  std::set<PeerInfo*> expected;
+
+  // Peers with the same address are interleaved with others so their
+  // probe sequences overlap.
+  for (uint16_t port = 0; port < 5; port++) {
+    peers.push_back(make_peer(1, 6881 + port));
+    peers.push_back(make_peer(2 + port));
+  }
+
+  for (auto& peer : peers) {
+    table.insert(peer.get());
+    expected.insert(peer.get());
+  }
+
+  verify_table(table, expected);
+
+  auto key = key_of(peers[0].get());
+  auto count = std::count_if(table.begin(), table.end(), [&key](PeerTable::value_type v) { return v.first == key; });
+
+  CPPUNIT_ASSERT(count == 5);
+
+  // Erasing the entry found by key leaves the rest findable.
+  for (int i = 5; i != 0; i--) {
+    auto itr = table.find(key);
+
+    CPPUNIT_ASSERT(itr != table.end());
+    CPPUNIT_ASSERT(itr->first == key);
+
+    expected.erase(itr.peer_info());
+    table.erase(itr);
+
+    verify_table(table, expected);
+  }
+
+  CPPUNIT_ASSERT(table.find(key) == table.end());
+}
+
+void
+test_peer_table::test_erase_while_iterating() {
+  PeerTable table;
+  std::vector<std::unique_ptr<PeerInfo>> peers;
+  std::set<PeerInfo*> expected;
+
+  for (uint32_t i = 0; i < 200; i++) {
+    peers.push_back(make_peer(i, 6881 + i % 3));
+    table.insert(peers.back().get());
+    expected.insert(peers.back().get());
+  }
+
+  auto capacity = table.capacity();
+  std::multiset<PeerInfo*> visited;
+
+  // Erase every other peer visited, the way PeerList::cull_peers does.
+  bool erase = false;
+
+  for (auto itr = table.begin(); itr != table.end();) {
+    visited.insert(itr.peer_info());
+
+    if ((erase = !erase)) {
+      expected.erase(itr.peer_info());
+      itr = table.erase(itr);
+    } else {
+      ++itr;
+    }
+  }
+
+  CPPUNIT_ASSERT(visited.size() == peers.size());
+  CPPUNIT_ASSERT(std::set<PeerInfo*>(visited.begin(), visited.end()).size() == peers.size());
+  CPPUNIT_ASSERT(table.capacity() == capacity);
+
+  verify_table(table, expected);
+
+  for (auto& peer : peers)
+    if (expected.find(peer.get()) == expected.end())
+      CPPUNIT_ASSERT(table.find(key_of(peer.get()), peer.get()) == table.end());
+
+  // Erasing the last entry returns end().
+  auto last = std::prev(table.end());
+  CPPUNIT_ASSERT(table.erase(last) == table.end());
+}
+
+// Erased slots are reused or dropped by rehashing at the same capacity,
+// so a table with a stable number of peers below half its capacity
+// does not grow.
+void
+test_peer_table::test_rehash_tombstones() {
+  PeerTable table;
+  std::vector<std::unique_ptr<PeerInfo>> peers;
+  std::set<PeerInfo*> expected;
+
+  for (uint32_t i = 0; i < 30; i++) {
+    peers.push_back(make_peer(i));
+    table.insert(peers.back().get());
+    expected.insert(peers.back().get());
+  }
+
+  CPPUNIT_ASSERT(table.capacity() == 64);
+
+  for (uint32_t i = 30; i < 4000; i++) {
+    auto oldest = peers[i - 30].get();
+
+    table.erase(table.find(key_of(oldest), oldest));
+    expected.erase(oldest);
+
+    peers.push_back(make_peer(i));
+    table.insert(peers.back().get());
+    expected.insert(peers.back().get());
+
+    CPPUNIT_ASSERT(table.capacity() == 64);
+
+    if (i % 97 == 0)
+      verify_table(table, expected);
+  }
+
+  verify_table(table, expected);
+
+  for (uint32_t i = 0; i < 4000 - 30; i++)
+    CPPUNIT_ASSERT(table.find(key_of(peers[i].get())) == table.end());
+}
+
+void
+test_peer_table::test_erase_insert_cycles() {
+  PeerTable table;
+  std::vector<std::unique_ptr<PeerInfo>> peers;
+  std::set<PeerInfo*> expected;
+  std::mt19937 rng(1);
+
+  // Few distinct addresses so there are many duplicate keys, and the
+  // size grows and shrinks to rehash in both directions.
+  for (int cycle = 0; cycle < 20; cycle++) {
+    uint32_t target = cycle % 2 == 0 ? 1000 : 10;
+
+    while (expected.size() != target) {
+      if (expected.size() < target && rng() % 4 != 0) {
+        peers.push_back(make_peer(rng() % 300, rng()));
+        table.insert(peers.back().get());
+        expected.insert(peers.back().get());
+
+      } else if (!expected.empty()) {
+        auto itr = table.begin();
+        std::advance(itr, rng() % table.size());
+
+        expected.erase(itr.peer_info());
+        table.erase(itr);
+      }
+    }
+
+    verify_table(table, expected);
+
+    CPPUNIT_ASSERT(table.size() * 8 <= table.capacity() * 7);
+  }
+
+  for (auto& peer : peers)
+    if (expected.find(peer.get()) == expected.end())
+      CPPUNIT_ASSERT(table.find(key_of(peer.get()), peer.get()) == table.end());
+}
@@ -0,0 +1,22 @@
+#include "helpers/test_main_thread.h"
+
+class test_peer_table : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(test_peer_table);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_duplicate_address);
+  CPPUNIT_TEST(test_erase_while_iterating);
+  CPPUNIT_TEST(test_rehash_tombstones);
+  CPPUNIT_TEST(test_erase_insert_cycles);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() override;
+
+  void test_basic();
+  void test_duplicate_address();
+  void test_erase_while_iterating();
+  void test_rehash_tombstones();
+  void test_erase_insert_cycles();
+};
@@ -0,0 +1,399 @@
+#include "config.h"
+
+#include "test/torrent/test_poll.h"
+
+#include <functional>
+#include <memory>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "torrent/event.h"
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_poll);
+
+using torrent::Poll;
+
+namespace {
+
+// Wait long enough for io_uring completions, events already ready
+// return immediately.
+constexpr int64_t poll_timeout = 10000;
+
+// See PollInternal::edge_requeue_max.
+constexpr unsigned int edge_requeue_max = 16;
+
+// One end of a socketpair, with the other end used to make it
+// readable.
+class test_poll_event : public torrent::Event {
+public:
+  test_poll_event();
+  ~test_poll_event() override;
+
+  const char*         type_name() const override { return "test_poll"; }
+
+  void                event_read() override;
+  void                event_write() override  { m_writes++; }
+  void                event_error() override  { m_errors++; }
+
+  void                send_peer(unsigned int bytes = 1);
+  void                drain();
+
+  // Closes the descriptor but keeps its number, as when the poll is
+  // told of the close afterwards.
+  void                close_socket();
+
+  int                 m_peer{-1};
+  bool                m_closed{false};
+
+  unsigned int        m_reads{0};
+  unsigned int        m_writes{0};
+  unsigned int        m_errors{0};
+
+  std::function<void ()> m_on_read;
+};
+
+test_poll_event::test_poll_event() {
+  int fds[2];
+
+  CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+
+  set_file_descriptor(fds[0]);
+  m_peer = fds[1];
+}
+
+test_poll_event::~test_poll_event() {
+  if (!m_closed)
+    close_file_descriptor();
+
+  ::close(m_peer);
+}
+
+void
+test_poll_event::event_read() {
+  m_reads++;
+
+  if (m_on_read)
+    m_on_read();
+}
+
+void
+test_poll_event::close_socket() {
+  ::close(file_descriptor());
+  m_closed = true;
+}
+
+void
+test_poll_event::send_peer(unsigned int bytes) {
+  char buffer[256] = {};
+
+  CPPUNIT_ASSERT(bytes <= sizeof(buffer));
+  CPPUNIT_ASSERT(::write(m_peer, buffer, bytes) == bytes);
+}
+
+void
+test_poll_event::drain() {
+  char buffer[256];
+
+  while (::read(file_descriptor(), buffer, sizeof(buffer)) > 0)
+    ; // Do nothing.
+}
+
+// Runs 'fn' with a poll of each backend available.
+void
+for_each_backend(const std::function<void (Poll*)>& fn) {
+  for (auto backend : { Poll::BACKEND_DEFAULT, Poll::BACKEND_IO_URING }) {
+    auto poll = Poll::create(backend);
+
+    CPPUNIT_ASSERT(poll != nullptr);
+
+    if (poll->backend() != backend)
+      continue;
+
+    fn(poll.get());
+  }
+}
+
+} // namespace
+
+void
+test_poll::test_open_close() {
+  for_each_backend([](Poll* poll) {
+      test_poll_event event;
+
+      poll->open(&event);
+
+      CPPUNIT_ASSERT(!poll->in_read(&event));
+      CPPUNIT_ASSERT(!poll->in_write(&event));
+      CPPUNIT_ASSERT(!poll->in_error(&event));
+
+      poll->insert_read(&event);
+      poll->insert_error(&event);
+
+      CPPUNIT_ASSERT(poll->in_read(&event));
+      CPPUNIT_ASSERT(!poll->in_write(&event));
+      CPPUNIT_ASSERT(poll->in_error(&event));
+
+      CPPUNIT_ASSERT_THROW(poll->open(&event), torrent::internal_error);
+      CPPUNIT_ASSERT_THROW(poll->close(&event), torrent::internal_error);
+
+      poll->remove_and_close(&event);
+
+      CPPUNIT_ASSERT(!poll->in_read(&event));
+      CPPUNIT_ASSERT(!poll->in_error(&event));
+
+      // Closed events may be opened again.
+      poll->open(&event);
+      poll->insert_read(&event);
+
+      event.send_peer();
+
+      CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+      CPPUNIT_ASSERT(event.m_reads == 1);
+
+      poll->remove_and_close(&event);
+    });
+}
+
+void
+test_poll::test_insert_remove() {
+  for_each_backend([](Poll* poll) {
+      test_poll_event event;
+
+      poll->open(&event);
+      poll->insert_read(&event);
+
+      CPPUNIT_ASSERT(poll->do_poll(0) == 0);
+
+      // Level-triggered events are reported until the socket is read.
+      event.send_peer();
+
+      CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+      CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+      CPPUNIT_ASSERT(event.m_reads == 2);
+
+      poll->insert_write(&event);
+
+      CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 2);
+      CPPUNIT_ASSERT(event.m_reads == 3);
+      CPPUNIT_ASSERT(event.m_writes == 1);
+
+      poll->remove_read(&event);
+
+      CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+      CPPUNIT_ASSERT(event.m_reads == 3);
+      CPPUNIT_ASSERT(event.m_writes == 2);
+
+      // Inserting and removing within an iteration has no effect.
+      poll->insert_read(&event);
+      poll->remove_read(&event);
+      poll->remove_write(&event);
+
+      CPPUNIT_ASSERT(poll->do_poll(0) == 0);
+
+      event.drain();
+      poll->insert_read(&event);
+
+      CPPUNIT_ASSERT(poll->do_poll(0) == 0);
+
+      event.send_peer();
+
+      CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+      CPPUNIT_ASSERT(event.m_reads == 4);
+
+      poll->remove_and_close(&event);
+    });
+}
+
+void
+test_poll::test_cleanup_closed() {
+  for_each_backend([](Poll* poll) {
+      test_poll_event event;
+
+      poll->open(&event);
+      poll->insert_read(&event);
+      poll->insert_error(&event);
+
+      CPPUNIT_ASSERT(poll->do_poll(0) == 0);
+
+      int fd = event.file_descriptor();
+
+      event.send_peer();
+      event.close_socket();
+
+      // The descriptor is reused before the poll is told of the close.
+      test_poll_event other;
+
+      CPPUNIT_ASSERT(other.file_descriptor() == fd);
+
+      poll->cleanup_closed(&event);
+
+      CPPUNIT_ASSERT(poll->do_poll(0) == 0);
+      CPPUNIT_ASSERT(event.m_reads == 0);
+
+      poll->open(&other);
+      poll->insert_read(&other);
+
+      other.send_peer();
+
+      CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+      CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+      CPPUNIT_ASSERT(other.m_reads == 2);
+      CPPUNIT_ASSERT(event.m_reads == 0);
+      CPPUNIT_ASSERT(event.m_errors == 0);
+
+      poll->remove_and_close(&other);
+    });
+}
+
+// Edge-triggered events use multishot polls that stay armed across
+// wakeups, and are only submitted again when interest changes or the
+// kernel terminates them.
+void
+test_poll::test_uring_multishot() {
+  auto poll = Poll::create(Poll::BACKEND_IO_URING);
+
+  if (poll->backend() != Poll::BACKEND_IO_URING)
+    return;
+
+  test_poll_event event;
+
+  event.m_on_read = [&]() {
+      event.drain();
+      poll->drained_read(&event);
+    };
+
+  poll->set_edge_triggered(true);
+  poll->open_edge(&event);
+  poll->insert_read(&event);
+
+  for (unsigned int i = 1; i <= 3; i++) {
+    event.send_peer();
+
+    CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+    CPPUNIT_ASSERT(poll->do_poll(0) == 0);
+    CPPUNIT_ASSERT(event.m_reads == i);
+  }
+
+  // Adding write interest replaces the armed poll.
+  poll->insert_write(&event);
+  event.send_peer();
+
+  CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 2);
+  CPPUNIT_ASSERT(event.m_reads == 4);
+  CPPUNIT_ASSERT(event.m_writes == 1);
+
+  poll->remove_write(&event);
+  event.send_peer();
+
+  CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+  CPPUNIT_ASSERT(event.m_reads == 5);
+  CPPUNIT_ASSERT(event.m_writes == 1);
+
+  poll->remove_and_close(&event);
+}
+
+// Edge-triggered events stay on the ready list until the handler
+// reports the socket drained, but only for 'edge_requeue_max' passes
+// after which the poll is re-armed.
+void
+test_poll::test_edge_requeue() {
+  for_each_backend([](Poll* poll) {
+      test_poll_event event;
+
+      poll->set_edge_triggered(true);
+      poll->open_edge(&event);
+      poll->insert_read(&event);
+
+      event.send_peer();
+
+      for (unsigned int i = 1; i <= edge_requeue_max; i++) {
+        CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+        CPPUNIT_ASSERT(event.m_reads == i);
+      }
+
+      // Re-armed, so the kernel decides if it is still readable.
+      event.drain();
+
+      CPPUNIT_ASSERT(poll->do_poll(0) == 0);
+      CPPUNIT_ASSERT(event.m_reads == edge_requeue_max);
+
+      event.send_peer();
+
+      CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+
+      // Requeued, as the handler didn't report the socket drained.
+      event.drain();
+
+      CPPUNIT_ASSERT(poll->do_poll(0) == 1);
+      CPPUNIT_ASSERT(event.m_reads == edge_requeue_max + 2);
+
+      poll->drained_read(&event);
+
+      CPPUNIT_ASSERT(poll->do_poll(0) == 0);
+
+      poll->remove_and_close(&event);
+    });
+}
+
+void
+test_poll::test_budget() {
+  auto poll = Poll::create();
+
+  // Zero means no limit.
+  CPPUNIT_ASSERT(!poll->read_budget_exhausted(1 << 30));
+  CPPUNIT_ASSERT(!poll->write_budget_exhausted(1 << 30));
+
+  poll->set_read_budget(30);
+  poll->set_write_budget(20);
+
+  CPPUNIT_ASSERT(!poll->write_budget_exhausted(19));
+  CPPUNIT_ASSERT(poll->write_budget_exhausted(20));
+  CPPUNIT_ASSERT(poll->stats_budget_exhausted() == 1);
+
+  // A handler reading 10 bytes at a time stops once the budget is
+  // used, and is called again on the next iteration for the rest.
+  test_poll_event event;
+  unsigned int received = 0;
+
+  event.m_on_read = [&]() {
+      uint64_t transferred = 0;
+      char buffer[10];
+
+      while (true) {
+        auto length = ::read(event.file_descriptor(), buffer, sizeof(buffer));
+
+        if (length <= 0) {
+          poll->drained_read(&event);
+          return;
+        }
+
+        received += length;
+        transferred += length;
+
+        if (poll->read_budget_exhausted(transferred))
+          return;
+      }
+    };
+
+  poll->set_edge_triggered(true);
+  poll->open_edge(&event);
+  poll->insert_read(&event);
+
+  event.send_peer(100);
+
+  for (unsigned int i = 1; i <= 3; i++) {
+    CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+    CPPUNIT_ASSERT(received == i * 30);
+  }
+
+  CPPUNIT_ASSERT(poll->do_poll(poll_timeout) == 1);
+  CPPUNIT_ASSERT(received == 100);
+  CPPUNIT_ASSERT(poll->stats_budget_exhausted() == 4);
+
+  CPPUNIT_ASSERT(poll->do_poll(0) == 0);
+  CPPUNIT_ASSERT(event.m_reads == 4);
+
+  poll->remove_and_close(&event);
+}
@@ -0,0 +1,22 @@
+#include "helpers/test_main_thread.h"
+
+class test_poll : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(test_poll);
+
+  CPPUNIT_TEST(test_open_close);
+  CPPUNIT_TEST(test_insert_remove);
+  CPPUNIT_TEST(test_cleanup_closed);
+  CPPUNIT_TEST(test_uring_multishot);
+  CPPUNIT_TEST(test_edge_requeue);
+  CPPUNIT_TEST(test_budget);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_open_close();
+  void test_insert_remove();
+  void test_cleanup_closed();
+  void test_uring_multishot();
+  void test_edge_requeue();
+  void test_budget();
+};
@@ -0,0 +1,138 @@
+#include "config.h"
+
+#include "test_resume_binary.h"
+
+#include <torrent/utils/resume_binary.h>
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_resume_binary, "torrent/utils");
+
+static void
+write_le(std::string& data, size_t pos, uint64_t value, unsigned int bytes) {
+  for (unsigned int i = 0; i != bytes; ++i, value >>= 8)
+    data[pos + i] = static_cast<char>(value & 0xff);
+}
+
+static void
+update_checksum(std::string& data) {
+  uint64_t hash = 0xcbf29ce484222325;
+
+  for (size_t i = 48; i != data.size(); ++i)
+    hash = (hash ^ static_cast<uint8_t>(data[i])) * 0x100000001b3;
+
+  write_le(data, 16, hash, 8);
+}
+
+// Two files, 12 chunks and one uncertain piece.
+static std::string
+create_resume_data() {
+  std::string data(48 + 2 * 24 + 4 + 4, '\0');
+
+  data.replace(0, 8, "LTRESUME");
+  write_le(data, 8, torrent::resume_binary_version, 4);
+  write_le(data, 24, 12, 4);
+  write_le(data, 28, 2, 4);
+  write_le(data, 32, 1, 4);
+  write_le(data, 40, 1000, 8);
+
+  write_le(data, 48, 1 << 20, 8);
+  write_le(data, 56, 123456, 8);
+  write_le(data, 64, 4, 4);
+  write_le(data, 72, 1 << 19, 8);
+  write_le(data, 80, 654321, 8);
+  write_le(data, 88, 2, 4);
+
+  data[96] = static_cast<char>(0xf3);
+  data[97] = static_cast<char>(0x30);
+  write_le(data, 100, 7, 4);
+
+  update_checksum(data);
+  return data;
+}
+
+void
+test_resume_binary::test_valid() {
+  std::string data = create_resume_data();
+
+  CPPUNIT_ASSERT(torrent::resume_binary_is_valid(data.data(), data.size()));
+}
+
+void
+test_resume_binary::test_truncated() {
+  std::string data = create_resume_data();
+
+  for (size_t length = 0; length != data.size(); ++length)
+    CPPUNIT_ASSERT(!torrent::resume_binary_is_valid(data.data(), length));
+
+  // A shorter file with a matching checksum must still fail the size
+  // check.
+  std::string truncated = data.substr(0, data.size() - 4);
+  update_checksum(truncated);
+
+  CPPUNIT_ASSERT(!torrent::resume_binary_is_valid(truncated.data(), truncated.size()));
+
+  data.append(4, '\0');
+  update_checksum(data);
+
+  CPPUNIT_ASSERT(!torrent::resume_binary_is_valid(data.data(), data.size()));
+}
+
+void
+test_resume_binary::test_corrupted() {
+  std::string data = create_resume_data();
+
+  for (size_t pos = 0; pos != data.size(); ++pos) {
+    // The flags, reserved and timestamp fields are not covered.
+    if ((pos >= 12 && pos < 16) || (pos >= 36 && pos < 48))
+      continue;
+
+    std::string corrupted = data;
+    corrupted[pos] ^= 0x40;
+
+    CPPUNIT_ASSERT_MESSAGE("pos " + std::to_string(pos), !torrent::resume_binary_is_valid(corrupted.data(), corrupted.size()));
+  }
+
+  std::string version = data;
+  write_le(version, 8, torrent::resume_binary_version + 1, 4);
+
+  CPPUNIT_ASSERT(!torrent::resume_binary_is_valid(version.data(), version.size()));
+}
+
+void
+test_resume_binary::test_oversized_count() {
+  std::string data = create_resume_data();
+
+  for (size_t field : { 24, 28, 32 }) {
+    for (uint64_t count : { uint64_t{0xffffffff}, uint64_t{0x80000000}, uint64_t{0x0aaaaaab} }) {
+      std::string oversized = data;
+      write_le(oversized, field, count, 4);
+
+      CPPUNIT_ASSERT(!torrent::resume_binary_is_valid(oversized.data(), oversized.size()));
+    }
+  }
+}
+
+void
+test_resume_binary::test_wrapped_chunks() {
+  // Chunk counts near 2^32 must not wrap the bitfield size to zero and
+  // match a file holding only the header.
+  for (uint64_t size_bits : { uint64_t{0xfffffff8}, uint64_t{0xfffffff9}, uint64_t{0xffffffff} }) {
+    std::string data = create_resume_data().substr(0, 48);
+
+    write_le(data, 24, size_bits, 4);
+    write_le(data, 28, 0, 4);
+    write_le(data, 32, 0, 4);
+    update_checksum(data);
+
+    CPPUNIT_ASSERT(!torrent::resume_binary_is_valid(data.data(), data.size()));
+  }
+}
+
+void
+test_resume_binary::test_stray_bits() {
+  std::string data = create_resume_data();
+
+  data[97] = static_cast<char>(0x38);
+  update_checksum(data);
+
+  CPPUNIT_ASSERT(!torrent::resume_binary_is_valid(data.data(), data.size()));
+}
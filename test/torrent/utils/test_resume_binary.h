@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class test_resume_binary : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_resume_binary);
+  CPPUNIT_TEST(test_valid);
+  CPPUNIT_TEST(test_truncated);
+  CPPUNIT_TEST(test_corrupted);
+  CPPUNIT_TEST(test_oversized_count);
+  CPPUNIT_TEST(test_wrapped_chunks);
+  CPPUNIT_TEST(test_stray_bits);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_valid();
+  void test_truncated();
+  void test_corrupted();
+  void test_oversized_count();
+  void test_wrapped_chunks();
+  void test_stray_bits();
+};
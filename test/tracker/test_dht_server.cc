@@ -0,0 +1,138 @@
+#include "config.h"
+
+#include "test_dht_server.h"
+
+#include <functional>
+#include <string>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "helpers/mock_function.h"
+#include "manager.h"
+#include "torrent/object.h"
+#include "torrent/poll.h"
+#include "torrent/net/network_config.h"
+#include "torrent/tracker/dht_controller.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_dht_server, "tracker");
+
+namespace {
+
+// An unused port for the inet6 socket of the DHT server.
+uint16_t
+unused_port() {
+  int fd = ::socket(AF_INET6, SOCK_DGRAM, 0);
+
+  sockaddr_in6 sa{};
+  sa.sin6_family = AF_INET6;
+  socklen_t length = sizeof(sa);
+
+  CPPUNIT_ASSERT(::bind(fd, reinterpret_cast<sockaddr*>(&sa), length) == 0);
+  CPPUNIT_ASSERT(::getsockname(fd, reinterpret_cast<sockaddr*>(&sa), &length) == 0);
+
+  ::close(fd);
+  return ntohs(sa.sin6_port);
+}
+
+torrent::tracker::DhtController*
+dht() {
+  return torrent::manager->dht_controller();
+}
+
+bool
+run_until(TestMainThread* thread, const std::function<bool()>& done) {
+  for (int i = 0; i < 100 && !done(); i++) {
+    torrent::this_thread::poll()->do_poll(10000);
+    thread->test_process_events_without_cached_time();
+  }
+
+  return done();
+}
+
+}
+
+void
+test_dht_server::setUp() {
+  TestFixtureWithMainNetTrackerThread::setUp();
+
+  mock_redirect(torrent::fd__bind, std::function<int(int, const sockaddr*, socklen_t)>([](int socket, const sockaddr* address, socklen_t address_len) {
+        return ::bind(socket, address, address_len);
+      }));
+
+  torrent::manager = new torrent::Manager;
+
+  m_port = unused_port();
+  torrent::config::network_config()->set_override_dht_port(m_port);
+
+  dht()->initialize(torrent::Object::create_map());
+  CPPUNIT_ASSERT(dht()->start());
+
+  // An IPv4 node, the server socket being inet6 its datagrams arrive
+  // from and are sent to v4-mapped addresses.
+  m_node = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sa.sin_port = htons(m_port);
+
+  CPPUNIT_ASSERT(::connect(m_node, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0);
+
+  dht()->reset_statistics();
+}
+
+void
+test_dht_server::tearDown() {
+  ::close(m_node);
+
+  dht()->stop();
+
+  delete torrent::manager;
+  torrent::manager = nullptr;
+
+  TestFixtureWithMainNetTrackerThread::tearDown();
+}
+
+// Datagrams are read in batches of 16 until one comes up short.
+void
+test_dht_server::test_read_batch() {
+  for (int i = 0; i < 40; i++)
+    CPPUNIT_ASSERT(::send(m_node, "not bencode", 11, 0) == 11);
+
+  CPPUNIT_ASSERT(run_until(m_main_thread.get(), [] { return dht()->get_statistics().read_datagrams == 40; }));
+
+  auto stats = dht()->get_statistics();
+
+  CPPUNIT_ASSERT(stats.read_calls == 3);
+  CPPUNIT_ASSERT(stats.write_calls == 0);
+}
+
+// Replies queued by one read are sent in a single batch back to the
+// IPv4 node.
+void
+test_dht_server::test_write_batch() {
+  const std::string query = "d1:t2:aa1:y1:qe";
+
+  for (int i = 0; i < 20; i++)
+    CPPUNIT_ASSERT(::send(m_node, query.data(), query.size(), 0) == static_cast<ssize_t>(query.size()));
+
+  CPPUNIT_ASSERT(run_until(m_main_thread.get(), [] { return dht()->get_statistics().write_datagrams == 20; }));
+
+  auto stats = dht()->get_statistics();
+
+  CPPUNIT_ASSERT(stats.read_calls == 2 && stats.read_datagrams == 20);
+  CPPUNIT_ASSERT(stats.write_calls == 1);
+
+  for (int i = 0; i < 20; i++) {
+    char buffer[512];
+    auto length = ::recv(m_node, buffer, sizeof(buffer), 0);
+
+    CPPUNIT_ASSERT(length > 0);
+    CPPUNIT_ASSERT(std::string(buffer, length).find("1:t2:aa") != std::string::npos);
+    CPPUNIT_ASSERT(std::string(buffer, length).find("1:y1:e") != std::string::npos);
+  }
+
+  char buffer[512];
+  CPPUNIT_ASSERT(::recv(m_node, buffer, sizeof(buffer), 0) == -1);
+}
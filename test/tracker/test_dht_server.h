@@ -0,0 +1,19 @@
+#include "helpers/test_main_thread.h"
+
+class test_dht_server : public TestFixtureWithMainNetTrackerThread {
+  CPPUNIT_TEST_SUITE(test_dht_server);
+  CPPUNIT_TEST(test_read_batch);
+  CPPUNIT_TEST(test_write_batch);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() override;
+  void tearDown() override;
+
+  void test_read_batch();
+  void test_write_batch();
+
+private:
+  uint16_t m_port{0};
+  int      m_node{-1};
+};
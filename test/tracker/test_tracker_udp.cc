@@ -0,0 +1,152 @@
+#include "config.h"
+
+#include "test_tracker_udp.h"
+
+#include <cerrno>
+#include <string>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "helpers/mock_function.h"
+#include "net/address_list.h"
+#include "net/socket_fd.h"
+#include "tracker/tracker_udp.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_tracker_udp, "tracker");
+
+namespace {
+
+constexpr uint32_t transaction_id = 0x12345678;
+
+std::string
+reply(uint32_t action, uint32_t transaction, const std::string& payload = std::string()) {
+  uint32_t header[2] = {htonl(action), htonl(transaction)};
+
+  return std::string(reinterpret_cast<const char*>(header), sizeof(header)) + payload;
+}
+
+torrent::TrackerInfo
+tracker_info() {
+  torrent::TrackerInfo info;
+  info.url = "udp://127.0.0.1:6969";
+
+  return info;
+}
+
+std::string
+announce_payload() {
+  uint32_t values[3] = {htonl(1800), htonl(2), htonl(3)};
+  const char peers[] = "\x7f\x00\x00\x01\x1a\xe1\x7f\x00\x00\x02\x1a\xe2";
+
+  return std::string(reinterpret_cast<const char*>(values), sizeof(values)) + std::string(peers, sizeof(peers) - 1);
+}
+
+}
+
+// A tracker waiting for an announce reply on a loopback socket, with
+// 'sender' standing in for the tracker server.
+struct test_tracker_udp::udp_tracker {
+  udp_tracker();
+  ~udp_tracker() { ::close(sender); }
+
+  void                send(const std::string& data);
+  bool                is_drained();
+
+  torrent::TrackerUdp tracker;
+  int                 sender;
+  sockaddr_in         address{};
+
+  unsigned int        success_count{0};
+  unsigned int        failure_count{0};
+  torrent::AddressList peers;
+  std::string         failure;
+};
+
+test_tracker_udp::udp_tracker::udp_tracker() :
+    tracker(tracker_info(), torrent::tracker::TrackerState::flag_enabled),
+    sender(::socket(AF_INET, SOCK_DGRAM, 0)) {
+
+  tracker.m_slot_close   = [] {};
+  tracker.m_slot_success = [this](torrent::AddressList&& l) { success_count++; peers = std::move(l); };
+  tracker.m_slot_failure = [this](const std::string& msg) { failure_count++; failure = msg; };
+
+  int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  socklen_t length = sizeof(address);
+
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  CPPUNIT_ASSERT(::bind(fd, reinterpret_cast<sockaddr*>(&address), length) == 0);
+  CPPUNIT_ASSERT(::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) == 0);
+
+  tracker.set_fd(torrent::SocketFd(fd, false));
+
+  // Closed once, either by the reply acted on or the destructor.
+  mock_expect(&torrent::this_thread::event_remove_and_close, static_cast<torrent::Event*>(&tracker));
+
+  tracker.m_read_buffer = std::make_unique<torrent::TrackerUdp::ReadBuffer>();
+  tracker.m_write_buffer = std::make_unique<torrent::TrackerUdp::WriteBuffer>();
+  tracker.m_action = 1;
+  tracker.m_transaction_id = transaction_id;
+}
+
+void
+test_tracker_udp::udp_tracker::send(const std::string& data) {
+  CPPUNIT_ASSERT(::sendto(sender, data.data(), data.size(), 0, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+                 static_cast<ssize_t>(data.size()));
+}
+
+bool
+test_tracker_udp::udp_tracker::is_drained() {
+  char buffer[16];
+  return ::recv(tracker.get_fd().get_fd(), buffer, sizeof(buffer), MSG_DONTWAIT) == -1 && errno == EAGAIN;
+}
+
+// Stale and malformed replies are all consumed by a single wakeup.
+void
+test_tracker_udp::test_read_drain() {
+  udp_tracker t;
+
+  t.send("abc");
+  t.send(reply(1, transaction_id + 1, announce_payload()));
+  t.send(reply(0, transaction_id, std::string(8, '\0')));
+  t.send(reply(3, transaction_id - 1, "stale error"));
+  t.send(reply(7, transaction_id, announce_payload()));
+
+  t.tracker.event_read();
+
+  CPPUNIT_ASSERT(t.is_drained());
+  CPPUNIT_ASSERT(t.tracker.is_busy());
+  CPPUNIT_ASSERT(t.success_count == 0 && t.failure_count == 0);
+}
+
+// Reading stops at the reply acted on, which closes the socket.
+void
+test_tracker_udp::test_read_announce() {
+  udp_tracker t;
+
+  t.send(reply(1, transaction_id + 1, announce_payload()));
+  t.send(reply(1, transaction_id, announce_payload()));
+  t.send(reply(1, transaction_id, announce_payload()));
+
+  t.tracker.event_read();
+
+  CPPUNIT_ASSERT(!t.tracker.is_busy());
+  CPPUNIT_ASSERT(t.success_count == 1 && t.failure_count == 0);
+  CPPUNIT_ASSERT(t.peers.size() == 2);
+}
+
+void
+test_tracker_udp::test_read_error() {
+  udp_tracker t;
+
+  t.send("abc");
+  t.send(reply(3, transaction_id, "tracker offline"));
+
+  t.tracker.event_read();
+
+  CPPUNIT_ASSERT(!t.tracker.is_busy());
+  CPPUNIT_ASSERT(t.success_count == 0 && t.failure_count == 1);
+  CPPUNIT_ASSERT(t.failure == "received error message: tracker offline");
+}
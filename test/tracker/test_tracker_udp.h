@@ -0,0 +1,17 @@
+#include "helpers/test_main_thread.h"
+
+class test_tracker_udp : public TestFixtureWithMainNetTrackerThread {
+  CPPUNIT_TEST_SUITE(test_tracker_udp);
+  CPPUNIT_TEST(test_read_drain);
+  CPPUNIT_TEST(test_read_announce);
+  CPPUNIT_TEST(test_read_error);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_read_drain();
+  void test_read_announce();
+  void test_read_error();
+
+private:
+  struct udp_tracker;
+};
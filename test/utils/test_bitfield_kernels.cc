@@ -0,0 +1,254 @@
+#include "config.h"
+
+#include "test/utils/test_bitfield_kernels.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "utils/bitfield_kernels.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_bitfield_kernels);
+
+// Each kernel is checked with the SIMD kernels both enabled and
+// disabled against results computed one bit at a time, using ranges
+// that start and end on and around byte, word and vector boundaries.
+
+namespace {
+
+bool
+get_bit(const uint8_t* data, uint32_t index) {
+  return data[index / 8] & (0x80 >> (index % 8));
+}
+
+struct expected_bits {
+  expected_bits(const uint8_t* a, const uint8_t* b, uint32_t size_bits);
+
+  uint32_t count(uint32_t first, uint32_t last) const { return prefix[last] - prefix[first]; }
+
+  static uint32_t find(const std::vector<uint32_t>& next, uint32_t first, uint32_t last) {
+    return std::min(next[first], last);
+  }
+
+  std::vector<uint32_t> prefix;
+  std::vector<uint32_t> next_copy;
+  std::vector<uint32_t> next_and;
+  std::vector<uint32_t> next_and_not;
+};
+
+expected_bits::expected_bits(const uint8_t* a, const uint8_t* b, uint32_t size_bits) :
+    prefix(size_bits + 1),
+    next_copy(size_bits + 1, size_bits),
+    next_and(size_bits + 1, size_bits),
+    next_and_not(size_bits + 1, size_bits) {
+
+  for (uint32_t index = 0; index < size_bits; index++)
+    prefix[index + 1] = prefix[index] + get_bit(a, index);
+
+  for (uint32_t index = size_bits; index-- != 0;) {
+    next_copy[index] = get_bit(a, index) ? index : next_copy[index + 1];
+    next_and[index] = get_bit(a, index) && get_bit(b, index) ? index : next_and[index + 1];
+    next_and_not[index] = get_bit(a, index) && !get_bit(b, index) ? index : next_and_not[index + 1];
+  }
+}
+
+std::vector<uint32_t>
+boundaries(uint32_t size_bits) {
+  std::vector<uint32_t> result;
+
+  for (uint32_t base : { 0u, 8u, 64u, 128u, 256u, 512u, 1024u }) {
+    for (int offset : { -1, 0, 1, 7 }) {
+      uint32_t position = base + offset;
+
+      if (base + offset <= size_bits && (offset >= 0 || base != 0))
+        result.push_back(position);
+    }
+  }
+
+  for (uint32_t offset : { 1u, 7u, 8u, 9u }) {
+    if (offset <= size_bits)
+      result.push_back(size_bits - offset);
+  }
+
+  result.push_back(size_bits);
+  return result;
+}
+
+void
+verify_kernels(const uint8_t* a, const uint8_t* b, uint32_t size_bits) {
+  expected_bits expected(a, b, size_bits);
+  auto positions = boundaries(size_bits);
+
+  for (bool simd : { false, true }) {
+    torrent::bitfield_set_simd(simd);
+
+    for (auto first : positions) {
+      for (auto last : positions) {
+        if (first > last)
+          continue;
+
+        CPPUNIT_ASSERT(torrent::bitfield_count(a, first, last) == expected.count(first, last));
+        CPPUNIT_ASSERT(torrent::bitfield_find(a, first, last) == expected.find(expected.next_copy, first, last));
+        CPPUNIT_ASSERT(torrent::bitfield_find_and(a, b, first, last) == expected.find(expected.next_and, first, last));
+        CPPUNIT_ASSERT(torrent::bitfield_find_and_not(a, b, first, last) == expected.find(expected.next_and_not, first, last));
+      }
+    }
+  }
+}
+
+// Byte sizes on both sides of the 8 byte word and the 16 and 32 byte
+// NEON and AVX2 vectors, with bit sizes that end mid-byte.
+std::vector<uint32_t>
+test_sizes_bits() {
+  std::vector<uint32_t> result{ 0 };
+
+  for (uint32_t bytes : { 1u, 2u, 7u, 8u, 9u, 15u, 16u, 17u, 31u, 32u, 33u, 63u, 64u, 65u, 100u, 129u, 200u })
+    for (uint32_t unused : { 0u, 1u, 5u, 7u })
+      result.push_back(bytes * 8 - unused);
+
+  return result;
+}
+
+std::vector<uint8_t>
+random_bits(std::mt19937& rng, uint32_t size_bits, uint32_t percent) {
+  std::vector<uint8_t> result((size_bits + 7) / 8);
+
+  for (uint32_t index = 0; index < size_bits; index++)
+    if (rng() % 100 < percent)
+      result[index / 8] |= 0x80 >> (index % 8);
+
+  return result;
+}
+
+}
+
+void
+test_bitfield_kernels::tearDown() {
+  torrent::bitfield_set_simd(true);
+
+  test_fixture::tearDown();
+}
+
+void
+test_bitfield_kernels::test_bit_order() {
+  const uint8_t data[] = { 0x80, 0x00, 0x01, 0x40 };
+  const uint8_t mask[] = { 0x80, 0x00, 0x00, 0x00 };
+
+  for (bool simd : { false, true }) {
+    torrent::bitfield_set_simd(simd);
+
+    CPPUNIT_ASSERT(torrent::bitfield_find(data, 0, 32) == 0);
+    CPPUNIT_ASSERT(torrent::bitfield_find(data, 1, 32) == 23);
+    CPPUNIT_ASSERT(torrent::bitfield_find(data, 24, 32) == 25);
+    CPPUNIT_ASSERT(torrent::bitfield_find(data, 1, 23) == 23);
+    CPPUNIT_ASSERT(torrent::bitfield_find(data, 26, 32) == 32);
+
+    CPPUNIT_ASSERT(torrent::bitfield_find_and(data, mask, 0, 32) == 0);
+    CPPUNIT_ASSERT(torrent::bitfield_find_and(data, mask, 1, 32) == 32);
+    CPPUNIT_ASSERT(torrent::bitfield_find_and_not(data, mask, 0, 32) == 23);
+
+    CPPUNIT_ASSERT(torrent::bitfield_count(data, 0, 32) == 3);
+    CPPUNIT_ASSERT(torrent::bitfield_count(data, 0, 1) == 1);
+    CPPUNIT_ASSERT(torrent::bitfield_count(data, 1, 23) == 0);
+    CPPUNIT_ASSERT(torrent::bitfield_count(data, 23, 26) == 2);
+  }
+}
+
+void
+test_bitfield_kernels::test_count() {
+  std::mt19937 rng(1);
+
+  for (auto size_bits : test_sizes_bits()) {
+    for (uint32_t percent : { 0u, 50u, 100u }) {
+      auto a = random_bits(rng, size_bits, percent);
+
+      verify_kernels(a.data(), a.data(), size_bits);
+    }
+  }
+}
+
+void
+test_bitfield_kernels::test_find() {
+  std::mt19937 rng(2);
+
+  for (auto size_bits : test_sizes_bits()) {
+    for (uint32_t percent : { 5u, 50u, 95u }) {
+      auto a = random_bits(rng, size_bits, percent);
+      auto b = random_bits(rng, size_bits, percent);
+
+      verify_kernels(a.data(), b.data(), size_bits);
+    }
+  }
+}
+
+// Single set bits after long runs of zeros, so the vector loops skip
+// over blocks before finding them.
+void
+test_bitfield_kernels::test_find_sparse() {
+  const uint32_t size_bits = 300 * 8 - 3;
+
+  std::vector<uint8_t> ones(300, 0xff);
+  std::vector<uint8_t> zeros(300, 0x00);
+
+  for (auto position : boundaries(size_bits)) {
+    if (position == size_bits)
+      continue;
+
+    auto a = zeros;
+    a[position / 8] |= 0x80 >> (position % 8);
+
+    verify_kernels(a.data(), ones.data(), size_bits);
+    verify_kernels(a.data(), zeros.data(), size_bits);
+
+    // Only the bit in 'a' that is also set in 'b' is found by
+    // bitfield_find_and, with the rest of 'a' set.
+    auto b = zeros;
+    b[position / 8] |= 0x80 >> (position % 8);
+
+    verify_kernels(ones.data(), b.data(), size_bits);
+  }
+}
+
+void
+test_bitfield_kernels::test_for_each() {
+  std::mt19937 rng(3);
+
+  for (auto size_bits : test_sizes_bits()) {
+    for (uint32_t percent : { 2u, 50u, 100u }) {
+      auto a = random_bits(rng, size_bits, percent);
+
+      for (bool simd : { false, true }) {
+        torrent::bitfield_set_simd(simd);
+
+        for (auto first : boundaries(size_bits)) {
+          std::vector<uint32_t> result;
+          std::vector<uint32_t> expected;
+
+          torrent::bitfield_for_each(a.data(), first, size_bits, [&result](uint32_t index) { result.push_back(index); });
+
+          for (uint32_t index = first; index < size_bits; index++)
+            if (get_bit(a.data(), index))
+              expected.push_back(index);
+
+          CPPUNIT_ASSERT(result == expected);
+        }
+      }
+    }
+  }
+}
+
+// The kernels use unaligned loads, so data need not start on a word
+// or vector boundary.
+void
+test_bitfield_kernels::test_unaligned() {
+  std::mt19937 rng(4);
+
+  for (uint32_t offset = 1; offset < 32; offset += 3) {
+    for (uint32_t size_bits : { 64u * 8, 129u * 8 - 3 }) {
+      auto a = random_bits(rng, size_bits + offset * 8, 10);
+      auto b = random_bits(rng, size_bits + offset * 8, 50);
+
+      verify_kernels(a.data() + offset, b.data() + offset, size_bits);
+    }
+  }
+}
@@ -0,0 +1,24 @@
+#include "helpers/test_fixture.h"
+
+class test_bitfield_kernels : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_bitfield_kernels);
+
+  CPPUNIT_TEST(test_bit_order);
+  CPPUNIT_TEST(test_count);
+  CPPUNIT_TEST(test_find);
+  CPPUNIT_TEST(test_find_sparse);
+  CPPUNIT_TEST(test_for_each);
+  CPPUNIT_TEST(test_unaligned);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void tearDown() override;
+
+  void test_bit_order();
+  void test_count();
+  void test_find();
+  void test_find_sparse();
+  void test_for_each();
+  void test_unaligned();
+};
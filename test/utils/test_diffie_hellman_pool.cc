@@ -0,0 +1,184 @@
+#include "config.h"
+
+#include "test/utils/test_diffie_hellman_pool.h"
+
+#include <memory>
+#include <set>
+#include <string>
+#include <sys/resource.h>
+
+#include "helpers/test_utils.h"
+#include "protocol/handshake_encryption.h"
+#include "utils/diffie_hellman.h"
+#include "utils/diffie_hellman_pool.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_diffie_hellman_pool);
+
+using torrent::DiffieHellmanPool;
+using torrent::HandshakeEncryption;
+
+static DiffieHellmanPool*
+make_pool() {
+  return new DiffieHellmanPool(HandshakeEncryption::dh_prime, HandshakeEncryption::dh_prime_length,
+                               HandshakeEncryption::dh_generator, HandshakeEncryption::dh_generator_length);
+}
+
+static int64_t
+cpu_usec() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * int64_t{1000000} +
+    usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static std::string
+pub_key(const DiffieHellmanPool::key_type& key) {
+  std::string result(HandshakeEncryption::dh_prime_length, '\0');
+
+  key->store_pub_key(reinterpret_cast<unsigned char*>(&result[0]), result.size());
+  return result;
+}
+
+void
+test_diffie_hellman_pool::test_disabled() {
+  std::unique_ptr<DiffieHellmanPool> pool(make_pool());
+
+  CPPUNIT_ASSERT(pool->max_size() == 0);
+
+  auto key = pool->take();
+
+  CPPUNIT_ASSERT(key && key->is_valid());
+  CPPUNIT_ASSERT(pool->size() == 0);
+  CPPUNIT_ASSERT(pool->stats_hits() == 0);
+  CPPUNIT_ASSERT(pool->stats_misses() == 0);
+}
+
+void
+test_diffie_hellman_pool::test_take_hits() {
+  std::unique_ptr<DiffieHellmanPool> pool(make_pool());
+  std::set<std::string> keys;
+
+  pool->set_max_size(4);
+  CPPUNIT_ASSERT(wait_for_true([&] { return pool->size() == 4; }));
+
+  for (int i = 0; i < 4; i++) {
+    auto key = pool->take();
+
+    CPPUNIT_ASSERT(key && key->is_valid());
+    keys.insert(pub_key(key));
+  }
+
+  // Every pooled key pair is handed out once.
+  CPPUNIT_ASSERT(keys.size() == 4);
+  CPPUNIT_ASSERT(pool->stats_hits() == 4);
+  CPPUNIT_ASSERT(pool->stats_misses() == 0);
+
+  // Taking wakes the refill thread.
+  CPPUNIT_ASSERT(wait_for_true([&] { return pool->size() == 4; }));
+
+  for (int i = 0; i < 4; i++)
+    keys.insert(pub_key(pool->take()));
+
+  CPPUNIT_ASSERT(keys.size() == 8);
+  CPPUNIT_ASSERT(pool->stats_hits() == 8);
+}
+
+void
+test_diffie_hellman_pool::test_take_misses() {
+  std::unique_ptr<DiffieHellmanPool> pool(make_pool());
+  std::set<std::string> keys;
+
+  pool->set_max_size(1);
+  CPPUNIT_ASSERT(wait_for_true([&] { return pool->size() == 1; }));
+
+  // The refill thread may or may not keep up, but the first take is
+  // always a hit and every take is counted once.
+  for (int i = 0; i < 16; i++) {
+    auto key = pool->take();
+
+    CPPUNIT_ASSERT(key && key->is_valid());
+    keys.insert(pub_key(key));
+  }
+
+  CPPUNIT_ASSERT(keys.size() == 16);
+  CPPUNIT_ASSERT(pool->stats_hits() >= 1);
+  CPPUNIT_ASSERT(pool->stats_hits() + pool->stats_misses() == 16);
+}
+
+void
+test_diffie_hellman_pool::test_shrink() {
+  std::unique_ptr<DiffieHellmanPool> pool(make_pool());
+
+  pool->set_max_size(4);
+  CPPUNIT_ASSERT(wait_for_true([&] { return pool->size() == 4; }));
+
+  pool->set_max_size(2);
+  CPPUNIT_ASSERT(pool->size() == 2);
+  CPPUNIT_ASSERT(pool->max_size() == 2);
+
+  pool->take();
+  pool->take();
+
+  CPPUNIT_ASSERT(pool->stats_hits() == 2);
+  CPPUNIT_ASSERT(wait_for_true([&] { return pool->size() == 2; }));
+}
+
+void
+test_diffie_hellman_pool::test_disable_enable() {
+  std::unique_ptr<DiffieHellmanPool> pool(make_pool());
+
+  pool->set_max_size(2);
+  CPPUNIT_ASSERT(wait_for_true([&] { return pool->size() == 2; }));
+
+  // Disabling joins the refill thread and drops pooled keys, after
+  // which takes are neither hits nor misses.
+  pool->set_max_size(0);
+  CPPUNIT_ASSERT(pool->size() == 0);
+
+  CPPUNIT_ASSERT(pool->take()->is_valid());
+  CPPUNIT_ASSERT(pool->stats_hits() == 0);
+  CPPUNIT_ASSERT(pool->stats_misses() == 0);
+
+  // Stays empty while disabled.
+  usleep(50 * 1000);
+  CPPUNIT_ASSERT(pool->size() == 0);
+
+  pool->set_max_size(3);
+  CPPUNIT_ASSERT(wait_for_true([&] { return pool->size() == 3; }));
+
+  CPPUNIT_ASSERT(pool->take()->is_valid());
+  CPPUNIT_ASSERT(pool->stats_hits() == 1);
+  CPPUNIT_ASSERT(pool->stats_misses() == 0);
+
+  pool->set_max_size(0);
+  pool->set_max_size(0);
+  CPPUNIT_ASSERT(pool->size() == 0);
+}
+
+void
+test_diffie_hellman_pool::test_invalid_keys() {
+  // A modulus too small for DH_generate_key, so every generated key
+  // pair is invalid.
+  static const unsigned char small_prime[] = { 0x00, 0x00, 0x00, 0x17 };
+
+  std::unique_ptr<DiffieHellmanPool> pool(new DiffieHellmanPool(small_prime, sizeof(small_prime),
+                                                                HandshakeEncryption::dh_generator,
+                                                                HandshakeEncryption::dh_generator_length));
+  CPPUNIT_ASSERT(!pool->generate()->is_valid());
+
+  pool->set_max_size(2);
+
+  // The refill thread backs off instead of spinning on failures.
+  int64_t start = cpu_usec();
+  usleep(200 * 1000);
+
+  CPPUNIT_ASSERT(cpu_usec() - start < 100 * 1000);
+  CPPUNIT_ASSERT(pool->size() == 0);
+
+  // Disabling wakes the thread out of its back off.
+  auto started = std::chrono::steady_clock::now();
+  pool->set_max_size(0);
+
+  CPPUNIT_ASSERT(std::chrono::steady_clock::now() - started < std::chrono::milliseconds(500));
+}
@@ -0,0 +1,22 @@
+#include "helpers/test_fixture.h"
+
+class test_diffie_hellman_pool : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_diffie_hellman_pool);
+
+  CPPUNIT_TEST(test_disabled);
+  CPPUNIT_TEST(test_take_hits);
+  CPPUNIT_TEST(test_take_misses);
+  CPPUNIT_TEST(test_shrink);
+  CPPUNIT_TEST(test_disable_enable);
+  CPPUNIT_TEST(test_invalid_keys);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_disabled();
+  void test_take_hits();
+  void test_take_misses();
+  void test_shrink();
+  void test_disable_enable();
+  void test_invalid_keys();
+};
@@ -0,0 +1,192 @@
+#include "config.h"
+
+#include "test/utils/test_rc4.h"
+
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "utils/crypto_queue.h"
+#include "utils/rc4.h"
+#include "utils/rc4_prefetch.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_rc4);
+
+static std::string
+to_hex(const std::string& data) {
+  static const char digits[] = "0123456789abcdef";
+  std::string result;
+
+  for (unsigned char c : data) {
+    result += digits[c >> 4];
+    result += digits[c & 0xf];
+  }
+
+  return result;
+}
+
+static torrent::RC4
+make_rc4(const std::string& key) {
+  return torrent::RC4(reinterpret_cast<const unsigned char*>(key.data()), key.size());
+}
+
+static std::vector<uint8_t>
+random_data(unsigned int length, unsigned int seed) {
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> data(length);
+
+  for (auto& c : data)
+    c = rng();
+
+  return data;
+}
+
+// Encrypts 'data' through 'prefetch' in pieces of varying size,
+// crossing the block boundaries as the block size grows, and checks
+// it against plain RC4.
+static void
+check_prefetch(torrent::RC4Prefetch& prefetch, torrent::RC4& reference, const std::vector<uint8_t>& data,
+               const std::function<void(unsigned int)>& between = {}) {
+  std::mt19937 rng(data.size());
+  std::vector<uint8_t> expected(data.size());
+  std::vector<uint8_t> result(data.size());
+
+  reference.crypt(data.data(), expected.data(), data.size());
+
+  for (unsigned int position = 0, step = 0; position < data.size(); position += step) {
+    step = std::min<unsigned int>(rng() % 9000 + 1, data.size() - position);
+
+    prefetch.crypt(data.data() + position, result.data() + position, step);
+
+    if (between)
+      between(position + step);
+  }
+
+  CPPUNIT_ASSERT(result == expected);
+}
+
+// Vectors from RFC 6229 and the examples of the original RC4 posting.
+void
+test_rc4::test_known_answers() {
+  const std::tuple<std::string, std::string, std::string> vectors[] = {
+    { "Key", "Plaintext", "bbf316e8d940af0ad3" },
+    { "Wiki", "pedia", "1021bf0420" },
+    { "Secret", "Attack at dawn", "45a01f645fc35b383552544b9bf5" },
+    { "\x01\x02\x03\x04\x05", std::string(32, '\0'), "b2396305f03dc027ccc3524a0a1118a86982944f18fc82d589c403a47a0d0919" },
+  };
+
+  for (const auto& v : vectors) {
+    auto rc4 = make_rc4(std::get<0>(v));
+    std::string result(std::get<1>(v).size(), '\0');
+
+    rc4.crypt(std::get<1>(v).data(), &result[0], result.size());
+
+    CPPUNIT_ASSERT_EQUAL(std::get<2>(v), to_hex(result));
+  }
+}
+
+// Keystream combined with xor_keystream, in place, and crypt called in
+// pieces all continue the same stream.
+void
+test_rc4::test_keystream() {
+  auto data = random_data(5000, 1);
+  auto rc4 = make_rc4("keystream");
+
+  std::vector<uint8_t> expected(data.size());
+  rc4.crypt(data.data(), expected.data(), data.size());
+
+  for (unsigned int split : { 0, 1, 7, 8, 9, 4096, 4999, 5000 }) {
+    auto stream = make_rc4("keystream");
+    auto in_place = make_rc4("keystream");
+
+    std::vector<uint8_t> keystream(data.size());
+    std::vector<uint8_t> result(data.size());
+    std::vector<uint8_t> copy = data;
+
+    stream.crypt(data.data(), result.data(), split);
+    stream.keystream(keystream.data(), data.size() - split);
+    torrent::RC4::xor_keystream(data.data() + split, keystream.data(), result.data() + split, data.size() - split);
+
+    CPPUNIT_ASSERT(result == expected);
+
+    in_place.crypt(copy.data(), split);
+    in_place.crypt(copy.data() + split, data.size() - split);
+
+    CPPUNIT_ASSERT(copy == expected);
+  }
+}
+
+void
+test_rc4::test_prefetch() {
+  torrent::CryptoQueue queue;
+  queue.set_worker_count(2);
+
+  auto data = random_data(256 << 10, 2);
+  auto reference = make_rc4("prefetch");
+
+  torrent::RC4Prefetch prefetch(make_rc4("prefetch"), &queue);
+
+  // Pausing now and then lets the workers finish the next block ahead
+  // of use, rather than it being taken back and generated inline.
+  check_prefetch(prefetch, reference, data, [](unsigned int position) {
+      if (position % 3 == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+}
+
+// Without workers the queued jobs are dropped and every block is
+// generated inline.
+void
+test_rc4::test_prefetch_no_workers() {
+  torrent::CryptoQueue queue;
+
+  auto data = random_data(128 << 10, 3);
+  auto reference = make_rc4("no workers");
+
+  torrent::RC4Prefetch prefetch(make_rc4("no workers"), &queue);
+
+  check_prefetch(prefetch, reference, data);
+}
+
+// Stopping the workers drops the queued blocks mid-stream, and the
+// stream continues inline and again once workers are restarted.
+void
+test_rc4::test_prefetch_workers_stopped() {
+  torrent::CryptoQueue queue;
+  queue.set_worker_count(1);
+
+  auto data = random_data(256 << 10, 4);
+  auto reference = make_rc4("stopped");
+
+  torrent::RC4Prefetch prefetch(make_rc4("stopped"), &queue);
+
+  unsigned int stage = 0;
+
+  check_prefetch(prefetch, reference, data, [&](unsigned int position) {
+      if (stage == 0 && position > (48 << 10)) {
+        queue.set_worker_count(0);
+        stage++;
+
+      } else if (stage == 1 && position > (128 << 10)) {
+        queue.set_worker_count(3);
+        stage++;
+      }
+    });
+
+  CPPUNIT_ASSERT(stage == 2);
+
+  // A prefetch destroyed with a block queued leaves the job to find
+  // the block abandoned.
+  {
+    torrent::RC4Prefetch abandoned(make_rc4("abandoned"), &queue);
+
+    uint8_t buffer[16] = {};
+    abandoned.crypt(buffer, buffer, sizeof(buffer));
+  }
+
+  queue.set_worker_count(0);
+}
@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class test_rc4 : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_rc4);
+
+  CPPUNIT_TEST(test_known_answers);
+  CPPUNIT_TEST(test_keystream);
+  CPPUNIT_TEST(test_prefetch);
+  CPPUNIT_TEST(test_prefetch_no_workers);
+  CPPUNIT_TEST(test_prefetch_workers_stopped);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_known_answers();
+  void test_keystream();
+  void test_prefetch();
+  void test_prefetch_no_workers();
+  void test_prefetch_workers_stopped();
+};
@@ -0,0 +1,190 @@
+#include "config.h"
+
+#include "test/utils/test_sha1.h"
+
+#include <random>
+#include <string>
+#include <vector>
+#include <openssl/sha.h>
+
+#include "torrent/hash_string.h"
+#include "utils/sha1.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_sha1);
+
+// When the CPU has the SHA extensions these go through the native
+// backend, else through OpenSSL.
+
+static std::string
+sha1_hex(const void* data, unsigned int length) {
+  torrent::Sha1 sha1;
+  torrent::HashString hash;
+
+  sha1.init();
+  sha1.update(data, length);
+  sha1.final_c(hash.data());
+
+  return torrent::hash_string_to_hex_str(hash);
+}
+
+static std::string
+openssl_hex(const void* data, size_t length) {
+  torrent::HashString hash;
+
+  SHA1(static_cast<const unsigned char*>(data), length, reinterpret_cast<unsigned char*>(hash.data()));
+
+  return torrent::hash_string_to_hex_str(hash);
+}
+
+// Test vectors from FIPS 180-2 and the NIST example messages.
+void
+test_sha1::test_known_answers() {
+  const std::pair<std::string, std::string> vectors[] = {
+    { "", "DA39A3EE5E6B4B0D3255BFEF95601890AFD80709" },
+    { "abc", "A9993E364706816ABA3E25717850C26C9CD0D89D" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "84983E441C3BD26EBAAE4AA1F95129E5E54670F1" },
+    { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+      "A49B2446A02C645BF419F995B67091253A04A259" },
+  };
+
+  for (const auto& v : vectors)
+    CPPUNIT_ASSERT_EQUAL(v.second, sha1_hex(v.first.data(), v.first.size()));
+}
+
+void
+test_sha1::test_million_a() {
+  std::string data(1000000, 'a');
+
+  CPPUNIT_ASSERT_EQUAL(std::string("34AA973CD4C4DAA4F61EEB2BDBAD27316534016F"), sha1_hex(data.data(), data.size()));
+
+  // Feed it in pieces that straddle the 64 byte block boundaries.
+  torrent::Sha1 sha1;
+  torrent::HashString hash;
+
+  sha1.init();
+
+  for (size_t position = 0, step = 1; position < data.size(); position += step, step = step % 199 + 7)
+    sha1.update(data.data() + position, std::min(step, data.size() - position));
+
+  sha1.final_c(hash.data());
+
+  CPPUNIT_ASSERT_EQUAL(std::string("34AA973CD4C4DAA4F61EEB2BDBAD27316534016F"), torrent::hash_string_to_hex_str(hash));
+}
+
+// Lengths around the padding boundaries, split at every position.
+void
+test_sha1::test_split_updates() {
+  std::mt19937 rng(1);
+  std::vector<uint8_t> data(300);
+
+  for (auto& c : data)
+    c = rng();
+
+  for (unsigned int length : { 0, 1, 55, 56, 57, 63, 64, 65, 119, 120, 127, 128, 129, 191, 300 }) {
+    std::string expected = openssl_hex(data.data(), length);
+
+    CPPUNIT_ASSERT_EQUAL(expected, sha1_hex(data.data(), length));
+
+    for (unsigned int split = 0; split <= length; split++) {
+      torrent::Sha1 sha1;
+      torrent::HashString hash;
+
+      sha1.init();
+      sha1.update(data.data(), split);
+      sha1.update(data.data() + split, length - split);
+      sha1.final_c(hash.data());
+
+      CPPUNIT_ASSERT_EQUAL(expected, torrent::hash_string_to_hex_str(hash));
+    }
+  }
+}
+
+void
+test_sha1::test_unaligned() {
+  std::mt19937 rng(2);
+  std::vector<uint8_t> data(4096 + 64);
+
+  for (auto& c : data)
+    c = rng();
+
+  for (unsigned int offset = 0; offset < 64; offset++)
+    for (unsigned int length : { 64, 1000, 4096 })
+      CPPUNIT_ASSERT_EQUAL(openssl_hex(data.data() + offset, length), sha1_hex(data.data() + offset, length));
+}
+
+// Every lane count, with each lane a different length so the lanes run
+// out of data and get padded at different times.
+void
+test_sha1::test_multi_lanes() {
+  if (!torrent::Sha1Multi::is_available())
+    return;
+
+  std::mt19937 rng(3);
+  std::vector<uint8_t> data(8 * 4096);
+
+  for (auto& c : data)
+    c = rng();
+
+  const unsigned int lengths[] = { 0, 55, 56, 64, 119, 4096, 1000, 3 };
+
+  torrent::Sha1Multi multi;
+
+  for (unsigned int lanes = 1; lanes <= torrent::Sha1Multi::max_lanes; lanes++) {
+    multi.init(lanes);
+    CPPUNIT_ASSERT_EQUAL(lanes, multi.lanes());
+
+    for (unsigned int lane = 0; lane < lanes; lane++)
+      multi.update(lane, data.data() + 4096 * lane, lengths[(lane + lanes) % 8]);
+
+    multi.finalize();
+
+    for (unsigned int lane = 0; lane < lanes; lane++) {
+      torrent::HashString hash;
+      multi.digest(lane, hash.data());
+
+      CPPUNIT_ASSERT_EQUAL(openssl_hex(data.data() + 4096 * lane, lengths[(lane + lanes) % 8]), torrent::hash_string_to_hex_str(hash));
+    }
+  }
+}
+
+// Messages fed as random segments, including empty ones and ones
+// smaller than a block, as chunks spanning several files are.
+void
+test_sha1::test_multi_segments() {
+  if (!torrent::Sha1Multi::is_available())
+    return;
+
+  std::mt19937 rng(4);
+  std::vector<uint8_t> data(8 * 20000);
+
+  for (auto& c : data)
+    c = rng();
+
+  torrent::Sha1Multi multi;
+
+  for (int round = 0; round < 20; round++) {
+    unsigned int lengths[torrent::Sha1Multi::max_lanes];
+
+    multi.init(torrent::Sha1Multi::max_lanes);
+
+    for (unsigned int lane = 0; lane < torrent::Sha1Multi::max_lanes; lane++) {
+      lengths[lane] = rng() % 20000;
+
+      for (unsigned int position = 0; position < lengths[lane]; ) {
+        unsigned int step = std::min<unsigned int>(rng() % (rng() % 2 ? 70 : 3000), lengths[lane] - position);
+
+        multi.update(lane, data.data() + 20000 * lane + position, step);
+        position += step;
+      }
+    }
+
+    multi.finalize();
+
+    for (unsigned int lane = 0; lane < torrent::Sha1Multi::max_lanes; lane++) {
+      torrent::HashString hash;
+      multi.digest(lane, hash.data());
+
+      CPPUNIT_ASSERT_EQUAL(openssl_hex(data.data() + 20000 * lane, lengths[lane]), torrent::hash_string_to_hex_str(hash));
+    }
+  }
+}
@@ -0,0 +1,22 @@
+#include "helpers/test_fixture.h"
+
+class test_sha1 : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_sha1);
+
+  CPPUNIT_TEST(test_known_answers);
+  CPPUNIT_TEST(test_million_a);
+  CPPUNIT_TEST(test_split_updates);
+  CPPUNIT_TEST(test_unaligned);
+  CPPUNIT_TEST(test_multi_lanes);
+  CPPUNIT_TEST(test_multi_segments);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_known_answers();
+  void test_million_a();
+  void test_split_updates();
+  void test_unaligned();
+  void test_multi_lanes();
+  void test_multi_segments();
+};